@@ -1,4 +1,7 @@
-#version 420 core
+#version 430 core
+#ifdef BINDLESS
+#extension GL_ARB_bindless_texture : require
+#endif
 
 struct VS_OUT
 {
@@ -8,28 +11,47 @@ struct VS_OUT
 };
 
 in VS_OUT vs_out;
+flat in uint material_index;
 
 layout (location = 0) out vec4 pixel_position;
 layout (location = 1) out vec4 pixel_normal;
 layout (location = 2) out vec4 pixel_albedo;
 
-layout (binding = 0) uniform sampler2D texture_data;
-//layout (binding = 1) uniform sampler2D material_data;
+// without bindless textures every material texture is a layer of this
+#ifndef BINDLESS
+layout (binding = 0) uniform sampler2DArray texture_layers;
+#endif
 
-void main()
+// matches GPU_Material in materials.h
+struct Material
 {
-	vec3 plastic_mat = vec3(1, .5, 1);
-	vec3 iron_mat    = vec3(1, .5, 1);
-	vec3 gold_mat    = vec3(1, .5, 1);
-
-	vec3 plastic_color = vec3(0.9, 0.1, 0.1); // red plastic
-	vec3 iron_color = vec3(0.560, 0.570, 0.580);
-	vec3 gold_color = vec3(1.000, 0.766, 0.336);
+	vec4  albedo; // rgb = base color
+	vec4  params; // metallic, roughness, ao, uv scale
+	uvec2 albedo_texture; // bindless handle, or layer + 1 in x without bindless. 0 = untextured
+	uvec2 padding;
+};
 
-	vec3 material = gold_mat;  //texture(texture_data, vs_out.uv * 4.f).rgb;
-	vec3 color    = gold_color;//texture(texture_data, vs_out.uv * 4.f).rgb;
+layout (std430, binding = 0) readonly buffer MaterialTable {
+	Material materials[];
+};
 
-	pixel_position = vec4(vs_out.world_position, material.r); // metalness
-	pixel_normal   = vec4(vs_out.normal, material.g);         // roughness
-	pixel_albedo   = vec4(color, material.b);                 // ambient occlusion
+void main()
+{
+	Material material = materials[material_index];
+
+	vec3 color = material.albedo.rgb;
+	vec2 uv    = vs_out.uv * material.params.w;
+
+	if (material.albedo_texture != uvec2(0))
+	{
+#ifdef BINDLESS
+		color *= texture(sampler2D(material.albedo_texture), uv).rgb;
+#else
+		color *= texture(texture_layers, vec3(uv, float(material.albedo_texture.x - 1u))).rgb;
+#endif
+	}
+
+	pixel_position = vec4(vs_out.world_position, material.params.x); // metalness
+	pixel_normal   = vec4(vs_out.normal, material.params.y);         // roughness
+	pixel_albedo   = vec4(color, material.params.z);                 // ambient occlusion
 }
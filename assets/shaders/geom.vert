@@ -4,7 +4,13 @@ layout (location = 0) in vec3 vertex_position;
 layout (location = 1) in vec3 vertex_normal;
 layout (location = 2) in vec2 vertex_uv;
 
-layout (location = 3) in mat4 instance_model; // model matrix for this instance
+#ifdef COMPACT_INSTANCES
+layout (location = 3) in vec4 instance_position_scale; // xyz = position, w = uniform scale
+layout (location = 4) in vec4 instance_rotation;       // unit quaternion, stored as snorm16
+#else
+layout (location = 3) in mat4 instance_model;    // model matrix for this instance
+#endif
+layout (location = 7) in uint instance_material; // index into the material table
 
 struct VS_OUT
 {
@@ -14,18 +20,31 @@ struct VS_OUT
 };
 
 out VS_OUT vs_out;
+flat out uint material_index; // integers can't be interpolated, so not part of VS_OUT
 
 uniform mat4 proj_view;
 
+vec3 rotate(vec4 q, vec3 v) { return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v); }
+
 void main()
 {
+#ifdef COMPACT_INSTANCES
+   vec4 rotation  = normalize(instance_rotation); // undo quantization error
+   vec4 world_pos = vec4(instance_position_scale.xyz + rotate(rotation, vertex_position * instance_position_scale.w), 1.0);
+   vs_out.world_position = world_pos.xyz;
+
+   // uniform scale : rotating is enough for normals
+   vs_out.normal = rotate(rotation, vertex_normal);
+#else
    vec4 world_pos = instance_model * vec4(vertex_position, 1.0);
    vs_out.world_position = world_pos.xyz;
 
    vec4 world_normal = instance_model * vec4(vertex_normal, 0.0);
    vs_out.normal = world_normal.xyz;
+#endif
 
    vs_out.uv = vertex_uv;
+   material_index = instance_material;
 
    gl_Position = proj_view * world_pos;
 }
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 430 core
+
+// copies a streamed texture into a layer of the material texture array (materials.h, no bindless)
+in vec2 uv;
+
+layout (location = 0) out vec4 color;
+
+layout (binding = 0) uniform sampler2D source; // minified by its own mips down to the layer size
+
+void main()
+{
+	color = texture(source, uv);
+}
@@ -0,0 +1,10 @@
+#version 430 core
+
+// one triangle over the whole target, no vertex buffer : ids 0, 1, 2 -> (0, 0), (2, 0), (0, 2)
+out vec2 uv;
+
+void main()
+{
+	uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
+}
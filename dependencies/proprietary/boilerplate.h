@@ -2,14 +2,19 @@
 // ----------  Action Game V1 : 16.9.24  ----------- //
 // ------------------------------------------------- //
 
+// #define HEADLESS before including this for a build with no window, GL, audio or UI (the dedicated server) :
+// just the platform layer, math, threads, files, physics & networking
+
 // -------------------- Libraries ------------------ //
 
 #pragma comment(lib, "winmm") // for timeBeginPeriod
 #pragma comment (lib, "Ws2_32.lib") // networking
+#ifndef HEADLESS
 #pragma comment(lib, "opengl32")
 #pragma comment(lib, "dependencies/external/GLEW/glew32s") // opengl extensions
 #pragma comment(lib, "dependencies/external/GLFW/glfw3") // window & input
 #pragma comment(lib, "dependencies/external/OpenAL/OpenAL32.lib") //  audio
+#endif
 
 // --------------------- includes ------------------ //
 
@@ -20,12 +25,14 @@
 #include "../external/stb_image.h"
 #include "../external/stb_image_write.h"
 
+#ifndef HEADLESS
 #define GLEW_STATIC
 #include "../external/GLEW\glew.h" // OpenGL functions
 #include "../external/GLFW\glfw3.h"// window & input
 
 #include "../external/OpenAL/al.h" // for audio
 #include "../external/OpenAL/alc.h"
+#endif
 
 #include <winsock2.h> // rearranging these includes breaks everything; idk why
 #include <ws2tcpip.h>
@@ -122,18 +129,6 @@ void os_sleep(uint milliseconds)
 #define DEBUG_TIMER_BEGIN() Timer d; d.init(); d.start();
 #define DEBUG_TIMER_END() d.print_microseconds("debug timer : ");
 
-// ------------------------------------------------- //
-// ---------------------- Audio -------------------- //
-// ------------------------------------------------- //
-
-/* -- how 2 play a sound --
-
-	Audio sound = load_audio("sound.audio");
-	play_sudio(sound);
-*/
-
-typedef ALuint Audio;
-
 // ------------------------------------------------- //
 // -------------------- 3D Camera ------------------ //
 // ------------------------------------------------- //
@@ -193,10 +188,157 @@ uint64 create_thread(thread_function function, void* params = NULL)
 	// im not sure if i should be keeping it
 	return thread_id;
 }
+
+// keeps the calling thread on one core : it never migrates, so its caches stay warm.
+// only worth it when the process has the machine to itself, like a dedicated server
+void pin_thread(uint core) { SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core); }
+
 //uint test(float a) { out(a); return 0; }
 //typedef uint temp(float);
 //void wtf(temp func) { func(7); return; }
 
+/* -- work queue --
+
+	a fixed ring of jobs that worker threads pull from. jobs are added from the
+	main thread only (single producer), any number of workers can take them.
+
+	work_queue       : short jobs the main thread waits on (parallel loops)
+	background_queue : long jobs nobody waits on (file io, decoding, transcoding)
+*/
+
+#define MAX_QUEUED_JOBS 256 // must be a power of 2
+
+typedef void job_function(void* data);
+
+struct WorkQueue
+{
+	volatile uint completion_goal, completion_count;
+	volatile uint next_entry_to_write, next_entry_to_read;
+
+	HANDLE semaphore; // workers sleep on this while the queue is empty
+
+	int first_core; // -1 = workers go wherever the scheduler puts them, otherwise one core each from here on
+	volatile uint num_started;
+
+	struct {
+		job_function* function;
+		void* data;
+	} entries[MAX_QUEUED_JOBS];
+} *work_queue, *background_queue;
+
+uint get_num_cores()
+{
+	SYSTEM_INFO info = {};
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+
+// WARNING : only call this from the main thread!
+void add_job(WorkQueue* queue, job_function* function, void* data)
+{
+	uint entry_to_write = queue->next_entry_to_write;
+	uint next_entry     = (entry_to_write + 1) & (MAX_QUEUED_JOBS - 1);
+
+	if (next_entry == queue->next_entry_to_read) { out("ERROR : work queue is full!"); stop; return; }
+
+	queue->entries[entry_to_write].function = function;
+	queue->entries[entry_to_write].data     = data;
+	queue->completion_goal += 1;
+
+	_WriteBarrier(); // the job has to be visible before the write index moves
+	queue->next_entry_to_write = next_entry;
+
+	ReleaseSemaphore(queue->semaphore, 1, NULL);
+}
+
+// returns false when there was nothing to do
+bool do_next_job(WorkQueue* queue)
+{
+	uint entry_to_read = queue->next_entry_to_read;
+	if (entry_to_read == queue->next_entry_to_write) return false;
+
+	uint next_entry = (entry_to_read + 1) & (MAX_QUEUED_JOBS - 1);
+	_ReadBarrier();
+	auto job = queue->entries[entry_to_read]; // once the read index moves, the producer can reuse the slot
+
+	// another thread might have grabbed this job first; if so, just report back and try again
+	if (InterlockedCompareExchange((LONG volatile*)&queue->next_entry_to_read, next_entry, entry_to_read) == entry_to_read)
+	{
+		job.function(job.data);
+		InterlockedIncrement((LONG volatile*)&queue->completion_count);
+	}
+
+	return true;
+}
+
+// the main thread helps out instead of just waiting
+void complete_all_jobs(WorkQueue* queue)
+{
+	while (queue->completion_goal != queue->completion_count) do_next_job(queue);
+
+	queue->completion_goal  = 0;
+	queue->completion_count = 0;
+}
+
+DWORD WINAPI worker_thread(LPVOID param)
+{
+	WorkQueue* queue = (WorkQueue*)param;
+
+	if (queue->first_core >= 0) pin_thread(queue->first_core + InterlockedIncrement((LONG volatile*)&queue->num_started) - 1);
+
+	while(1) if (!do_next_job(queue)) WaitForSingleObjectEx(queue->semaphore, INFINITE, FALSE);
+
+	return 0;
+}
+
+void init_work_queue(WorkQueue* queue, uint num_threads, int first_core = -1)
+{
+	*queue = {};
+	queue->first_core = first_core;
+	queue->semaphore = CreateSemaphoreEx(0, 0, num_threads, 0, 0, SEMAPHORE_ALL_ACCESS);
+
+	for (uint i = 0; i < num_threads; i++) create_thread(worker_thread, queue);
+}
+
+// splits [0, count) into batches & runs them on the work queue, returns when all are done
+// WARNING : only call this from the main thread!
+typedef void parallel_function(void* data, uint begin, uint end);
+void parallel_for(uint count, uint batch_size, parallel_function* function, void* data)
+{
+	struct Batch {
+		parallel_function* function;
+		void* data;
+		uint begin, end;
+	};
+
+	const auto run_batch = [](void* param) {
+		Batch* batch = (Batch*)param;
+		batch->function(batch->data, batch->begin, batch->end);
+	};
+
+	uint max_batches = MAX_QUEUED_JOBS / 2; // leave room for anything else in the queue
+	uint num_batches = (count + batch_size - 1) / batch_size;
+	if (num_batches > max_batches)
+	{
+		batch_size  = (count + max_batches - 1) / max_batches;
+		num_batches = (count + batch_size  - 1) / batch_size;
+	}
+
+	if (num_batches <= 1 || !work_queue) { function(data, 0, count); return; }
+
+	Batch* batches = Alloc(Batch, num_batches);
+
+	for (uint i = 0; i < num_batches; i++)
+	{
+		uint end = (i + 1) * batch_size;
+		batches[i] = { function, data, i * batch_size, end < count ? end : count };
+		add_job(work_queue, run_batch, &batches[i]);
+	}
+
+	complete_all_jobs(work_queue);
+	free(batches);
+}
+
 // ------------------------------------------------- //
 // --------------- Files & Directories ------------- //
 // ------------------------------------------------- //
@@ -362,6 +504,50 @@ uint get_file_size(const char* path)
 	CloseHandle(file_handle);
 	return size.QuadPart; // file size in bytes!
 }
+
+// read only, the OS pages it in as it gets touched & can drop it again whenever it wants
+struct MappedFile
+{
+	const byte* data; // NULL = not mapped
+	uint64 size;
+	HANDLE file, mapping;
+};
+
+MappedFile map_file(const char* path)
+{
+	MappedFile mapped = {};
+
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return mapped;
+
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(file, &size);
+
+	HANDLE mapping = size.QuadPart ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL; // an empty file can't be mapped
+	const byte* data = mapping ? (const byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!data)
+	{
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		return mapped;
+	}
+
+	mapped.data    = data;
+	mapped.size    = size.QuadPart;
+	mapped.file    = file;
+	mapped.mapping = mapping;
+	return mapped;
+}
+
+void unmap_file(MappedFile* mapped)
+{
+	if (!mapped->data) return;
+
+	UnmapViewOfFile(mapped->data);
+	CloseHandle(mapped->mapping);
+	CloseHandle(mapped->file);
+	*mapped = {};
+}
 uint get_directory_size(Directory* dir, const char* path)
 {
 	uint directory_size = 0; // in bytes
@@ -402,6 +588,12 @@ uint get_directory_size(const char* path)
 // ------------------------------------------------- //
 
 #include "networking.h"
+#include "replication.h" // game state over UDP
+
+#define KiloByte(n) (n * 1024)
+#define MegaByte(n) (KiloByte(n) * 1024)
+
+#ifndef HEADLESS
 
 // ------------------------------------------------- //
 // ----------------------- UX ---------------------- //
@@ -411,9 +603,6 @@ uint get_directory_size(const char* path)
 #include "../external/IMGUI/backends/imgui_impl_glfw.h"
 #include "../external/IMGUI/backends/imgui_impl_opengl3.h"
 
-#define KiloByte(n) (n * 1024)
-#define MegaByte(n) (KiloByte(n) * 1024)
-
 // IMGUI
 void apply_imgui_style(ImGuiIO& io)
 {
@@ -498,4 +687,6 @@ void apply_imgui_style(ImGuiIO& io)
 	style->WindowRounding = 0;
 	style->ScrollbarRounding = 0;
 	style->FramePadding = ImVec2(5, 5);
-}
\ No newline at end of file
+}
+
+#endif // HEADLESS
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "../external/GLM/gtx/quaternion.hpp"
 #include "../external/GLM/gtx/transform.hpp"
 
+#include <immintrin.h> // SSE/AVX intrinsics
+#include <intrin.h>    // __cpuid
+
 using glm::vec2;  using glm::vec3; using glm::vec4;
 using glm::mat3;  using glm::mat4;
 using glm::quat;
@@ -15,6 +18,44 @@ using glm::lookAt; using glm::perspective; using glm::fract;
 #define PI	  3.14159265359f
 #define TWOPI 6.28318530718f
 
+// cpu features
+
+enum SIMD_LEVEL {
+	SIMD_SSE2 = 0, // every x64 cpu
+	SIMD_AVX2,     // 8 wide, gathers
+	SIMD_AVX512    // 16 wide
+};
+
+// what the cpu & os support, checked once
+uint simd_level()
+{
+	static int level = -1;
+	if (level >= 0) return level;
+
+	int info[4] = {};
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	level = SIMD_SSE2;
+	if (max_leaf < 7) return level;
+
+	__cpuid(info, 1);
+	bool osxsave = info[2] & (1 << 27);
+	bool fma     = info[2] & (1 << 12);
+	if (!osxsave) return level;
+
+	uint64 xcr0 = _xgetbv(0); // which register states the os saves on a context switch
+
+	__cpuidex(info, 7, 0);
+	bool avx2    = info[1] & (1 << 5);
+	bool avx512f = info[1] & (1 << 16);
+
+	if (avx2 && fma && (xcr0 & 0x06) == 0x06) level = SIMD_AVX2;
+	if (avx512f && (xcr0 & 0xE6) == 0xE6)     level = SIMD_AVX512;
+
+	return level;
+}
+
 #define ToRadians(value) ( ((value) * PI) / 180.0f )
 #define ToDegrees(value) ( ((value) * 180.0f) / PI )
 
@@ -24,17 +65,203 @@ using glm::lookAt; using glm::perspective; using glm::fract;
 #define BIT_NOISE_2 0x68E31DA4
 #define BIT_NOISE_3 0x1B56C4E9
 
+/* Random : xoshiro256** for single numbers, 16 lanes of xoshiro128** for bulk fills
+
+	- every thread gets its own generator from thread_random(), so nothing is shared or locked
+	- random_seed() picks the sequence. each thread then takes the next stream, 2^128 numbers apart
+	- jobs that need to be reproducible no matter which thread runs them take a split() of their own
+	- bulk fills give the same numbers whatever SIMD level the cpu has
+	- gaussians use a 128 layer ziggurat (Marsaglia & Tsang, as laid out by Doornik)
+*/
+
+const uint RANDOM_LANES = 16;
+
+struct Random
+{
+	uint64 s[4];
+	uint   lanes[4][RANDOM_LANES]; // bulk fill state, word k of lane j is lanes[k][j]
+	uint   generation; // of random_seed(), for thread_random()
+
+	void   seed(uint64 value);
+	void   jump(); // skips 2^128 numbers
+	Random split(); // returns this stream & jumps past it
+
+	uint64 next();
+	uint   next_uint() { return (uint)(next() >> 32); }
+	uint   range(uint n) { return (uint)(((uint64)next_uint() * n) >> 32); } // [0, n)
+	float  next_float() { return (next() >> 40) * (1.f / (1 << 24)); } // [0, 1)
+	float  range(float lo, float hi) { return lo + next_float() * (hi - lo); }
+	float  gaussian(); // mean 0, standard deviation 1
+
+	// bulk : SIMD, any count
+	void fill(uint* output, uint count); // all 32 bits random
+	void fill(uint* output, uint count, uint n); // [0, n)
+	void fill(float* output, uint count, float lo = 0, float hi = 1);
+	void fill_gaussian(float* output, uint count, float mean = 0, float deviation = 1);
+
+	void seed_lanes();
+	float ziggurat_slow(uint layer, float u);
+};
+
+inline uint64 rotl64(uint64 x, int k) { return (x << k) | (x >> (64 - k)); }
+
+inline uint64 splitmix64(uint64* x)
+{
+	uint64 z = (*x += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+uint64 Random::next()
+{
+	uint64 result = rotl64(s[1] * 5, 7) * 9;
+	uint64 t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl64(s[3], 45);
+
+	return result;
+}
+
+void Random::seed(uint64 value)
+{
+	for (uint i = 0; i < 4; i++) s[i] = splitmix64(&value);
+	seed_lanes();
+}
+
+// the lanes are seeded from the main generator, so they follow its seed & stream
+void Random::seed_lanes()
+{
+	for (uint k = 0; k < 4; k++)
+	for (uint j = 0; j < RANDOM_LANES; j++)
+		lanes[k][j] = next_uint();
+}
+
+void Random::jump()
+{
+	static const uint64 JUMP[] = { 0x180EC6D33CFD0ABAull, 0xD5A61266F0C9392Cull, 0xA9582618E03FC9AAull, 0x39ABDC4529B1661Cull };
+
+	uint64 t[4] = {};
+	for (uint i = 0; i < 4; i++)
+	for (uint b = 0; b < 64; b++)
+	{
+		if (JUMP[i] & (1ull << b)) for (uint k = 0; k < 4; k++) t[k] ^= s[k];
+		next();
+	}
+
+	memcpy(s, t, sizeof(s));
+	seed_lanes();
+}
+
+Random Random::split()
+{
+	Random stream = *this;
+	stream.seed_lanes();
+	jump();
+	return stream;
+}
+
+// ziggurat tables : layer i is x[i] wide, r[i] = x[i + 1] / x[i] is the part that's always under the curve
+struct Ziggurat
+{
+	float x[129], r[128];
+
+	Ziggurat()
+	{
+		const double R = 3.442619855899, V = 9.91256303526217e-3;
+
+		double X[129], f = exp(-.5 * R * R);
+		X[0] = V / f; // the bottom layer also covers the tail
+		X[1] = R;
+		X[128] = 0;
+		for (uint i = 2; i < 128; i++)
+		{
+			X[i] = sqrt(-2 * log(V / X[i - 1] + f));
+			f = exp(-.5 * X[i] * X[i]);
+		}
+
+		for (uint i = 0; i < 129; i++) x[i] = (float)X[i];
+		for (uint i = 0; i < 128; i++) r[i] = (float)(X[i + 1] / X[i]);
+	}
+} ziggurat;
+
+// u in [-1, 1) missed the rectangle of its layer : try the wedge, or the tail for layer 0. loops until it gets one
+float Random::ziggurat_slow(uint layer, float u)
+{
+	const float R = ziggurat.x[1];
+
+	for (;;)
+	{
+		if (layer == 0)
+		{
+			float x, y;
+			do {
+				x = logf(1 - next_float()) / R;
+				y = logf(1 - next_float());
+			} while (-2 * y < x * x);
+			return (u < 0) ? x - R : R - x;
+		}
+
+		float x  = u * ziggurat.x[layer];
+		float f0 = expf(-.5f * (ziggurat.x[layer] * ziggurat.x[layer] - x * x));
+		float f1 = expf(-.5f * (ziggurat.x[layer + 1] * ziggurat.x[layer + 1] - x * x));
+		if (f1 + next_float() * (f0 - f1) < 1) return x;
+
+		uint bits = next_uint();
+		layer = bits & 127;
+		u = (bits >> 8) * (1.f / (1 << 23)) - 1;
+		if (u < ziggurat.r[layer] && -ziggurat.r[layer] < u) return u * ziggurat.x[layer];
+	}
+}
+
+// 7 bits pick the layer, the top 24 are the position. ~99% of the time that's the answer
+float Random::gaussian()
+{
+	uint bits = next_uint();
+	uint layer = bits & 127;
+	float u = (bits >> 8) * (1.f / (1 << 23)) - 1;
+
+	if (u < ziggurat.r[layer] && -ziggurat.r[layer] < u) return u * ziggurat.x[layer];
+	return ziggurat_slow(layer, u);
+}
+
+uint64 random_base_seed = 0x5EED;
+uint random_generation = 1;
+volatile long random_streams;
+
+thread_local Random thread_rng;
+
+// every thread's generator. the first thread to ask after random_seed() gets stream 0, the next gets stream 1, ...
+Random* thread_random()
+{
+	if (thread_rng.generation != random_generation)
+	{
+		uint stream = InterlockedIncrement(&random_streams) - 1;
+
+		thread_rng.seed(random_base_seed);
+		for (uint i = 0; i < stream; i++) thread_rng.jump();
+		thread_rng.generation = random_generation;
+	}
+	return &thread_rng;
+}
+
+// call from the main thread, with no jobs running
+void random_seed(uint64 seed)
+{
+	random_base_seed = seed;
+	random_streams = 0;
+	random_generation++;
+	thread_random(); // the main thread always gets stream 0
+}
+
 uint random_uint()
 {
-	uint seed = __rdtsc();
-	seed *= BIT_NOISE_1;
-	seed *= seed; // helps avoid linearity
-	seed ^= (seed >> 8);
-	seed += BIT_NOISE_2;
-	seed ^= (seed >> 8);
-	seed *= BIT_NOISE_3;
-	seed ^= (seed >> 8);
-	return seed;
+	return thread_random()->next_uint();
 }
 int random_int()
 {
@@ -49,8 +276,7 @@ int random_int()
 }
 float random_normalized_float() // random float between 0 and 1
 {
-	uint seed = random_uint();
-	return (float)seed / (float)UINT_MAX; // is there a better way to do this?
+	return thread_random()->next_float();
 }
 float random_normalized_float_signed() // random float between -1 and 1
 {
@@ -118,6 +344,215 @@ vec3  randf3ns() { return vec3(randfns(), randfns(), randfns()); }
 vec3  randf3n(uint a, uint b, uint c) { return vec3(randfn(a), randfn(b), randfn(c)); }
 vec3  randf3ns(uint a, uint b, uint c) { return vec3(randfns(a), randfns(b), randfns(c)); }
 
+// bulk random numbers
+
+enum RANDOM_FILL { RANDOM_BITS, RANDOM_UNIFORM, RANDOM_GAUSSIAN };
+
+template <typename L> inline typename L::I xoshiro128_lanes(typename L::I* s)
+{
+	typedef typename L::I I;
+
+	I x = L::muli(s[1], L::seti(5));
+	I result = L::muli(L::xori(L::slli(x, 7), L::srli(x, 25)), L::seti(9));
+	I t = L::slli(s[1], 9);
+
+	s[2] = L::xori(s[2], s[0]);
+	s[3] = L::xori(s[3], s[1]);
+	s[1] = L::xori(s[1], s[2]);
+	s[0] = L::xori(s[0], s[3]);
+	s[2] = L::xori(s[2], t);
+	s[3] = L::xori(L::slli(s[3], 11), L::srli(s[3], 21));
+
+	return result;
+}
+
+// output[block * RANDOM_LANES + j] always comes from lane j, so every L gives the same sequence
+// uniform : a + [0, 1) * b | gaussian : a + N(0, 1) * b
+template <typename L, int MODE> void random_fill_lanes(Random* rng, void* output, uint blocks, float a, float b)
+{
+	typedef typename L::F F;
+	typedef typename L::I I;
+	const uint GROUPS = RANDOM_LANES / L::N;
+
+	I s[GROUPS][4];
+	for (uint g = 0; g < GROUPS; g++)
+	for (uint k = 0; k < 4; k++) s[g][k] = L::loadi(rng->lanes[k] + g * L::N);
+
+	for (uint block = 0; block < blocks; block++)
+	for (uint g = 0; g < GROUPS; g++)
+	{
+		I bits = xoshiro128_lanes<L>(s[g]);
+		uint at = block * RANDOM_LANES + g * L::N;
+
+		if (MODE == RANDOM_BITS)
+		{
+			L::storei((uint*)output + at, bits);
+			continue;
+		}
+
+		float* out = (float*)output + at;
+		if (MODE == RANDOM_UNIFORM)
+		{
+			F f = L::mul(L::tofloat(L::srli(bits, 8)), L::set(1.f / (1 << 24)));
+			L::store(out, L::add(L::set(a), L::mul(f, L::set(b))));
+			continue;
+		}
+
+		// gaussian : the rectangle test for every lane at once, then the rare misses one at a time
+		I layer = L::andi(bits, L::seti(127));
+		F u = L::sub(L::mul(L::tofloat(L::srli(bits, 8)), L::set(1.f / (1 << 23))), L::set(1));
+		F r = L::gatherf(ziggurat.r, layer);
+		typename L::M inside = L::mand(L::lt(u, r), L::lt(L::sub(L::set(0), r), u));
+		L::store(out, L::add(L::set(a), L::mul(L::mul(u, L::gatherf(ziggurat.x, layer)), L::set(b))));
+
+		int missed = ~L::movemask(inside) & ((1 << L::N) - 1);
+		if (!missed) continue;
+
+		alignas(64) uint lane_bits[L::N];
+		L::storei(lane_bits, bits);
+		for (uint j = 0; j < (uint)L::N; j++)
+		{
+			if (!(missed & (1 << j))) continue;
+			float uj = (lane_bits[j] >> 8) * (1.f / (1 << 23)) - 1;
+			out[j] = a + rng->ziggurat_slow(lane_bits[j] & 127, uj) * b;
+		}
+	}
+
+	for (uint g = 0; g < GROUPS; g++)
+	for (uint k = 0; k < 4; k++) L::storei(rng->lanes[k] + g * L::N, s[g][k]);
+}
+
+template <int MODE> void random_fill(Random* rng, void* output, uint count, float a, float b)
+{
+	uint blocks = count / RANDOM_LANES, tail = count % RANDOM_LANES;
+
+	switch (simd_level())
+	{
+	case SIMD_AVX512: random_fill_lanes<Lanes_AVX512, MODE>(rng, output, blocks, a, b); break;
+	case SIMD_AVX2  : random_fill_lanes<Lanes_AVX2  , MODE>(rng, output, blocks, a, b); break;
+	default         : random_fill_lanes<Lanes_SSE2  , MODE>(rng, output, blocks, a, b); break;
+	}
+
+	if (!tail) return;
+
+	// a whole block for the last few, the rest is thrown away
+	alignas(64) uint last[RANDOM_LANES];
+	random_fill_lanes<Lanes_SSE2, MODE>(rng, last, 1, a, b);
+	memcpy((uint*)output + blocks * RANDOM_LANES, last, tail * sizeof(uint));
+}
+
+void Random::fill(uint* output, uint count) { random_fill<RANDOM_BITS>(this, output, count, 0, 0); }
+void Random::fill(uint* output, uint count, uint n)
+{
+	fill(output, count);
+	for (uint i = 0; i < count; i++) output[i] = (uint)(((uint64)output[i] * n) >> 32);
+}
+void Random::fill(float* output, uint count, float lo, float hi) { random_fill<RANDOM_UNIFORM>(this, output, count, lo, hi - lo); }
+void Random::fill_gaussian(float* output, uint count, float mean, float deviation) { random_fill<RANDOM_GAUSSIAN>(this, output, count, mean, deviation); }
+
+// speed, plus a few quick statistical checks. not a replacement for PractRand / TestU01, but catches the obvious
+void random_benchmark()
+{
+	const uint COUNT = 1 << 24;
+
+	uint*  bits    = Alloc(uint , COUNT);
+	float* floats  = Alloc(float, COUNT);
+	float* normals = Alloc(float, COUNT);
+	memset(floats, 1, COUNT * sizeof(float)); // page faults aren't what's being measured
+	memset(normals, 1, COUNT * sizeof(float));
+
+	Random rng = {};
+	rng.seed(12345);
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	const auto mps = [&]() { return COUNT / ((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart); };
+
+	QueryPerformanceCounter(&start);
+	for (uint i = 0; i < COUNT; i++) bits[i] = rng.next_uint();
+	QueryPerformanceCounter(&end);
+	print(" scalar uints    : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	for (uint i = 0; i < COUNT; i++) normals[i] = rng.gaussian();
+	QueryPerformanceCounter(&end);
+	print(" scalar gaussian : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	rng.fill(bits, COUNT);
+	QueryPerformanceCounter(&end);
+	print(" fill uints      : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	rng.fill(floats, COUNT);
+	QueryPerformanceCounter(&end);
+	print(" fill floats     : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	rng.fill_gaussian(normals, COUNT);
+	QueryPerformanceCounter(&end);
+	print(" fill gaussian   : %7.1f M/s\n", mps());
+
+	// byte frequencies : chi squared with 255 degrees of freedom, ~255 +- 23
+	double counts[256] = {};
+	for (uint i = 0; i < COUNT; i++) for (uint b = 0; b < 4; b++) counts[(bits[i] >> (b * 8)) & 255]++;
+	double chi = 0, expected = COUNT * 4.0 / 256;
+	for (uint i = 0; i < 256; i++) chi += (counts[i] - expected) * (counts[i] - expected) / expected;
+	print(" byte chi^2      : %7.1f (255 +- 23)\n", chi);
+
+	// bit balance : every bit should be set half the time
+	double worst_bit = 0;
+	for (uint b = 0; b < 32; b++)
+	{
+		uint set = 0;
+		for (uint i = 0; i < COUNT; i++) set += (bits[i] >> b) & 1;
+		worst_bit = glm::max(worst_bit, abs(set / (double)COUNT - .5));
+	}
+	print(" worst bit bias  : %7.5f (< %.5f)\n", worst_bit, 4 * .5 / sqrt((double)COUNT));
+
+	// uniform floats : mean 1/2, variance 1/12, no correlation between neighbours
+	double mean = 0, variance = 0, serial = 0;
+	for (uint i = 0; i < COUNT; i++) mean += floats[i];
+	mean /= COUNT;
+	for (uint i = 0; i < COUNT; i++)
+	{
+		variance += (floats[i] - mean) * (floats[i] - mean);
+		if (i) serial += (floats[i] - mean) * (floats[i - 1] - mean);
+	}
+	serial /= variance;
+	variance /= COUNT;
+	print(" uniform         : mean %.5f var %.5f serial %.5f (.5, .08333, 0)\n", mean, variance, serial);
+
+	// gaussians : the first 4 moments & how much lands past 3 deviations
+	double m1 = 0, m2 = 0, m3 = 0, m4 = 0, tail = 0;
+	for (uint i = 0; i < COUNT; i++)
+	{
+		double x = normals[i];
+		m1 += x; m2 += x * x; m3 += x * x * x; m4 += x * x * x * x;
+		tail += abs(x) > 3;
+	}
+	m1 /= COUNT; m2 /= COUNT; m3 /= COUNT; m4 /= COUNT;
+	print(" gaussian        : mean %.4f var %.4f skew %.4f kurtosis %.4f tail %.5f (0, 1, 0, 3, .00270)\n", m1, m2 - m1 * m1, m3 / pow(m2, 1.5), m4 / (m2 * m2), tail / COUNT);
+
+	// same seed, every SIMD level, same numbers
+	uint mismatches = 0;
+	Random a = {}, b = {};
+	a.seed(7); b.seed(7);
+	random_fill_lanes<Lanes_SSE2, RANDOM_GAUSSIAN>(&a, floats , 4096 / RANDOM_LANES, 0, 1);
+	if (simd_level() >= SIMD_AVX2) random_fill_lanes<Lanes_AVX2, RANDOM_GAUSSIAN>(&b, normals, 4096 / RANDOM_LANES, 0, 1);
+	else random_fill_lanes<Lanes_SSE2, RANDOM_GAUSSIAN>(&b, normals, 4096 / RANDOM_LANES, 0, 1);
+	for (uint i = 0; i < 4096; i++) mismatches += floats[i] != normals[i];
+	print(" simd mismatches : %u\n", mismatches);
+
+	// split streams shouldn't track each other
+	Random first = rng.split(), second = rng.split();
+	double correlation = 0;
+	for (uint i = 0; i < COUNT; i++) correlation += (first.next_float() - .5) * (second.next_float() - .5);
+	print(" stream correlation : %.5f (0)\n", correlation / (COUNT / 12.0));
+
+	free(bits); free(floats); free(normals);
+}
+
 // interpolation
 
 float lerp_spring(float amount, float stiffness = 1, float period = 1) // probably broken
@@ -127,10 +562,10 @@ float lerp_spring(float amount, float stiffness = 1, float period = 1) // probab
 float lerp(float a, float b, float amount) { return (a + amount * (b - a)); }
 vec3  lerp(vec3  a, vec3  b, float amount) { return (a + amount * (b - a)); }
 quat  lerp(quat  a, quat  b, float amount) { return (a + amount * (b - a)); }
-mat4  lerp(mat4 a, mat4 b, float amount)
+mat4  lerp(mat4 a, mat4 b, float amount) // decomposes both every call, keep a Transform instead if it's done a lot
 {
-	vec3 pos_1 = vec3(a[0][3], a[1][3], a[2][3]);
-	vec3 pos_2 = vec3(b[0][3], b[1][3], b[2][3]);
+	vec3 pos_1 = vec3(a[3]); // glm is column major, translation is the last column
+	vec3 pos_2 = vec3(b[3]);
 
 	quat rot_1 = quat(a);
 	quat rot_2 = quat(b);
@@ -139,16 +574,14 @@ mat4  lerp(mat4 a, mat4 b, float amount)
 	quat rot = lerp(rot_1, rot_2, amount);
 
 	mat4 ret = mat4(rot);
-	ret[0][3] = pos.x;
-	ret[1][3] = pos.y;
-	ret[2][3] = pos.z;
+	ret[3] = vec4(pos, 1);
 
 	return ret;
 }
-mat4  nlerp(mat4 a, mat4 b, float amount)
+mat4  nlerp(mat4 a, mat4 b, float amount) // decomposes both every call, keep a Transform instead if it's done a lot
 {
-	vec3 pos_1 = vec3(a[0][3], a[1][3], a[2][3]);
-	vec3 pos_2 = vec3(b[0][3], b[1][3], b[2][3]);
+	vec3 pos_1 = vec3(a[3]); // glm is column major, translation is the last column
+	vec3 pos_2 = vec3(b[3]);
 
 	quat rot_1 = quat(a);
 	quat rot_2 = quat(b);
@@ -157,9 +590,7 @@ mat4  nlerp(mat4 a, mat4 b, float amount)
 	quat rot = normalize(lerp(rot_1, rot_2, amount));
 
 	mat4 ret = mat4(rot);
-	ret[0][3] = pos.x;
-	ret[1][3] = pos.y;
-	ret[2][3] = pos.z;
+	ret[3] = vec4(pos, 1);
 
 	return ret;
 }
@@ -179,34 +610,25 @@ float bezier3(float b, float c, float t) // a = 0 and d = 1
 	//
 	//return lerp(lerp(l1, l12, t), lerp(l2, l3, t), t);
 }
-float bezier5(float b, float c, float d, float e, float t) // a = 0 and d = 1
+float bezier5(float b, float c, float d, float e, float t) // a = 0 and f = 1
 {
-	// this implementation is not the fastest
-	float a1 = lerp(0, b, t);
-	float a2 = lerp(b, c, t);
-	float a3 = lerp(c, d, t);
-	float a4 = lerp(d, e, t);
-	float a5 = lerp(e, 1, t);
-
-	float b1 = lerp(a1, a2, t);
-	float b2 = lerp(a2, a3, t);
-	float b3 = lerp(a3, a4, t);
-	float b4 = lerp(a4, a5, t);
-
-	float c1 = lerp(b1, b2, t);
-	float c2 = lerp(b2, b3, t);
-	float c3 = lerp(b3, b4, t);
+	float s = 1.f - t;
+	float s2 = s * s;
+	float s3 = s2 * s;
+	float s4 = s2 * s2;
 
-	float d1 = lerp(c1, c2, t);
-	float d2 = lerp(c2, c3, t);
+	float t2 = t  * t;
+	float t3 = t2 * t;
+	float t4 = t2 * t2;
+	float t5 = t3 * t2;
 
-	return lerp(d1, d2, t);
+	return (5.f * b * s4 * t) + (10.f * c * s3 * t2) + (10.f * d * s2 * t3) + (5.f * e * s * t4) + t5;
 }
-float bezier7(float b, float c, float d, float e, float f, float g, float t) // a = 0 and d = 1
+float bezier7(float b, float c, float d, float e, float f, float g, float t) // a = 0 and h = 1
 {
 	float s = 1.f - t;
-	float s2 = t * t;
-	float s3 = s2 * t;
+	float s2 = s  * s;
+	float s3 = s2 * s;
 	float s4 = s2 * s2;
 	float s5 = s3 * s2;
 	float s6 = s3 * s3;
@@ -218,7 +640,7 @@ float bezier7(float b, float c, float d, float e, float f, float g, float t) //
 	float t6 = t3 * t3;
 	float t7 = t3 * t4;
 
-	return (7.f * b * s6 * t) + (21.f * c * s5 * t2) + (35.f * d * s4 * t3) * (35.f * e * s3 * t4) + (21.f * f * s2 * t5) + (7.f * g * s * t6) + t7;
+	return (7.f * b * s6 * t) + (21.f * c * s5 * t2) + (35.f * d * s4 * t3) + (35.f * e * s3 * t4) + (21.f * f * s2 * t5) + (7.f * g * s * t6) + t7;
 }
 float bounce(float t, float a = -.45, float b = .25, float c = .55, float d = .75)
 {
@@ -234,55 +656,388 @@ float smoothstep(float a, float b, float amount)
 	//return (b - a) * (amount * (amount * 6.0 - 15.0) * amount * amount * amount + 10.0) + a;
 }
 
-// specialized noise
+// batched curves : SoA in & out, for animating lots of values per frame
+
+void lerp(uint count, const float* a, const float* b, const float* amount, float* output)
+{
+	for (uint i = 0; i < count; i++) output[i] = a[i] + amount[i] * (b[i] - a[i]); // simple enough for the compiler to vectorize
+}
+void smoothstep(uint count, const float* a, const float* b, const float* amount, float* output)
+{
+	for (uint i = 0; i < count; i++) output[i] = (b[i] - a[i]) * (3.f - amount[i] * 2.f) * amount[i] * amount[i] + a[i];
+}
+
+inline int binomial(int n, int k)
+{
+	int result = 1;
+	for (int i = 1; i <= k; i++) result = result * (n - k + i) / i;
+	return result;
+}
+
+// power form of a bezier from 0 to 1 : coefficient k (of t^k) = sum C(n, k) C(k, i) (-1)^(k - i) * point i
+inline double bezier_weight(int n, int k, int i) { return binomial(n, k) * binomial(k, i) * (((k - i) & 1) ? -1.0 : 1.0); }
+
+// same terms in the same order as the scalar versions, so the results match bit for bit.
+// (horner on the power form is faster, but loses ~1e-4 at degree 7 to cancellation. EasingCurve uses it for fixed curves)
+template <typename L, int N> inline typename L::F bezier_lanes(const typename L::F* p, typename L::F t)
+{
+	typedef typename L::F F;
+	const auto mul4 = [](F a, F b, F c, F d) { return L::mul(L::mul(L::mul(a, b), c), d); };
+
+	F s  = L::sub(L::set(1), t);
+	F s2 = L::mul(s, s), s3 = L::mul(s2, s), s4 = L::mul(s2, s2);
+	F t2 = L::mul(t, t), t3 = L::mul(t2, t), t4 = L::mul(t2, t2);
 
-vec2 random2(vec2 p) { // hack that i stole
-	return fract(sin(vec2(dot(p, vec2(127.1, 311.7)), dot(p, vec2(269.5, 183.3)))) * 43758.5453f);
+	if (N == 3) return L::add(L::add(mul4(L::set(3), p[1], s2, t), mul4(L::set(3), p[2], s, t2)), t3);
+
+	F t5 = L::mul(t3, t2);
+	if (N == 5)
+	{
+		F sum = L::add(mul4(L::set(5), p[1], s4, t), mul4(L::set(10), p[2], s3, t2));
+		sum = L::add(sum, mul4(L::set(10), p[3], s2, t3));
+		sum = L::add(sum, mul4(L::set(5), p[4], s, t4));
+		return L::add(sum, t5);
+	}
+
+	F s5 = L::mul(s3, s2), s6 = L::mul(s3, s3);
+	F t6 = L::mul(t3, t3), t7 = L::mul(t3, t4);
+
+	F sum = L::add(mul4(L::set(7), p[1], s6, t), mul4(L::set(21), p[2], s5, t2));
+	sum = L::add(sum, mul4(L::set(35), p[3], s4, t3));
+	sum = L::add(sum, mul4(L::set(35), p[4], s3, t4));
+	sum = L::add(sum, mul4(L::set(21), p[5], s2, t5));
+	sum = L::add(sum, mul4(L::set(7), p[6], s, t6));
+	return L::add(sum, t7);
 }
 
-float perlin(float x, float y)
+// points = the N - 1 inner control point arrays. the last partial group goes through a zero padded copy
+template <typename L, int N> void bezier_batch_lanes(uint count, const float* const* points, const float* t, float* output)
 {
-	const auto dot_grid_gradient = [](float X, float Y, float x, float y)
+	typedef typename L::F F;
+
+	uint i = 0;
+	for (; i + L::N <= count; i += L::N)
 	{
-		float n = TWOPI * random2(vec2(X, Y)).x;// out(x << '.' << Y << ';' << randfns(X, Y));
+		F p[8];
+		for (int k = 1; k < N; k++) p[k] = L::load(points[k - 1] + i);
+		L::store(output + i, bezier_lanes<L, N>(p, L::load(t + i)));
+	}
+	if (i == count) return;
 
-		vec2 gradient = vec2(cos(n), sin(n));
-		vec2 distance = { x - X, y - Y };
+	alignas(64) float padded[N][L::N] = {};
+	alignas(64) float result[L::N];
+	uint tail = count - i;
+	for (int k = 0; k < N; k++) memcpy(padded[k], ((k < N - 1) ? points[k] : t) + i, tail * sizeof(float));
 
-		return dot(distance, gradient);
+	F p[8];
+	for (int k = 1; k < N; k++) p[k] = L::load(padded[k - 1]);
+	L::store(result, bezier_lanes<L, N>(p, L::load(padded[N - 1])));
+	memcpy(output + i, result, tail * sizeof(float));
+}
+
+template <int N> void bezier_batch(uint count, const float* const* points, const float* t, float* output)
+{
+	switch (simd_level())
+	{
+	case SIMD_AVX512: bezier_batch_lanes<Lanes_AVX512, N>(count, points, t, output); break;
+	case SIMD_AVX2  : bezier_batch_lanes<Lanes_AVX2  , N>(count, points, t, output); break;
+	default         : bezier_batch_lanes<Lanes_SSE2  , N>(count, points, t, output); break;
+	}
+}
+
+// every element has its own control points
+void bezier3(uint count, const float* b, const float* c, const float* t, float* output)
+{
+	const float* points[] = { b, c };
+	bezier_batch<3>(count, points, t, output);
+}
+void bezier5(uint count, const float* b, const float* c, const float* d, const float* e, const float* t, float* output)
+{
+	const float* points[] = { b, c, d, e };
+	bezier_batch<5>(count, points, t, output);
+}
+void bezier7(uint count, const float* b, const float* c, const float* d, const float* e, const float* f, const float* g, const float* t, float* output)
+{
+	const float* points[] = { b, c, d, e, f, g };
+	bezier_batch<7>(count, points, t, output);
+}
+
+/* EasingCurve : one curve shared by everything that uses it
+
+	- init_bezier() keeps the power form, so evaluate() is a straight horner polynomial per lane
+	- any curve (bounce, lerp_spring, ...) can also be sampled into a table, then lookup() is 2 gathers & a lerp
+	- lookup() clamps t to [0, 1], evaluate() doesn't
+*/
+
+const uint EASING_TABLE_SIZE = 256;
+
+struct EasingCurve
+{
+	uint  degree; // of the polynomial, 0 = table only
+	float coefficients[8];
+	float table[EASING_TABLE_SIZE + 1];
+
+	void init_bezier(uint degree, const float* points); // the degree - 1 inner control points, the ends are 0 & 1
+	template <typename Curve> void init(Curve curve)   // float curve(float t)
+	{
+		degree = 0;
+		for (uint i = 0; i <= EASING_TABLE_SIZE; i++) table[i] = curve(i / (float)EASING_TABLE_SIZE);
+	}
+
+	float evaluate(float t);
+	void  evaluate(uint count, const float* t, float* output);
+	void  lookup(uint count, const float* t, float* output);
+};
+
+void EasingCurve::init_bezier(uint n, const float* points)
+{
+	if (n < 1 || n > 7) { out("ERROR : easing curves go up to degree 7!"); stop; return; }
+
+	degree = n;
+	for (uint k = 0; k <= n; k++)
+	{
+		double c = (k == n) ? 1 : 0;
+		for (uint i = 1; i <= k && i < n; i++) c += bezier_weight(n, k, i) * points[i - 1];
+		coefficients[k] = (float)c;
+	}
+
+	for (uint i = 0; i <= EASING_TABLE_SIZE; i++) table[i] = evaluate(i / (float)EASING_TABLE_SIZE);
+}
+
+float EasingCurve::evaluate(float t)
+{
+	float result = coefficients[degree];
+	for (int k = degree - 1; k >= 0; k--) result = result * t + coefficients[k];
+	return result;
+}
+
+template <typename L> inline typename L::F easing_lanes(const EasingCurve* curve, bool lookup, typename L::F t)
+{
+	typedef typename L::F F;
+
+	if (!lookup)
+	{
+		F result = L::set(curve->coefficients[curve->degree]);
+		for (int k = curve->degree - 1; k >= 0; k--) result = L::add(L::mul(result, t), L::set(curve->coefficients[k]));
+		return result;
+	}
+
+	t = L::min(L::select(L::lt(t, L::set(0)), L::set(0), t), L::set(1));
+	F x = L::mul(t, L::set((float)EASING_TABLE_SIZE));
+	typename L::I i = L::floor(L::min(x, L::set(EASING_TABLE_SIZE - 1.f))); // so t = 1 still has a next sample
+
+	F a = L::gatherf(curve->table, i);
+	F b = L::gatherf(curve->table + 1, i);
+	return L::add(a, L::mul(L::sub(b, a), L::sub(x, L::tofloat(i))));
+}
+
+template <typename L> void easing_batch_lanes(const EasingCurve* curve, bool lookup, uint count, const float* t, float* output)
+{
+	uint i = 0;
+	for (; i + L::N <= count; i += L::N) L::store(output + i, easing_lanes<L>(curve, lookup, L::load(t + i)));
+	if (i == count) return;
+
+	alignas(64) float padded[L::N] = {};
+	alignas(64) float result[L::N];
+	memcpy(padded, t + i, (count - i) * sizeof(float));
+	L::store(result, easing_lanes<L>(curve, lookup, L::load(padded)));
+	memcpy(output + i, result, (count - i) * sizeof(float));
+}
+
+void easing_batch(const EasingCurve* curve, bool lookup, uint count, const float* t, float* output)
+{
+	switch (simd_level())
+	{
+	case SIMD_AVX512: easing_batch_lanes<Lanes_AVX512>(curve, lookup, count, t, output); break;
+	case SIMD_AVX2  : easing_batch_lanes<Lanes_AVX2  >(curve, lookup, count, t, output); break;
+	default         : easing_batch_lanes<Lanes_SSE2  >(curve, lookup, count, t, output); break;
+	}
+}
+
+void EasingCurve::evaluate(uint count, const float* t, float* output)
+{
+	if (!degree) { lookup(count, t, output); return; } // tables are all there is
+	easing_batch(this, false, count, t, output);
+}
+void EasingCurve::lookup(uint count, const float* t, float* output)
+{
+	easing_batch(this, true, count, t, output);
+}
+
+// de casteljau in double, the slow obviously correct way
+double bezier_reference(uint n, const float* inner, double t)
+{
+	double p[8] = {};
+	for (uint i = 1; i < n; i++) p[i] = inner[i - 1];
+	p[n] = 1;
+
+	for (uint level = n; level > 0; level--)
+	for (uint i = 0; i < level; i++) p[i] = p[i] + (p[i + 1] - p[i]) * t;
+
+	return p[0];
+}
+
+// checks every bezier path against de casteljau, then times them
+void easing_benchmark()
+{
+	const uint COUNT = 1 << 16;
+	const float TOLERANCE = 2e-5f; // relative to the biggest control point
+
+	float* points[6];
+	for (uint k = 0; k < 6; k++) points[k] = Alloc(float, COUNT);
+	float* t      = Alloc(float, COUNT);
+	float* result = Alloc(float, COUNT);
+
+	Random rng = {};
+	rng.seed(37);
+	for (uint k = 0; k < 6; k++) rng.fill(points[k], COUNT, -1, 2);
+	rng.fill(t, COUNT);
+	t[0] = 0; t[1] = 1; // the ends have to be exact-ish too
+
+	const auto check = [&](const char* name, uint n, const float* values, uint count) {
+		double worst = 0;
+		for (uint i = 0; i < count; i++)
+		{
+			float inner[6] = { points[0][i], points[1][i], points[2][i], points[3][i], points[4][i], points[5][i] };
+			worst = glm::max(worst, abs(values[i] - bezier_reference(n, inner, t[i])));
+		}
+		print(" %-22s max error %.2e %s\n", name, worst, worst < TOLERANCE * 2 ? "ok" : "FAILED");
 	};
 
+	for (uint i = 0; i < COUNT; i++) result[i] = bezier3(points[0][i], points[1][i], t[i]);
+	check("bezier3 scalar", 3, result, COUNT);
+	for (uint i = 0; i < COUNT; i++) result[i] = bezier5(points[0][i], points[1][i], points[2][i], points[3][i], t[i]);
+	check("bezier5 scalar", 5, result, COUNT);
+	for (uint i = 0; i < COUNT; i++) result[i] = bezier7(points[0][i], points[1][i], points[2][i], points[3][i], points[4][i], points[5][i], t[i]);
+	check("bezier7 scalar", 7, result, COUNT);
+
+	// odd counts, so the padded tail gets checked too
+	bezier_batch_lanes<Lanes_SSE2, 3>(COUNT - 3, points, t, result); check("bezier3 SSE2", 3, result, COUNT - 3);
+	bezier_batch_lanes<Lanes_SSE2, 5>(COUNT - 3, points, t, result); check("bezier5 SSE2", 5, result, COUNT - 3);
+	bezier_batch_lanes<Lanes_SSE2, 7>(COUNT - 3, points, t, result); check("bezier7 SSE2", 7, result, COUNT - 3);
+	if (simd_level() >= SIMD_AVX2)
+	{
+		bezier_batch_lanes<Lanes_AVX2, 7>(COUNT - 3, points, t, result); check("bezier7 AVX2", 7, result, COUNT - 3);
+	}
+	if (simd_level() >= SIMD_AVX512)
+	{
+		bezier_batch_lanes<Lanes_AVX512, 7>(COUNT - 3, points, t, result); check("bezier7 AVX-512", 7, result, COUNT - 3);
+	}
+
+	uint mismatches = 0;
+	bezier7(COUNT, points[0], points[1], points[2], points[3], points[4], points[5], t, result);
+	for (uint i = 0; i < COUNT; i++) mismatches += result[i] != bezier7(points[0][i], points[1][i], points[2][i], points[3][i], points[4][i], points[5][i], t[i]);
+	print(" %-22s %u different from scalar %s\n", "bezier7 batched", mismatches, mismatches ? "FAILED" : "ok");
+
+	// one shared curve : horner & the table
+	float inner[6] = { -.2f, .1f, 1.4f, -.3f, 1.2f, .9f };
+	EasingCurve curve = {};
+	curve.init_bezier(7, inner);
+
+	double worst_polynomial = 0, worst_table = 0;
+	curve.evaluate(COUNT, t, result);
+	for (uint i = 0; i < COUNT; i++) worst_polynomial = glm::max(worst_polynomial, abs(result[i] - bezier_reference(7, inner, t[i])));
+	curve.lookup(COUNT, t, result);
+	for (uint i = 0; i < COUNT; i++) worst_table = glm::max(worst_table, abs(result[i] - bezier_reference(7, inner, t[i])));
+	print(" %-22s max error %.2e %s\n", "EasingCurve evaluate", worst_polynomial, worst_polynomial < 1e-4 ? "ok" : "FAILED"); // power form, see bezier_lanes
+	print(" %-22s max error %.2e\n", "EasingCurve lookup", worst_table);
+
+	// speed
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	const auto mps = [&]() { return COUNT / ((end.QuadPart - start.QuadPart) * 1e6 / frequency.QuadPart); };
+
+	QueryPerformanceCounter(&start);
+	for (uint i = 0; i < COUNT; i++) result[i] = bezier7(points[0][i], points[1][i], points[2][i], points[3][i], points[4][i], points[5][i], t[i]);
+	QueryPerformanceCounter(&end);
+	print(" bezier7 scalar   : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	bezier7(COUNT, points[0], points[1], points[2], points[3], points[4], points[5], t, result);
+	QueryPerformanceCounter(&end);
+	print(" bezier7 batched  : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	curve.evaluate(COUNT, t, result);
+	QueryPerformanceCounter(&end);
+	print(" curve evaluate   : %7.1f M/s\n", mps());
+
+	QueryPerformanceCounter(&start);
+	curve.lookup(COUNT, t, result);
+	QueryPerformanceCounter(&end);
+	print(" curve lookup     : %7.1f M/s\n", mps());
+
+	EasingCurve bounces = {};
+	bounces.init([](float t) { return bounce(t); });
+	QueryPerformanceCounter(&start);
+	bounces.lookup(COUNT, t, result);
+	QueryPerformanceCounter(&end);
+	print(" bounce lookup    : %7.1f M/s\n", mps());
+
+	for (uint k = 0; k < 6; k++) free(points[k]);
+	free(t); free(result);
+}
+
+// specialized noise
+
+// integer lattice hash : squirrel3 on a 2d cell coordinate. only integer ops, so every
+// machine gets the same bits, and it vectorizes (see the batched versions below)
+uint lattice_hash(int x, int y, uint seed = 0)
+{
+	uint n = (uint)x + 198491317u * (uint)y; // large prime keeps rows apart
+	n *= BIT_NOISE_1;
+	n += seed;
+	n ^= (n >> 8);
+	n += BIT_NOISE_2;
+	n ^= (n << 8);
+	n *= BIT_NOISE_3;
+	n ^= (n >> 8);
+	return n;
+}
+
+// 16 unit gradients, written out so nobody's cos() / sin() gets involved
+static const float lattice_gradient_x[16] = { 1.f, 0.923879504f, 0.707106769f, 0.382683426f, 0.f, -0.382683426f, -0.707106769f, -0.923879504f,
+                                            -1.f, -0.923879504f, -0.707106769f, -0.382683426f, 0.f, 0.382683426f, 0.707106769f, 0.923879504f };
+static const float lattice_gradient_y[16] = { 0.f, 0.382683426f, 0.707106769f, 0.923879504f, 1.f, 0.923879504f, 0.707106769f, 0.382683426f,
+                                             0.f, -0.382683426f, -0.707106769f, -0.923879504f, -1.f, -0.923879504f, -0.707106769f, -0.382683426f };
+
+// NOTE : the scalar & batched versions do the same float ops in the same order. results are
+// bit identical everywhere as long as the compiler isn't allowed to contract into FMAs
+
+// returns a value between 0 and 1
+float perlin(float x, float y, uint seed = 0)
+{
+	const auto dot_grid_gradient = [](int X, int Y, float dx, float dy, uint seed)
+	{
+		uint h = lattice_hash(X, Y, seed) & 15;
+		return dx * lattice_gradient_x[h] + dy * lattice_gradient_y[h];
+	};
+
+	// cubic s-curve between a & b
+	const auto interpolate = [](float a, float b, float w) { return (b - a) * (3.f - w * 2.f) * w * w + a; };
+
 	// grid coordinates
-	float X = (int)x;
-	float Y = (int)y;
+	float fx = floorf(x);
+	float fy = floorf(y);
+	int X = (int)fx;
+	int Y = (int)fy;
 
-	// interpolation weights (could also use higher order polynomial/s-curve here)
-	float wx = x - X;
-	float wy = y - Y;
+	// interpolation weights
+	float wx = x - fx;
+	float wy = y - fy;
 
 	// interpolate between grid point gradients
 	float a, b, c, d;
 
-	a  = dot_grid_gradient(X + 0, Y + 0, x, y);
-	b  = dot_grid_gradient(X + 1, Y + 0, x, y);
-	c = smoothstep(a, b, wx); // lerp or smoothstep for different results
-	
-	a  = dot_grid_gradient(X + 0, Y + 1, x, y);
-	b  = dot_grid_gradient(X + 1, Y + 1, x, y);
-	d = smoothstep(a, b, wx);
-	
-	return (smoothstep(c, d, wy) + 1.f) / 2.f;
-
-	//// without lerping; for testing
-	//a = dot_grid_gradient(X + 0, Y + 0, x, y);
-	//b = dot_grid_gradient(X + 1, Y + 0, x, y);
-	//c = wx > .5 ? a : b;// lerp(a, b, wx); // change lerp to smoothstep for different results
-	//
-	//a = dot_grid_gradient(X + 0, Y + 1, x, y);
-	//b = dot_grid_gradient(X + 1, Y + 1, x, y);
-	//d = wx > .5 ? a : b;
-	//float k = wy > .5 ? c : d;
-	//return (k + 1.f) / 2.f;
+	a = dot_grid_gradient(X + 0, Y + 0, wx, wy, seed);
+	b = dot_grid_gradient(X + 1, Y + 0, wx - 1.f, wy, seed);
+	c = interpolate(a, b, wx);
+
+	a = dot_grid_gradient(X + 0, Y + 1, wx, wy - 1.f, seed);
+	b = dot_grid_gradient(X + 1, Y + 1, wx - 1.f, wy - 1.f, seed);
+	d = interpolate(a, b, wx);
+
+	return (interpolate(c, d, wy) + 1.f) * .5f;
 }
 float perlin(float x)
 {
@@ -325,63 +1080,180 @@ float perlins(float x)
 	return (perlin(x) * 2) - 1;
 }
 
-float worley(float x, float z) // add a seed later
+// distance to the closest random point, one point per cell
+float worley(float x, float z, uint seed = 0)
 {
-	vec2 test_point = fract(vec2{ x, z });
-	vec2 grid_index = floor(vec2{ x, z }); //print("%f,%f | ", x, z);
+	float fx = floorf(x);
+	float fz = floorf(z);
+	int X = (int)fx;
+	int Z = (int)fz;
+
+	vec2 test_point = vec2(x - fx, z - fz);
 
-	float first_smallest = 2, second_smallest = 2;
+	float closest = 2;
 
 	for (int u = -1; u < 2; u++) {
 	for (int v = -1; v < 2; v++)
 	{
-		uvec2 index = grid_index + vec2(u, v) + 3.f;
-		//vec2 point = vec2(u, v) + vec2(randfn(index.x, index.y)); // this box's random point
-		vec2 point = random2(grid_index + vec2(u,v)) + vec2(u,v); // this box's random point
+		// this box's random point : 16 bits of hash per axis
+		uint h = lattice_hash(X + u, Z + v, seed);
+		float px = (float)u + (float)(h & 0xFFFF) * (1.f / 65536);
+		float pz = (float)v + (float)(h >> 16)    * (1.f / 65536);
 
-		float distance = length(test_point - point);
+		float dx = test_point.x - px;
+		float dz = test_point.y - pz;
+		float distance = sqrtf(dx * dx + dz * dz);
 
-		if (distance <= first_smallest)
-		{
-			second_smallest = first_smallest;
-			first_smallest = distance;
-		}
-		else if (distance < second_smallest)
-			second_smallest = distance;
+		closest = (distance < closest) ? distance : closest;
 	}}
 
-	return first_smallest / 1.414213f; // sqrt 2
-	//return second_smallest / 2.828427f; // 2 * sqrt 2
+	return closest * (1.f / 1.414213f); // sqrt 2
+}
+float voronoi(float x, float z, uint seed = 0) // UNFINISHED!!!
+{
+	return worley(x, z, seed) > .9f ? 0 : 1;
+}
+
+// batched versions : same results, 4 / 8 / 16 points at a time (see the Lanes structs in noise.h)
+
+template <typename L> inline typename L::I lattice_hash_lanes(typename L::I x, typename L::I y, typename L::I seed)
+{
+	typename L::I n = L::addi(x, L::muli(y, L::seti(198491317)));
+	n = L::muli(n, L::seti((int32_t)BIT_NOISE_1));
+	n = L::addi(n, seed);
+	n = L::xori(n, L::srli(n, 8));
+	n = L::addi(n, L::seti((int32_t)BIT_NOISE_2));
+	n = L::xori(n, L::slli(n, 8));
+	n = L::muli(n, L::seti((int32_t)BIT_NOISE_3));
+	n = L::xori(n, L::srli(n, 8));
+	return n;
 }
-float voronoi(float x, float z) // UNFINISHED!!!
+
+template <typename L> inline void perlin_lanes(const float* px, const float* py, uint seed, float* output)
+{
+	typedef typename L::F F;
+	typedef typename L::I I;
+
+	const auto dot_grid_gradient = [](I X, I Y, F dx, F dy, I seed) {
+		I h = L::andi(lattice_hash_lanes<L>(X, Y, seed), L::seti(15));
+		return L::add(L::mul(dx, L::gatherf(lattice_gradient_x, h)), L::mul(dy, L::gatherf(lattice_gradient_y, h)));
+	};
+	const auto interpolate = [](F a, F b, F w) {
+		return L::add(L::mul(L::mul(L::mul(L::sub(b, a), L::sub(L::set(3.f), L::mul(w, L::set(2.f)))), w), w), a);
+	};
+
+	F x = L::load(px), y = L::load(py);
+	I X = L::floor(x), Y = L::floor(y);
+	F wx = L::sub(x, L::tofloat(X));
+	F wy = L::sub(y, L::tofloat(Y));
+
+	I one = L::seti(1), s = L::seti(seed);
+	F wx1 = L::sub(wx, L::set(1.f));
+	F wy1 = L::sub(wy, L::set(1.f));
+
+	F c = interpolate(dot_grid_gradient(X, Y, wx, wy, s), dot_grid_gradient(L::addi(X, one), Y, wx1, wy, s), wx);
+	F d = interpolate(dot_grid_gradient(X, L::addi(Y, one), wx, wy1, s), dot_grid_gradient(L::addi(X, one), L::addi(Y, one), wx1, wy1, s), wx);
+
+	L::store(output, L::mul(L::add(interpolate(c, d, wy), L::set(1.f)), L::set(.5f)));
+}
+
+template <typename L> inline void worley_lanes(const float* px, const float* pz, uint seed, float* output)
 {
-	vec2 test_point = vec2(fract(x), fract(z));
-	vec2 grid_index = vec2(floor(x), floor(z)); //print("%f,%f | ", x, z);
+	typedef typename L::F F;
+	typedef typename L::I I;
 
-	float first_smallest = 2, second_smallest = 2;
-	vec2 smallest_index = {};
+	F x = L::load(px), z = L::load(pz);
+	I X = L::floor(x), Z = L::floor(z);
+	F tx = L::sub(x, L::tofloat(X));
+	F tz = L::sub(z, L::tofloat(Z));
+
+	I s = L::seti(seed);
+	F closest = L::set(2.f);
 
 	for (int u = -1; u < 2; u++) {
 	for (int v = -1; v < 2; v++)
 	{
-		vec2 point = random2(grid_index + vec2(u,v)) + vec2(u,v); // this box's random point
+		I h = lattice_hash_lanes<L>(L::addi(X, L::seti(u)), L::addi(Z, L::seti(v)), s);
+		F cx = L::add(L::set((float)u), L::mul(L::tofloat(L::andi(h, L::seti(0xFFFF))), L::set(1.f / 65536)));
+		F cz = L::add(L::set((float)v), L::mul(L::tofloat(L::srli(h, 16)), L::set(1.f / 65536)));
 
-		float distance = length(test_point - point);
+		F dx = L::sub(tx, cx);
+		F dz = L::sub(tz, cz);
+		F distance = L::sqrt(L::add(L::mul(dx, dx), L::mul(dz, dz)));
 
-		if (distance <= first_smallest)
-		{
-			second_smallest = first_smallest;
-			first_smallest = distance;
-			smallest_index = grid_index + vec2(u, v);
-		}
-		else if (distance < second_smallest)
-			second_smallest = distance;
+		closest = L::min(distance, closest);
 	}}
 
-	//unfinished
+	L::store(output, L::mul(closest, L::set(1.f / 1.414213f)));
+}
+
+template <typename L> void lattice_noise_lanes(bool cells, uint count, const float* x, const float* y, float* output, uint seed)
+{
+	uint full = count - (count % L::N);
+
+	for (uint i = 0; i < full; i += L::N)
+	{
+		if (cells) worley_lanes<L>(x + i, y + i, seed, output + i);
+		else       perlin_lanes<L>(x + i, y + i, seed, output + i);
+	}
+
+	for (uint i = full; i < count; i++) output[i] = cells ? worley(x[i], y[i], seed) : perlin(x[i], y[i], seed);
+}
+void lattice_noise_dispatch(bool cells, uint count, const float* x, const float* y, float* output, uint seed)
+{
+	switch (simd_level())
+	{
+	case SIMD_AVX512: lattice_noise_lanes<Lanes_AVX512>(cells, count, x, y, output, seed); break;
+	case SIMD_AVX2  : lattice_noise_lanes<Lanes_AVX2  >(cells, count, x, y, output, seed); break;
+	default         : lattice_noise_lanes<Lanes_SSE2  >(cells, count, x, y, output, seed); break;
+	}
+}
+
+// output[i] = perlin(x[i], y[i], seed)
+void perlin(uint count, const float* x, const float* y, float* output, uint seed = 0) { lattice_noise_dispatch(false, count, x, y, output, seed); }
+
+// output[i] = worley(x[i], z[i], seed)
+void worley(uint count, const float* x, const float* z, float* output, uint seed = 0) { lattice_noise_dispatch(true, count, x, z, output, seed); }
+
+// scalar vs batched perlin & worley : checks they agree, prints points per second on one core
+void lattice_noise_benchmark()
+{
+	const uint COUNT = 1 << 18;
+
+	float* x = Alloc(float, COUNT * 4);
+	float* y = x + COUNT;
+	float* scalar  = y + COUNT;
+	float* batched = scalar + COUNT;
+
+	for (uint i = 0; i < COUNT; i++)
+	{
+		x[i] = (i % 512) * .0731f - 17.f;
+		y[i] = (i / 512) * .0731f - 17.f;
+	}
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+	const auto mpts = [&]() { return COUNT / ((double)(end.QuadPart - start.QuadPart) / frequency.QuadPart) * 1e-6; };
+
+	for (uint cells = 0; cells < 2; cells++)
+	{
+		QueryPerformanceCounter(&start);
+		for (uint i = 0; i < COUNT; i++) scalar[i] = cells ? worley(x[i], y[i], 7) : perlin(x[i], y[i], 7);
+		QueryPerformanceCounter(&end);
+		double scalar_mpts = mpts();
+
+		QueryPerformanceCounter(&start);
+		if (cells) worley(COUNT, x, y, batched, 7);
+		else       perlin(COUNT, x, y, batched, 7);
+		QueryPerformanceCounter(&end);
+
+		uint mismatches = 0;
+		for (uint i = 0; i < COUNT; i++) mismatches += memcmp(&scalar[i], &batched[i], sizeof(float)) != 0;
+
+		print(" %s : scalar %.1f Mpts/s | batched %.1f Mpts/s | %u / %u bits differ\n", cells ? "worley" : "perlin", scalar_mpts, mpts(), mismatches, COUNT);
+	}
 
-	return (first_smallest / 1.414213f) > .9 ? 0:1; // sqrt 2
-	//return second_smallest / 2.828427f; // 2 * sqrt 2
+	free(x);
 }
 
 // misc utilities
@@ -414,6 +1286,115 @@ mat3 point_at(vec3 dir, vec3 up)
 	return inverse(result);
 }
 
+// transforms
+
+// translation * rotation * scale, without going through 3 matrix multiplies
+mat4 trs(vec3 position, quat rotation, vec3 scale)
+{
+	mat4 m = glm::mat4_cast(rotation);
+	m[0] *= scale.x;
+	m[1] *= scale.y;
+	m[2] *= scale.z;
+	m[3]  = vec4(position, 1);
+	return m;
+}
+
+// a * b with SSE : each column of the result is a blend of a's columns
+void mul(const mat4& a, const mat4& b, mat4* result)
+{
+	__m128 a0 = _mm_loadu_ps(&a[0][0]);
+	__m128 a1 = _mm_loadu_ps(&a[1][0]);
+	__m128 a2 = _mm_loadu_ps(&a[2][0]);
+	__m128 a3 = _mm_loadu_ps(&a[3][0]);
+
+	for (uint j = 0; j < 4; j++)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[j][0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[j][2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[j][3])));
+		_mm_storeu_ps(&(*result)[j][0], column);
+	}
+}
+
+// Transform : position, rotation & scale kept apart, so blending never has to take a matrix apart.
+// padded so each part loads & stores as one vec4
+struct Transform
+{
+	vec3  position; float unused_0;
+	quat  rotation;
+	vec3  scale;    float unused_1;
+};
+
+Transform transform(vec3 position, quat rotation = quat(1, 0, 0, 0), vec3 scale = vec3(1))
+{
+	Transform t = {};
+	t.position = position;
+	t.rotation = rotation;
+	t.scale    = scale;
+	return t;
+}
+
+mat4 trs(const Transform& t) { return trs(t.position, t.rotation, t.scale); }
+
+// parent * child. like every engine that does this, non-uniform scale under a rotation loses its shear
+Transform mul(const Transform& parent, const Transform& child)
+{
+	Transform t = {};
+	t.position = parent.position + parent.rotation * (parent.scale * child.position);
+	t.rotation = parent.rotation * child.rotation;
+	t.scale    = parent.scale * child.scale;
+	return t;
+}
+
+// rotations take the short way around
+Transform nlerp(const Transform& a, const Transform& b, float amount)
+{
+	quat rb = (glm::dot(a.rotation, b.rotation) < 0) ? -b.rotation : b.rotation;
+
+	Transform t = {};
+	t.position = lerp(a.position, b.position, amount);
+	t.rotation = glm::normalize(lerp(a.rotation, rb, amount));
+	t.scale    = lerp(a.scale, b.scale, amount);
+	return t;
+}
+
+// one transform per iteration, each part a single SSE register
+inline void nlerp_sse(const Transform* a, const Transform* b, __m128 amount, Transform* output)
+{
+	const __m128 sign = _mm_set1_ps(-0.f);
+
+	__m128 pa = _mm_loadu_ps(&a->position.x), pb = _mm_loadu_ps(&b->position.x);
+	__m128 qa = _mm_loadu_ps(&a->rotation.x), qb = _mm_loadu_ps(&b->rotation.x);
+	__m128 sa = _mm_loadu_ps(&a->scale.x)   , sb = _mm_loadu_ps(&b->scale.x);
+
+	// dot(qa, qb) in every lane, then flip qb if it's negative
+	__m128 d = _mm_mul_ps(qa, qb);
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+	d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 0, 3, 2)));
+	qb = _mm_xor_ps(qb, _mm_and_ps(d, sign));
+
+	__m128 q = _mm_add_ps(qa, _mm_mul_ps(_mm_sub_ps(qb, qa), amount));
+	__m128 length = _mm_mul_ps(q, q);
+	length = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(2, 3, 0, 1)));
+	length = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(1, 0, 3, 2)));
+
+	_mm_storeu_ps(&output->position.x, _mm_add_ps(pa, _mm_mul_ps(_mm_sub_ps(pb, pa), amount)));
+	_mm_storeu_ps(&output->rotation.x, _mm_div_ps(q, _mm_sqrt_ps(length)));
+	_mm_storeu_ps(&output->scale.x   , _mm_add_ps(sa, _mm_mul_ps(_mm_sub_ps(sb, sa), amount)));
+}
+
+// output may be a or b
+void nlerp(uint count, const Transform* a, const Transform* b, float amount, Transform* output)
+{
+	__m128 t = _mm_set1_ps(amount);
+	for (uint i = 0; i < count; i++) nlerp_sse(a + i, b + i, t, output + i);
+}
+void nlerp(uint count, const Transform* a, const Transform* b, const float* amounts, Transform* output)
+{
+	for (uint i = 0; i < count; i++) nlerp_sse(a + i, b + i, _mm_set1_ps(amounts[i]), output + i);
+}
+
 // fast fourier transforms
 
 #include <complex>
@@ -421,14 +1402,9 @@ typedef std::complex<double> Complex;
 
 Complex gaussian_random_complex()
 {
-	float x1, x2, w;
-	do {
-		x1 = random_normalized_float_signed();
-		x2 = random_normalized_float_signed();
-		w = x1 * x1 + x2 * x2;
-	} while (w > 1.f);
-	w = sqrt((-2.f * log(w)) / w);
-	return Complex(x1 * w, x2 * w);
+	Random* rng = thread_random();
+	float re = rng->gaussian();
+	return Complex(re, rng->gaussian());
 }
 
 // fast fourier : result stored in input array
@@ -565,6 +1541,321 @@ void ifft2D(Complex* input, uint N, bool scale = false)
 	free(subarray);
 }
 
+/* -- planned fft --
+
+	fft() above recomputes its twiddles with a trig recurrence in double, for every call.
+	FFT does the expensive parts once per size, then transforms single precision data in place :
+
+	- twiddle & bit reverse tables are built in init()
+	- data is split complex (separate real & imaginary arrays) so butterflies vectorize cleanly
+	- stages are done two at a time (radix 2^2, same math as radix 4) with SSE2 / AVX2 / AVX-512
+	- 2D transforms do rows in parallel, then a blocked transpose, rows again, transpose back
+	- inverse = forward with real & imaginary swapped, so there's only one set of twiddles
+
+	WARNING : N must be a power of 2
+*/
+
+void parallel_for(uint count, uint batch_size, void (*function)(void* data, uint begin, uint end), void* data); // boilerplate.h
+
+struct FFT
+{
+	uint N, log2N;
+	uint num_swaps;
+	uint* swaps; // bit reversal as pairs of indices to swap
+	float* twiddle_re; // the stage with half size h uses entries [h, 2h) : e^(-i * pi * j / h)
+	float* twiddle_im;
+
+	void init(uint N);
+	void transform(float* re, float* im, bool inverse = false); // one row of N
+	void transform2D(float* re, float* im, bool inverse = false, bool scale = false); // N * N, row major
+	void release();
+};
+
+void FFT::init(uint size)
+{
+	N = size;
+	log2N = 0;
+	while ((1u << log2N) < N) log2N++;
+
+	num_swaps = 0;
+	swaps = Alloc(uint, N);
+	for (uint i = 0; i < N; i++)
+	{
+		uint r = 0;
+		for (uint b = 0; b < log2N; b++) r |= ((i >> b) & 1) << (log2N - 1 - b);
+		if (i < r) { swaps[2 * num_swaps] = i; swaps[2 * num_swaps + 1] = r; num_swaps++; }
+	}
+
+	// computed in double, then rounded once
+	twiddle_re = Alloc(float, N);
+	twiddle_im = Alloc(float, N);
+	for (uint h = 1; h < N; h <<= 1)
+	for (uint j = 0; j < h; j++)
+	{
+		double angle = -3.14159265358979323846 * j / h;
+		twiddle_re[h + j] = (float)cos(angle);
+		twiddle_im[h + j] = (float)sin(angle);
+	}
+}
+void FFT::release()
+{
+	free(swaps);
+	free(twiddle_re);
+	free(twiddle_im);
+	*this = {};
+}
+
+// stages 1 & 2 : the twiddles are 1 & -i, so it's just a radix 4 butterfly with no multiplies
+void fft_first_stages(float* re, float* im, uint N)
+{
+	for (uint k = 0; k + 3 < N; k += 4)
+	{
+		float* r = re + k; float* i = im + k;
+		float ar = r[0] + r[1], ai = i[0] + i[1], br = r[0] - r[1], bi = i[0] - i[1];
+		float cr = r[2] + r[3], ci = i[2] + i[3], dr = r[2] - r[3], di = i[2] - i[3];
+
+		r[0] = ar + cr; i[0] = ai + ci;
+		r[2] = ar - cr; i[2] = ai - ci;
+		r[1] = br + di; i[1] = bi - dr; // b + d * -i
+		r[3] = br - di; i[3] = bi + dr;
+	}
+
+	if (N == 2)
+	{
+		float r = re[0] - re[1], i = im[0] - im[1];
+		re[0] += re[1]; im[0] += im[1];
+		re[1] = r; im[1] = i;
+	}
+}
+
+// (ar, ai) * (br, bi)
+template <typename L> inline void complex_mul_lanes(typename L::F ar, typename L::F ai, typename L::F br, typename L::F bi, typename L::F* r, typename L::F* i)
+{
+	*r = L::sub(L::mul(ar, br), L::mul(ai, bi));
+	*i = L::add(L::mul(ar, bi), L::mul(ai, br));
+}
+
+// stages h & 2h in one pass : 4 points per butterfly, every load & store does 2 stages of work
+template <typename L> void fft_stage_pair_lanes(float* re, float* im, uint N, uint h, const float* twiddle_re, const float* twiddle_im)
+{
+	typedef typename L::F F;
+	const float* w1r = twiddle_re + h;     const float* w1i = twiddle_im + h;
+	const float* w2r = twiddle_re + 2 * h; const float* w2i = twiddle_im + 2 * h;
+
+	for (uint k = 0; k < N; k += 4 * h)
+	for (uint j = 0; j < h; j += L::N)
+	{
+		float* r0 = re + k + j; float* i0 = im + k + j;
+
+		F a0r = L::load(r0        ), a0i = L::load(i0        );
+		F a1r = L::load(r0 +     h), a1i = L::load(i0 +     h);
+		F a2r = L::load(r0 + 2 * h), a2i = L::load(i0 + 2 * h);
+		F a3r = L::load(r0 + 3 * h), a3i = L::load(i0 + 3 * h);
+
+		// stage h : (a0, a1) & (a2, a3) with the same twiddle
+		F wr = L::load(w1r + j), wi = L::load(w1i + j), tr, ti;
+		complex_mul_lanes<L>(a1r, a1i, wr, wi, &tr, &ti);
+		a1r = L::sub(a0r, tr); a1i = L::sub(a0i, ti);
+		a0r = L::add(a0r, tr); a0i = L::add(a0i, ti);
+		complex_mul_lanes<L>(a3r, a3i, wr, wi, &tr, &ti);
+		a3r = L::sub(a2r, tr); a3i = L::sub(a2i, ti);
+		a2r = L::add(a2r, tr); a2i = L::add(a2i, ti);
+
+		// stage 2h : (a0, a2) with twiddle j, (a1, a3) with twiddle j + h
+		complex_mul_lanes<L>(a2r, a2i, L::load(w2r + j), L::load(w2i + j), &tr, &ti);
+		L::store(r0 + 2 * h, L::sub(a0r, tr)); L::store(i0 + 2 * h, L::sub(a0i, ti));
+		L::store(r0        , L::add(a0r, tr)); L::store(i0        , L::add(a0i, ti));
+		complex_mul_lanes<L>(a3r, a3i, L::load(w2r + j + h), L::load(w2i + j + h), &tr, &ti);
+		L::store(r0 + 3 * h, L::sub(a1r, tr)); L::store(i0 + 3 * h, L::sub(a1i, ti));
+		L::store(r0 +     h, L::add(a1r, tr)); L::store(i0 +     h, L::add(a1i, ti));
+	}
+}
+template <typename L> void fft_stage_lanes(float* re, float* im, uint N, uint h, const float* twiddle_re, const float* twiddle_im)
+{
+	typedef typename L::F F;
+	for (uint k = 0; k < N; k += 2 * h)
+	for (uint j = 0; j < h; j += L::N)
+	{
+		float* ar = re + k + j; float* ai = im + k + j;
+		F tr, ti;
+		complex_mul_lanes<L>(L::load(ar + h), L::load(ai + h), L::load(twiddle_re + h + j), L::load(twiddle_im + h + j), &tr, &ti);
+		F xr = L::load(ar), xi = L::load(ai);
+		L::store(ar + h, L::sub(xr, tr)); L::store(ai + h, L::sub(xi, ti));
+		L::store(ar    , L::add(xr, tr)); L::store(ai    , L::add(xi, ti));
+	}
+}
+template <typename L> void fft_lanes(FFT* plan, float* re, float* im)
+{
+	uint N = plan->N;
+
+	for (uint n = 0; n < plan->num_swaps; n++)
+	{
+		uint i = plan->swaps[2 * n], r = plan->swaps[2 * n + 1];
+		float t = re[i]; re[i] = re[r]; re[r] = t;
+		t = im[i]; im[i] = im[r]; im[r] = t;
+	}
+
+	fft_first_stages(re, im, N);
+
+	// stages narrower than L::N use 4 wide vectors instead
+	uint h = 4;
+	for (; 4 * h <= N; h <<= 2)
+	{
+		if (h < (uint)L::N) fft_stage_pair_lanes<Lanes_SSE2>(re, im, N, h, plan->twiddle_re, plan->twiddle_im);
+		else fft_stage_pair_lanes<L>(re, im, N, h, plan->twiddle_re, plan->twiddle_im);
+	}
+	if (h < N)
+	{
+		if (h < (uint)L::N) fft_stage_lanes<Lanes_SSE2>(re, im, N, h, plan->twiddle_re, plan->twiddle_im);
+		else fft_stage_lanes<L>(re, im, N, h, plan->twiddle_re, plan->twiddle_im);
+	}
+}
+
+void FFT::transform(float* re, float* im, bool inverse)
+{
+	if (inverse) { float* t = re; re = im; im = t; } // ifft(x) = swap(fft(swap(x)))
+
+	switch (simd_level())
+	{
+	case SIMD_AVX512: fft_lanes<Lanes_AVX512>(this, re, im); break;
+	case SIMD_AVX2  : fft_lanes<Lanes_AVX2  >(this, re, im); break;
+	default         : fft_lanes<Lanes_SSE2  >(this, re, im); break;
+	}
+}
+
+// swaps the 4 x 4 tiles at (i, j) & (j, i), transposing both
+inline void transpose_tiles(float* data, uint N, uint i, uint j, __m128 scale)
+{
+	float* a = data + i * N + j;
+	float* b = data + j * N + i;
+
+	__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + N), a2 = _mm_loadu_ps(a + 2 * N), a3 = _mm_loadu_ps(a + 3 * N);
+	__m128 b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b + N), b2 = _mm_loadu_ps(b + 2 * N), b3 = _mm_loadu_ps(b + 3 * N);
+	_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+	_MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+	_mm_storeu_ps(b        , _mm_mul_ps(a0, scale)); _mm_storeu_ps(b +     N, _mm_mul_ps(a1, scale));
+	_mm_storeu_ps(b + 2 * N, _mm_mul_ps(a2, scale)); _mm_storeu_ps(b + 3 * N, _mm_mul_ps(a3, scale));
+	_mm_storeu_ps(a        , _mm_mul_ps(b0, scale)); _mm_storeu_ps(a +     N, _mm_mul_ps(b1, scale));
+	_mm_storeu_ps(a + 2 * N, _mm_mul_ps(b2, scale)); _mm_storeu_ps(a + 3 * N, _mm_mul_ps(b3, scale));
+}
+
+// in place, square, in 16 x 16 blocks so both the rows & columns being touched stay in cache
+void transpose_rows(float* data, uint N, uint first_block_row, uint end_block_row, float scale)
+{
+	if (N < 4) // a single 2 x 2
+	{
+		float t = data[1];
+		data[0] *= scale; data[1] = data[2] * scale;
+		data[2]  = t * scale; data[3] *= scale;
+		return;
+	}
+
+	const uint B = 16;
+	uint blocks = (N + B - 1) / B;
+	__m128 s = _mm_set1_ps(scale);
+
+	for (uint bi = first_block_row; bi < end_block_row; bi++)
+	for (uint bj = bi; bj < blocks; bj++)
+	{
+		uint i_end = glm::min((bi + 1) * B, N), j_end = glm::min((bj + 1) * B, N);
+
+		for (uint i = bi * B; i < i_end; i += 4)
+		for (uint j = (bi == bj) ? i : bj * B; j < j_end; j += 4)
+		{
+			if (i != j) { transpose_tiles(data, N, i, j, s); continue; }
+
+			// on the diagonal, the tile swaps with itself
+			float* a = data + i * N + i;
+			__m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + N), a2 = _mm_loadu_ps(a + 2 * N), a3 = _mm_loadu_ps(a + 3 * N);
+			_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+			_mm_storeu_ps(a        , _mm_mul_ps(a0, s)); _mm_storeu_ps(a +     N, _mm_mul_ps(a1, s));
+			_mm_storeu_ps(a + 2 * N, _mm_mul_ps(a2, s)); _mm_storeu_ps(a + 3 * N, _mm_mul_ps(a3, s));
+		}
+	}
+}
+
+void FFT::transform2D(float* re, float* im, bool inverse, bool scale)
+{
+	struct Params {
+		FFT* plan;
+		float *re, *im;
+		bool inverse;
+		float scale;
+	} params = { this, re, im, inverse, 1.f };
+
+	const auto rows = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		uint N = p->plan->N;
+		for (uint row = begin; row < end; row++) p->plan->transform(p->re + row * N, p->im + row * N, p->inverse);
+	};
+	const auto transpose = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		transpose_rows(p->re, p->plan->N, begin, end, p->scale);
+		transpose_rows(p->im, p->plan->N, begin, end, p->scale);
+	};
+
+	uint block_rows = (N + 15) / 16;
+
+	parallel_for(N, 16, rows, &params);
+	parallel_for(block_rows, 1, transpose, &params);
+	parallel_for(N, 16, rows, &params);
+
+	if (inverse && scale) params.scale = 1.f / ((float)N * N); // folded into the last transpose
+	parallel_for(block_rows, 1, transpose, &params);
+}
+
+// 512 x 512 complex, forward & back, checked against the double precision fft2D
+void fft_benchmark()
+{
+	const uint N = 512;
+
+	FFT plan = {};
+	plan.init(N);
+
+	float* re = Alloc(float, N * N);
+	float* im = Alloc(float, N * N);
+	Complex* reference = Alloc(Complex, N * N);
+
+	for (uint i = 0; i < N * N; i++)
+	{
+		re[i] = random_normalized_float_signed();
+		im[i] = random_normalized_float_signed();
+		reference[i] = Complex(re[i], im[i]);
+	}
+
+	LARGE_INTEGER frequency, start, end;
+	QueryPerformanceFrequency(&frequency);
+
+	QueryPerformanceCounter(&start);
+	fft2D(reference, N);
+	QueryPerformanceCounter(&end);
+	double reference_ms = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+
+	const uint RUNS = 20;
+	QueryPerformanceCounter(&start);
+	for (uint run = 0; run < RUNS; run++)
+	{
+		plan.transform2D(re, im);
+		if (run < RUNS - 1) plan.transform2D(re, im, true, true);
+	}
+	QueryPerformanceCounter(&end);
+	double planned_ms = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart / (2 * RUNS - 1);
+
+	// fft2D does the columns first, but the result is the same either way
+	double max_error = 0, max_value = 0;
+	for (uint i = 0; i < N * N; i++)
+	{
+		max_error = glm::max(max_error, abs(reference[i] - Complex(re[i], im[i])));
+		max_value = glm::max(max_value, abs(reference[i]));
+	}
+
+	print(" fft %u x %u : fft2D %.2f ms | planned %.3f ms | relative error %g\n", N, N, reference_ms, planned_ms, max_error / max_value);
+
+	free(re); free(im); free(reference);
+	plan.release();
+}
+
 void save_fft2D(Complex* data, uint N, const char* name = "fft2D.bmp")
 {
 	bvec3* bitmap = (bvec3*)calloc(N * N, 3); // 3 bytes per channel
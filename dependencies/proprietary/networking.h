@@ -1,150 +1,1553 @@
 #define NETWORK_ERROR(err) std::cout << "NETWORK ERROR: " << err << '\n'
 
+/* Networking : event driven sockets on their own I/O thread
+
+	- one I/O thread owns every socket. it sleeps in epoll_wait (WSAPoll on windows)
+	  and only ever touches the connections that are ready, so a quiet tick costs nothing
+	- epoll is edge-triggered : a ready socket gets drained until it would block,
+	  because the same bytes are never reported twice
+	- every connection has a receive ring (I/O thread writes, game thread reads), readv fills both halves of it in one call
+	- what goes out is a NetMessage : serialized once, reference counted & queued on every recipient's send queue
+	  without a copy. sendmsg gathers a connection's whole queue straight out of the shared buffers.
+	  each client can only have so many bytes queued, a slow one gets skipped instead of piling up memory
+	- messages are framed (16 bit size, 16 bit type) so partial & coalesced reads come out whole.
+	  a frame is read in place from the receive ring, only one that wraps around gets copied into a reassembly buffer.
+	  NetSchema writes & reads a struct's fields at offsets the compiler works out, decoding allocates nothing
+	- connects, disconnects & "there's data" go to the game thread through a lock-free event queue,
+	  flushes & closes come back through a command queue. the game thread never makes a socket call
+*/
+
 #define MAX_CLIENTS 32
 
-#define STATUS_CONNECTED    1
-#define STATUS_DISCONNECTED 2
+#define STATUS_CONNECTED    1
+#define STATUS_DISCONNECTED 2
+
+#define NET_RING_SIZE     (16 * 1024) // receive ring per connection, must be a power of 2
+#define NET_MAX_READY     256u // sockets handled per wakeup
+#define NET_POLL_TIMEOUT  100 // milliseconds, only matters for shutdown
+#define NET_MAX_DATAGRAMS 64  // per recvmmsg / sendmmsg
+#define NET_MAX_GATHER    64  // messages per sendmsg
+#define NET_SEND_QUEUE    512 // messages queued per connection
+#define NET_MAX_QUEUED    (256 * 1024) // bytes queued per connection, past this sends to it get dropped
+
+// -------------------- platform ------------------- //
+
+#ifdef _WIN32
+
+#define net_error() WSAGetLastError()
+#define NET_WOULDBLOCK WSAEWOULDBLOCK
+#define NET_INPROGRESS WSAEWOULDBLOCK
+
+#define NET_THREAD DWORD WINAPI
+typedef HANDLE net_thread;
+
+net_thread net_thread_start(LPTHREAD_START_ROUTINE function, void* params) { return CreateThread(0, 0, function, params, 0, 0); }
+void net_thread_join(net_thread thread) { WaitForSingleObject(thread, INFINITE); CloseHandle(thread); }
+void net_thread_pin(net_thread thread, uint core) { SetThreadAffinityMask(thread, (DWORD_PTR)1 << core); }
+
+// x86 loads & stores already have acquire / release semantics, only the compiler needs stopping
+uint64 net_load_acquire(volatile uint64* p) { uint64 v = *p; _ReadWriteBarrier(); return v; }
+void net_store_release(volatile uint64* p, uint64 v) { _ReadWriteBarrier(); *p = v; }
+long net_exchange(volatile long* p, long v) { return InterlockedExchange(p, v); }
+long net_increment(volatile long* p) { return InterlockedIncrement(p); }
+long net_decrement(volatile long* p) { return InterlockedDecrement(p); }
+bool net_compare_exchange(volatile uint64* p, uint64 expected, uint64 v) { return (uint64)InterlockedCompareExchange64((volatile LONG64*)p, v, expected) == expected; }
+void net_fence() { MemoryBarrier(); }
+
+#else
+
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+
+typedef int SOCKET;
+#define INVALID_SOCKET -1
+#define SOCKET_ERROR   -1
+#define closesocket close
+#define Sleep(milliseconds) usleep((milliseconds) * 1000)
+
+#define net_error() errno
+#define NET_WOULDBLOCK EWOULDBLOCK
+#define NET_INPROGRESS EINPROGRESS
+
+#define NET_THREAD void*
+typedef pthread_t net_thread;
+
+net_thread net_thread_start(void* (*function)(void*), void* params) { pthread_t thread = {}; pthread_create(&thread, NULL, function, params); return thread; }
+void net_thread_join(net_thread thread) { pthread_join(thread, NULL); }
+void net_thread_pin(net_thread thread, uint core) { cpu_set_t set; CPU_ZERO(&set); CPU_SET(core, &set); pthread_setaffinity_np(thread, sizeof(set), &set); }
+
+uint64 net_load_acquire(volatile uint64* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+void net_store_release(volatile uint64* p, uint64 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+long net_exchange(volatile long* p, long v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+long net_increment(volatile long* p) { return __atomic_add_fetch(p, 1, __ATOMIC_RELAXED); }
+long net_decrement(volatile long* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_ACQ_REL); }
+bool net_compare_exchange(volatile uint64* p, uint64 expected, uint64 v) { return __atomic_compare_exchange_n(p, &expected, v, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+void net_fence() { __atomic_thread_fence(__ATOMIC_SEQ_CST); }
+
+#endif
+
+int net_startup()
+{
+#ifdef _WIN32
+	WSADATA wsa_data = {};
+	int err = WSAStartup(MAKEWORD(2, 2), &wsa_data);
+	if (err != 0)
+	{
+		NETWORK_ERROR("WSAStartup failed | Error code: " << err);
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+void net_cleanup()
+{
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void net_set_nonblocking(SOCKET s)
+{
+#ifdef _WIN32
+	u_long mode = 1; // FIONBIO : mode = 0 for blocking, mode != 0 for non-blocking
+	ioctlsocket(s, FIONBIO, &mode);
+#else
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+// games send lots of small messages, nagle would hold them back
+void net_set_nodelay(SOCKET s)
+{
+	int on = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+}
+
+struct NetSpan
+{
+	byte* data;
+	uint size;
+};
+
+// scatter / gather, returns bytes moved or SOCKET_ERROR
+int net_readv(SOCKET s, NetSpan* spans, uint count)
+{
+#ifdef _WIN32
+	WSABUF buffers[2] = {};
+	for (uint i = 0; i < count; i++) buffers[i] = { spans[i].size, (char*)spans[i].data };
+	DWORD received = 0, flags = 0;
+	if (WSARecv(s, buffers, count, &received, &flags, NULL, NULL) == SOCKET_ERROR) return SOCKET_ERROR;
+	return received;
+#else
+	iovec buffers[2] = {};
+	for (uint i = 0; i < count; i++) buffers[i] = { spans[i].data, spans[i].size };
+	return readv(s, buffers, count);
+#endif
+}
+
+int net_writev(SOCKET s, NetSpan* spans, uint count)
+{
+#ifdef _WIN32
+	WSABUF buffers[NET_MAX_GATHER] = {};
+	for (uint i = 0; i < count; i++) buffers[i] = { spans[i].size, (char*)spans[i].data };
+	DWORD sent = 0;
+	if (WSASend(s, buffers, count, &sent, 0, NULL, NULL) == SOCKET_ERROR) return SOCKET_ERROR;
+	return sent;
+#else
+	iovec buffers[NET_MAX_GATHER] = {};
+	for (uint i = 0; i < count; i++) buffers[i] = { spans[i].data, spans[i].size };
+	msghdr message = {};
+	message.msg_iov    = buffers;
+	message.msg_iovlen = count;
+	return sendmsg(s, &message, MSG_NOSIGNAL); // writev would SIGPIPE on a closed peer
+#endif
+}
+
+// -- datagrams --
+// batched, for UDP sockets : one recvmmsg / sendmmsg per batch instead of one syscall per packet
+
+struct NetDatagram
+{
+	sockaddr_storage address;
+	int address_size;
+	byte* data;
+	uint size; // receive : capacity in, bytes received out
+};
+
+bool net_resolve(const char* ip, const char* port, sockaddr_storage* address, int* address_size)
+{
+	addrinfo* result = NULL;
+	addrinfo hints = {};
+	hints.ai_family   = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+
+	int err = 0;
+	if ((err = getaddrinfo(ip, port, &hints, &result)) != 0)
+	{
+		NETWORK_ERROR("getaddrinfo failed | Error code: " << err);
+		return false;
+	}
+
+	memcpy(address, result->ai_addr, result->ai_addrlen);
+	*address_size = (int)result->ai_addrlen;
+	freeaddrinfo(result);
+	return true;
+}
+
+bool net_same_address(const sockaddr_storage* a, const sockaddr_storage* b)
+{
+	const sockaddr_in* x = (const sockaddr_in*)a;
+	const sockaddr_in* y = (const sockaddr_in*)b;
+	return x->sin_port == y->sin_port && x->sin_addr.s_addr == y->sin_addr.s_addr;
+}
+
+// non-blocking UDP socket bound to ip:port, port "0" picks a free one
+SOCKET net_udp_open(const char* ip, const char* port, uint* bound_port = NULL)
+{
+	if (net_startup() != 0) return INVALID_SOCKET;
+
+	sockaddr_storage address = {};
+	int address_size = 0;
+	if (!net_resolve(ip, port, &address, &address_size)) return INVALID_SOCKET;
+
+	SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == INVALID_SOCKET)
+	{
+		NETWORK_ERROR("socket creation failed | Error code: " << net_error());
+		return INVALID_SOCKET;
+	}
+
+	if (bind(s, (sockaddr*)&address, address_size) == SOCKET_ERROR)
+	{
+		NETWORK_ERROR("bind() failed | Error code : " << net_error());
+		closesocket(s);
+		return INVALID_SOCKET;
+	}
+
+	// a burst of snapshots shouldn't overflow the default buffers
+	int buffer_size = 1024 * 1024;
+	setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+	setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*)&buffer_size, sizeof(buffer_size));
+
+	if (bound_port)
+	{
+		sockaddr_in bound = {};
+		socklen_t bound_size = sizeof(bound);
+		getsockname(s, (sockaddr*)&bound, &bound_size);
+		*bound_port = ntohs(bound.sin_port);
+	}
+
+	net_set_nonblocking(s);
+	return s;
+}
+
+// returns the number of datagrams received, 0 when nothing's waiting
+uint net_recv_datagrams(SOCKET s, NetDatagram* batch, uint count)
+{
+	if (count > NET_MAX_DATAGRAMS) count = NET_MAX_DATAGRAMS;
+
+#ifdef _WIN32
+	uint n = 0;
+	for (; n < count; n++)
+	{
+		batch[n].address_size = sizeof(sockaddr_storage);
+		int received = recvfrom(s, (char*)batch[n].data, batch[n].size, 0, (sockaddr*)&batch[n].address, &batch[n].address_size);
+		if (received < 0) break;
+		batch[n].size = received;
+	}
+	return n;
+#else
+	mmsghdr headers[NET_MAX_DATAGRAMS] = {};
+	iovec buffers[NET_MAX_DATAGRAMS] = {};
+	for (uint i = 0; i < count; i++)
+	{
+		buffers[i] = { batch[i].data, batch[i].size };
+		headers[i].msg_hdr.msg_iov     = &buffers[i];
+		headers[i].msg_hdr.msg_iovlen  = 1;
+		headers[i].msg_hdr.msg_name    = &batch[i].address;
+		headers[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+	}
+
+	int n = recvmmsg(s, headers, count, MSG_DONTWAIT, NULL);
+	if (n < 0) return 0;
+
+	for (int i = 0; i < n; i++)
+	{
+		batch[i].size = headers[i].msg_len;
+		batch[i].address_size = headers[i].msg_hdr.msg_namelen;
+	}
+	return n;
+#endif
+}
+
+// returns the number of datagrams handed to the kernel
+uint net_send_datagrams(SOCKET s, const NetDatagram* batch, uint count)
+{
+	if (count > NET_MAX_DATAGRAMS) count = NET_MAX_DATAGRAMS;
+
+#ifdef _WIN32
+	uint n = 0;
+	for (; n < count; n++) if (sendto(s, (const char*)batch[n].data, batch[n].size, 0, (const sockaddr*)&batch[n].address, batch[n].address_size) < 0) break;
+	return n;
+#else
+	mmsghdr headers[NET_MAX_DATAGRAMS] = {};
+	iovec buffers[NET_MAX_DATAGRAMS] = {};
+	for (uint i = 0; i < count; i++)
+	{
+		buffers[i] = { batch[i].data, batch[i].size };
+		headers[i].msg_hdr.msg_iov     = &buffers[i];
+		headers[i].msg_hdr.msg_iovlen  = 1;
+		headers[i].msg_hdr.msg_name    = (void*)&batch[i].address;
+		headers[i].msg_hdr.msg_namelen = batch[i].address_size;
+	}
+
+	int n = sendmmsg(s, headers, count, MSG_DONTWAIT | MSG_NOSIGNAL);
+	return n < 0 ? 0 : n;
+#endif
+}
+
+// ---------------- lock-free queues --------------- //
+
+/* single producer, single consumer. read & write only ever grow (64 bits won't wrap),
+   only the producer moves write & only the consumer moves read, so nothing needs a lock */
+
+struct NetRing
+{
+	byte* data;
+	uint  size; // power of 2
+	volatile uint64 write, read;
+};
+
+void ring_init(NetRing* ring, uint size)
+{
+	*ring = {};
+	ring->data = Alloc(byte, size);
+	ring->size = size;
+}
+
+// producer side
+uint ring_writable(NetRing* ring) { return ring->size - (uint)(ring->write - net_load_acquire(&ring->read)); }
+
+// the free space as up to 2 spans (it might wrap around)
+uint ring_write_spans(NetRing* ring, NetSpan* spans)
+{
+	uint free  = ring_writable(ring);
+	uint start = ring->write & (ring->size - 1);
+	uint first = glm::min(free, ring->size - start);
+
+	spans[0] = { ring->data + start, first };
+	spans[1] = { ring->data, free - first };
+	return free ? (free > first ? 2 : 1) : 0;
+}
+
+void ring_commit_write(NetRing* ring, uint size) { net_store_release(&ring->write, ring->write + size); }
+
+// all or nothing
+bool ring_write(NetRing* ring, const byte* source, uint size)
+{
+	if (ring_writable(ring) < size) return false;
+
+	uint start = ring->write & (ring->size - 1);
+	uint first = glm::min(size, ring->size - start);
+	memcpy(ring->data + start, source, first);
+	memcpy(ring->data, source + first, size - first);
+
+	ring_commit_write(ring, size);
+	return true;
+}
+
+// consumer side
+uint ring_readable(NetRing* ring) { return (uint)(net_load_acquire(&ring->write) - ring->read); }
+
+uint ring_read_spans(NetRing* ring, NetSpan* spans)
+{
+	uint used  = ring_readable(ring);
+	uint start = ring->read & (ring->size - 1);
+	uint first = glm::min(used, ring->size - start);
+
+	spans[0] = { ring->data + start, first };
+	spans[1] = { ring->data, used - first };
+	return used ? (used > first ? 2 : 1) : 0;
+}
+
+void ring_commit_read(NetRing* ring, uint size) { net_store_release(&ring->read, ring->read + size); }
+
+// as much as fits, returns bytes read
+uint ring_read(NetRing* ring, byte* destination, uint max_size)
+{
+	NetSpan spans[2];
+	uint count = ring_read_spans(ring, spans), size = 0;
+	for (uint i = 0; i < count && size < max_size; i++)
+	{
+		uint n = glm::min(spans[i].size, max_size - size);
+		memcpy(destination + size, spans[i].data, n);
+		size += n;
+	}
+
+	ring_commit_read(ring, size);
+	return size;
+}
+
+// copies without consuming, false when there isn't that much
+bool ring_peek(NetRing* ring, uint offset, byte* destination, uint size)
+{
+	if (ring_readable(ring) < offset + size) return false;
+
+	uint start = (ring->read + offset) & (ring->size - 1);
+	uint first = glm::min(size, ring->size - start);
+	memcpy(destination, ring->data + start, first);
+	memcpy(destination + first, ring->data, size - first);
+	return true;
+}
+
+// ring of small fixed size items, same rules
+template<typename T>
+struct NetQueue
+{
+	T* items;
+	uint size; // power of 2
+	volatile uint64 write, read;
+
+	void init(uint min_size) { *this = {}; size = 64; while (size < min_size) size *= 2; items = Alloc(T, size); }
+	void release() { free(items); *this = {}; }
+
+	bool push(const T& item)
+	{
+		if (write - net_load_acquire(&read) == size) return false;
+		items[write & (size - 1)] = item;
+		net_store_release(&write, write + 1);
+		return true;
+	}
+
+	bool pop(T* item)
+	{
+		if (read == net_load_acquire(&write)) return false;
+		*item = items[read & (size - 1)];
+		net_store_release(&read, read + 1);
+		return true;
+	}
+
+	bool empty() { return read == net_load_acquire(&write); }
+	bool full() { return write - net_load_acquire(&read) == size; } // producer side
+
+	// consumer side, without popping
+	uint count() { return (uint)(net_load_acquire(&write) - read); }
+	T& peek(uint i) { return items[(read + i) & (size - 1)]; }
+	void skip() { net_store_release(&read, read + 1); }
+};
+
+// same ring for any number of producers & one consumer. producers claim a slot by moving write along,
+// every slot says whose turn it is : its index once it's free, index + 1 once it's filled in
+template<typename T>
+struct NetSharedQueue
+{
+	struct Slot {
+		volatile uint64 sequence;
+		T item;
+	};
+
+	Slot* slots;
+	uint size; // power of 2
+	volatile uint64 write;
+	uint64 read; // consumer only
+
+	void init(uint min_size)
+	{
+		*this = {};
+		size = 64; while (size < min_size) size *= 2;
+		slots = Alloc(Slot, size);
+		for (uint i = 0; i < size; i++) slots[i].sequence = i;
+	}
+	void release() { free(slots); *this = {}; }
+
+	bool push(const T& item)
+	{
+		uint64 w = net_load_acquire(&write);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &slots[w & (size - 1)];
+			uint64 sequence = net_load_acquire(&slot->sequence);
+
+			if (sequence == w && net_compare_exchange(&write, w, w + 1)) break;
+			if (sequence < w) return false; // still holds the item from a lap ago, full
+
+			w = net_load_acquire(&write); // somebody else got there first
+		}
+
+		slot->item = item;
+		net_store_release(&slot->sequence, w + 1);
+		return true;
+	}
+
+	bool pop(T* item)
+	{
+		Slot* slot = &slots[read & (size - 1)];
+		if (net_load_acquire(&slot->sequence) != read + 1) return false; // empty, or claimed & not filled in yet
+
+		*item = slot->item;
+		net_store_release(&slot->sequence, read + size); // free for the next lap
+		read++;
+		return true;
+	}
+};
+
+// ---------------------- messages ----------------- //
+
+/* reference counted buffers, in size classes of 64 bytes * 4^n. the game thread hands them out & takes them back,
+   the I/O thread returns the ones it's done with through a queue, so nothing is allocated once it's warmed up */
+
+#define NET_MESSAGE_CLASSES 6 // 64 bytes to 64KB, bigger ones are malloc'd
+
+struct NetMessage
+{
+	volatile long references;
+	uint size, capacity;
+	uint size_class; // NET_MESSAGE_CLASSES = not pooled
+	NetMessage* next; // in the free list
+	byte* data; // capacity bytes, right after this
+};
+
+// ---------------------- framing ------------------ //
+
+/* TCP is a byte stream : one send can show up in pieces, several can show up in one read.
+   every message goes out as a frame, a 4 byte header (payload size, type) & then the payload.
+   a frame that's in one piece in the receive ring is handed out right where it is,
+   one that wraps around the end (or is bigger than the ring) gets put back together in the reassembly buffer */
+
+#define NET_FRAME_HEADER 4
+#define NET_MAX_FRAME    0xFFFF // payload bytes, the size is 16 bits
+
+struct NetFrame
+{
+	uint type;
+	uint size; // payload
+	const byte* data; // the payload, valid until the next frame is asked for
+};
+
+struct NetFramer
+{
+	byte* buffer; // reassembly, grows to the biggest frame that had to be copied
+	uint capacity;
+	uint gathered; // bytes of the current frame in buffer, header included
+	uint held; // bytes of the last in-place frame, let go of on the next call
+};
+
+void net_write_frame_header(byte* out, uint type, uint size)
+{
+	out[0] = (byte)size; out[1] = (byte)(size >> 8);
+	out[2] = (byte)type; out[3] = (byte)(type >> 8);
+}
+
+// consumer side of the ring : the next whole frame, false when it hasn't all arrived yet
+bool net_next_frame(NetFramer* framer, NetRing* ring, NetFrame* frame)
+{
+	if (framer->held) { ring_commit_read(ring, framer->held); framer->held = 0; }
+
+	byte header[NET_FRAME_HEADER];
+	if (framer->gathered) memcpy(header, framer->buffer, NET_FRAME_HEADER);
+	else if (!ring_peek(ring, 0, header, NET_FRAME_HEADER)) return false;
+
+	frame->size = header[0] | (header[1] << 8);
+	frame->type = header[2] | (header[3] << 8);
+	uint total  = NET_FRAME_HEADER + frame->size;
+
+	if (!framer->gathered)
+	{
+		NetSpan spans[2];
+		ring_read_spans(ring, spans);
+		if (spans[0].size >= total)
+		{
+			frame->data  = spans[0].data + NET_FRAME_HEADER;
+			framer->held = total;
+			return true;
+		}
+
+		// the rest is on its way & there's room for it, a frame only gets copied when it has to be
+		if (spans[0].size + spans[1].size < total && total <= ring->size) return false;
+	}
+
+	if (framer->capacity < total)
+	{
+		framer->buffer   = (byte*)realloc(framer->buffer, total);
+		framer->capacity = total;
+	}
+
+	framer->gathered += ring_read(ring, framer->buffer + framer->gathered, total - framer->gathered);
+	if (framer->gathered < total) return false;
+
+	framer->gathered = 0; // the buffer holds on to it until the next call
+	frame->data = framer->buffer + NET_FRAME_HEADER;
+	return true;
+}
+
+// ------------------- connections ----------------- //
+
+// io_state, only the I/O thread changes it
+#define NET_FREE       0
+#define NET_CONNECTING 1 // outgoing, waiting to become writable
+#define NET_OPEN       2
+#define NET_CLOSED     3 // socket's gone, slot waits for the game thread to let go of it
+
+enum NetEventType { NET_CONNECT = 1, NET_DISCONNECT, NET_DATA };
+
+struct NetEvent
+{
+	uint type;
+	uint connection;
+};
+
+enum NetCommandType { NET_CMD_FLUSH = 1, NET_CMD_READ, NET_CMD_CLOSE, NET_CMD_RELEASE, NET_CMD_ADOPT };
+
+struct NetCommand
+{
+	uint type;
+	uint connection;
+	SOCKET socket; // NET_CMD_ADOPT
+};
+
+struct Server_Connection
+{
+	uint status; // game thread's view : STATUS_CONNECTED, STATUS_DISCONNECTED, 0
+
+	SOCKET socket;
+	uint io_state;
+	bool write_blocked; // waiting for the socket to drain
+	bool hung_up;       // the peer's FIN is in : read to the 0 byte read, there's no edge after this one
+
+	NetRing recv; // I/O thread -> game thread
+	NetFramer framer; // game thread only
+	NetQueue<NetMessage*> send; // game thread -> I/O thread
+	uint send_offset; // into the first message, I/O thread only
+
+	// backpressure : the game thread counts bytes in, the I/O thread counts bytes out
+	uint64 bytes_queued;
+	volatile uint64 bytes_flushed;
+
+	// set by whoever raised the signal, cleared by whoever handled it
+	volatile long data_signaled; // a NET_DATA event is in the queue
+	volatile long flush_pending; // a NET_CMD_FLUSH is in the queue
+	volatile long recv_stalled;  // the receive ring filled up, the I/O thread stopped reading
+};
+
+struct NetStats
+{
+	uint64 wakeups, syscalls;
+	uint64 bytes_received, bytes_sent;
+	uint64 accepted, closed;
+	uint64 dropped_sends; // game thread, backpressure
+};
+
+struct Server
+{
+	uint num_active_clients, max_clients;
+	Server_Connection* clients;
+
+	SOCKET listen_socket;
+	uint port; // the one actually bound, for port "0"
+
+	NetQueue<NetEvent>   events;   // I/O thread -> game thread
+	NetQueue<NetCommand> commands; // game thread -> I/O thread
+	uint pending_release; // index + 1, let go of on the next poll
+
+	NetMessage* free_messages[NET_MESSAGE_CLASSES]; // game thread only
+	NetQueue<NetMessage*> released; // I/O thread -> game thread, messages nobody needs anymore. the I/O thread is its only producer
+	uint max_queued_bytes; // per client
+
+	// I/O thread only
+	uint* free_slots;
+	uint num_free_slots;
+	NetStats stats;
+
+#ifdef _WIN32
+	WSAPOLLFD* pollfds;
+	uint* poll_keys;
+#else
+	int epoll, wakeup;
+#endif
+
+	volatile long running, io_sleeping;
+	net_thread io_thread;
+};
+
+// --------------------- poller -------------------- //
+
+// keys : 0 = the listen socket, 1 = the wakeup, connection index + 2
+#define NET_KEY_LISTEN 0
+#define NET_KEY_WAKEUP 1
+
+struct NetReady
+{
+	uint64 key;
+	bool readable, writable, closed;
+	bool hung_up; // the peer shut down (EPOLLRDHUP / EPOLLHUP, POLLHUP), whatever it sent before is still readable
+};
+
+void net_poll_init(Server* server)
+{
+#ifdef _WIN32
+	server->pollfds   = Alloc(WSAPOLLFD, server->max_clients + 1);
+	server->poll_keys = Alloc(uint, server->max_clients + 1);
+#else
+	server->epoll  = epoll_create1(0);
+	server->wakeup = eventfd(0, EFD_NONBLOCK);
+
+	epoll_event event = {};
+	event.events   = EPOLLIN | EPOLLET;
+	event.data.u64 = NET_KEY_WAKEUP;
+	epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->wakeup, &event);
+#endif
+}
+
+void net_poll_add(Server* server, SOCKET s, uint64 key)
+{
+#ifndef _WIN32
+	epoll_event event = {};
+	event.events   = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	event.data.u64 = key;
+	epoll_ctl(server->epoll, EPOLL_CTL_ADD, s, &event);
+	server->stats.syscalls++;
+#endif
+	// WSAPoll gets its socket list rebuilt from the connections on every wait
+}
+
+// wakes the I/O thread up from net_poll_wait
+void net_poll_wake(Server* server)
+{
+#ifndef _WIN32
+	uint64 one = 1;
+	write(server->wakeup, &one, sizeof(one));
+#endif
+	// WSAPoll can't wait on anything but sockets, so on windows the I/O thread polls with a short timeout instead
+}
+
+uint net_poll_wait(Server* server, NetReady* ready, uint max_ready, int timeout)
+{
+#ifdef _WIN32
+	uint count = 0;
+	if (server->listen_socket != INVALID_SOCKET)
+	{
+		server->pollfds[count]   = { server->listen_socket, POLLRDNORM, 0 };
+		server->poll_keys[count] = NET_KEY_LISTEN;
+		count++;
+	}
+	for (uint i = 0; i < server->max_clients; i++)
+	{
+		Server_Connection* c = &server->clients[i];
+		if (c->io_state != NET_OPEN && c->io_state != NET_CONNECTING) continue;
+
+		short events = POLLRDNORM;
+		if (c->io_state == NET_CONNECTING || c->write_blocked) events |= POLLWRNORM;
+		server->pollfds[count]   = { c->socket, events, 0 };
+		server->poll_keys[count] = i + 2;
+		count++;
+	}
+
+	int n = count ? WSAPoll(server->pollfds, count, 1) : (Sleep(1), 0);
+	server->stats.syscalls++;
+
+	uint num_ready = 0;
+	for (uint i = 0; i < count && n > 0 && num_ready < max_ready; i++)
+	{
+		short revents = server->pollfds[i].revents;
+		if (!revents) continue;
+		ready[num_ready++] = { server->poll_keys[i], (revents & (POLLRDNORM | POLLHUP)) != 0, (revents & POLLWRNORM) != 0, (revents & (POLLERR | POLLNVAL)) != 0, (revents & POLLHUP) != 0 };
+	}
+	return num_ready;
+#else
+	epoll_event events[NET_MAX_READY];
+	int n = epoll_wait(server->epoll, events, glm::min(max_ready, NET_MAX_READY), timeout);
+	server->stats.syscalls++;
+
+	for (int i = 0; i < n; i++)
+	{
+		uint e = events[i].events;
+		ready[i] = { events[i].data.u64, (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0, (e & EPOLLOUT) != 0, (e & EPOLLERR) != 0, (e & (EPOLLRDHUP | EPOLLHUP)) != 0 };
+	}
+	return n < 0 ? 0 : n;
+#endif
+}
+
+// back into its pool, game thread only
+void net_pool_message(Server* server, NetMessage* message)
+{
+	if (message->size_class == NET_MESSAGE_CLASSES) { free(message); return; }
+	message->next = server->free_messages[message->size_class];
+	server->free_messages[message->size_class] = message;
+}
+
+// takes back the messages the I/O thread is done with, game thread only
+void net_collect_messages(Server* server)
+{
+	NetMessage* message;
+	while (server->released.pop(&message)) net_pool_message(server, message);
+}
+
+/* a reference let go of. either thread can hold the last one, but released only takes one producer :
+   net_release_message on the I/O thread hands it over, net_return_message on the game thread pools it right away */
+void net_release_message(Server* server, NetMessage* message)
+{
+	if (net_decrement(&message->references) != 0) return;
+	if (!server->released.push(message)) NETWORK_ERROR("released message queue is full!");
+}
+
+void net_return_message(Server* server, NetMessage* message)
+{
+	if (net_decrement(&message->references) == 0) net_pool_message(server, message);
+}
+
+// ------------------- I/O thread ------------------ //
+
+void net_push_event(Server* server, uint type, uint connection)
+{
+	// the queue holds every event all the slots could have outstanding, so this can't fail
+	if (!server->events.push({ type, connection })) NETWORK_ERROR("event queue is full!");
+}
+
+void net_close(Server* server, uint id)
+{
+	Server_Connection* c = &server->clients[id];
+	if (c->io_state == NET_CLOSED || c->io_state == NET_FREE) return;
+
+	closesocket(c->socket); // also takes it out of the epoll set
+	c->socket   = INVALID_SOCKET;
+	c->io_state = NET_CLOSED;
+	server->stats.closed++;
+	server->stats.syscalls++;
+
+	net_push_event(server, NET_DISCONNECT, id);
+}
+
+// drains the socket into the receive ring
+void net_read(Server* server, uint id)
+{
+	Server_Connection* c = &server->clients[id];
+	uint received = 0;
+
+	while (c->io_state == NET_OPEN)
+	{
+		NetSpan spans[2];
+		uint count = ring_write_spans(&c->recv, spans);
+		if (!count)
+		{
+			// full; the game thread sends NET_CMD_READ once it makes room.
+			// if it already made room before seeing the flag, take the flag back & keep going
+			net_exchange(&c->recv_stalled, 1);
+			net_fence();
+			if (ring_writable(&c->recv) && net_exchange(&c->recv_stalled, 0)) continue;
+			break;
+		}
+
+		int n = net_readv(c->socket, spans, count);
+		server->stats.syscalls++;
+
+		if (n > 0)
+		{
+			ring_commit_write(&c->recv, n);
+			received += n;
+			// a short read on a stream means it's drained, unless the FIN came with it : the edge that said so
+			// won't come again, so it's read again until the 0 that closes it
+			if ((uint)n < spans[0].size + spans[1].size && !c->hung_up) break;
+			continue;
+		}
+
+		if (n == 0 || net_error() != NET_WOULDBLOCK) net_close(server, id); // orderly shutdown or reset
+		break;
+	}
+
+	server->stats.bytes_received += received;
+
+	// one NET_DATA in the queue at a time, the game thread clears the flag when it pops it
+	if (received && !net_exchange(&c->data_signaled, 1)) net_push_event(server, NET_DATA, id);
+}
+
+// gathers the send queue into the socket, as much as it takes
+void net_flush(Server* server, uint id)
+{
+	Server_Connection* c = &server->clients[id];
+
+	// cleared first, so anything the game thread queues from here on asks for another flush
+	net_exchange(&c->flush_pending, 0);
+
+	while (c->io_state == NET_OPEN)
+	{
+		NetSpan spans[NET_MAX_GATHER];
+		uint count = glm::min(c->send.count(), (uint)NET_MAX_GATHER);
+		if (!count) { c->write_blocked = false; return; }
+
+		for (uint i = 0; i < count; i++)
+		{
+			NetMessage* message = c->send.peek(i);
+			uint skip = i ? 0 : c->send_offset;
+			spans[i] = { message->data + skip, message->size - skip };
+		}
+
+		int n = net_writev(c->socket, spans, count);
+		server->stats.syscalls++;
+
+		if (n > 0)
+		{
+			server->stats.bytes_sent += n;
+			net_store_release(&c->bytes_flushed, c->bytes_flushed + n);
+
+			// whatever went out completely gets let go of
+			uint left = n;
+			while (left)
+			{
+				NetMessage* message = c->send.peek(0);
+				uint rest = message->size - c->send_offset;
+				if (left < rest) { c->send_offset += left; break; }
+
+				left -= rest;
+				c->send_offset = 0;
+				c->send.skip();
+				net_release_message(server, message);
+			}
+			continue;
+		}
+
+		if (n < 0 && net_error() == NET_WOULDBLOCK) { c->write_blocked = true; return; } // picked up again on the next writable edge
+		net_close(server, id);
+	}
+}
+
+// a closed connection's unsent messages. I/O thread, or the game thread once the I/O thread is gone
+void net_drop_sends(Server* server, uint id)
+{
+	Server_Connection* c = &server->clients[id];
+	NetMessage* message;
+	while (c->send.pop(&message)) net_release_message(server, message);
+	c->send_offset = 0;
+}
+
+// the game thread has to be done with a slot before it gets reused
+void net_open_slot(Server* server, SOCKET s, uint io_state)
+{
+	if (!server->num_free_slots)
+	{
+		closesocket(s); // edge-triggered accept has to take it anyway
+		server->stats.syscalls++;
+		return;
+	}
+
+	uint id = server->free_slots[--server->num_free_slots];
+	Server_Connection* c = &server->clients[id];
+
+	// the queues are idle now, nobody else is looking at them
+	c->recv.read = c->recv.write = 0;
+	c->send.read = c->send.write = 0;
+	c->send_offset   = 0;
+	c->bytes_queued  = c->bytes_flushed = 0;
+	c->data_signaled = c->flush_pending = c->recv_stalled = 0;
+	c->write_blocked = false;
+	c->hung_up       = false;
+	c->socket   = s;
+	c->io_state = io_state;
+
+	net_set_nodelay(s);
+	net_poll_add(server, s, id + 2);
+
+	if (io_state == NET_OPEN) net_push_event(server, NET_CONNECT, id);
+}
+
+void net_accept(Server* server)
+{
+	while (1)
+	{
+#ifdef _WIN32
+		SOCKET s = accept(server->listen_socket, NULL, NULL);
+		if (s != INVALID_SOCKET) net_set_nonblocking(s);
+#else
+		SOCKET s = accept4(server->listen_socket, NULL, NULL, SOCK_NONBLOCK);
+#endif
+		server->stats.syscalls++;
+		if (s == INVALID_SOCKET) return;
+
+		server->stats.accepted++;
+		net_open_slot(server, s, NET_OPEN);
+	}
+}
+
+void net_connection_ready(Server* server, uint id, NetReady ready)
+{
+	Server_Connection* c = &server->clients[id];
+
+	if (c->io_state == NET_CONNECTING)
+	{
+		if (!ready.writable && !ready.closed) return;
+
+		int err = 0;
+		socklen_t size = sizeof(err);
+		getsockopt(c->socket, SOL_SOCKET, SO_ERROR, (char*)&err, &size);
+		server->stats.syscalls++;
+
+		c->io_state = NET_OPEN;
+		net_push_event(server, NET_CONNECT, id);
+		if (err) { net_close(server, id); return; } // connect, then disconnect : the game thread always sees both
+	}
+
+	if (c->io_state != NET_OPEN) return;
+
+	if (ready.hung_up) c->hung_up = true; // kept, a full ring picks the read up again later from NET_CMD_READ
+	if (ready.readable || ready.closed) net_read(server, id);
+	if (ready.writable && c->io_state == NET_OPEN && c->send.count()) net_flush(server, id);
+}
+
+void net_process_commands(Server* server)
+{
+	NetCommand command;
+	while (server->commands.pop(&command))
+	{
+		uint id = command.connection;
+		switch (command.type)
+		{
+		case NET_CMD_FLUSH: if (!server->clients[id].write_blocked) net_flush(server, id); break;
+		case NET_CMD_READ : net_read(server, id); break;
+		case NET_CMD_CLOSE: net_close(server, id); break;
+		case NET_CMD_ADOPT: net_open_slot(server, command.socket, NET_CONNECTING); break;
+		case NET_CMD_RELEASE:
+			net_drop_sends(server, id); // nothing can be queued on it after this
+			server->clients[id].io_state = NET_FREE;
+			server->free_slots[server->num_free_slots++] = id;
+			break;
+		}
+	}
+}
+
+NET_THREAD net_io_thread(void* param)
+{
+	Server* server = (Server*)param;
+	NetReady ready[NET_MAX_READY];
+
+	while (server->running)
+	{
+		net_process_commands(server);
+
+		// the game thread only bothers with the wakeup when this is set, so check once more after setting it
+		net_exchange(&server->io_sleeping, 1);
+		if (!server->commands.empty()) { net_exchange(&server->io_sleeping, 0); continue; }
+
+		uint num_ready = net_poll_wait(server, ready, NET_MAX_READY, NET_POLL_TIMEOUT);
+		net_exchange(&server->io_sleeping, 0);
+		server->stats.wakeups++;
+
+		for (uint i = 0; i < num_ready; i++)
+		{
+			uint64 key = ready[i].key;
+			if (key == NET_KEY_LISTEN) net_accept(server);
+			else if (key == NET_KEY_WAKEUP)
+			{
+#ifndef _WIN32
+				uint64 count = 0;
+				read(server->wakeup, &count, sizeof(count));
+#endif
+			}
+			else net_connection_ready(server, (uint)(key - 2), ready[i]);
+		}
+	}
+
+	return 0;
+}
+
+// -------------------- game side ------------------ //
+
+void net_command(Server* server, NetCommand command)
+{
+	if (!server->commands.push(command)) { NETWORK_ERROR("command queue is full!"); return; }
+
+	net_fence();
+	if (net_exchange(&server->io_sleeping, 0)) net_poll_wake(server);
+}
+
+// port "0" picks a free one, see server->port. ip = NULL listens on every interface,
+// port = NULL doesn't listen at all (a host for outgoing connections only)
+int server_init(Server* server, const char* ip, const char* port, int max_clients = 1)
+{
+	*server = {};
+	server->listen_socket = INVALID_SOCKET;
+
+	if (net_startup() != 0) return -1;
+
+	if (port)
+	{
+		addrinfo* result = NULL;
+		addrinfo hints = {};
+		hints.ai_family   = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+		hints.ai_flags    = AI_PASSIVE;
+
+		// Resoooolve server address and port
+		int err = 0;
+		if ((err = getaddrinfo(ip, port, &hints, &result)) != 0)
+		{
+			NETWORK_ERROR("getaddrinfo failed | Error code: " << err);
+			net_cleanup();
+			return -1;
+		}
+
+		// create SOCKET to listen for connections
+		SOCKET listen_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+		if (listen_socket == INVALID_SOCKET)
+		{
+			NETWORK_ERROR("socket creation failed | Error code: " << net_error());
+			freeaddrinfo(result);
+			net_cleanup();
+			return -1;
+		}
+
+		int reuse = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+		// set up TCP listening socket
+		if (bind(listen_socket, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR)
+		{
+			NETWORK_ERROR("bind() failed | Error code : " << net_error());
+			freeaddrinfo(result);
+			closesocket(listen_socket);
+			net_cleanup();
+			return -1;
+		}
+
+		freeaddrinfo(result);
+
+		if (listen(listen_socket, max_clients) == SOCKET_ERROR)
+		{
+			NETWORK_ERROR("listen() failed | Error code: " << net_error());
+			closesocket(listen_socket);
+			net_cleanup();
+			return -1;
+		}
+
+		sockaddr_in bound = {};
+		socklen_t bound_size = sizeof(bound);
+		getsockname(listen_socket, (sockaddr*)&bound, &bound_size);
+
+		net_set_nonblocking(listen_socket);
+		server->listen_socket = listen_socket;
+		server->port = ntohs(bound.sin_port);
+	}
+
+	server->max_clients = max_clients;
+	server->clients     = Alloc(Server_Connection, max_clients);
+	server->free_slots  = Alloc(uint, max_clients);
+	for (int i = 0; i < max_clients; i++)
+	{
+		ring_init(&server->clients[i].recv, NET_RING_SIZE);
+		server->clients[i].send.init(NET_SEND_QUEUE);
+		server->clients[i].socket = INVALID_SOCKET;
+		server->free_slots[i] = max_clients - 1 - i; // hands out slot 0 first
+	}
+	server->num_free_slots = max_clients;
+
+	// room for everything every slot could have outstanding at once
+	server->events.init(max_clients * 4);
+	server->commands.init(max_clients * 8);
+	server->released.init(max_clients * NET_SEND_QUEUE); // a live message is always in some send queue
+	server->max_queued_bytes = NET_MAX_QUEUED;
+
+	net_poll_init(server);
+	if (server->listen_socket != INVALID_SOCKET) net_poll_add(server, server->listen_socket, NET_KEY_LISTEN);
+
+	server->running   = 1;
+	server->io_thread = net_thread_start(net_io_thread, server);
+
+	return 0;
+}
 
-struct Server_Connection
+void server_shutdown(Server* server)
 {
-	uint status;
-	SOCKET socket;
-};
+	net_exchange(&server->running, 0);
+	net_poll_wake(server);
+	net_thread_join(server->io_thread);
 
-struct Server
-{
-	uint num_active_clients, max_clients;
-	Server_Connection clients[MAX_CLIENTS];
+	for (uint i = 0; i < server->max_clients; i++)
+	{
+		if (server->clients[i].socket != INVALID_SOCKET) closesocket(server->clients[i].socket);
+		net_drop_sends(server, i);
+		free(server->clients[i].recv.data);
+		free(server->clients[i].framer.buffer);
+		server->clients[i].send.release();
+	}
 
-	SOCKET listen_socket;
-};
+	net_collect_messages(server);
+	for (uint i = 0; i < NET_MESSAGE_CLASSES; i++)
+	{
+		for (NetMessage* message = server->free_messages[i], *next = NULL; message; message = next)
+		{
+			next = message->next;
+			free(message);
+		}
+	}
+	if (server->listen_socket != INVALID_SOCKET) closesocket(server->listen_socket);
 
-int server_init(Server* server, const char* ip, const char* port, int max_clients = 1)
+#ifdef _WIN32
+	free(server->pollfds);
+	free(server->poll_keys);
+#else
+	close(server->epoll);
+	close(server->wakeup);
+#endif
+
+	server->events.release();
+	server->commands.release();
+	server->released.release();
+	free(server->clients);
+	free(server->free_slots);
+	*server = {};
+	net_cleanup();
+}
+
+// next connect / disconnect / data event. a disconnected slot stays readable until the next call
+bool server_poll(Server* server, NetEvent* event)
 {
-	WSADATA wsa_data;
-	addrinfo* result = NULL;
+	net_collect_messages(server);
 
-	// init winsock
-	int err = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-	if (err != 0)
+	if (server->pending_release)
 	{
-		NETWORK_ERROR("WSAStartup failed | Error code: " << err);
-		return -1;
+		net_command(server, { NET_CMD_RELEASE, server->pending_release - 1 });
+		server->pending_release = 0;
+	}
+
+	if (!server->events.pop(event)) return false;
+
+	Server_Connection* c = &server->clients[event->connection];
+	switch (event->type)
+	{
+	case NET_CONNECT:
+		c->status = STATUS_CONNECTED;
+		c->framer.gathered = c->framer.held = 0; // whatever the last one left behind
+		server->num_active_clients += 1;
+		break;
+	case NET_DATA:
+		net_exchange(&c->data_signaled, 0); // before reading, so new data raises a new event
+		break;
+	case NET_DISCONNECT:
+		c->status = STATUS_DISCONNECTED;
+		server->num_active_clients -= 1;
+		server->pending_release = event->connection + 1;
+		break;
 	}
 
+	return true;
+}
+
+// handles new connections & disconnected clients, for callers that just check every slot for data
+int server_update_connections(Server* server)
+{
+	NetEvent event;
+	while (server_poll(server, &event));
+
+	return server->num_active_clients;
+}
+
+// outgoing connection through the same I/O thread, shows up as NET_CONNECT (then NET_DISCONNECT if it failed)
+int server_connect(Server* server, const char* ip, const char* port)
+{
+	addrinfo* result = NULL;
 	addrinfo hints = {};
 	hints.ai_family   = AF_INET;
 	hints.ai_socktype = SOCK_STREAM;
 	hints.ai_protocol = IPPROTO_TCP;
-	hints.ai_flags    = AI_PASSIVE;
 
-	// Resoooolve server address and port
-	if ((err = getaddrinfo(NULL, port, &hints, &result)) != 0)
+	int err = 0;
+	if ((err = getaddrinfo(ip, port, &hints, &result)) != 0)
 	{
-		NETWORK_ERROR("getaddrinfo failed | Error code: " << WSAGetLastError());
-		WSACleanup();
+		NETWORK_ERROR("getaddrinfo failed | Error code: " << err);
 		return -1;
 	}
 
-	// create SOCKET to listen for connections
-	SOCKET listen_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-	if (listen_socket == INVALID_SOCKET)
+	SOCKET s = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (s == INVALID_SOCKET)
 	{
-		NETWORK_ERROR("socket creation failed | Error code: " << WSAGetLastError());
+		NETWORK_ERROR("socket creation failed | Error code: " << net_error());
 		freeaddrinfo(result);
-		WSACleanup();
 		return -1;
 	}
 
-	// set up TCP listening socket
-	err = bind(listen_socket, result->ai_addr, (int)result->ai_addrlen);
-	if (err == SOCKET_ERROR)
+	net_set_nonblocking(s);
+	if (connect(s, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR && net_error() != NET_INPROGRESS)
 	{
-		NETWORK_ERROR("bind() failed | Error code : " << WSAGetLastError());
+		NETWORK_ERROR("could not connect to " << ip);
+		closesocket(s);
 		freeaddrinfo(result);
-		closesocket(listen_socket);
-		WSACleanup();
 		return -1;
 	}
 
 	freeaddrinfo(result);
+	net_command(server, { NET_CMD_ADOPT, 0, s });
+	return 0;
+}
 
-	err = listen(listen_socket, max_clients);
-	if (err == SOCKET_ERROR)
+// keeps the I/O thread on one core, for a dedicated server that pins everything
+void server_pin_io_thread(Server* server, uint core) { net_thread_pin(server->io_thread, core); }
+
+void server_disconnect(Server* server, uint client_id)
+{
+	if (server->clients[client_id].status == STATUS_CONNECTED) net_command(server, { NET_CMD_CLOSE, client_id });
+}
+
+// the I/O thread stopped reading because the ring was full. it gets going again once half the ring is free,
+// or once the game thread has read all it can : restarting it for every few bytes would cost a readv each
+void net_recv_consumed(Server* server, uint id, bool drained)
+{
+	Server_Connection* c = &server->clients[id];
+	if (!c->recv_stalled) return;
+	if (!drained && ring_readable(&c->recv) > c->recv.size / 2) return;
+	if (net_exchange(&c->recv_stalled, 0)) net_command(server, { NET_CMD_READ, id });
+}
+
+//receive raw bytes from server.clients[id], returns the bytes read (0 = nothing yet). don't mix with server_next_frame
+int server_recieve(Server* server, byte* memory, uint max_size = 256, uint id = 0)
+{
+	uint size = ring_read(&server->clients[id].recv, memory, max_size);
+	net_recv_consumed(server, id, size < max_size);
+	return size;
+}
+
+// next whole frame from server.clients[id], false when there isn't one yet.
+// frame->data points into the receive ring (no copy) & stays valid until the next call for the same client
+bool server_next_frame(Server* server, uint id, NetFrame* frame)
+{
+	Server_Connection* c = &server->clients[id];
+	bool complete = net_next_frame(&c->framer, &c->recv, frame);
+	net_recv_consumed(server, id, !complete);
+	return complete;
+}
+
+// a buffer to serialize into, hand it to server_send_message or server_broadcast
+NetMessage* server_message(Server* server, uint size)
+{
+	uint size_class = 0;
+	while (size_class < NET_MESSAGE_CLASSES && size > (64u << (2 * size_class))) size_class++;
+
+	NetMessage* message = (size_class < NET_MESSAGE_CLASSES) ? server->free_messages[size_class] : NULL;
+	if (!message)
 	{
-		NETWORK_ERROR("listen() failed | Error code: " << WSAGetLastError());
-		closesocket(listen_socket);
-		WSACleanup();
-		return -1;
+		net_collect_messages(server);
+		message = (size_class < NET_MESSAGE_CLASSES) ? server->free_messages[size_class] : NULL;
 	}
 
-	// FIONBIO sets blocking mode for a socket, mode = 0 for blocking, mode != 0 for non-blocking
-	u_long blocking_mode = 1; // non-blocking
-	Sleep(1);
-	err = ioctlsocket(listen_socket, FIONBIO, &blocking_mode);
+	if (message) server->free_messages[size_class] = message->next;
+	else
+	{
+		uint capacity = (size_class < NET_MESSAGE_CLASSES) ? (64u << (2 * size_class)) : size;
+		message = (NetMessage*)malloc(sizeof(NetMessage) + capacity);
+		message->capacity   = capacity;
+		message->size_class = size_class;
+		message->data       = (byte*)(message + 1);
+	}
 
-	*server = {};
-	server->max_clients = max_clients;
-	server->listen_socket = listen_socket;
+	message->references = 1; // the caller's, until it's sent
+	message->size       = size;
+	message->next       = NULL;
+	return message;
+}
 
-	return 0;
+// a message holding one frame (size <= NET_MAX_FRAME), write the payload at message->data + NET_FRAME_HEADER
+NetMessage* server_frame(Server* server, uint type, uint size)
+{
+	NetMessage* message = server_message(server, NET_FRAME_HEADER + size);
+	net_write_frame_header(message->data, type, size);
+	return message;
 }
 
-// handles new connections & disconnected clients
-int server_update_connections(Server* server)
+// queues without copying, false when the client has too much queued already
+bool net_queue_message(Server* server, NetMessage* message, uint client_id)
+{
+	Server_Connection* c = &server->clients[client_id];
+	if (c->status != STATUS_CONNECTED) return false;
+
+	uint64 queued = c->bytes_queued - net_load_acquire(&c->bytes_flushed);
+	if (queued + message->size > server->max_queued_bytes || c->send.full()) { server->stats.dropped_sends++; return false; }
+
+	net_increment(&message->references);
+	c->send.push(message);
+	c->bytes_queued += message->size;
+
+	if (!net_exchange(&c->flush_pending, 1)) net_command(server, { NET_CMD_FLUSH, client_id });
+	return true;
+}
+
+// how full a client's send queue is, [0, 1] by bytes or messages. for games that want to back off before anything gets dropped
+float server_send_load(Server* server, uint client_id)
+{
+	Server_Connection* c = &server->clients[client_id];
+	float bytes    = (c->bytes_queued - net_load_acquire(&c->bytes_flushed)) / (float)server->max_queued_bytes;
+	float messages = (c->send.write - net_load_acquire(&c->send.read)) / (float)c->send.size;
+	return glm::max(bytes, messages);
+}
+
+// these take over the message, don't touch it afterwards
+int server_send_message(Server* server, NetMessage* message, uint client_id)
 {
-	SOCKET test_socket = INVALID_SOCKET;
+	int size = net_queue_message(server, message, client_id) ? message->size : 0;
+	net_return_message(server, message);
+	return size;
+}
 
-	for (uint i = 0; i < server->max_clients; ++i)
+// serialized once, queued on every client, returns how many it went to
+int server_broadcast(Server* server, NetMessage* message)
+{
+	int count = 0;
+	for (uint i = 0; i < server->max_clients; i++)
 	{
-		if (server->clients[i].status != NULL)
-		{
-			if (recv(server->clients[i].socket, NULL, 0, 0) == SOCKET_ERROR && WSAGetLastError() == WSAECONNRESET)
-			{
-				//print("-- client %d disconnected --\n", i);
-				server->clients[i] = {};
-				server->num_active_clients -= 1;
-			} continue;
-		}
+		if (server->clients[i].status == STATUS_CONNECTED) count += net_queue_message(server, message, i);
+	}
 
-		if ((test_socket = accept(server->listen_socket, NULL, NULL)) != INVALID_SOCKET)
-		{
-			u_long mode = 1; // set socket to non-blocking mode
-			ioctlsocket(test_socket, FIONBIO, &mode);
+	net_return_message(server, message);
+	return count;
+}
 
-			server->clients[i].status = STATUS_CONNECTED;
-			server->clients[i].socket = test_socket;
-			server->num_active_clients += 1;
+//send msg to server.clients[id], all or nothing. returns 0 when the client has too much queued
+int server_send(Server* server, byte* msg, uint msg_size, uint client_id = 0)
+{
+	if (server->clients[client_id].status != STATUS_CONNECTED) return -1;
 
-			//print("-- new connection established!--\n");
-		}
+	NetMessage* message = server_message(server, msg_size);
+	memcpy(message->data, msg, msg_size);
+	return server_send_message(server, message, client_id);
+}
+
+//send msg to all clients, returns how many it went to
+int server_send_to_all(Server* server, byte* msg, uint msg_size)
+{
+	NetMessage* message = server_message(server, msg_size);
+	memcpy(message->data, msg, msg_size);
+	return server_broadcast(server, message);
+}
+
+// ------------------- serializer ------------------ //
+
+/* a message type lists its fields once, the compiler works out the rest :
+
+	struct PlayerInput
+	{
+		uint tick;
+		vec2 move;
+		uint16 buttons;
+
+		using schema = NetSchema<7, &PlayerInput::tick, &PlayerInput::move, &PlayerInput::buttons>; // 7 = the frame type
+	};
+
+   on the wire the fields are packed back to back in that order (no padding), little endian like the machines this runs on.
+   every offset & the size are constants, so writing & reading come down to a few moves straight to & from the frame.
+   net_read copies into a struct on the stack, NetView reads single fields right out of the receive ring.
+   a frame can be longer than the schema, so a newer sender can append fields without breaking older readers */
+
+template<typename M> struct net_member;
+template<typename C, typename F> struct net_member<F C::*> { typedef C owner; typedef F field; };
+
+template<auto A, auto B> constexpr bool net_same_member()
+{
+	if constexpr (std::is_same<decltype(A), decltype(B)>::value) return A == B;
+	else return false;
+}
+
+template<uint Type, auto... Members>
+struct NetSchema
+{
+	static_assert(sizeof...(Members) > 0, "a schema needs fields");
+	static_assert((std::is_trivially_copyable<typename net_member<decltype(Members)>::field>::value && ...), "fields get copied byte for byte");
+
+	static constexpr uint type = Type;
+	static constexpr uint size = (sizeof(typename net_member<decltype(Members)>::field) + ...); // payload bytes
+
+	template<auto Member> static constexpr uint offset_of()
+	{
+		uint offset = 0, found = size;
+		((found = (found == size && net_same_member<Member, Members>()) ? offset : found,
+			offset += sizeof(typename net_member<decltype(Members)>::field)), ...);
+		return found;
 	}
 
-	return server->num_active_clients;
+	template<typename T> static void write(const T& message, byte* out)
+	{
+		((memcpy(out, &(message.*Members), sizeof(message.*Members)), out += sizeof(message.*Members)), ...);
+	}
+
+	template<typename T> static void read(T* message, const byte* in)
+	{
+		((memcpy(&(message->*Members), in, sizeof(message->*Members)), in += sizeof(message->*Members)), ...);
+	}
+};
+
+// fields straight out of a frame, nothing's decoded until it's asked for
+template<typename T>
+struct NetView
+{
+	const byte* data;
+
+	template<auto Member> typename net_member<decltype(Member)>::field get() const
+	{
+		constexpr uint offset = T::schema::template offset_of<Member>();
+		static_assert(offset < T::schema::size, "not in the schema");
+
+		typename net_member<decltype(Member)>::field value;
+		memcpy(&value, data + offset, sizeof(value));
+		return value;
+	}
+};
+
+// header & fields, out needs NET_FRAME_HEADER + T::schema::size bytes. returns the bytes written
+template<typename T> uint net_write_frame(byte* out, const T& message)
+{
+	static_assert(T::schema::size <= NET_MAX_FRAME, "too big for one frame");
+	net_write_frame_header(out, T::schema::type, T::schema::size);
+	T::schema::write(message, out + NET_FRAME_HEADER);
+	return NET_FRAME_HEADER + T::schema::size;
+}
+
+// false when the frame isn't a T
+template<typename T> bool net_read(const NetFrame& frame, T* message)
+{
+	if (frame.type != T::schema::type || frame.size < T::schema::size) return false;
+	T::schema::read(message, frame.data);
+	return true;
 }
 
-//receive msg from server.clients[id]
-int server_recieve(Server server, byte* memory, uint max_size = 256, uint id = 0)
+template<typename T> bool net_view(const NetFrame& frame, NetView<T>* view)
 {
-	return recv(server.clients[id].socket, (char*)memory, max_size, 0);
+	if (frame.type != T::schema::type || frame.size < T::schema::size) return false;
+	view->data = frame.data;
+	return true;
 }
 
-//send msg to server.clients[id]
-int server_send(Server server, byte* msg, uint msg_size, uint client_id = 0)
+template<typename T> int server_send_frame(Server* server, const T& message, uint client_id = 0)
 {
-	return send(server.clients[client_id].socket, (char*)msg, msg_size, 0);
+	if (server->clients[client_id].status != STATUS_CONNECTED) return -1;
+
+	NetMessage* frame = server_message(server, NET_FRAME_HEADER + T::schema::size);
+	net_write_frame(frame->data, message);
+	return server_send_message(server, frame, client_id);
 }
 
-//send msg to all clients
-int server_send_to_all(Server server, byte* msg, uint msg_size)
+// serialized once for everybody
+template<typename T> int server_broadcast_frame(Server* server, const T& message)
 {
-	//TODO : IMPLEMENT
-	return send(server.clients[0].socket, (char*)msg, msg_size, 0);
+	NetMessage* frame = server_message(server, NET_FRAME_HEADER + T::schema::size);
+	net_write_frame(frame->data, message);
+	return server_broadcast(server, frame);
 }
 
+// ---------------- blocking client ---------------- //
+
 struct Client
 {
 	SOCKET socket;
+	NetRing recv; // framing, see client_next_frame
+	NetFramer framer;
 };
 
 // connects to a server at ip
@@ -155,14 +1558,7 @@ int client_init(Client* client, const char* ip, const char* port)
 
 	print("Connecting to %s - ", ip);
 
-	// Initialize Winsock
-	WSADATA wsa_data = {};
-	err = WSAStartup(MAKEWORD(2, 2), &wsa_data);
-	if (err != 0)
-	{
-		NETWORK_ERROR("WSAStartup failed | Error code: " << err);
-		return -1;
-	}
+	if (net_startup() != 0) return -1;
 
 	addrinfo hints = {};
 	hints.ai_family = AF_INET;
@@ -173,17 +1569,17 @@ int client_init(Client* client, const char* ip, const char* port)
 	// Resoooolve server address and port
 	if ((err = getaddrinfo(ip, port, &hints, &result)) != 0)
 	{
-		NETWORK_ERROR("getaddrinfo failed | Error code: " << WSAGetLastError());
-		WSACleanup();
+		NETWORK_ERROR("getaddrinfo failed | Error code: " << err);
+		net_cleanup();
 		return -1;
 	}
 
 	SOCKET connect_socket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
 	if (connect_socket == INVALID_SOCKET)
 	{
-		NETWORK_ERROR("socket creation failed | Error code: " << WSAGetLastError());
+		NETWORK_ERROR("socket creation failed | Error code: " << net_error());
 		freeaddrinfo(result);
-		WSACleanup();
+		net_cleanup();
 		return -1;
 	}
 
@@ -199,14 +1595,24 @@ int client_init(Client* client, const char* ip, const char* port)
 
 	freeaddrinfo(result);
 
-	u_long mode = 1;
-	ioctlsocket(connect_socket, FIONBIO, &mode);
+	net_set_nonblocking(connect_socket);
+	net_set_nodelay(connect_socket);
 
 	*client = {};
 	client->socket = connect_socket;
+	ring_init(&client->recv, NET_RING_SIZE);
 
 	return 0;
 }
+void client_shutdown(Client* client)
+{
+	closesocket(client->socket);
+	free(client->recv.data);
+	free(client->framer.buffer);
+	*client = {};
+	net_cleanup();
+}
+// raw bytes, don't mix with client_next_frame
 int client_receive(Client client, byte* memory, uint max_size = 256)
 {
 	return recv(client.socket, (char*)memory, max_size, 0);
@@ -215,6 +1621,53 @@ int client_send(Client client, byte* msg, uint size)
 {
 	return send(client.socket, (char*)msg, size, 0);
 }
+// next whole frame, false when there isn't one yet. reads whatever the socket has first
+bool client_next_frame(Client* client, NetFrame* frame)
+{
+	if (net_next_frame(&client->framer, &client->recv, frame)) return true;
+
+	NetSpan spans[2];
+	uint count = ring_write_spans(&client->recv, spans);
+	if (!count) return false;
+
+	int n = net_readv(client->socket, spans, count);
+	if (n <= 0) return false;
+
+	ring_commit_write(&client->recv, n);
+	return net_next_frame(&client->framer, &client->recv, frame);
+}
+// header & payload, all of it even if the socket only takes part at a time. returns the bytes sent or SOCKET_ERROR
+int client_send_frame(Client* client, uint type, const byte* payload, uint size)
+{
+	byte header[NET_FRAME_HEADER];
+	net_write_frame_header(header, type, size);
+
+	NetSpan spans[2] = { { header, NET_FRAME_HEADER }, { (byte*)payload, size } };
+	uint total = NET_FRAME_HEADER + size, sent = 0;
+	while (sent < total)
+	{
+		uint skip = sent, first = 0;
+		while (skip >= spans[first].size) skip -= spans[first++].size;
+
+		NetSpan rest[2] = { { spans[first].data + skip, spans[first].size - skip }, spans[1] };
+		int n = net_writev(client->socket, rest, 2 - first);
+		if (n == SOCKET_ERROR)
+		{
+			if (net_error() != NET_WOULDBLOCK) return SOCKET_ERROR;
+			Sleep(1);
+			continue;
+		}
+		sent += n;
+	}
+
+	return sent;
+}
+template<typename T> int client_send_frame(Client* client, const T& message)
+{
+	byte payload[T::schema::size];
+	T::schema::write(message, payload);
+	return client_send_frame(client, T::schema::type, payload, T::schema::size);
+}
 
 int client_demo(const char* ip, const char* port)
 {
@@ -225,39 +1678,40 @@ int client_demo(const char* ip, const char* port)
 	{
 		char outgoing[64] = { "howdy there, server" };
 
-		std::cout << client_send(client, (byte*)outgoing, sizeof(outgoing));
+		std::cout << client_send_frame(&client, 1, (byte*)outgoing, strlen(outgoing) + 1);
 		Sleep(300);
-		
-		byte re[512] = {};
-		client_receive(client, re, 511);
-		print((char*)re);
+
+		NetFrame frame = {};
+		while (client_next_frame(&client, &frame)) print("%.*s\n", frame.size, (char*)frame.data);
 	}
 
 	return 0;
 }
 int server_demo(const char* ip, const char* port)
 {
-	Server server = {};
-	server_init(&server, ip, port, 4);
+	Server* server = Alloc(Server, 1);
+	server_init(server, ip, port, 4);
 
-	while (!server_update_connections(&server)) Sleep(100);
+	while (!server_update_connections(server)) Sleep(100);
 
 	while (1)
 	{
-		server_update_connections(&server);
+		server_update_connections(server);
 
-		for (int i = 0; i < server.max_clients; ++i)
+		for (int i = 0; i < server->max_clients; ++i)
 		{
-			if (server.clients[i].status != NULL)
+			if (server->clients[i].status == STATUS_CONNECTED)
 			{
-				byte incoming[512] = {};
-				char outgoing[64] = "what's up, client";
+				const char outgoing[64] = "what's up, client";
 
-				if (server_recieve(server, incoming, 511, i) > 0)
+				// one frame per message however the bytes arrived
+				NetFrame frame = {};
+				while (server_next_frame(server, i, &frame))
 				{
-					print(" CLIENT %d: %s\n", i, incoming);
-					Sleep(100);
-					server_send(server, (byte*)outgoing, strlen(outgoing), i);
+					print(" CLIENT %d: %.*s\n", i, frame.size, (char*)frame.data);
+					NetMessage* reply = server_frame(server, 1, strlen(outgoing));
+					memcpy(reply->data + NET_FRAME_HEADER, outgoing, strlen(outgoing));
+					server_send_message(server, reply, i);
 					print("response sent\n");
 				}
 			}
@@ -269,3 +1723,299 @@ int server_demo(const char* ip, const char* port)
 	return 0;
 }
 
+// 1000 loopback connections through two hosts, each on its own I/O thread.
+// every round each client sends a message & the server echoes it back
+void network_load_test(uint num_clients = 1000, uint num_rounds = 100, uint message_size = 64)
+{
+	Server* server = Alloc(Server, 1);
+	Server* clients = Alloc(Server, 1);
+	if (server_init(server, "127.0.0.1", "0", num_clients) != 0) return;
+	server_init(clients, NULL, NULL, num_clients);
+
+	char port[8] = {};
+	snprintf(port, 8, "%u", server->port);
+
+	Timer timer = {};
+	timer.init();
+	timer.start();
+
+	for (uint i = 0; i < num_clients; i++) server_connect(clients, "127.0.0.1", port);
+
+	// both sides have to see every connection
+	while (server->num_active_clients < num_clients || clients->num_active_clients < num_clients)
+	{
+		server_update_connections(server);
+		server_update_connections(clients);
+	}
+	int64 connect_time = timer.microseconds_elapsed();
+
+	byte* message = Alloc(byte, message_size);
+	byte buffer[NET_RING_SIZE];
+	uint* echoed = Alloc(uint, num_clients); // bytes back at each client this round
+	uint64 server_syscalls = server->stats.syscalls, server_wakeups = server->stats.wakeups;
+
+	timer.start();
+	for (uint round = 0; round < num_rounds; round++)
+	{
+		memset(message, round, message_size);
+		memset(echoed, 0, num_clients * sizeof(uint));
+		for (uint i = 0; i < num_clients; i++) server_send(clients, message, message_size, i);
+
+		uint done = 0;
+		while (done < num_clients)
+		{
+			// only the connections with something to read show up, no scanning every slot
+			NetEvent event;
+			while (server_poll(server, &event))
+			{
+				if (event.type != NET_DATA) continue;
+				int size = 0;
+				while ((size = server_recieve(server, buffer, sizeof(buffer), event.connection)) > 0) server_send(server, buffer, size, event.connection);
+			}
+
+			while (server_poll(clients, &event))
+			{
+				if (event.type != NET_DATA) continue;
+				int size = 0;
+				while ((size = server_recieve(clients, buffer, sizeof(buffer), event.connection)) > 0)
+				{
+					if (buffer[0] != (byte)round) print("wrong round at client %u!\n", event.connection);
+					echoed[event.connection] += size;
+					if (echoed[event.connection] == message_size) done++;
+				}
+			}
+		}
+	}
+	int64 echo_time = timer.microseconds_elapsed();
+
+	uint64 messages = (uint64)num_clients * num_rounds;
+	print(" %u clients connected in %.1f ms\n", num_clients, connect_time / 1000.f);
+	print(" %u rounds : %.2f ms per round, %.0f echoes per second\n", num_rounds, echo_time / 1000.f / num_rounds, messages / (echo_time / 1000000.0));
+	print(" server : %.2f syscalls & %.2f wakeups per message, %llu bytes in, %llu bytes out\n",
+		(server->stats.syscalls - server_syscalls) / (double)messages, (server->stats.wakeups - server_wakeups) / (double)messages,
+		server->stats.bytes_received, server->stats.bytes_sent);
+
+	// everybody leaves, the server has to notice every one of them
+	timer.start();
+	for (uint i = 0; i < num_clients; i++) server_disconnect(clients, i);
+	while (server->num_active_clients) server_update_connections(server);
+	print(" %u disconnects noticed in %.1f ms\n", num_clients, timer.microseconds_elapsed() / 1000.f);
+
+	server_shutdown(clients);
+	server_shutdown(server);
+	free(clients);
+	free(server);
+	free(message);
+	free(echoed);
+}
+
+// one server broadcasting small messages to 32, 256 & 1024 loopback clients as fast as they can take them
+void network_broadcast_benchmark(uint message_size = 64, uint milliseconds = 1000)
+{
+	const uint client_counts[] = { 32, 256, 1024 };
+
+	for (uint num_clients : client_counts)
+	{
+		Server* server = Alloc(Server, 1);
+		Server* clients = Alloc(Server, 1);
+		if (server_init(server, "127.0.0.1", "0", num_clients) != 0) return;
+		server_init(clients, NULL, NULL, num_clients);
+
+		char port[8] = {};
+		snprintf(port, 8, "%u", server->port);
+		for (uint i = 0; i < num_clients; i++) server_connect(clients, "127.0.0.1", port);
+		while (server->num_active_clients < num_clients || clients->num_active_clients < num_clients)
+		{
+			server_update_connections(server);
+			server_update_connections(clients);
+		}
+
+		byte buffer[NET_RING_SIZE];
+		uint64 queued = 0, received = 0;
+
+		Timer timer = {};
+		timer.init();
+		timer.start();
+
+		// keep every client's queue topped up, read whatever's arrived
+		uint64 broadcasts = 0;
+		while (timer.microseconds_elapsed() < milliseconds * 1000)
+		{
+			float load = 0;
+			for (uint i = 0; i < server->max_clients; i++) load = glm::max(load, server_send_load(server, i));
+
+			for (uint i = 0; i < 16 && load < .5f; i++)
+			{
+				NetMessage* message = server_message(server, message_size);
+				memset(message->data, (byte)broadcasts++, message_size);
+				queued += server_broadcast(server, message);
+			}
+
+			NetEvent event;
+			while (server_poll(clients, &event))
+			{
+				if (event.type != NET_DATA) continue;
+				int size = 0;
+				while ((size = server_recieve(clients, buffer, sizeof(buffer), event.connection)) > 0) received += size;
+			}
+		}
+		int64 sending = timer.microseconds_elapsed();
+
+		// & whatever's still in flight
+		while (received < queued * message_size)
+		{
+			NetEvent event;
+			while (server_poll(clients, &event))
+			{
+				if (event.type != NET_DATA) continue;
+				int size = 0;
+				while ((size = server_recieve(clients, buffer, sizeof(buffer), event.connection)) > 0) received += size;
+			}
+			server_poll(server, &event);
+		}
+		int64 total = timer.microseconds_elapsed();
+
+		print(" %4u clients : %9.0f messages/s delivered, %llu broadcasts, %llu sends dropped by backpressure, %.2f syscalls per message, %.1f ms to drain\n",
+			num_clients, (received / message_size) / (total / 1000000.0), broadcasts, server->stats.dropped_sends,
+			server->stats.syscalls / (double)glm::max(queued, 1ull), (total - sending) / 1000.0);
+
+		server_shutdown(clients);
+		server_shutdown(server);
+		free(clients);
+		free(server);
+	}
+}
+
+// what a client might send every tick, 20 bytes of payload
+struct NetInputSample
+{
+	uint tick;
+	vec3 aim;
+	uint16 buttons, flags;
+
+	using schema = NetSchema<1, &NetInputSample::tick, &NetInputSample::aim, &NetInputSample::buttons, &NetInputSample::flags>;
+};
+
+// small messages through the serializer & framing, first on one core without sockets, then over a loopback connection
+void network_frame_benchmark(uint num_messages = 10000000)
+{
+	const uint frame_size = NET_FRAME_HEADER + NetInputSample::schema::size;
+
+	// -- one core : serialize into a ring in odd sized chunks (so frames wrap around), frame & decode them back out --
+	{
+		NetRing ring = {};
+		ring_init(&ring, NET_RING_SIZE);
+		NetFramer framer = {};
+
+		byte chunk[37 * frame_size];
+		uint64 checksum = 0, expected = 0;
+		uint written = 0, decoded = 0, bad = 0;
+
+		Timer timer = {};
+		timer.init();
+		timer.start();
+
+		while (decoded < num_messages)
+		{
+			uint chunk_size = 0;
+			while (written < num_messages && chunk_size + frame_size <= sizeof(chunk) && ring_writable(&ring) >= chunk_size + frame_size)
+			{
+				NetInputSample sample = { written, vec3(written, 1, 2), (uint16)written, 3 };
+				chunk_size += net_write_frame(chunk + chunk_size, sample);
+				expected += written++;
+			}
+			ring_write(&ring, chunk, chunk_size);
+
+			NetFrame frame = {};
+			NetInputSample sample = {};
+			while (net_next_frame(&framer, &ring, &frame))
+			{
+				if (!net_read(frame, &sample) || sample.aim.x != (float)sample.tick) bad++;
+				checksum += sample.tick;
+				decoded++;
+			}
+		}
+		int64 time = timer.microseconds_elapsed();
+
+		print(" one core : %.1f million messages/s serialized, framed & decoded, %u bad, checksum %s\n",
+			num_messages / (double)time, bad, checksum == expected ? "ok" : "WRONG");
+
+		// & field by field, in place
+		uint64 buttons = 0;
+		timer.start();
+		for (uint i = 0; i < num_messages; i += 64)
+		{
+			byte frames[64 * frame_size];
+			for (uint j = 0; j < 64; j++) net_write_frame(frames + j * frame_size, NetInputSample{ i + j, vec3(0), (uint16)(i + j), 0 });
+
+			ring_write(&ring, frames, sizeof(frames));
+			NetFrame frame = {};
+			NetView<NetInputSample> view = {};
+			while (net_next_frame(&framer, &ring, &frame)) if (net_view(frame, &view)) buttons += view.get<&NetInputSample::buttons>();
+		}
+		time = timer.microseconds_elapsed();
+		print(" one core : %.1f million messages/s through NetView (%llu)\n", num_messages / (double)time, buttons);
+
+		free(ring.data);
+		free(framer.buffer);
+	}
+
+	// -- loopback : 256 frames per message, the receiver decodes every one of them --
+	{
+		Server* server = Alloc(Server, 1);
+		Server* client = Alloc(Server, 1);
+		if (server_init(server, "127.0.0.1", "0", 1) != 0) return;
+		server_init(client, NULL, NULL, 1);
+
+		char port[8] = {};
+		snprintf(port, 8, "%u", server->port);
+		server_connect(client, "127.0.0.1", port);
+		while (!server->num_active_clients || !client->num_active_clients)
+		{
+			server_update_connections(server);
+			server_update_connections(client);
+		}
+
+		const uint batch = 256;
+		uint sent = 0, received = 0, bad = 0;
+
+		Timer timer = {};
+		timer.init();
+		timer.start();
+
+		while (received < num_messages)
+		{
+			while (sent < num_messages && server_send_load(client, 0) < .5f)
+			{
+				uint count = glm::min(batch, num_messages - sent);
+				NetMessage* message = server_message(client, count * frame_size);
+				for (uint i = 0; i < count; i++, sent++) net_write_frame(message->data + i * frame_size, NetInputSample{ sent, vec3(sent), 0, 0 });
+				server_send_message(client, message, 0);
+			}
+
+			NetEvent event;
+			while (server_poll(client, &event));
+			while (server_poll(server, &event))
+			{
+				if (event.type != NET_DATA) continue;
+
+				NetFrame frame = {};
+				NetInputSample sample = {};
+				while (server_next_frame(server, event.connection, &frame))
+				{
+					if (!net_read(frame, &sample) || sample.tick != received) bad++;
+					received++;
+				}
+			}
+		}
+		int64 time = timer.microseconds_elapsed();
+
+		print(" loopback : %.1f million messages/s received & decoded, %u out of order, %.3f syscalls per message\n",
+			num_messages / (double)time, bad, (server->stats.syscalls + client->stats.syscalls) / (double)num_messages);
+
+		server_shutdown(client);
+		server_shutdown(server);
+		free(client);
+		free(server);
+	}
+}
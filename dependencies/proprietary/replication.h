@@ -0,0 +1,1472 @@
+/* Replication : game state from the server to every client over UDP
+
+	- the server keeps every entity's state quantized (2mm positions, smallest-three rotations).
+	  each tick every client gets one datagram with the entities that differ from what that client has acknowledged
+	- each entity is delta encoded against its own baseline : the last state of it the client acked.
+	  the baseline's age rides along, the client keeps the last few states of every entity to find it
+	- packets carry sequence, ack & 32 ack bits, so every ack goes out 33 times. nothing gets resent as is :
+	  a lost update just stays different from the baseline & goes out again with whatever's newest.
+	  reliable messages ride along in every packet until the client says it has taken them.
+	  that's their own id, not a packet ack : a packet can arrive while the client has no room for them
+	- every client has a byte budget per second. entities build up priority every tick (closer = faster)
+	  & the highest ones go first until the packet's full
+*/
+
+#define MAX_PACKET_SIZE          1200 // stays under any MTU
+#define PACKET_HEADER_SIZE       28   // IPv4 + UDP, counted against the budget
+#define REPLICATION_HISTORY      32   // sent packets remembered, also the oldest usable baseline (5 bits)
+#define REPLICATION_MAX_ENTITIES 16384
+#define MAX_ENTITIES_PER_PACKET  512
+#define MAX_RELIABLE_MESSAGES    64   // queued per client
+#define MAX_RELIABLE_SIZE        255
+
+#define POSITION_BITS   21
+#define POSITION_EXTENT 2048.f // world is [-2048, 2048) on every axis
+#define POSITION_SCALE  ((1 << POSITION_BITS) / (2 * POSITION_EXTENT)) // 512 steps per meter
+#define ROTATION_BITS   10 // per smallest-three component
+
+#define PRIORITY_RADIUS 32.f // meters, entities this close build priority at half the rate of one on top of you
+#define PRIORITY_UNSEEN .25f // per tick at least, for entities a client has nothing of yet
+
+// --------------------- bit packing --------------- //
+
+struct BitWriter
+{
+	uint32* words;
+	uint num_words;
+	uint64 scratch;
+	uint scratch_bits, word_index, bits_written;
+	bool overflow;
+
+	void init(void* buffer, uint size) { *this = {}; words = (uint32*)buffer; num_words = size / 4; }
+
+	void write(uint32 value, uint bits)
+	{
+		if (bits_written + bits > num_words * 32) { overflow = true; return; }
+
+		scratch |= (uint64)(value & (((uint64)1 << bits) - 1)) << scratch_bits;
+		scratch_bits += bits;
+		bits_written += bits;
+
+		if (scratch_bits >= 32)
+		{
+			words[word_index++] = (uint32)scratch;
+			scratch >>= 32;
+			scratch_bits -= 32;
+		}
+	}
+
+	void flush() { if (scratch_bits) words[word_index] = (uint32)scratch; }
+	uint bytes() { return (bits_written + 7) / 8; }
+};
+
+struct BitReader
+{
+	const uint32* words;
+	uint num_bits;
+	uint64 scratch;
+	uint scratch_bits, word_index, bits_read;
+	bool overflow;
+
+	// the buffer has to be readable up to the next multiple of 4 bytes
+	void init(const void* buffer, uint size) { *this = {}; words = (const uint32*)buffer; num_bits = size * 8; }
+
+	uint32 read(uint bits)
+	{
+		if (bits_read + bits > num_bits) { overflow = true; return 0; }
+
+		if (scratch_bits < bits)
+		{
+			scratch |= (uint64)words[word_index++] << scratch_bits;
+			scratch_bits += 32;
+		}
+
+		uint32 value = (uint32)(scratch & (((uint64)1 << bits) - 1));
+		scratch >>= bits;
+		scratch_bits -= bits;
+		bits_read += bits;
+		return value;
+	}
+};
+
+inline uint32 zigzag(int32 n) { return ((uint32)n << 1) ^ (uint32)(n >> 31); }
+inline int32 unzigzag(uint32 n) { return (int32)(n >> 1) ^ -(int32)(n & 1); }
+
+// small values are cheap : 2 bits pick the smallest of 4 widths that fits
+void write_bucketed(BitWriter* writer, uint32 value, const uint* widths)
+{
+	uint bucket = 0;
+	while (bucket < 3 && value >= (1u << widths[bucket])) bucket++;
+	writer->write(bucket, 2);
+	writer->write(value, widths[bucket]);
+}
+
+uint32 read_bucketed(BitReader* reader, const uint* widths)
+{
+	return reader->read(widths[reader->read(2)]);
+}
+
+const uint GAP_WIDTHS[4]      = { 2, 5, 9, 14 };
+const uint POSITION_WIDTHS[4] = { 4, 8, 13, POSITION_BITS + 1 };
+const uint ROTATION_WIDTHS[4] = { 3, 6, 9, ROTATION_BITS + 1 };
+
+// ---------------------- quantizing --------------- //
+
+struct QuantizedEntity
+{
+	int32  position[3];
+	uint32 rotation; // 2 bits largest component, 3 x 10 bits the others
+	uint16 state;    // animation, flags, whatever the game wants
+	uint16 active;
+};
+
+uint32 quantize_rotation(quat q)
+{
+	float c[4] = { q.x, q.y, q.z, q.w };
+	uint largest = 0;
+	for (uint i = 1; i < 4; i++) if (fabsf(c[i]) > fabsf(c[largest])) largest = i;
+
+	// q & -q are the same rotation, so the dropped one can always be positive
+	float sign = c[largest] < 0 ? -1.f : 1.f;
+	uint32 packed = largest, max = (1 << ROTATION_BITS) - 1;
+	for (uint i = 0; i < 4; i++)
+	{
+		if (i == largest) continue;
+		float v = glm::clamp(c[i] * sign * 0.70710678f + .5f, 0.f, 1.f); // the others are in [-1/sqrt2, 1/sqrt2]
+		packed = (packed << ROTATION_BITS) | (uint32)(v * max + .5f);
+	}
+	return packed;
+}
+
+quat dequantize_rotation(uint32 packed)
+{
+	float c[4] = {}, sum = 0;
+	uint largest = packed >> (3 * ROTATION_BITS), max = (1 << ROTATION_BITS) - 1;
+
+	for (int i = 3, shift = 0; i >= 0; i--)
+	{
+		if (i == (int)largest) continue;
+		c[i] = (((packed >> shift) & max) / (float)max - .5f) * 1.41421356f;
+		sum += c[i] * c[i];
+		shift += ROTATION_BITS;
+	}
+	c[largest] = sqrtf(glm::max(0.f, 1 - sum));
+
+	return glm::normalize(quat(c[3], c[0], c[1], c[2]));
+}
+
+QuantizedEntity quantize_entity(vec3 position, quat rotation, uint16 state)
+{
+	QuantizedEntity q = {};
+	for (uint i = 0; i < 3; i++) q.position[i] = glm::clamp((int32)floorf((position[i] + POSITION_EXTENT) * POSITION_SCALE + .5f), 0, (1 << POSITION_BITS) - 1);
+	q.rotation = quantize_rotation(rotation);
+	q.state    = state;
+	q.active   = 1;
+	return q;
+}
+
+vec3 dequantize_position(const QuantizedEntity& q)
+{
+	return vec3(q.position[0], q.position[1], q.position[2]) / POSITION_SCALE - POSITION_EXTENT;
+}
+
+bool same_entity(const QuantizedEntity& a, const QuantizedEntity& b) { return !memcmp(&a, &b, sizeof(QuantizedEntity)); }
+
+/* entity encoding, baseline = NULL for a full state
+	full  : active bit, if active : 3 x 21 position, 32 rotation, 16 state
+	delta : active bit, if active : changed bits for position, rotation & state, then the changed ones :
+		position : 3 zigzag differences, bucketed
+		rotation : 1 bit same largest component, then 3 zigzag differences, bucketed. otherwise all 32 bits
+		state    : 16 bits
+*/
+void write_entity(BitWriter* writer, const QuantizedEntity& entity, const QuantizedEntity* baseline)
+{
+	writer->write(entity.active, 1);
+	if (!entity.active) return;
+
+	if (!baseline)
+	{
+		for (uint i = 0; i < 3; i++) writer->write(entity.position[i], POSITION_BITS);
+		writer->write(entity.rotation, 32);
+		writer->write(entity.state, 16);
+		return;
+	}
+
+	bool position = memcmp(entity.position, baseline->position, sizeof(entity.position)) != 0;
+	bool rotation = entity.rotation != baseline->rotation;
+	bool state    = entity.state != baseline->state;
+	writer->write(position, 1);
+	writer->write(rotation, 1);
+	writer->write(state, 1);
+
+	if (position) for (uint i = 0; i < 3; i++) write_bucketed(writer, zigzag(entity.position[i] - baseline->position[i]), POSITION_WIDTHS);
+
+	if (rotation)
+	{
+		bool same_largest = (entity.rotation >> 30) == (baseline->rotation >> 30);
+		writer->write(same_largest, 1);
+		if (!same_largest) writer->write(entity.rotation, 32);
+		else for (uint i = 0; i < 3; i++)
+		{
+			int32 a = (entity.rotation >> (i * ROTATION_BITS)) & ((1 << ROTATION_BITS) - 1);
+			int32 b = (baseline->rotation >> (i * ROTATION_BITS)) & ((1 << ROTATION_BITS) - 1);
+			write_bucketed(writer, zigzag(a - b), ROTATION_WIDTHS);
+		}
+	}
+
+	if (state) writer->write(entity.state, 16);
+}
+
+QuantizedEntity read_entity(BitReader* reader, const QuantizedEntity* baseline)
+{
+	QuantizedEntity entity = {};
+	entity.active = reader->read(1);
+	if (!entity.active) return entity;
+
+	if (!baseline)
+	{
+		for (uint i = 0; i < 3; i++) entity.position[i] = reader->read(POSITION_BITS);
+		entity.rotation = reader->read(32);
+		entity.state    = reader->read(16);
+		return entity;
+	}
+
+	entity = *baseline;
+	entity.active = 1;
+	bool position = reader->read(1), rotation = reader->read(1), state = reader->read(1);
+
+	if (position) for (uint i = 0; i < 3; i++) entity.position[i] = baseline->position[i] + unzigzag(read_bucketed(reader, POSITION_WIDTHS));
+
+	if (rotation)
+	{
+		if (!reader->read(1)) entity.rotation = reader->read(32);
+		else
+		{
+			uint32 packed = baseline->rotation & (3u << 30);
+			for (uint i = 0; i < 3; i++)
+			{
+				int32 b = (baseline->rotation >> (i * ROTATION_BITS)) & ((1 << ROTATION_BITS) - 1);
+				packed |= (uint32)((b + unzigzag(read_bucketed(reader, ROTATION_WIDTHS))) & ((1 << ROTATION_BITS) - 1)) << (i * ROTATION_BITS);
+			}
+			entity.rotation = packed;
+		}
+	}
+
+	if (state) entity.state = reader->read(16);
+	return entity;
+}
+
+// 16 bit sequence numbers wrap, "greater" means less than half the range ahead
+inline bool sequence_greater(uint16 a, uint16 b) { return (a > b && a - b <= 32768) || (a < b && b - a > 32768); }
+
+// -------------------- lossy links ---------------- //
+
+// for testing : drops & delays outgoing datagrams. zeroed = a perfect link
+struct NetConditions
+{
+	float loss;    // [0, 1]
+	float latency; // seconds, one way
+	float jitter;  // seconds, +-
+};
+
+struct DelayedDatagram
+{
+	double deliver_time;
+	sockaddr_storage address;
+	int address_size;
+	uint size;
+	byte data[MAX_PACKET_SIZE];
+};
+
+// a UDP socket that batches what goes out : send() queues, flush() hands everything due to one sendmmsg
+struct NetLink
+{
+	SOCKET socket;
+	uint port;
+	NetConditions conditions;
+
+	DelayedDatagram* queued;
+	uint num_queued, max_queued;
+
+	uint64 packets_sent, packets_dropped, bytes_sent;
+
+	bool init(const char* ip, const char* port, uint max_in_flight = 256);
+	void release();
+	void send(const sockaddr_storage* address, int address_size, const byte* data, uint size, double now);
+	void flush(double now);
+	uint receive(NetDatagram* batch, uint count);
+};
+
+bool NetLink::init(const char* ip, const char* port_name, uint max_in_flight)
+{
+	*this = {};
+	socket = net_udp_open(ip, port_name, &port);
+	if (socket == INVALID_SOCKET) return false;
+
+	max_queued = max_in_flight;
+	queued = Alloc(DelayedDatagram, max_queued);
+	return true;
+}
+
+void NetLink::release()
+{
+	closesocket(socket);
+	free(queued);
+	*this = {};
+}
+
+void NetLink::send(const sockaddr_storage* address, int address_size, const byte* data, uint size, double now)
+{
+	if (conditions.loss > 0 && thread_random()->next_float() < conditions.loss) { packets_dropped++; return; }
+	if (num_queued == max_queued) { packets_dropped++; return; } // nobody's draining the link
+
+	DelayedDatagram* d = &queued[num_queued++];
+	d->deliver_time = now + conditions.latency + (conditions.jitter ? thread_random()->range(-conditions.jitter, conditions.jitter) : 0);
+	d->address      = *address;
+	d->address_size = address_size;
+	d->size         = size;
+	memcpy(d->data, data, size);
+}
+
+void NetLink::flush(double now)
+{
+	NetDatagram batch[NET_MAX_DATAGRAMS];
+	uint due[NET_MAX_DATAGRAMS];
+
+	while (1)
+	{
+		uint count = 0;
+		for (uint i = 0; i < num_queued && count < NET_MAX_DATAGRAMS; i++)
+		{
+			DelayedDatagram* d = &queued[i];
+			if (d->deliver_time > now) continue;
+
+			batch[count] = { d->address, d->address_size, d->data, d->size };
+			due[count++] = i;
+		}
+		if (!count) return;
+
+		uint sent = net_send_datagrams(socket, batch, count);
+		for (uint i = 0; i < sent; i++) { packets_sent++; bytes_sent += batch[i].size; }
+
+		// swap remove, back to front so the indices stay valid
+		for (int i = count - 1; i >= 0; i--) queued[due[i]] = queued[--num_queued];
+
+		if (sent < count) return; // the kernel's full, the rest are gone
+	}
+}
+
+uint NetLink::receive(NetDatagram* batch, uint count) { return net_recv_datagrams(socket, batch, count); }
+
+// --------------------- interest ------------------ //
+
+/* which entities a client gets at all. entities sit in a uniform grid over the replicated extent (x & z, height doesn't count),
+   each cell keeps its entities' ids & positions side by side, so a query only reads the cells it overlaps.
+   moving within a cell is one write, into another one a swap remove & an append.
+   every tick each client gathers what's within its radius, one client per job, & checks it against last tick's
+   for enter / leave events through a small hash set. a client only ever holds its own set, nothing per entity.
+   once in, an entity stays in until it's INTEREST_HYSTERESIS times the radius away,
+   so one sitting on the edge doesn't flicker in & out */
+
+#define INTEREST_CELL_SIZE  32.f // meters
+#define INTEREST_GRID_SIZE  ((uint)(2 * POSITION_EXTENT / INTEREST_CELL_SIZE)) // cells per side
+#define INTEREST_HYSTERESIS 1.1f
+
+struct InterestCell
+{
+	uint* entities;
+	vec2* positions; // x & z
+	uint count, capacity;
+};
+
+struct InterestList
+{
+	uint* items;
+	uint count, capacity;
+
+	void reserve(uint size)
+	{
+		if (size <= capacity) return;
+		while (capacity < size) capacity = capacity ? capacity * 2 : 64;
+		items = (uint*)realloc(items, capacity * sizeof(uint));
+	}
+
+	void push(uint item)
+	{
+		reserve(count + 1);
+		items[count++] = item;
+	}
+};
+
+// open addressing, entity + 1 per slot (0 = empty), never more than half full
+struct InterestSet
+{
+	uint* slots;
+	uint bits; // 2^bits slots
+
+	void build(const uint* items, uint count)
+	{
+		uint needed = 6;
+		while ((1u << needed) < count * 2) needed++;
+		if (needed > bits) { free(slots); slots = Alloc(uint, 1u << needed); bits = needed; }
+		else memset(slots, 0, sizeof(uint) << bits);
+
+		uint mask = (1u << bits) - 1;
+		for (uint i = 0; i < count; i++)
+		{
+			uint slot = (items[i] * 2654435761u) >> (32 - bits);
+			while (slots[slot]) slot = (slot + 1) & mask;
+			slots[slot] = items[i] + 1;
+		}
+	}
+
+	bool contains(uint item) const
+	{
+		if (!slots) return false;
+
+		uint mask = (1u << bits) - 1;
+		for (uint slot = (item * 2654435761u) >> (32 - bits); slots[slot]; slot = (slot + 1) & mask) if (slots[slot] == item + 1) return true;
+		return false;
+	}
+};
+
+struct InterestClient
+{
+	bool active;
+	vec2 position; // x & z
+	float radius;
+
+	InterestList relevant; // this tick's set, in no particular order
+	InterestList previous; // last tick's
+	InterestList entered, left; // since last tick
+	InterestList scratch;
+	InterestSet relevant_set, previous_set;
+};
+
+struct InterestGrid
+{
+	uint max_entities, max_clients;
+	InterestCell* cells; // by z * INTEREST_GRID_SIZE + x
+	uint* cell_of; // + 1, 0 = not in the grid
+	uint* slot_of; // within its cell
+	InterestClient* clients;
+
+	void init(uint max_entities, uint max_clients);
+	void release();
+
+	void set_entity(uint id, vec3 position);
+	void remove_entity(uint id);
+	void set_client(uint id, vec3 position, float radius);
+	void remove_client(uint id); // everything it had leaves on the next update
+
+	void update(); // every client's set & events, on the workers
+	bool is_relevant(uint client, uint entity) { return clients[client].relevant_set.contains(entity); }
+};
+
+inline uint interest_cell(float x) { return (uint)glm::clamp((int)floorf((x + POSITION_EXTENT) / INTEREST_CELL_SIZE), 0, (int)INTEREST_GRID_SIZE - 1); }
+
+void InterestGrid::init(uint entities, uint num_clients)
+{
+	*this = {};
+	max_entities = entities;
+	max_clients  = num_clients;
+	cells   = Alloc(InterestCell, INTEREST_GRID_SIZE * INTEREST_GRID_SIZE);
+	cell_of = Alloc(uint, max_entities);
+	slot_of = Alloc(uint, max_entities);
+	clients = Alloc(InterestClient, max_clients);
+}
+
+void InterestGrid::release()
+{
+	for (uint i = 0; i < INTEREST_GRID_SIZE * INTEREST_GRID_SIZE; i++) { free(cells[i].entities); free(cells[i].positions); }
+	for (uint i = 0; i < max_clients; i++)
+	{
+		InterestClient* c = &clients[i];
+		free(c->relevant.items); free(c->previous.items);
+		free(c->entered.items); free(c->left.items);
+		free(c->scratch.items);
+		free(c->relevant_set.slots); free(c->previous_set.slots);
+	}
+
+	free(cells);
+	free(cell_of);
+	free(slot_of);
+	free(clients);
+	*this = {};
+}
+
+void InterestGrid::set_entity(uint id, vec3 position)
+{
+	uint index = interest_cell(position.z) * INTEREST_GRID_SIZE + interest_cell(position.x);
+
+	// still in the same cell, most of the time
+	if (cell_of[id] == index + 1) { cells[index].positions[slot_of[id]] = vec2(position.x, position.z); return; }
+
+	remove_entity(id);
+
+	InterestCell* cell = &cells[index];
+	if (cell->count == cell->capacity)
+	{
+		cell->capacity  = cell->capacity ? cell->capacity * 2 : 16;
+		cell->entities  = (uint*)realloc(cell->entities, cell->capacity * sizeof(uint));
+		cell->positions = (vec2*)realloc(cell->positions, cell->capacity * sizeof(vec2));
+	}
+
+	cell->entities [cell->count] = id;
+	cell->positions[cell->count] = vec2(position.x, position.z);
+	cell_of[id] = index + 1;
+	slot_of[id] = cell->count++;
+}
+
+void InterestGrid::remove_entity(uint id)
+{
+	if (!cell_of[id]) return;
+
+	InterestCell* cell = &cells[cell_of[id] - 1];
+	uint slot = slot_of[id], last = --cell->count;
+	cell->entities [slot] = cell->entities [last];
+	cell->positions[slot] = cell->positions[last];
+	slot_of[cell->entities[slot]] = slot;
+	cell_of[id] = 0;
+}
+
+void InterestGrid::set_client(uint id, vec3 position, float radius)
+{
+	clients[id].active   = true;
+	clients[id].position = vec2(position.x, position.z);
+	clients[id].radius   = radius;
+}
+
+void InterestGrid::remove_client(uint id) { clients[id].active = false; }
+
+// one client's set, diffed against last tick's
+void interest_query(InterestGrid* grid, uint client)
+{
+	InterestClient* c = &grid->clients[client];
+
+	InterestList swap = c->previous;
+	c->previous = c->relevant;
+	c->relevant = swap;
+	c->relevant.count = c->entered.count = c->left.count = 0;
+
+	InterestSet swap_set = c->previous_set;
+	c->previous_set = c->relevant_set;
+	c->relevant_set = swap_set;
+
+	if (c->active)
+	{
+		float enter = c->radius * c->radius;
+		float stay  = enter * INTEREST_HYSTERESIS * INTEREST_HYSTERESIS;
+		float reach = c->radius * INTEREST_HYSTERESIS;
+
+		uint x0 = interest_cell(c->position.x - reach), x1 = interest_cell(c->position.x + reach);
+		uint z0 = interest_cell(c->position.y - reach), z1 = interest_cell(c->position.y + reach);
+		// written unconditionally, the count only moves when it's in : whether it is is a coin toss for the branch predictor.
+		// the ones in the band between the radii go to scratch, they only stay if they were already in
+		for (uint z = z0; z <= z1; z++)
+		for (uint x = x0; x <= x1; x++)
+		{
+			InterestCell* cell = &grid->cells[z * INTEREST_GRID_SIZE + x];
+			c->relevant.reserve(c->relevant.count + cell->count);
+			c->scratch.reserve(c->scratch.count + cell->count);
+
+			for (uint i = 0; i < cell->count; i++)
+			{
+				vec2 d = cell->positions[i] - c->position;
+				float d2 = d.x * d.x + d.y * d.y;
+
+				uint e = cell->entities[i];
+				c->relevant.items[c->relevant.count] = e;
+				c->scratch.items[c->scratch.count] = e;
+				c->relevant.count += d2 < enter;
+				c->scratch.count  += (d2 >= enter) & (d2 < stay);
+			}
+		}
+
+		for (uint i = 0; i < c->scratch.count; i++) if (c->previous_set.contains(c->scratch.items[i])) c->relevant.push(c->scratch.items[i]);
+		c->scratch.count = 0;
+	}
+
+	c->relevant_set.build(c->relevant.items, c->relevant.count);
+	for (uint i = 0; i < c->relevant.count; i++) if (!c->previous_set.contains(c->relevant.items[i])) c->entered.push(c->relevant.items[i]);
+	for (uint i = 0; i < c->previous.count; i++) if (!c->relevant_set.contains(c->previous.items[i])) c->left.push(c->previous.items[i]);
+}
+
+void InterestGrid::update()
+{
+	const auto query = [](void* data, uint begin, uint end) {
+		for (uint i = begin; i < end; i++) interest_query((InterestGrid*)data, i);
+	};
+	parallel_for(max_clients, 16, query, this);
+}
+
+// ---------------------- server ------------------- //
+
+struct SentPacket
+{
+	uint16 sequence;
+	bool   valid;
+	uint   num_entities;
+	uint16* entities;
+	QuantizedEntity* states;
+};
+
+// the server's view of one client
+struct ReplicationPeer
+{
+	bool connected;
+	sockaddr_storage address;
+	int address_size;
+	uint16 sequence; // of the next packet
+	uint16 last_received; // newest client packet, older ones are dropped
+	double last_heard;
+	vec3 viewer; // sent by the client, for priorities
+
+	QuantizedEntity* baseline; // last acked state of every entity
+	uint16* baseline_sequence;
+	byte* has_baseline;
+	float* priority;
+
+	// with interest management : entities that left the client's interest but it still has, they go out as removed
+	InterestList leaving;
+	byte* is_leaving;
+
+	SentPacket sent[REPLICATION_HISTORY];
+
+	struct {
+		uint16 id;
+		byte size;
+		byte data[MAX_RELIABLE_SIZE];
+	} reliable[MAX_RELIABLE_MESSAGES];
+	uint16 reliable_first, reliable_next; // [first, next) aren't acked yet
+
+	uint bytes_per_second;
+	uint64 bytes_sent, packets_sent;
+};
+
+struct ReplicationCandidate
+{
+	float priority;
+	uint entity;
+	uint bits; // worst case, including the index & baseline
+	bool leaving; // goes out as removed
+};
+
+struct ReplicationServer
+{
+	NetLink link;
+	float tick_rate;
+
+	uint num_entities;
+	QuantizedEntity* world;
+
+	ReplicationPeer peers[MAX_CLIENTS];
+	uint num_peers;
+
+	ReplicationCandidate* candidates;
+
+	InterestGrid* interest; // NULL = every client gets every entity
+	float interest_radius;
+
+	bool init(const char* ip, const char* port, uint num_entities, float tick_rate = 20, uint bytes_per_second = 4096);
+	void release();
+
+	void set_entity(uint id, vec3 position, quat rotation, uint16 state = 0);
+	void remove_entity(uint id);
+	void use_interest(float radius); // clients only get what's within radius of their viewer
+	bool send_reliable(uint peer, const byte* data, uint size); // false when the client's queue is full
+
+	void receive(double now); // new clients, acks & viewer positions
+	void send(double now);    // one packet to every client, once per tick
+	void drop_silent(double now, double timeout); // clients not heard from in that long lose their slot
+};
+
+bool ReplicationServer::init(const char* ip, const char* port, uint entities, float rate, uint bytes_per_second)
+{
+	*this = {};
+	if (entities > REPLICATION_MAX_ENTITIES) { NETWORK_ERROR("too many replicated entities : " << entities); return false; }
+	if (!link.init(ip, port, MAX_CLIENTS * 16)) return false;
+
+	tick_rate    = rate;
+	num_entities = entities;
+	world        = Alloc(QuantizedEntity, num_entities);
+	candidates   = Alloc(ReplicationCandidate, num_entities);
+
+	for (uint i = 0; i < MAX_CLIENTS; i++)
+	{
+		ReplicationPeer* peer = &peers[i];
+		peer->bytes_per_second  = bytes_per_second;
+		peer->baseline          = Alloc(QuantizedEntity, num_entities);
+		peer->baseline_sequence = Alloc(uint16, num_entities);
+		peer->has_baseline      = Alloc(byte, num_entities);
+		peer->priority          = Alloc(float, num_entities);
+		peer->is_leaving        = Alloc(byte, num_entities);
+
+		for (uint j = 0; j < REPLICATION_HISTORY; j++)
+		{
+			peer->sent[j].entities = Alloc(uint16, MAX_ENTITIES_PER_PACKET);
+			peer->sent[j].states   = Alloc(QuantizedEntity, MAX_ENTITIES_PER_PACKET);
+		}
+	}
+
+	return true;
+}
+
+void ReplicationServer::release()
+{
+	for (uint i = 0; i < MAX_CLIENTS; i++)
+	{
+		ReplicationPeer* peer = &peers[i];
+		free(peer->baseline);
+		free(peer->baseline_sequence);
+		free(peer->has_baseline);
+		free(peer->priority);
+		free(peer->is_leaving);
+		free(peer->leaving.items);
+		for (uint j = 0; j < REPLICATION_HISTORY; j++) { free(peer->sent[j].entities); free(peer->sent[j].states); }
+	}
+
+	if (interest) { interest->release(); free(interest); }
+	link.release();
+	free(world);
+	free(candidates);
+	*this = {};
+}
+
+void ReplicationServer::set_entity(uint id, vec3 position, quat rotation, uint16 state)
+{
+	world[id] = quantize_entity(position, rotation, state);
+	if (interest) interest->set_entity(id, position);
+}
+
+void ReplicationServer::remove_entity(uint id)
+{
+	world[id] = {};
+	if (interest) interest->remove_entity(id);
+}
+
+void ReplicationServer::use_interest(float radius)
+{
+	if (!interest)
+	{
+		interest = Alloc(InterestGrid, 1);
+		interest->init(num_entities, MAX_CLIENTS);
+		for (uint e = 0; e < num_entities; e++) if (world[e].active) interest->set_entity(e, dequantize_position(world[e]));
+	}
+	interest_radius = radius;
+}
+
+bool ReplicationServer::send_reliable(uint id, const byte* data, uint size)
+{
+	ReplicationPeer* peer = &peers[id];
+	if (!peer->connected || size > MAX_RELIABLE_SIZE) return false;
+	if ((uint16)(peer->reliable_next - peer->reliable_first) == MAX_RELIABLE_MESSAGES) return false;
+
+	uint16 message_id = peer->reliable_next++;
+	auto* message = &peer->reliable[message_id % MAX_RELIABLE_MESSAGES];
+	message->id   = message_id;
+	message->size = size;
+	memcpy(message->data, data, size);
+	return true;
+}
+
+// the client got these, so their states become baselines
+void process_acks(ReplicationPeer* peer, uint16 ack, uint32 ack_bits)
+{
+	for (uint i = 0; i <= 32; i++)
+	{
+		if (i && !(ack_bits & (1u << (i - 1)))) continue;
+
+		uint16 sequence = ack - i;
+		SentPacket* packet = &peer->sent[sequence % REPLICATION_HISTORY];
+		if (!packet->valid || packet->sequence != sequence) continue;
+
+		for (uint j = 0; j < packet->num_entities; j++)
+		{
+			uint e = packet->entities[j];
+			if (peer->has_baseline[e] && !sequence_greater(sequence, peer->baseline_sequence[e])) continue;
+
+			peer->baseline[e]          = packet->states[j];
+			peer->baseline_sequence[e] = sequence;
+			peer->has_baseline[e]      = 1;
+		}
+
+		packet->valid = false;
+	}
+}
+
+/* client -> server : uint16 sequence, 1 bit has acks (nothing's acked before the first packet arrives), uint16 ack, uint32 ack bits,
+   vec3 viewer (raw floats), uint16 next reliable message the client wants */
+void ReplicationServer::receive(double now)
+{
+	NetDatagram batch[NET_MAX_DATAGRAMS];
+	uint32 buffers[NET_MAX_DATAGRAMS][MAX_PACKET_SIZE / 4 + 1];
+
+	while (1)
+	{
+		for (uint i = 0; i < NET_MAX_DATAGRAMS; i++) { batch[i].data = (byte*)buffers[i]; batch[i].size = MAX_PACKET_SIZE; }
+
+		uint count = link.receive(batch, NET_MAX_DATAGRAMS);
+		for (uint i = 0; i < count; i++)
+		{
+			// find the client, or take a new slot for it
+			ReplicationPeer* peer = NULL;
+			for (uint p = 0; p < MAX_CLIENTS && !peer; p++) if (peers[p].connected && net_same_address(&peers[p].address, &batch[i].address)) peer = &peers[p];
+			for (uint p = 0; p < MAX_CLIENTS && !peer; p++) if (!peers[p].connected)
+			{
+				peer = &peers[p];
+				peer->connected      = true;
+				peer->address        = batch[i].address;
+				peer->address_size   = batch[i].address_size;
+				peer->sequence       = 0;
+				peer->last_received  = 0;
+				peer->reliable_first = peer->reliable_next = 0;
+				memset(peer->has_baseline, 0, num_entities);
+				memset(peer->priority, 0, num_entities * sizeof(float));
+				memset(peer->is_leaving, 0, num_entities);
+				peer->leaving.count = 0;
+				for (uint j = 0; j < REPLICATION_HISTORY; j++) peer->sent[j].valid = false;
+				num_peers++;
+			}
+			if (!peer) continue; // full
+
+			BitReader reader;
+			reader.init(batch[i].data, batch[i].size);
+			uint16 sequence = reader.read(16);
+			bool has_acks = reader.read(1);
+			uint16 ack = reader.read(16);
+			uint32 ack_bits = reader.read(32);
+			vec3 viewer;
+			for (uint k = 0; k < 3; k++) { uint32 bits = reader.read(32); memcpy(&viewer[k], &bits, 4); }
+			uint16 next_message = reader.read(16);
+			if (reader.overflow) continue;
+
+			peer->last_heard = now;
+			if (has_acks) process_acks(peer, ack, ack_bits); // acks are good in any order, the viewer only if it's newer
+
+			// an older packet only says less, & never past what was sent
+			if (sequence_greater(next_message, peer->reliable_first) && !sequence_greater(next_message, peer->reliable_next)) peer->reliable_first = next_message;
+
+			if (sequence_greater(sequence, peer->last_received) || peer->last_received == 0)
+			{
+				peer->last_received = sequence;
+				peer->viewer = viewer;
+				if (interest) interest->set_client((uint)(peer - peers), viewer, interest_radius);
+			}
+		}
+
+		if (count < NET_MAX_DATAGRAMS) break;
+	}
+}
+
+void ReplicationServer::drop_silent(double now, double timeout)
+{
+	for (uint p = 0; p < MAX_CLIENTS; p++)
+	{
+		if (!peers[p].connected || now - peers[p].last_heard < timeout) continue;
+
+		peers[p].connected = false;
+		num_peers--;
+		if (interest) interest->remove_client(p);
+	}
+}
+
+int compare_candidates(const void* a, const void* b)
+{
+	float x = ((const ReplicationCandidate*)a)->priority, y = ((const ReplicationCandidate*)b)->priority;
+	return (x < y) - (x > y); // highest first
+}
+
+int compare_candidate_entities(const void* a, const void* b)
+{
+	return (int)((const ReplicationCandidate*)a)->entity - (int)((const ReplicationCandidate*)b)->entity;
+}
+
+/* server -> client :
+	uint16 sequence, uint16 ack (of the client's packets), uint32 nothing yet
+	1 bit reliable messages, then uint16 first id, 6 bits count, each : 8 bit size & the bytes
+	per entity, in index order : 1 bit more, bucketed index gap, baseline age (1 bit same as the last one, or 5 bits, 0 = none), the entity
+	then a 0 bit
+*/
+void ReplicationServer::send(double now)
+{
+	byte buffer[MAX_PACKET_SIZE];
+	byte scratch[256];
+
+	if (interest) interest->update();
+
+	for (uint p = 0; p < MAX_CLIENTS; p++)
+	{
+		ReplicationPeer* peer = &peers[p];
+		if (!peer->connected) continue;
+
+		uint budget = (uint)(peer->bytes_per_second / tick_rate);
+		budget = (glm::clamp(budget, (uint)PACKET_HEADER_SIZE + 16, (uint)MAX_PACKET_SIZE + PACKET_HEADER_SIZE) - PACKET_HEADER_SIZE) * 8;
+
+		uint16 sequence = peer->sequence++;
+		SentPacket* record = &peer->sent[sequence % REPLICATION_HISTORY];
+		record->sequence     = sequence;
+		record->valid        = true;
+		record->num_entities = 0;
+
+		BitWriter writer;
+		writer.init(buffer, MAX_PACKET_SIZE);
+		writer.write(sequence, 16);
+		writer.write(peer->last_received, 16);
+		writer.write(0, 32);
+
+		// reliable messages go first, every unacked one fits or none after it does
+		uint16 first = peer->reliable_first, end = first;
+		uint reliable_bits = 1 + 16 + 6;
+		while (end != peer->reliable_next && (uint16)(end - first) < 63)
+		{
+			uint bits = 8 + peer->reliable[end % MAX_RELIABLE_MESSAGES].size * 8;
+			if (writer.bits_written + reliable_bits + bits + 1 > budget) break;
+			reliable_bits += bits;
+			end++;
+		}
+
+		writer.write(end != first, 1);
+		if (end != first)
+		{
+			writer.write(first, 16);
+			writer.write((uint16)(end - first), 6);
+			for (uint16 id = first; id != end; id++)
+			{
+				auto* message = &peer->reliable[id % MAX_RELIABLE_MESSAGES];
+				writer.write(message->size, 8);
+				for (uint b = 0; b < message->size; b++) writer.write(message->data[b], 8);
+			}
+		}
+
+		// everything that differs from what the client has builds up priority, closer builds faster
+		uint num_candidates = 0;
+		const auto consider = [&](uint e, bool leaving) {
+			const QuantizedEntity entity = leaving ? QuantizedEntity{} : world[e];
+			bool known = peer->has_baseline[e] && (uint16)(sequence - peer->baseline_sequence[e]) < REPLICATION_HISTORY;
+			if (peer->has_baseline[e] ? same_entity(entity, peer->baseline[e]) : !entity.active) return;
+
+			float d2 = entity.active ? glm::length2(dequantize_position(entity) - peer->viewer) : 0;
+			float weight = 1 / (1 + d2 / (PRIORITY_RADIUS * PRIORITY_RADIUS));
+			if (!peer->has_baseline[e]) weight = glm::max(weight, PRIORITY_UNSEEN); // far away is fine, missing isn't
+			peer->priority[e] += weight;
+
+			BitWriter sizer;
+			sizer.init(scratch, sizeof(scratch));
+			write_entity(&sizer, entity, known ? &peer->baseline[e] : NULL);
+
+			candidates[num_candidates++] = { peer->priority[e], e, sizer.bits_written + 1 + 2 + 14 + 6, leaving };
+		};
+
+		if (!interest) for (uint e = 0; e < num_entities; e++) consider(e, false);
+		else
+		{
+			// only what's within its radius, & removals for what the client still has from before
+			InterestClient* client = &interest->clients[p];
+			for (uint i = 0; i < client->left.count; i++)
+			{
+				uint e = client->left.items[i];
+				if (!peer->is_leaving[e]) { peer->is_leaving[e] = 1; peer->leaving.push(e); }
+			}
+
+			for (uint i = 0; i < client->relevant.count; i++) consider(client->relevant.items[i], false);
+
+			uint kept = 0;
+			for (uint i = 0; i < peer->leaving.count; i++)
+			{
+				uint e = peer->leaving.items[i];
+				bool gone = !peer->has_baseline[e] || !peer->baseline[e].active; // it never had it, or the removal was acked
+				if (gone || interest->is_relevant(p, e)) { peer->is_leaving[e] = 0; continue; }
+
+				peer->leaving.items[kept++] = e;
+				consider(e, true);
+			}
+			peer->leaving.count = kept;
+		}
+
+		// most important first until the budget's gone, then back in index order for small gaps
+		qsort(candidates, num_candidates, sizeof(ReplicationCandidate), compare_candidates);
+		uint num_selected = 0, bits = writer.bits_written + 1;
+		for (uint i = 0; i < num_candidates && num_selected < MAX_ENTITIES_PER_PACKET; i++)
+		{
+			if (bits + candidates[i].bits > budget) continue; // something smaller might still fit
+			bits += candidates[i].bits;
+			candidates[num_selected++] = candidates[i];
+		}
+		qsort(candidates, num_selected, sizeof(ReplicationCandidate), compare_candidate_entities);
+
+		int previous = -1;
+		uint previous_age = ~0u;
+		for (uint i = 0; i < num_selected; i++)
+		{
+			uint e = candidates[i].entity;
+			bool known = peer->has_baseline[e] && (uint16)(sequence - peer->baseline_sequence[e]) < REPLICATION_HISTORY;
+			uint age = known ? (uint16)(sequence - peer->baseline_sequence[e]) : 0;
+
+			writer.write(1, 1);
+			write_bucketed(&writer, e - previous - 1, GAP_WIDTHS);
+			writer.write(age == previous_age, 1);
+			if (age != previous_age) writer.write(age, 5);
+			const QuantizedEntity entity = candidates[i].leaving ? QuantizedEntity{} : world[e];
+			write_entity(&writer, entity, known ? &peer->baseline[e] : NULL);
+
+			record->entities[record->num_entities] = e;
+			record->states[record->num_entities++] = entity;
+			peer->priority[e] = 0;
+			previous = e;
+			previous_age = age;
+		}
+		writer.write(0, 1);
+		writer.flush();
+
+		uint size = writer.bytes();
+		link.send(&peer->address, peer->address_size, buffer, size, now);
+		peer->bytes_sent += size + PACKET_HEADER_SIZE;
+		peer->packets_sent++;
+	}
+
+	link.flush(now);
+}
+
+// ---------------------- client ------------------- //
+
+struct ReplicationClient
+{
+	NetLink link;
+	sockaddr_storage server_address;
+	int server_address_size;
+
+	uint num_entities;
+	QuantizedEntity* entities; // newest of each
+	uint16* entity_sequence;
+	byte* known;
+
+	// the last few states of every entity, by packet sequence, for the baselines
+	struct HistoryEntry {
+		uint16 sequence;
+		bool valid;
+		QuantizedEntity state;
+	} *history; // num_entities * REPLICATION_HISTORY
+
+	uint16 sequence, received_sequence;
+	uint32 received_bits; // older packets received, bit i = received_sequence - 1 - i
+	bool received_any;
+	vec3 viewer;
+
+	// reliable messages in order, until the game takes them
+	struct {
+		byte size;
+		byte data[MAX_RELIABLE_SIZE];
+	} messages[MAX_RELIABLE_MESSAGES];
+	uint16 next_message, messages_read, messages_written;
+
+	uint64 bytes_received, packets_received, packets_rejected;
+
+	bool init(const char* server_ip, const char* server_port, uint num_entities);
+	void release();
+
+	void receive(double now);
+	void send(double now); // acks & the viewer, once per tick
+
+	bool get_entity(uint id, vec3* position, quat* rotation, uint16* state = NULL);
+	bool next_reliable(byte* data, uint* size); // in the order they were sent
+};
+
+bool ReplicationClient::init(const char* server_ip, const char* server_port, uint count)
+{
+	*this = {};
+	if (!net_resolve(server_ip, server_port, &server_address, &server_address_size)) return false;
+	if (!link.init("127.0.0.1", "0", 32)) return false;
+
+	num_entities    = count;
+	entities        = Alloc(QuantizedEntity, num_entities);
+	entity_sequence = Alloc(uint16, num_entities);
+	known           = Alloc(byte, num_entities);
+	history         = Alloc(HistoryEntry, num_entities * REPLICATION_HISTORY);
+	return true;
+}
+
+void ReplicationClient::release()
+{
+	link.release();
+	free(entities);
+	free(entity_sequence);
+	free(known);
+	free(history);
+	*this = {};
+}
+
+void ReplicationClient::receive(double now)
+{
+	NetDatagram batch[NET_MAX_DATAGRAMS];
+	uint32 buffers[NET_MAX_DATAGRAMS][MAX_PACKET_SIZE / 4 + 1];
+
+	while (1)
+	{
+		for (uint i = 0; i < NET_MAX_DATAGRAMS; i++) { batch[i].data = (byte*)buffers[i]; batch[i].size = MAX_PACKET_SIZE; }
+
+		uint count = link.receive(batch, NET_MAX_DATAGRAMS);
+		for (uint i = 0; i < count; i++)
+		{
+			if (!net_same_address(&batch[i].address, &server_address)) continue;
+			bytes_received += batch[i].size + PACKET_HEADER_SIZE;
+
+			BitReader reader;
+			reader.init(batch[i].data, batch[i].size);
+			uint16 packet_sequence = reader.read(16);
+			reader.read(16); // the server's acks of our packets, nothing uses them yet
+			reader.read(32);
+
+			// too old to have baselines for, or a duplicate
+			if (received_any)
+			{
+				uint16 behind = received_sequence - packet_sequence;
+				bool newer = sequence_greater(packet_sequence, received_sequence);
+				if (!newer && (behind == 0 || behind > 32 || (received_bits & (1u << (behind - 1))))) { packets_rejected++; continue; }
+			}
+
+			// reliable messages : everything from the oldest one the server hasn't seen acked, skip the ones we have
+			uint16 reliable_first = 0, reliable_count = 0;
+			byte sizes[64];
+			byte payload[MAX_PACKET_SIZE];
+			uint payload_size = 0;
+			if (reader.read(1))
+			{
+				reliable_first = reader.read(16);
+				reliable_count = reader.read(6);
+				for (uint m = 0; m < reliable_count; m++)
+				{
+					sizes[m] = reader.read(8);
+					for (uint b = 0; b < sizes[m]; b++) payload[payload_size++] = reader.read(8);
+				}
+			}
+
+			// decode everything first, a bad packet changes nothing & doesn't get acked
+			uint num_decoded = 0;
+			static thread_local uint16 decoded_ids[MAX_ENTITIES_PER_PACKET];
+			static thread_local QuantizedEntity decoded[MAX_ENTITIES_PER_PACKET];
+			int previous = -1;
+			uint age = 0;
+			bool bad = reader.overflow;
+
+			while (!bad && reader.read(1))
+			{
+				uint e = previous + 1 + read_bucketed(&reader, GAP_WIDTHS);
+				if (!reader.read(1)) age = reader.read(5);
+
+				const QuantizedEntity* baseline = NULL;
+				if (age)
+				{
+					uint16 baseline_sequence = packet_sequence - age;
+					HistoryEntry* entry = e < num_entities ? &history[e * REPLICATION_HISTORY + baseline_sequence % REPLICATION_HISTORY] : NULL;
+					if (!entry || !entry->valid || entry->sequence != baseline_sequence) { bad = true; break; }
+					baseline = &entry->state;
+				}
+
+				if (e >= num_entities || num_decoded == MAX_ENTITIES_PER_PACKET) { bad = true; break; }
+				decoded_ids[num_decoded] = e;
+				decoded[num_decoded++]   = read_entity(&reader, baseline);
+				bad = reader.overflow;
+				previous = e;
+			}
+			if (bad) { packets_rejected++; continue; }
+
+			for (uint j = 0; j < num_decoded; j++)
+			{
+				uint e = decoded_ids[j];
+				HistoryEntry* entry = &history[e * REPLICATION_HISTORY + packet_sequence % REPLICATION_HISTORY];
+				*entry = { packet_sequence, true, decoded[j] };
+
+				if (!known[e] || sequence_greater(packet_sequence, entity_sequence[e]))
+				{
+					entities[e]        = decoded[j];
+					entity_sequence[e] = packet_sequence;
+					known[e]           = 1;
+				}
+			}
+
+			for (uint m = 0, offset = 0; m < reliable_count; offset += sizes[m], m++)
+			{
+				uint16 id = reliable_first + m;
+				if (sequence_greater(next_message, id)) continue; // had it
+				if (id != next_message) break; // can't happen, the server always starts at the oldest unacked
+				if ((uint16)(messages_written - messages_read) == MAX_RELIABLE_MESSAGES) break; // the game isn't reading, next_message says so & it comes again
+
+				auto* message = &messages[messages_written++ % MAX_RELIABLE_MESSAGES];
+				message->size = sizes[m];
+				memcpy(message->data, payload + offset, sizes[m]);
+				next_message++;
+			}
+
+			// ack bookkeeping
+			if (!received_any) { received_sequence = packet_sequence; received_bits = 0; received_any = true; }
+			else if (sequence_greater(packet_sequence, received_sequence))
+			{
+				uint16 shift = packet_sequence - received_sequence;
+				received_bits = shift > 32 ? 0 : ((received_bits << 1) | 1) << (shift - 1);
+				received_sequence = packet_sequence;
+			}
+			else received_bits |= 1u << ((uint16)(received_sequence - packet_sequence) - 1);
+
+			packets_received++;
+		}
+
+		if (count < NET_MAX_DATAGRAMS) break;
+	}
+}
+
+void ReplicationClient::send(double now)
+{
+	uint32 buffer[8] = {};
+	BitWriter writer;
+	writer.init(buffer, sizeof(buffer));
+	writer.write(sequence++, 16);
+	writer.write(received_any, 1);
+	writer.write(received_sequence, 16);
+	writer.write(received_bits, 32);
+	for (uint k = 0; k < 3; k++) { uint32 bits; memcpy(&bits, &viewer[k], 4); writer.write(bits, 32); }
+	writer.write(next_message, 16);
+	writer.flush();
+
+	link.send(&server_address, server_address_size, (byte*)buffer, writer.bytes(), now);
+	link.flush(now);
+}
+
+bool ReplicationClient::get_entity(uint id, vec3* position, quat* rotation, uint16* state)
+{
+	if (id >= num_entities || !known[id] || !entities[id].active) return false;
+
+	*position = dequantize_position(entities[id]);
+	*rotation = dequantize_rotation(entities[id].rotation);
+	if (state) *state = entities[id].state;
+	return true;
+}
+
+bool ReplicationClient::next_reliable(byte* data, uint* size)
+{
+	if (messages_read == messages_written) return false;
+
+	auto* message = &messages[messages_read++ % MAX_RELIABLE_MESSAGES];
+	memcpy(data, message->data, message->size);
+	*size = message->size;
+	return true;
+}
+
+// ----------------------- test -------------------- //
+
+// 32 clients, 1000 entities over loopback with loss, latency & jitter. time is simulated, so it runs as fast as it can.
+// interest_radius > 0 : clients only get what's that close to them
+void replication_test(uint num_clients = 32, uint num_entities = 1000, NetConditions conditions = { .05f, .05f, .01f }, uint bytes_per_second = 4096,
+	float interest_radius = 0)
+{
+	const float TICK_RATE = 20;
+	const uint  NUM_TICKS = 400; // 20 seconds
+	const uint  NUM_MOVING = 200; // the first num_clients of them are the players
+
+	ReplicationServer* server = Alloc(ReplicationServer, 1);
+	if (!server->init("127.0.0.1", "0", num_entities, TICK_RATE, bytes_per_second)) return;
+	server->link.conditions = conditions;
+	if (interest_radius > 0) server->use_interest(interest_radius);
+
+	char port[8] = {};
+	snprintf(port, 8, "%u", server->link.port);
+
+	ReplicationClient* clients = Alloc(ReplicationClient, num_clients);
+	for (uint i = 0; i < num_clients; i++)
+	{
+		clients[i].init("127.0.0.1", port, num_entities);
+		clients[i].link.conditions = conditions;
+	}
+
+	// a 512m square, most of it standing still
+	Random rng = {};
+	rng.seed(0x5EED);
+	vec3* centers = Alloc(vec3, num_entities);
+	for (uint e = 0; e < num_entities; e++) centers[e] = vec3(rng.range(-256.f, 256.f), 0, rng.range(-256.f, 256.f));
+
+	Timer timer = {};
+	timer.init();
+	int64 server_time = 0;
+
+	double near_error = 0, far_error = 0;
+	uint64 near_count = 0, far_count = 0;
+	uint reliable_sent = 0, reliable_received = 0, reliable_out_of_order = 0;
+	uint* expected = Alloc(uint, num_clients);
+
+	for (uint tick = 0; tick < NUM_TICKS; tick++)
+	{
+		double now = tick / TICK_RATE;
+
+		// movers walk circles at ~4 m/s & turn as they go
+		for (uint e = 0; e < num_entities; e++)
+		{
+			float t = (e < NUM_MOVING) ? (float)now * (4.f / 8) + e : 0;
+			vec3 position = centers[e] + vec3(cosf(t), 0, sinf(t)) * 8.f;
+			server->set_entity(e, position, glm::angleAxis(t, vec3(0, 1, 0)), e < NUM_MOVING ? (uint16)(tick / 20) : 0);
+		}
+
+		// a chat line every half second
+		if (tick % 10 == 0) for (uint c = 0; c < server->num_peers; c++)
+		{
+			char line[32];
+			uint length = snprintf(line, 32, "message %u", tick / 10);
+			if (server->send_reliable(c, (byte*)line, length)) reliable_sent++;
+		}
+
+		// each client watches from one of the players, the server tells them apart by order of arrival.
+		// the viewer goes out before the server's tick, so with no latency it queries with the one checked below
+		for (uint c = 0; c < num_clients; c++)
+		{
+			vec3 position; quat rotation;
+			if (!clients[c].get_entity(c, &position, &rotation)) position = centers[c];
+			clients[c].viewer = position;
+			clients[c].send(now);
+		}
+
+		timer.start();
+		server->receive(now);
+		server->send(now);
+		server_time += timer.microseconds_elapsed();
+
+		for (uint c = 0; c < num_clients; c++)
+		{
+			ReplicationClient* client = &clients[c];
+			client->receive(now);
+
+			byte data[MAX_RELIABLE_SIZE + 1]; uint size = 0;
+			while (client->next_reliable(data, &size))
+			{
+				uint n = 0;
+				data[size] = 0;
+				sscanf((char*)data, "message %u", &n);
+				if (expected[c] && n != expected[c]) reliable_out_of_order++; // the first one depends on when the client showed up
+				expected[c] = n + 1;
+				reliable_received++;
+			}
+		}
+
+		// after things settle, compare what the clients see with the truth
+		if (tick < NUM_TICKS / 2) continue;
+		for (uint c = 0; c < num_clients; c++)
+		for (uint e = 0; e < num_entities; e++)
+		{
+			vec3 position; quat rotation;
+			if (!clients[c].get_entity(e, &position, &rotation)) continue;
+
+			vec3 truth = dequantize_position(server->world[e]);
+			float error = glm::length(position - truth);
+			if (glm::length(truth - clients[c].viewer) < PRIORITY_RADIUS) { near_error += error; near_count++; }
+			else { far_error += error; far_count++; }
+		}
+	}
+
+	// with interest management only what's within the radius has to be there. on a bad link the server's viewer is a round trip
+	// & a lost packet behind this one, & what it sent last is still on the way : what's that close to the edge gets a pass,
+	// at 8 m/s for a player & a mover walking straight at each other
+	float lag = (conditions.loss > 0 || conditions.latency > 0) ? 2 * (conditions.latency + conditions.jitter) + 2 / TICK_RATE : 0;
+	float margin = 8 * lag;
+	uint missing = 0, expected_entities = 0;
+	for (uint c = 0; c < num_clients; c++) for (uint e = 0; e < num_entities; e++)
+	{
+		vec3 position; quat rotation;
+		vec3 truth = dequantize_position(server->world[e]);
+		if (interest_radius > 0 && glm::length(vec2(truth.x - clients[c].viewer.x, truth.z - clients[c].viewer.z)) > interest_radius - margin) continue;
+		missing += !clients[c].get_entity(e, &position, &rotation);
+		expected_entities++;
+	}
+
+	uint64 total_bytes = 0;
+	for (uint p = 0; p < MAX_CLIENTS; p++) total_bytes += server->peers[p].bytes_sent;
+	float seconds = NUM_TICKS / TICK_RATE;
+
+	print(" %u clients x %u entities, %.0f%% loss, %.0f ms latency, budget %u B/s\n", num_clients, num_entities, conditions.loss * 100, conditions.latency * 1000, bytes_per_second);
+	print(" downstream : %.0f B/s per client\n", total_bytes / seconds / num_clients);
+	print(" position error : %.3f m within %.0f m, %.3f m further out\n", near_error / glm::max(near_count, 1ull), PRIORITY_RADIUS, far_error / glm::max(far_count, 1ull));
+	if (interest_radius > 0) print(" interest radius %.0f m, the last %.2f m of it not checked\n", interest_radius, margin);
+	print(" %u of %u entities never reached their client\n", missing, expected_entities);
+	print(" reliable : %u sent, %u received, %u out of order\n", reliable_sent, reliable_received, reliable_out_of_order);
+	print(" server : %.1f us per tick for all clients\n", server_time / (float)NUM_TICKS);
+
+	for (uint i = 0; i < num_clients; i++) clients[i].release();
+	server->release();
+	free(clients);
+	free(server);
+	free(centers);
+	free(expected);
+}
+
+// 1000 clients & 100k entities on a 2km square, a tenth of the entities & every client moving each tick.
+// checked against brute force, which is also timed for one tick
+void interest_benchmark(uint num_clients = 1000, uint num_entities = 100000, uint num_ticks = 100, float radius = 48)
+{
+	const float HALF_SIZE = 1024, SPEED = 5, DT = 1 / 20.f;
+
+	InterestGrid* grid = Alloc(InterestGrid, 1);
+	grid->init(num_entities, num_clients);
+
+	Random rng = {};
+	rng.seed(0x5EED);
+	vec3* entities = Alloc(vec3, num_entities);
+	vec3* clients  = Alloc(vec3, num_clients);
+	for (uint e = 0; e < num_entities; e++) grid->set_entity(e, entities[e] = vec3(rng.range(-HALF_SIZE, HALF_SIZE), 0, rng.range(-HALF_SIZE, HALF_SIZE)));
+	for (uint c = 0; c < num_clients; c++) grid->set_client(c, clients[c] = vec3(rng.range(-HALF_SIZE, HALF_SIZE), 0, rng.range(-HALF_SIZE, HALF_SIZE)), radius);
+	grid->update();
+
+	Timer timer = {};
+	timer.init();
+	int64 move_time = 0, query_time = 0;
+	uint64 relevant = 0, events = 0;
+
+	for (uint tick = 0; tick < num_ticks; tick++)
+	{
+		const auto walk = [&](vec3 p) {
+			float angle = rng.range(0.f, 6.2831853f);
+			p += vec3(cosf(angle), 0, sinf(angle)) * (SPEED * DT);
+			return glm::clamp(p, vec3(-HALF_SIZE), vec3(HALF_SIZE));
+		};
+
+		timer.start();
+		for (uint i = 0; i < num_entities / 10; i++)
+		{
+			uint e = (tick * (num_entities / 10) + i) % num_entities;
+			grid->set_entity(e, entities[e] = walk(entities[e]));
+		}
+		move_time += timer.microseconds_elapsed();
+
+		for (uint c = 0; c < num_clients; c++) grid->set_client(c, clients[c] = walk(clients[c]), radius);
+
+		timer.start();
+		grid->update();
+		query_time += timer.microseconds_elapsed();
+
+		for (uint c = 0; c < num_clients; c++)
+		{
+			relevant += grid->clients[c].relevant.count;
+			events   += grid->clients[c].entered.count + grid->clients[c].left.count;
+		}
+	}
+
+	// everything within the radius has to be in, nothing past the hysteresis band can be
+	timer.start();
+	uint wrong = 0;
+	for (uint c = 0; c < num_clients; c++)
+	for (uint e = 0; e < num_entities; e++)
+	{
+		vec2 d = vec2(entities[e].x - clients[c].x, entities[e].z - clients[c].z);
+		float d2 = glm::dot(d, d);
+		bool in = grid->is_relevant(c, e);
+		if ((d2 < radius * radius && !in) || (d2 >= radius * radius * INTEREST_HYSTERESIS * INTEREST_HYSTERESIS && in)) wrong++;
+	}
+	int64 brute_time = timer.microseconds_elapsed();
+
+	print(" %u clients x %u entities, radius %.0f m\n", num_clients, num_entities, radius);
+	print(" moving %u entities : %.3f ms per tick\n", num_entities / 10, move_time / 1000.f / num_ticks);
+	print(" every client's set & events : %.3f ms per tick, on the workers\n", query_time / 1000.f / num_ticks);
+	print(" %.1f relevant & %.2f enter / leave events per client per tick\n", relevant / (double)num_ticks / num_clients, events / (double)num_ticks / num_clients);
+	print(" brute force, one thread : %.1f ms for one tick, %u wrong\n", brute_time / 1000.f, wrong);
+
+	grid->release();
+	free(grid);
+	free(entities);
+	free(clients);
+}
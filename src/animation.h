@@ -0,0 +1,733 @@
+#include "ocean.h"
+
+/* Animation : skeletal animation & skinning on the worker threads
+*
+* - poses stay as Transforms the whole way : sample 2 clips, blend them, walk the hierarchy,
+*   and only then turn into matrices (times the inverse bind pose) for the palette
+* - one job per character builds its palette & skins its vertices straight into the mapped vertex buffer
+* - skinned characters draw with the geometry shader like everything else, one multi-draw for all of them
+*
+* .mesh_anim_uv layout (.mesh_anim is the same without the uvs) :
+*	uint num_vertices, num_indices         | same start as .mesh_uv, so MeshLoader can still size it
+*	vec3 positions[num_vertices]
+*	vec3 normals  [num_vertices]
+*	vec2 uvs      [num_vertices]           | .mesh_anim_uv only
+*	uint indices  [num_indices]
+*	byte bone_ids    [num_vertices][4]
+*	vec4 bone_weights[num_vertices]        | sum to 1
+*	uint num_bones, num_clips
+*	per bone : int parent (-1 = root, parents come before their children), Transform bind_pose (local), mat4 inverse_bind
+*	per clip : char name[32], uint num_frames, float frames_per_second, Transform poses[num_frames][num_bones] (local)
+*/
+
+const uint MAX_BONES              = 128;
+const uint MAX_SKINNED_MESHES     = 8;
+const uint MAX_ANIMATION_CLIPS    = 16; // per mesh
+const uint MAX_CHARACTERS         = 4096;
+const uint MAX_SKINNED_VERTICES   = 1024 * 1024; // all characters together
+const uint MAX_SKINNED_INDICES    = 1024 * 1024; // all meshes together
+const uint MAX_ANIMATION_NAME     = 32;
+
+struct AnimatedVertex {
+	vec3 position, normal;
+	vec2 uv;
+};
+
+struct AnimationClip
+{
+	char  name[MAX_ANIMATION_NAME];
+	uint  num_frames;
+	float frames_per_second;
+	Transform* poses; // num_frames * num_bones
+};
+
+struct SkinnedMesh
+{
+	uint num_vertices, num_indices;
+	uint num_bones, num_clips;
+
+	vec3* positions, *normals;
+	vec2* uvs;
+	uint* indices;
+	byte* bone_ids; // 4 per vertex
+	vec4* bone_weights;
+
+	uint* parent; // index + 1, 0 = root
+	Transform* bind_pose;
+	mat4* inverse_bind;
+	AnimationClip clips[MAX_ANIMATION_CLIPS];
+
+	uint first_index; // in the Animator's index buffer
+
+	bool load(const char* path);
+	bool save(const char* path);
+	void release();
+	uint find_clip(const char* name); // index + 1, 0 = not found
+};
+
+bool SkinnedMesh::load(const char* path)
+{
+	FILETYPE type = get_filetype((char*)path);
+	if (type != MESH_ANIM && type != MESH_ANIM_UV) { print("not an animated mesh: %s\n", path); return false; }
+
+	FILE* file = fopen(path, "rb");
+	if (!file) { print("could not open animated mesh file: %s\n", path); return false; }
+
+	*this = {};
+	fread(&num_vertices, sizeof(uint), 1, file);
+	fread(&num_indices , sizeof(uint), 1, file);
+
+	positions    = Alloc(vec3, num_vertices);
+	normals      = Alloc(vec3, num_vertices);
+	uvs          = Alloc(vec2, num_vertices);
+	indices      = Alloc(uint, num_indices);
+	bone_ids     = Alloc(byte, num_vertices * 4);
+	bone_weights = Alloc(vec4, num_vertices);
+
+	fread(positions, sizeof(vec3), num_vertices, file);
+	fread(normals  , sizeof(vec3), num_vertices, file);
+	if (type == MESH_ANIM_UV) fread(uvs, sizeof(vec2), num_vertices, file);
+	fread(indices     , sizeof(uint), num_indices     , file);
+	fread(bone_ids    , sizeof(byte), num_vertices * 4, file);
+	fread(bone_weights, sizeof(vec4), num_vertices    , file);
+
+	fread(&num_bones, sizeof(uint), 1, file);
+	fread(&num_clips, sizeof(uint), 1, file);
+
+	if (num_bones > MAX_BONES || num_clips > MAX_ANIMATION_CLIPS)
+	{
+		print("too many bones or clips in %s : [%d], [%d]\n", path, num_bones, num_clips);
+		num_clips = 0; // nothing allocated for them yet
+		fclose(file);
+		release();
+		return false;
+	}
+
+	// skinning indexes a MAX_BONES palette on the stack with these
+	for (uint i = 0; i < num_vertices * 4; i++)
+	{
+		if (bone_ids[i] < num_bones) continue;
+
+		print("bone id [%d] past the [%d] bones in %s\n", bone_ids[i], num_bones, path);
+		fclose(file);
+		release();
+		return false;
+	}
+
+	parent       = Alloc(uint, num_bones);
+	bind_pose    = Alloc(Transform, num_bones);
+	inverse_bind = Alloc(mat4, num_bones);
+
+	for (uint i = 0; i < num_bones; i++)
+	{
+		int p = -1;
+		fread(&p, sizeof(int), 1, file);
+		fread(&bind_pose[i], sizeof(Transform), 1, file);
+		fread(&inverse_bind[i], sizeof(mat4), 1, file);
+		parent[i] = (p >= 0 && (uint)p < i) ? p + 1 : 0; // a parent after its child would break the single pass hierarchy walk
+	}
+
+	for (uint i = 0; i < num_clips; i++)
+	{
+		AnimationClip* clip = &clips[i];
+		fread(clip->name, 1, MAX_ANIMATION_NAME, file);
+		fread(&clip->num_frames, sizeof(uint), 1, file);
+		fread(&clip->frames_per_second, sizeof(float), 1, file);
+		clip->name[MAX_ANIMATION_NAME - 1] = 0;
+
+		if (!clip->num_frames || !(clip->frames_per_second > 0)) // sample_clip() divides by both
+		{
+			print("clip [%d] in %s has no frames\n", i, path);
+			num_clips = i; // only the ones before it have poses to free
+			fclose(file);
+			release();
+			return false;
+		}
+
+		clip->poses = Alloc(Transform, clip->num_frames * num_bones);
+		fread(clip->poses, sizeof(Transform), clip->num_frames * num_bones, file);
+	}
+
+	bool complete = !feof(file) && !ferror(file);
+	fclose(file);
+
+	if (!complete) { print("animated mesh file is truncated: %s\n", path); release(); return false; }
+	return true;
+}
+
+bool SkinnedMesh::save(const char* path)
+{
+	FILETYPE type = get_filetype((char*)path);
+	if (type != MESH_ANIM && type != MESH_ANIM_UV) { print("not an animated mesh: %s\n", path); return false; }
+
+	FILE* file = fopen(path, "wb");
+	if (!file) { print("could not write animated mesh file: %s\n", path); return false; }
+
+	fwrite(&num_vertices, sizeof(uint), 1, file);
+	fwrite(&num_indices , sizeof(uint), 1, file);
+	fwrite(positions, sizeof(vec3), num_vertices, file);
+	fwrite(normals  , sizeof(vec3), num_vertices, file);
+	if (type == MESH_ANIM_UV) fwrite(uvs, sizeof(vec2), num_vertices, file);
+	fwrite(indices     , sizeof(uint), num_indices     , file);
+	fwrite(bone_ids    , sizeof(byte), num_vertices * 4, file);
+	fwrite(bone_weights, sizeof(vec4), num_vertices    , file);
+
+	fwrite(&num_bones, sizeof(uint), 1, file);
+	fwrite(&num_clips, sizeof(uint), 1, file);
+
+	for (uint i = 0; i < num_bones; i++)
+	{
+		int p = (int)parent[i] - 1;
+		fwrite(&p, sizeof(int), 1, file);
+		fwrite(&bind_pose[i], sizeof(Transform), 1, file);
+		fwrite(&inverse_bind[i], sizeof(mat4), 1, file);
+	}
+
+	for (uint i = 0; i < num_clips; i++)
+	{
+		fwrite(clips[i].name, 1, MAX_ANIMATION_NAME, file);
+		fwrite(&clips[i].num_frames, sizeof(uint), 1, file);
+		fwrite(&clips[i].frames_per_second, sizeof(float), 1, file);
+		fwrite(clips[i].poses, sizeof(Transform), clips[i].num_frames * num_bones, file);
+	}
+
+	bool written = !ferror(file);
+	fclose(file);
+	return written;
+}
+
+void SkinnedMesh::release()
+{
+	free(positions); free(normals); free(uvs); free(indices);
+	free(bone_ids); free(bone_weights);
+	free(parent); free(bind_pose); free(inverse_bind);
+	for (uint i = 0; i < num_clips; i++) free(clips[i].poses);
+	*this = {};
+}
+
+uint SkinnedMesh::find_clip(const char* name)
+{
+	for (uint i = 0; i < num_clips; i++) if (!strcmp(clips[i].name, name)) return i + 1;
+	return 0;
+}
+
+// local pose at a time in seconds, looping. clip 0 = the bind pose
+void sample_clip(const SkinnedMesh* mesh, uint clip_id, float time, Transform* pose)
+{
+	if (!clip_id) { memcpy(pose, mesh->bind_pose, mesh->num_bones * sizeof(Transform)); return; }
+
+	const AnimationClip* clip = &mesh->clips[clip_id - 1];
+	float frame = time * clip->frames_per_second;
+	frame -= floorf(frame / clip->num_frames) * clip->num_frames;
+
+	uint a = glm::min((uint)frame, clip->num_frames - 1), b = (a + 1) % clip->num_frames;
+	nlerp(mesh->num_bones, clip->poses + a * mesh->num_bones, clip->poses + b * mesh->num_bones, frame - a, pose);
+}
+
+// local pose -> palette, parents before children so it's one pass
+void build_palette(const SkinnedMesh* mesh, Transform* pose, mat4* palette)
+{
+	for (uint i = 0; i < mesh->num_bones; i++)
+	{
+		if (mesh->parent[i]) pose[i] = mul(pose[mesh->parent[i] - 1], pose[i]);
+		mul(trs(pose[i]), mesh->inverse_bind[i], &palette[i]);
+	}
+}
+
+// linear blend skinning : the 4 bone matrices are blended first, then applied once to position & normal
+void skin_vertices(const SkinnedMesh* mesh, const mat4* palette, AnimatedVertex* output)
+{
+	for (uint v = 0; v < mesh->num_vertices; v++)
+	{
+		const byte* bones = mesh->bone_ids + v * 4;
+		const vec4& weights = mesh->bone_weights[v];
+
+		__m128 c0 = _mm_setzero_ps(), c1 = _mm_setzero_ps(), c2 = _mm_setzero_ps(), c3 = _mm_setzero_ps();
+		for (uint k = 0; k < 4; k++)
+		{
+			if (weights[k] == 0) continue; // most vertices only use 1 or 2 bones
+			__m128 w = _mm_set1_ps(weights[k]);
+			const mat4& m = palette[bones[k]];
+			c0 = _mm_add_ps(c0, _mm_mul_ps(_mm_loadu_ps(&m[0][0]), w));
+			c1 = _mm_add_ps(c1, _mm_mul_ps(_mm_loadu_ps(&m[1][0]), w));
+			c2 = _mm_add_ps(c2, _mm_mul_ps(_mm_loadu_ps(&m[2][0]), w));
+			c3 = _mm_add_ps(c3, _mm_mul_ps(_mm_loadu_ps(&m[3][0]), w));
+		}
+
+		vec3 p = mesh->positions[v], n = mesh->normals[v];
+
+		__m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(p.x)), _mm_mul_ps(c1, _mm_set1_ps(p.y))),
+		                             _mm_add_ps(_mm_mul_ps(c2, _mm_set1_ps(p.z)), c3));
+		__m128 normal   = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(n.x)), _mm_mul_ps(c1, _mm_set1_ps(n.y))),
+		                             _mm_mul_ps(c2, _mm_set1_ps(n.z)));
+
+		// normals only get renormalized, fine for rotation & uniform scale
+		__m128 length = _mm_mul_ps(normal, normal);
+		length = _mm_add_ps(_mm_add_ps(_mm_shuffle_ps(length, length, 0), _mm_shuffle_ps(length, length, 0x55)), _mm_shuffle_ps(length, length, 0xAA));
+		normal = _mm_div_ps(normal, _mm_sqrt_ps(_mm_max_ps(length, _mm_set1_ps(1e-12f))));
+
+		// each store spills one float into the next field, which the next store overwrites
+		AnimatedVertex* out = output + v;
+		_mm_storeu_ps(&out->position.x, position);
+		_mm_storeu_ps(&out->normal.x, normal);
+		out->uv = mesh->uvs[v];
+	}
+}
+
+struct Character
+{
+	uint  mesh;           // index + 1
+	uint  clip, next_clip; // index + 1, 0 = bind pose
+	float time, next_time; // seconds into each clip
+	float blend;          // 0 = all clip, 1 = all next_clip
+	float blend_speed;    // per second, 0 = not crossfading
+	Transform world;
+	uint  material;
+	uint  first_vertex;   // in the vertex buffer
+};
+
+struct Animator
+{
+	SkinnedMesh meshes[MAX_SKINNED_MESHES];
+	uint num_meshes, num_indices;
+
+	Character characters[MAX_CHARACTERS];
+	uint num_characters, num_vertices;
+	bool characters_changed;
+
+	GLuint VAO;
+	GLuint vert_buffer, indx_buffer, inst_buffer, matl_buffer, cmds_buffer;
+	uint instance_format;
+
+	void init(uint instance_format = INSTANCE_MAT4);
+	uint add_mesh(const char* path); // .mesh_anim or .mesh_anim_uv, returns index + 1
+	uint add_mesh(SkinnedMesh mesh); // takes ownership
+	uint add_character(uint mesh, Transform world, uint material = 0); // returns index + 1
+	void play(uint character, uint clip, float fade_seconds = .2f);
+	void advance(float dtime); // clip times & crossfades, on the main thread
+	void update(float dtime);  // once per frame : advance, then pose & skin everyone on the work queue
+	void draw(); // during the geometry pass, with the geometry shader bound
+};
+
+void Animator::init(uint format)
+{
+	*this = {};
+	instance_format = format;
+
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &vert_buffer);
+	glGenBuffers(1, &indx_buffer);
+	glGenBuffers(1, &inst_buffer);
+	glGenBuffers(1, &matl_buffer);
+	glGenBuffers(1, &cmds_buffer);
+
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX_SKINNED_VERTICES * sizeof(AnimatedVertex), NULL, GL_STREAM_DRAW);
+
+	// same layout as DrawBuffer meshes : vec3 position, vec3 normal, vec2 uv
+	uint stride = sizeof(AnimatedVertex);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3) * 2));
+	glEnableVertexAttribArray(2);
+
+	// one instance per character : same layout as the DrawBuffer
+	uint instance_stride = (instance_format == INSTANCE_COMPACT) ? sizeof(CompactInstance) : sizeof(mat4);
+
+	glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX_CHARACTERS * instance_stride, NULL, GL_DYNAMIC_DRAW);
+
+	if (instance_format == INSTANCE_COMPACT)
+	{
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, instance_stride, (void*)0);
+		glVertexAttribPointer(4, 4, GL_SHORT, GL_TRUE , instance_stride, (void*)(sizeof(vec4)));
+		for (uint i = 3; i < 5; i++)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+	}
+	else for (uint i = 3; i < 7; i++)
+	{
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(sizeof(vec4) * (i - 3)));
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX_CHARACTERS * sizeof(uint), NULL, GL_DYNAMIC_DRAW);
+	glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(uint), (void*)0);
+	glEnableVertexAttribArray(7);
+	glVertexAttribDivisor(7, 1);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_SKINNED_INDICES * sizeof(uint), NULL, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_CHARACTERS * 5 * sizeof(uint), NULL, GL_DYNAMIC_DRAW);
+
+	glBindVertexArray(0);
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init Animator | Max Characters : [%d]", MAX_CHARACTERS);
+	console->add_entry(msg, SUCCESS, RNDR);
+}
+
+uint Animator::add_mesh(const char* path)
+{
+	SkinnedMesh mesh = {};
+	if (!mesh.load(path)) return 0;
+	return add_mesh(mesh);
+}
+
+uint Animator::add_mesh(SkinnedMesh mesh)
+{
+	if (num_meshes == MAX_SKINNED_MESHES) { out("ERROR : max skinned meshes exceeded!"); stop; mesh.release(); return 0; }
+	if (num_indices + mesh.num_indices > MAX_SKINNED_INDICES) { out("ERROR : skinned index buffer is full!"); mesh.release(); return 0; }
+
+	// indices are relative to the mesh, each character's base vertex does the rest
+	mesh.first_index = num_indices;
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(uint), mesh.num_indices * sizeof(uint), mesh.indices);
+	num_indices += mesh.num_indices;
+	meshes[num_meshes] = mesh;
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Add Skinned Mesh | Bones : [%d], Clips : [%d]", mesh.num_bones, mesh.num_clips);
+	console->add_entry(msg, SUCCESS, RNDR);
+
+	return ++num_meshes;
+}
+
+uint Animator::add_character(uint mesh, Transform world, uint material)
+{
+	if (!mesh || mesh > num_meshes) { out("ERROR : no such skinned mesh!"); return 0; }
+	if (num_characters == MAX_CHARACTERS) { out("ERROR : max characters exceeded!"); stop; return 0; }
+
+	uint vertices = meshes[mesh - 1].num_vertices;
+	if (num_vertices + vertices > MAX_SKINNED_VERTICES) { out("ERROR : skinned vertex buffer is full!"); return 0; }
+
+	Character* c = &characters[num_characters];
+	*c = {};
+	c->mesh         = mesh;
+	c->world        = world;
+	c->material     = material;
+	c->first_vertex = num_vertices;
+
+	num_vertices += vertices;
+	characters_changed = true;
+	return ++num_characters;
+}
+
+void Animator::play(uint character, uint clip, float fade_seconds)
+{
+	Character* c = &characters[character - 1];
+	if (fade_seconds <= 0) { c->clip = clip; c->time = 0; c->blend = 0; c->blend_speed = 0; return; }
+
+	c->next_clip   = clip;
+	c->next_time   = 0;
+	c->blend       = 0;
+	c->blend_speed = 1 / fade_seconds;
+}
+
+void Animator::advance(float dtime)
+{
+	for (uint i = 0; i < num_characters; i++)
+	{
+		Character* c = &characters[i];
+		c->time += dtime;
+		if (!c->blend_speed) continue;
+
+		c->next_time += dtime;
+		c->blend += c->blend_speed * dtime;
+		if (c->blend < 1) continue;
+
+		// crossfade's done
+		c->clip        = c->next_clip;
+		c->time        = c->next_time;
+		c->blend       = 0;
+		c->blend_speed = 0;
+	}
+}
+
+// the whole per character pipeline, runs on the workers
+void animate_characters(Animator* animator, uint begin, uint end, AnimatedVertex* vertices)
+{
+	Transform pose[MAX_BONES], next_pose[MAX_BONES];
+	mat4 palette[MAX_BONES];
+
+	for (uint i = begin; i < end; i++)
+	{
+		Character* c = &animator->characters[i];
+		const SkinnedMesh* mesh = &animator->meshes[c->mesh - 1];
+
+		sample_clip(mesh, c->clip, c->time, pose);
+		if (c->blend > 0)
+		{
+			sample_clip(mesh, c->next_clip, c->next_time, next_pose);
+			nlerp(mesh->num_bones, pose, next_pose, c->blend, pose);
+		}
+
+		build_palette(mesh, pose, palette);
+		skin_vertices(mesh, palette, vertices + c->first_vertex);
+	}
+}
+
+void Animator::update(float dtime)
+{
+	advance(dtime);
+	if (!num_characters) return;
+
+	// workers write straight into the mapped buffer
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	AnimatedVertex* vertices = (AnimatedVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, num_vertices * sizeof(AnimatedVertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!vertices) { out("ERROR : could not map the skinned vertex buffer!"); return; }
+
+	struct Params {
+		Animator* animator;
+		AnimatedVertex* vertices;
+	} params = { this, vertices };
+
+	const auto animate = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		animate_characters(p->animator, begin, end, p->vertices);
+	};
+
+	parallel_for(num_characters, 8, animate, &params);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	// world transforms can change any time, so they go up every frame
+	glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+	if (instance_format == INSTANCE_COMPACT)
+	{
+		CompactInstance* packed = (CompactInstance*)glMapBufferRange(GL_ARRAY_BUFFER, 0, num_characters * sizeof(CompactInstance), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+
+		InstancePacker packer;
+		packer.output = packed;
+		packer.count  = 0;
+		for (uint i = 0; i < num_characters; i++)
+		{
+			const Transform& t = characters[i].world;
+			packer.add(i, t.position, t.rotation, t.scale.x); // compact instances only scale uniformly
+		}
+		packer.flush();
+
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+	else
+	{
+		mat4* models = (mat4*)glMapBufferRange(GL_ARRAY_BUFFER, 0, num_characters * sizeof(mat4), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		for (uint i = 0; i < num_characters; i++) models[i] = trs(characters[i].world);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	if (!characters_changed) return;
+
+	// materials & draw commands only change when characters are added
+	uint* materials = Alloc(uint, num_characters);
+	uint* commands  = Alloc(uint, num_characters * 5);
+	for (uint i = 0; i < num_characters; i++)
+	{
+		const SkinnedMesh* mesh = &meshes[characters[i].mesh - 1];
+		materials[i] = characters[i].material;
+
+		uint* cmd = commands + i * 5;
+		cmd[0] = mesh->num_indices;
+		cmd[1] = 1;
+		cmd[2] = mesh->first_index;
+		cmd[3] = characters[i].first_vertex;
+		cmd[4] = i; // base instance
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, num_characters * sizeof(uint), materials);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, num_characters * 5 * sizeof(uint), commands);
+
+	free(materials);
+	free(commands);
+	characters_changed = false;
+}
+
+void Animator::draw()
+{
+	if (!num_characters) return;
+
+	glBindVertexArray(VAO);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, num_characters, 0);
+}
+
+// a tube bent by a chain of bones, 2 clips. for the benchmark & as a format example
+void generate_skinned_tube(SkinnedMesh* mesh, uint num_bones, uint rings_per_bone, uint segments)
+{
+	*mesh = {};
+
+	uint rings = num_bones * rings_per_bone + 1;
+	mesh->num_vertices = rings * segments;
+	mesh->num_indices  = (rings - 1) * segments * 6;
+	mesh->num_bones    = num_bones;
+
+	mesh->positions    = Alloc(vec3, mesh->num_vertices);
+	mesh->normals      = Alloc(vec3, mesh->num_vertices);
+	mesh->uvs          = Alloc(vec2, mesh->num_vertices);
+	mesh->indices      = Alloc(uint, mesh->num_indices);
+	mesh->bone_ids     = Alloc(byte, mesh->num_vertices * 4);
+	mesh->bone_weights = Alloc(vec4, mesh->num_vertices);
+	mesh->parent       = Alloc(uint, num_bones);
+	mesh->bind_pose    = Alloc(Transform, num_bones);
+	mesh->inverse_bind = Alloc(mat4, num_bones);
+
+	const float BONE_LENGTH = 1;
+
+	// straight up the y axis, each bone one unit above its parent
+	for (uint b = 0; b < num_bones; b++)
+	{
+		mesh->parent[b]       = b; // the previous bone, index + 1
+		mesh->bind_pose[b]    = transform(vec3(0, b ? BONE_LENGTH : 0, 0));
+		mesh->inverse_bind[b] = glm::translate(mat4(1), vec3(0, -(float)b * BONE_LENGTH, 0));
+	}
+
+	for (uint r = 0; r < rings; r++)
+	for (uint s = 0; s < segments; s++)
+	{
+		uint v = r * segments + s;
+		float y = r * BONE_LENGTH / rings_per_bone, angle = TWOPI * s / segments;
+
+		mesh->normals[v]   = vec3(cosf(angle), 0, sinf(angle));
+		mesh->positions[v] = mesh->normals[v] * .3f + vec3(0, y, 0);
+		mesh->uvs[v]       = vec2(s / (float)segments, y / (num_bones * BONE_LENGTH));
+
+		// blend between the 2 nearest bones
+		float along = glm::clamp(y / BONE_LENGTH - .5f, 0.f, num_bones - 1.f);
+		uint a = (uint)along, b = glm::min(a + 1, num_bones - 1);
+		float w = along - a;
+		byte ids[4] = { (byte)a, (byte)b, 0, 0 };
+		memcpy(mesh->bone_ids + v * 4, ids, 4);
+		mesh->bone_weights[v] = vec4(1 - w, w, 0, 0);
+	}
+
+	uint n = 0;
+	for (uint r = 0; r < rings - 1; r++)
+	for (uint s = 0; s < segments; s++)
+	{
+		uint a = r * segments + s, b = r * segments + (s + 1) % segments, c = a + segments, d = b + segments;
+		uint quad[6] = { a, c, b, b, c, d };
+		memcpy(mesh->indices + n, quad, sizeof(quad));
+		n += 6;
+	}
+
+	// "sway" bends every joint the same way, "twist" rolls them
+	const char* names[] = { "sway", "twist" };
+	mesh->num_clips = 2;
+	for (uint i = 0; i < 2; i++)
+	{
+		AnimationClip* clip = &mesh->clips[i];
+		strcpy(clip->name, names[i]);
+		clip->num_frames        = 30;
+		clip->frames_per_second = 30;
+		clip->poses             = Alloc(Transform, clip->num_frames * num_bones);
+
+		for (uint f = 0; f < clip->num_frames; f++)
+		for (uint b = 0; b < num_bones; b++)
+		{
+			float phase = TWOPI * f / clip->num_frames;
+			vec3 axis = i ? vec3(0, 1, 0) : vec3(0, 0, 1);
+			quat rotation = glm::angleAxis(.15f * sinf(phase + b * .3f), axis);
+			clip->poses[f * num_bones + b] = transform(mesh->bind_pose[b].position, rotation);
+		}
+	}
+}
+
+// the cpu side of a frame, without gl : 2 clips blended, hierarchy, palettes & skinning
+void animation_benchmark()
+{
+	const uint NUM_CHARACTERS = 2000;
+	const uint NUM_FRAMES     = 30;
+
+	Animator* animator = Alloc(Animator, 1);
+	generate_skinned_tube(&animator->meshes[0], 64, 4, 8); // 64 bones, ~2k vertices
+	animator->num_meshes = 1;
+
+	// round trip through the file format
+	SkinnedMesh* mesh = &animator->meshes[0];
+	if (mesh->save("skinned_tube.mesh_anim_uv"))
+	{
+		SkinnedMesh loaded = {};
+		bool same = loaded.load("skinned_tube.mesh_anim_uv") && loaded.num_vertices == mesh->num_vertices && loaded.num_clips == mesh->num_clips
+			&& !memcmp(loaded.clips[1].poses, mesh->clips[1].poses, mesh->num_bones * mesh->clips[1].num_frames * sizeof(Transform))
+			&& !memcmp(loaded.parent, mesh->parent, mesh->num_bones * sizeof(uint));
+		print(" .mesh_anim_uv round trip : %s\n", same ? "ok" : "FAILED");
+		loaded.release();
+		remove("skinned_tube.mesh_anim_uv");
+	}
+
+	for (uint i = 0; i < NUM_CHARACTERS; i++)
+	{
+		Character* c = &animator->characters[animator->num_characters++];
+		c->mesh = 1;
+		c->clip = 1 + (i & 1);
+		c->time = i * .01f;
+		c->first_vertex = animator->num_vertices;
+		animator->num_vertices += mesh->num_vertices;
+		if (i % 3 == 0) { c->next_clip = 2 - (i & 1); c->blend_speed = .5f; } // a third of them crossfading
+	}
+
+	AnimatedVertex* vertices = Alloc(AnimatedVertex, animator->num_vertices);
+
+	struct Params {
+		Animator* animator;
+		AnimatedVertex* vertices;
+	} params = { animator, vertices };
+
+	const auto animate = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		animate_characters(p->animator, begin, end, p->vertices);
+	};
+
+	Timer timer = {};
+	timer.init();
+
+	// palettes alone, on this thread
+	Transform pose[MAX_BONES];
+	mat4 palette[MAX_BONES];
+	timer.start();
+	for (uint frame = 0; frame < NUM_FRAMES; frame++)
+	for (uint i = 0; i < NUM_CHARACTERS; i++)
+	{
+		sample_clip(mesh, animator->characters[i].clip, animator->characters[i].time + frame / 60.f, pose);
+		build_palette(mesh, pose, palette);
+	}
+	int64 palettes = timer.microseconds_elapsed();
+
+	timer.start();
+	for (uint frame = 0; frame < NUM_FRAMES; frame++)
+	{
+		animator->advance(1 / 60.f);
+		parallel_for(animator->num_characters, 8, animate, &params);
+	}
+	int64 total = timer.microseconds_elapsed();
+
+	// the bind pose has to come back out unchanged
+	sample_clip(mesh, 0, 0, pose);
+	build_palette(mesh, pose, palette);
+	skin_vertices(mesh, palette, vertices);
+	float error = 0;
+	for (uint v = 0; v < mesh->num_vertices; v++) error = glm::max(error, glm::length(vertices[v].position - mesh->positions[v]));
+
+	print(" %u characters, %u bones, %u vertices each\n", NUM_CHARACTERS, mesh->num_bones, mesh->num_vertices);
+	print(" palettes only (1 thread) : %.2f ms per frame\n", palettes / 1000.f / NUM_FRAMES);
+	print(" palettes + skinning      : %.2f ms per frame\n", total / 1000.f / NUM_FRAMES);
+	print(" bind pose error          : %g\n", error);
+
+	free(vertices);
+	mesh->release();
+}
@@ -0,0 +1,1056 @@
+#include "codec.h"
+
+/* Audio : OpenAL on its own thread, the game only ever posts commands
+
+	- the audio thread owns every source & buffer. game threads fill in a command & push it
+	  onto a lock-free queue (a NetSharedQueue, any number of producers), nobody ever waits on anybody
+	- a fixed pool of sources, made up front. a sound that wants one while they're all busy takes the one
+	  playing the least important sound (the oldest of those on a tie), or gets dropped if everything playing matters more
+	- short sounds are loaded whole into one buffer. long ones (music, ambience) stream : a few small buffers
+	  are queued on the source & refilled as it finishes with them, nothing loads a whole track
+	- every .audio file is memory mapped, loading one doesn't read it. the audio thread reads it from the mapping
+	  when it needs it, the OS pages in what gets touched
+	- playing a sound allocates nothing : the command is copied into the queue, the source already exists
+	  & streams read into one staging buffer they all share
+	- AUDIO_SOFTWARE mixes every voice on the audio thread instead (mixer.h) & plays the result
+	  through one streaming source : more voices, buses with a low-pass & reverb sends.
+	  streams fill a float ring ahead of their voice instead of AL buffers, topped up before every block
+	- AUDIO_NULL is the same mixer with no device at all, kept at real time by the clock.
+	  everything behaves like it does with a sound card, for tests & machines without one
+	- .audio files can be IMA ADPCM (codec.h), a quarter of the size. with the mixer, loaded ones stay
+	  compressed in their mapping & every voice decodes its own into a ring as it plays.
+	  AL only takes PCM, so with AUDIO_OPENAL they get decoded once into their buffer.
+	  compress_audio_file() turns a 16 bit one into one of these
+
+	-- how 2 play a sound --
+
+	Audio boom  = window->audio.load("assets/audio/boom.audio");
+	Audio theme = window->audio.open_stream("assets/audio/theme.audio");
+
+	window->audio.play(theme, .5f, AUDIO_PRIORITY_MUSIC, AUDIO_LOOP);
+	uint id = window->audio.play_at(boom, position);
+	window->audio.stop_sound(id);
+
+	window->audio.play(boom, 1, AUDIO_PRIORITY_NORMAL, 0, 1, AUDIO_BUS_SFX); // buses only matter to the mixer
+	window->audio.set_bus(AUDIO_BUS_MUSIC, .5f, 2000); // muffled, like under water
+
+	.audio files : uint format (AL_FORMAT_* or AUDIO_FORMAT_ADPCM_*), uint sample_rate, uint size,
+	then size bytes of PCM or ADPCM blocks
+*/
+
+#define AUDIO_MAX_VOICES     32   // sources made up front, fewer if the device won't give that many
+#define AUDIO_MAX_SOUNDS     1024 // loaded & streamed ones
+#define AUDIO_MAX_STREAMS    4    // playing at once with AUDIO_OPENAL, the mixer gives every voice one
+#define AUDIO_STREAM_BUFFERS 4    // queued per stream
+#define AUDIO_STREAM_CHUNK   (32 * 1024) // bytes per stream buffer, ~190 ms of 16 bit stereo at 44.1 kHz
+#define AUDIO_QUEUE_SIZE     1024 // commands between two updates of the audio thread
+#define AUDIO_UPDATE_MS      4    // the audio thread refills streams & reaps voices this often
+#define AUDIO_HEADER_SIZE    (3 * sizeof(uint))
+
+#define AUDIO_OUTPUT_RATE    48000 // the mixer's
+#define AUDIO_OUTPUT_BUFFERS 4     // queued on the mixer's source
+#define AUDIO_OUTPUT_BLOCKS  4     // mixer blocks per output buffer, ~21 ms
+#define AUDIO_RING_FRAMES    2048  // a voice's ring with the mixer, 8 blocks at twice the pitch
+
+enum AUDIO_MODE {
+	AUDIO_OPENAL = 0, // a source per voice
+	AUDIO_SOFTWARE,   // mixed on the audio thread, one source
+	AUDIO_NULL        // mixed on the audio thread, no device
+};
+
+// the mixer's bus graph. a bus only feeds buses made before it, so the reverb comes first
+#define AUDIO_BUS_MASTER 0
+#define AUDIO_BUS_REVERB 1
+#define AUDIO_BUS_MUSIC  2
+#define AUDIO_BUS_SFX    3
+
+// who gets a source when there aren't enough
+#define AUDIO_PRIORITY_LOW    64
+#define AUDIO_PRIORITY_NORMAL 128
+#define AUDIO_PRIORITY_HIGH   192
+#define AUDIO_PRIORITY_MUSIC  255
+
+#define AUDIO_LOOP       1
+#define AUDIO_POSITIONAL 2 // play_at() sets this, everything else is relative to the listener
+
+typedef uint Audio; // a loaded or streamed sound, 0 = nothing
+
+enum AUDIO_COMMAND {
+	AUDIO_CMD_LOAD = 0,
+	AUDIO_CMD_PLAY,
+	AUDIO_CMD_STOP,
+	AUDIO_CMD_GAIN,
+	AUDIO_CMD_POSITION,
+	AUDIO_CMD_LISTENER,
+	AUDIO_CMD_BUS
+};
+
+struct AudioCommand
+{
+	byte type, priority, flags, bus;
+	Audio sound;
+	uint play_id;
+	float gain, pitch;
+	vec3 position, front, up; // front & up are only for the listener
+	float lowpass, send; // AUDIO_CMD_BUS
+};
+
+struct SoundAsset
+{
+	ALuint buffer; // audio thread, 0 for streamed ones
+	uint format, sample_rate, size; // size of the data, in bytes
+	uint num_frames;
+	bool streamed;
+	MappedFile file; // the audio thread unmaps it once it has its own copy
+	const byte* data; // into the mapping, past the header. NULL once it's unmapped
+	MixerSound pcm; // audio thread, what the mixer plays of loaded PCM ones
+};
+
+struct AudioStream
+{
+	ALuint buffers[AUDIO_STREAM_BUFFERS];
+	Audio sound; // 0 = free
+	AdpcmDecoder cursor; // the next frame to read, & where the decoder is with ADPCM
+	MixerSound ring; // with the mixer : a loop the voice plays, refilled ahead of it
+	uint64 written; // frames into the ring so far
+};
+
+struct AudioVoice
+{
+	ALuint source;
+	uint play_id; // 0 = free
+	Audio sound;
+	byte priority, flags;
+	int stream; // -1 = the sound is in one buffer
+};
+
+// written by the audio thread, anyone can read them
+struct AudioStats
+{
+	volatile uint playing, streaming;
+	volatile uint64 played, stolen, dropped, underruns;
+	volatile uint64 blocks, mix_us, decode_us; // the mixer's
+	volatile uint64 loaded, resident; // sounds, & bytes of them the audio thread keeps (PCM, floats or still compressed)
+	volatile float peak; // loudest sample out of the mixer so far
+};
+
+struct AudioSystem
+{
+	uint mode; // AUDIO_MODE
+	ALCdevice* device;
+	ALCcontext* context;
+	net_thread thread;
+	volatile long running;
+
+	NetSharedQueue<AudioCommand> commands; // game threads -> audio thread
+
+	// main thread, the sounds are only read after they're loaded
+	SoundAsset* sounds;
+	uint num_sounds;
+
+	// any game thread
+	volatile long next_play_id;
+	volatile long dropped_commands; // the queue was full
+
+	// audio thread
+	AudioVoice voices[MIXER_MAX_VOICES]; // AUDIO_MAX_VOICES of them with a source each
+	uint num_voices;
+	AudioStream streams[MIXER_MAX_VOICES];
+	uint num_streams; // AUDIO_MAX_STREAMS, or one per voice with the mixer
+	byte* staging; // one stream chunk
+	AudioStats stats;
+
+	// the mixer's, not with AUDIO_OPENAL
+	Mixer* mixer;
+	ALuint output_source, output_buffers[AUDIO_OUTPUT_BUFFERS];
+	int16* output; // one output buffer
+	Timer clock;
+	double next_block_us; // AUDIO_NULL
+
+	bool init(uint mode = AUDIO_OPENAL); // false = no sound card, everything after that does nothing
+	void shutdown();
+
+	// WARNING : only call these from the main thread!
+	Audio load(const char* path);        // maps the file, the audio thread reads it into a buffer (or not at all)
+	Audio open_stream(const char* path); // maps the file, the audio thread reads it while it plays
+	Audio map_sound(const char* path, bool streamed);
+
+	// any thread, once the sound is loaded
+	uint play(Audio sound, float gain = 1, byte priority = AUDIO_PRIORITY_NORMAL, byte flags = 0, float pitch = 1, byte bus = AUDIO_BUS_SFX); // play id, 0 = nothing
+	uint play_at(Audio sound, vec3 position, float gain = 1, byte priority = AUDIO_PRIORITY_NORMAL, byte flags = 0, float pitch = 1, byte bus = AUDIO_BUS_SFX);
+	void stop_sound(uint play_id);
+	void set_gain(uint play_id, float gain);
+	void set_position(uint play_id, vec3 position);
+	void set_listener(const Camera& camera);
+	void set_bus(uint bus, float gain, float lowpass = 0, float reverb_send = 0); // lowpass in hz, 0 = off
+	void post(const AudioCommand& command);
+
+	// audio thread
+	void execute(const AudioCommand& command);
+	void update();
+	AudioVoice* find_voice(uint play_id);
+	bool uses_stream(const SoundAsset& sound);
+	AudioVoice* take_voice(byte priority, bool streamed);
+	void start_voice(AudioVoice* voice, const AudioCommand& command);
+	void stop_voice(AudioVoice* voice);
+	uint read(AudioStream* stream, const SoundAsset& sound, bool loop, uint max_frames); // into staging
+	bool fill(AudioStream* stream, ALuint buffer, const SoundAsset& sound, bool loop);
+	void update_stream(AudioVoice* voice);
+	void fill_ring(AudioVoice* voice);
+	void fill_rings();
+	void mix_block(int16* output);
+	void update_output();
+};
+
+// ------------------- audio thread ---------------- //
+
+NET_THREAD audio_thread(void* param)
+{
+	AudioSystem* audio = (AudioSystem*)param;
+	mixer_flush_denormals(); // the software mixer runs on this thread
+
+	while (audio->running)
+	{
+		AudioCommand command;
+		while (audio->commands.pop(&command)) audio->execute(command);
+
+		audio->update();
+		os_sleep(AUDIO_UPDATE_MS);
+	}
+
+	return 0;
+}
+
+// of what read() puts out, ADPCM decodes to 16 bit
+uint pcm_format(uint format) { return is_adpcm(format) ? (format == AUDIO_FORMAT_ADPCM_STEREO ? AL_FORMAT_STEREO16 : AL_FORMAT_MONO16) : format; }
+uint pcm_channels(uint format) { format = pcm_format(format); return format == AL_FORMAT_STEREO8 || format == AL_FORMAT_STEREO16 ? 2 : 1; }
+uint pcm_frame_size(uint format) { return pcm_channels(format) * (format == AL_FORMAT_MONO8 || format == AL_FORMAT_STEREO8 ? 1 : 2); }
+
+// 8 or 16 bit AL_FORMAT_* frames into planar float, channel c starts at planes + c * stride
+void pcm_to_planar(uint format, const byte* data, uint num_frames, float* planes, uint stride)
+{
+	uint channels = pcm_channels(format);
+	bool wide = pcm_frame_size(format) == channels * 2;
+
+	for (uint c = 0; c < channels; c++)
+	{
+		float* plane = planes + c * stride;
+		if (wide) for (uint i = 0; i < num_frames; i++) plane[i] = ((const int16*)data)[i * channels + c] * (1.f / 32768);
+		else      for (uint i = 0; i < num_frames; i++) plane[i] = (data[i * channels + c] - 128) * (1.f / 128);
+	}
+}
+
+void AudioSystem::execute(const AudioCommand& command)
+{
+	uint index = 0; // of the voice, for the mixer
+	AudioVoice* voice = command.play_id ? find_voice(command.play_id) : NULL;
+	if (voice) index = (uint)(voice - voices);
+
+	switch (command.type)
+	{
+	case AUDIO_CMD_LOAD:
+	{
+		SoundAsset& sound = sounds[command.sound];
+		uint channels = pcm_channels(sound.format), frame_size = pcm_frame_size(sound.format);
+
+		if (mode == AUDIO_OPENAL)
+		{
+			const byte* pcm = sound.data;
+			byte* decoded = NULL;
+			if (is_adpcm(sound.format))
+			{
+				AdpcmDecoder decoder = {};
+				pcm = decoded = Alloc(byte, sound.num_frames * frame_size);
+				adpcm_decode(sound.data, sound.size, channels, &decoder, (int16*)decoded, sound.num_frames);
+			}
+
+			alGenBuffers(1, &sound.buffer);
+			alBufferData(sound.buffer, pcm_format(sound.format), pcm, sound.num_frames * frame_size, sound.sample_rate);
+			stats.resident += sound.num_frames * frame_size;
+
+			free(decoded);
+			unmap_file(&sound.file);
+			sound.data = NULL;
+		}
+		else if (is_adpcm(sound.format)) stats.resident += sound.size; // stays mapped, voices decode it as they play
+		else
+		{
+			sound.pcm = make_mixer_sound(NULL, sound.num_frames, channels, sound.sample_rate);
+			pcm_to_planar(sound.format, sound.data, sound.num_frames, sound.pcm.samples, sound.num_frames + MIXER_PAD);
+			stats.resident += (sound.num_frames + MIXER_PAD) * channels * sizeof(float);
+
+			unmap_file(&sound.file);
+			sound.data = NULL;
+		}
+
+		stats.loaded++;
+	} break;
+	case AUDIO_CMD_PLAY:
+	{
+		AudioVoice* voice = take_voice(command.priority, uses_stream(sounds[command.sound]));
+		if (voice) start_voice(voice, command);
+		else stats.dropped++;
+	} break;
+	case AUDIO_CMD_STOP:
+		if (voice) stop_voice(voice);
+		break;
+	case AUDIO_CMD_GAIN:
+		if (!voice) break;
+		if (mode == AUDIO_OPENAL) alSourcef(voice->source, AL_GAIN, command.gain);
+		else mixer->voices[index].gain = command.gain;
+		break;
+	case AUDIO_CMD_POSITION:
+		if (!voice) break;
+		if (mode == AUDIO_OPENAL) alSource3f(voice->source, AL_POSITION, command.position.x, command.position.y, command.position.z);
+		else mixer->voices[index].position = command.position;
+		break;
+	case AUDIO_CMD_LISTENER:
+	{
+		if (mode != AUDIO_OPENAL) { mixer->set_listener(command.position, command.front, command.up); break; }
+
+		float orientation[6] = { command.front.x, command.front.y, command.front.z, command.up.x, command.up.y, command.up.z };
+		alListener3f(AL_POSITION, command.position.x, command.position.y, command.position.z);
+		alListenerfv(AL_ORIENTATION, orientation);
+	} break;
+	case AUDIO_CMD_BUS:
+		if (!mixer || command.bus >= mixer->num_buses) break;
+		mixer->buses[command.bus].gain = command.gain;
+		mixer->set_lowpass(command.bus, command.lowpass);
+		mixer->set_send(command.bus, AUDIO_BUS_REVERB, command.send);
+		break;
+	}
+}
+
+// lets go of everything that finished & keeps the streams fed
+void AudioSystem::update()
+{
+	uint playing = 0, streaming = 0;
+
+	for (uint i = 0; i < num_voices; i++)
+	{
+		AudioVoice* voice = &voices[i];
+		if (!voice->play_id) continue;
+
+		if (mode != AUDIO_OPENAL)
+		{
+			if (!mixer->voices[i].sound) stop_voice(voice); // its ring gets topped up by mix_block()
+		}
+		else if (voice->stream >= 0) update_stream(voice);
+		else
+		{
+			ALint state = 0;
+			alGetSourcei(voice->source, AL_SOURCE_STATE, &state);
+			if (state == AL_STOPPED) stop_voice(voice);
+		}
+
+		if (voice->play_id) { playing++; streaming += voice->stream >= 0; }
+	}
+
+	stats.playing   = playing;
+	stats.streaming = streaming;
+
+	if (mode != AUDIO_OPENAL) update_output();
+}
+
+AudioVoice* AudioSystem::find_voice(uint play_id)
+{
+	for (uint i = 0; i < num_voices; i++) if (voices[i].play_id == play_id) return &voices[i];
+	return NULL;
+}
+
+// streamed ones, & with the mixer ADPCM ones too : they stay in the mapping & get decoded while they play
+bool AudioSystem::uses_stream(const SoundAsset& sound) { return sound.streamed || (mode != AUDIO_OPENAL && is_adpcm(sound.format)); }
+
+// a free voice, or the least important one playing if it doesn't matter more than this
+AudioVoice* AudioSystem::take_voice(byte priority, bool streamed)
+{
+	bool stream_free = !streamed || mode != AUDIO_OPENAL; // the mixer gives every voice a stream
+	for (uint s = 0; s < num_streams && !stream_free; s++) stream_free = !streams[s].sound;
+
+	AudioVoice* victim = NULL;
+	for (uint i = 0; i < num_voices; i++)
+	{
+		AudioVoice* voice = &voices[i];
+		if (!stream_free && voice->stream < 0) continue; // only stopping a stream makes room for another
+
+		if (!voice->play_id) return voice;
+		if (!victim || voice->priority < victim->priority || (voice->priority == victim->priority && voice->play_id < victim->play_id)) victim = voice;
+	}
+
+	if (!victim || victim->priority > priority) return NULL;
+
+	stop_voice(victim);
+	stats.stolen++;
+	return victim;
+}
+
+void AudioSystem::start_voice(AudioVoice* voice, const AudioCommand& command)
+{
+	const SoundAsset& sound = sounds[command.sound];
+	bool loop = command.flags & AUDIO_LOOP;
+
+	AudioStream* stream = NULL;
+	voice->stream = -1;
+	if (uses_stream(sound))
+	{
+		int s = 0;
+		if (mode != AUDIO_OPENAL) s = (int)(voice - voices); // its own
+		else while (streams[s].sound) s++; // take_voice() made sure there's one
+
+		stream = &streams[s];
+		stream->sound  = command.sound;
+		stream->cursor = {};
+		voice->stream  = s;
+	}
+
+	voice->play_id  = command.play_id;
+	voice->sound    = command.sound;
+	voice->priority = command.priority;
+	voice->flags    = command.flags;
+	stats.played++;
+
+	if (mode != AUDIO_OPENAL)
+	{
+		uint flags = (loop ? MIXER_LOOP : 0) | (command.flags & AUDIO_POSITIONAL ? MIXER_POSITIONAL : 0);
+		const MixerSound* pcm = &sound.pcm;
+		if (stream)
+		{
+			stream->ring.channels    = pcm_channels(sound.format);
+			stream->ring.sample_rate = sound.sample_rate;
+			stream->written = 0;
+			pcm = &stream->ring;
+			flags |= MIXER_LOOP | MIXER_LIMITED; // the ring goes round, the stream decides where it ends
+		}
+
+		mixer->start((uint)(voice - voices), pcm, command.bus, command.gain, command.pitch, flags, command.position);
+		if (stream) fill_ring(voice);
+		return;
+	}
+
+	ALuint source = voice->source;
+	if (stream)
+	{
+		alSourcei(source, AL_BUFFER, 0);
+		alSourcei(source, AL_LOOPING, AL_FALSE); // the loop happens in read()
+		for (uint b = 0; b < AUDIO_STREAM_BUFFERS; b++)
+			if (fill(stream, stream->buffers[b], sound, loop)) alSourceQueueBuffers(source, 1, &stream->buffers[b]);
+	}
+	else
+	{
+		alSourcei(source, AL_BUFFER, sound.buffer);
+		alSourcei(source, AL_LOOPING, loop ? AL_TRUE : AL_FALSE);
+	}
+
+	vec3 position = command.flags & AUDIO_POSITIONAL ? command.position : vec3(0);
+	alSourcei(source, AL_SOURCE_RELATIVE, command.flags & AUDIO_POSITIONAL ? AL_FALSE : AL_TRUE);
+	alSource3f(source, AL_POSITION, position.x, position.y, position.z);
+	alSourcef(source, AL_GAIN, command.gain);
+	alSourcef(source, AL_PITCH, command.pitch);
+	alSourcePlay(source);
+}
+
+void AudioSystem::stop_voice(AudioVoice* voice)
+{
+	if (mode == AUDIO_OPENAL)
+	{
+		alSourceStop(voice->source);
+		alSourcei(voice->source, AL_BUFFER, 0); // detaches the buffer, or unqueues every one of a stream's
+	}
+	else mixer->voices[voice - voices].sound = NULL;
+
+	if (voice->stream >= 0) streams[voice->stream].sound = 0;
+
+	voice->play_id = 0;
+	voice->stream  = -1;
+}
+
+// the next frames of the sound into staging as PCM (pcm_format()), 0 once there's nothing left
+uint AudioSystem::read(AudioStream* stream, const SoundAsset& sound, bool loop, uint max_frames)
+{
+	if (stream->cursor.frame >= sound.num_frames && loop) stream->cursor = {}; // back to the start
+
+	uint frames = (uint)glm::min((uint64)max_frames, sound.num_frames - glm::min(stream->cursor.frame, (uint64)sound.num_frames));
+	if (is_adpcm(sound.format)) return adpcm_decode(sound.data, sound.size, pcm_channels(sound.format), &stream->cursor, (int16*)staging, frames);
+
+	uint frame_size = pcm_frame_size(sound.format);
+	memcpy(staging, sound.data + stream->cursor.frame * frame_size, frames * frame_size);
+	stream->cursor.frame += frames;
+	return frames;
+}
+
+// the next chunk of the sound into buffer, false once there's nothing left
+bool AudioSystem::fill(AudioStream* stream, ALuint buffer, const SoundAsset& sound, bool loop)
+{
+	uint frame_size = pcm_frame_size(sound.format);
+	uint frames = read(stream, sound, loop, AUDIO_STREAM_CHUNK / frame_size);
+	if (!frames) return false;
+
+	alBufferData(buffer, pcm_format(sound.format), staging, frames * frame_size, sound.sample_rate);
+	return true;
+}
+
+void AudioSystem::update_stream(AudioVoice* voice)
+{
+	AudioStream* stream = &streams[voice->stream];
+	const SoundAsset& sound = sounds[voice->sound];
+	ALuint source = voice->source;
+
+	ALint processed = 0;
+	alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+	while (processed-- > 0)
+	{
+		ALuint buffer = 0;
+		alSourceUnqueueBuffers(source, 1, &buffer);
+		if (fill(stream, buffer, sound, voice->flags & AUDIO_LOOP)) alSourceQueueBuffers(source, 1, &buffer);
+	}
+
+	ALint state = 0, queued = 0;
+	alGetSourcei(source, AL_SOURCE_STATE, &state);
+	alGetSourcei(source, AL_BUFFERS_QUEUED, &queued);
+	if (state != AL_STOPPED) return;
+
+	if (queued) { alSourcePlay(source); stats.underruns++; } // it ran dry before the refill, pick up where it stopped
+	else stop_voice(voice); // played out
+}
+
+// with the mixer : tops the ring up to a whole ring ahead of the voice
+void AudioSystem::fill_ring(AudioVoice* voice)
+{
+	AudioStream* stream = &streams[voice->stream];
+	const SoundAsset& sound = sounds[voice->sound];
+	MixerVoice* playing = &mixer->voices[voice - voices];
+	uint frame_size = pcm_frame_size(sound.format);
+
+	while (!(playing->flags & MIXER_LAST))
+	{
+		int64 ahead = glm::max((int64)(stream->written - playing->consumed), (int64)0);
+		uint position = (uint)(stream->written % AUDIO_RING_FRAMES);
+
+		uint free_frames = (uint)(AUDIO_RING_FRAMES - glm::min(ahead, (int64)AUDIO_RING_FRAMES));
+		if (free_frames < MIXER_BLOCK) break; // not worth a read yet
+
+		// up to the end of the ring, the rest goes round to the start
+		uint frames = glm::min(free_frames, AUDIO_RING_FRAMES - position);
+		frames = glm::min(frames, AUDIO_STREAM_CHUNK / frame_size);
+
+		frames = read(stream, sound, voice->flags & AUDIO_LOOP, frames);
+		if (!frames) { playing->flags |= MIXER_LAST; break; } // the voice stops where the ring ends
+
+		pcm_to_planar(pcm_format(sound.format), staging, frames, stream->ring.samples + position, AUDIO_RING_FRAMES + MIXER_PAD);
+		if (position < MIXER_PAD) pad_for_loop(&stream->ring);
+
+		stream->written += frames;
+		playing->limit = stream->written;
+	}
+}
+
+void AudioSystem::fill_rings()
+{
+	for (uint i = 0; i < num_voices; i++) if (voices[i].stream >= 0 && mixer->voices[i].sound) fill_ring(&voices[i]);
+}
+
+// one block of the mixer into output, interleaved 16 bit. the rings get topped up first,
+// so they only ever have to be a block or so ahead
+void AudioSystem::mix_block(int16* output)
+{
+	int64 decode_start = clock.microseconds_elapsed();
+	fill_rings();
+
+	int64 start = clock.microseconds_elapsed();
+	uint64 underruns = mixer->underruns;
+
+	mixer->mix();
+
+	MixerBus* master = &mixer->buses[AUDIO_BUS_MASTER];
+	mixer_to_pcm16(master->left, master->right, output, MIXER_BLOCK);
+
+	float peak = stats.peak;
+	for (uint i = 0; i < MIXER_BLOCK * 2; i++) peak = glm::max(peak, fabsf(master->left[i]));
+
+	stats.peak       = peak;
+	stats.underruns += mixer->underruns - underruns;
+	stats.blocks++;
+	stats.mix_us    += clock.microseconds_elapsed() - start;
+	stats.decode_us += start - decode_start;
+}
+
+// keeps the mixer's source queued up, or the null device on time
+void AudioSystem::update_output()
+{
+	if (mode == AUDIO_NULL)
+	{
+		const double block_us = MIXER_BLOCK * 1000000.0 / AUDIO_OUTPUT_RATE;
+		double now = (double)clock.microseconds_elapsed();
+		if (now - next_block_us > 100000) next_block_us = now; // stalled for a while, don't make it all up at once
+
+		for (; next_block_us <= now; next_block_us += block_us) mix_block(output);
+		return;
+	}
+
+	ALint processed = 0;
+	alGetSourcei(output_source, AL_BUFFERS_PROCESSED, &processed);
+	while (processed-- > 0)
+	{
+		ALuint buffer = 0;
+		alSourceUnqueueBuffers(output_source, 1, &buffer);
+
+		for (uint b = 0; b < AUDIO_OUTPUT_BLOCKS; b++) mix_block(output + b * MIXER_BLOCK * 2);
+		alBufferData(buffer, AL_FORMAT_STEREO16, output, AUDIO_OUTPUT_BLOCKS * MIXER_BLOCK * 2 * sizeof(int16), AUDIO_OUTPUT_RATE);
+		alSourceQueueBuffers(output_source, 1, &buffer);
+	}
+
+	ALint state = 0;
+	alGetSourcei(output_source, AL_SOURCE_STATE, &state);
+	if (state == AL_STOPPED) { alSourcePlay(output_source); stats.underruns++; }
+}
+
+// ------------------- game thread ----------------- //
+
+bool AudioSystem::init(uint mode)
+{
+	*this = {};
+	this->mode = mode;
+
+	if (mode != AUDIO_NULL)
+	{
+		device = alcOpenDevice(NULL);
+		if (!device) return false;
+
+		context = alcCreateContext(device, NULL);
+		if (!context) { alcCloseDevice(device); device = NULL; return false; }
+		alcMakeContextCurrent(context);
+	}
+
+	if (mode == AUDIO_OPENAL)
+	{
+		// as many as the device gives, up to the pool size
+		alGetError();
+		for (num_voices = 0; num_voices < AUDIO_MAX_VOICES; num_voices++)
+		{
+			alGenSources(1, &voices[num_voices].source);
+			if (alGetError() != AL_NO_ERROR) break;
+		}
+		num_streams = AUDIO_MAX_STREAMS;
+		for (uint s = 0; s < num_streams; s++) alGenBuffers(AUDIO_STREAM_BUFFERS, streams[s].buffers);
+	}
+	else
+	{
+		num_voices = MIXER_MAX_VOICES;
+
+		mixer = Alloc(Mixer, 1);
+		mixer->init(AUDIO_OUTPUT_RATE);
+		mixer->add_reverb(AUDIO_BUS_MASTER); // AUDIO_BUS_REVERB
+		mixer->add_bus(AUDIO_BUS_MASTER);    // AUDIO_BUS_MUSIC
+		mixer->add_bus(AUDIO_BUS_MASTER);    // AUDIO_BUS_SFX
+		mixer->set_send(AUDIO_BUS_SFX, AUDIO_BUS_REVERB, .2f);
+
+		num_streams = num_voices;
+		for (uint s = 0; s < num_streams; s++) streams[s].ring = make_mixer_sound(NULL, AUDIO_RING_FRAMES, 2, AUDIO_OUTPUT_RATE);
+		output = Alloc(int16, AUDIO_OUTPUT_BLOCKS * MIXER_BLOCK * 2);
+
+		clock.init();
+		clock.start();
+	}
+	for (uint i = 0; i < num_voices; i++) voices[i].stream = -1;
+
+	commands.init(AUDIO_QUEUE_SIZE);
+	sounds = Alloc(SoundAsset, AUDIO_MAX_SOUNDS);
+	num_sounds = 1; // 0 is nothing
+	staging = Alloc(byte, AUDIO_STREAM_CHUNK);
+
+	if (mode == AUDIO_SOFTWARE)
+	{
+		// already spatialized, it just has to come out as it is
+		alGenSources(1, &output_source);
+		alSourcei(output_source, AL_SOURCE_RELATIVE, AL_TRUE);
+		alGenBuffers(AUDIO_OUTPUT_BUFFERS, output_buffers);
+
+		for (uint b = 0; b < AUDIO_OUTPUT_BUFFERS; b++)
+		{
+			for (uint k = 0; k < AUDIO_OUTPUT_BLOCKS; k++) mix_block(output + k * MIXER_BLOCK * 2);
+			alBufferData(output_buffers[b], AL_FORMAT_STEREO16, output, AUDIO_OUTPUT_BLOCKS * MIXER_BLOCK * 2 * sizeof(int16), AUDIO_OUTPUT_RATE);
+		}
+		alSourceQueueBuffers(output_source, AUDIO_OUTPUT_BUFFERS, output_buffers);
+		alSourcePlay(output_source);
+	}
+
+	running = 1;
+	thread = net_thread_start(audio_thread, this);
+	return true;
+}
+
+void AudioSystem::shutdown()
+{
+	if (!running) return;
+
+	net_exchange(&running, 0);
+	net_thread_join(thread);
+
+	// loads nobody got to are still mapped, that goes with the rest below
+	AudioCommand command;
+	while (commands.pop(&command));
+
+	for (uint i = 0; i < num_voices; i++)
+	{
+		if (voices[i].play_id) stop_voice(&voices[i]);
+		if (mode == AUDIO_OPENAL) alDeleteSources(1, &voices[i].source);
+	}
+	if (mode == AUDIO_OPENAL) for (uint s = 0; s < num_streams; s++) alDeleteBuffers(AUDIO_STREAM_BUFFERS, streams[s].buffers);
+	for (uint i = 1; i < num_sounds; i++)
+	{
+		if (sounds[i].buffer) alDeleteBuffers(1, &sounds[i].buffer);
+		unmap_file(&sounds[i].file);
+		free(sounds[i].pcm.samples);
+	}
+
+	if (mode == AUDIO_SOFTWARE)
+	{
+		alSourceStop(output_source);
+		alDeleteSources(1, &output_source);
+		alDeleteBuffers(AUDIO_OUTPUT_BUFFERS, output_buffers);
+	}
+	if (mixer)
+	{
+		for (uint s = 0; s < num_streams; s++) free(streams[s].ring.samples);
+		mixer->release();
+		free(mixer);
+		free(output);
+	}
+
+	if (device)
+	{
+		alcMakeContextCurrent(NULL);
+		alcDestroyContext(context);
+		alcCloseDevice(device);
+	}
+
+	commands.release();
+	free(sounds);
+	free(staging);
+	*this = {};
+}
+
+// the header is read here, everything after it by the audio thread
+Audio AudioSystem::map_sound(const char* path, bool streamed)
+{
+	if (!running || num_sounds == AUDIO_MAX_SOUNDS) return 0;
+
+	MappedFile file = map_file(path);
+	if (file.size < AUDIO_HEADER_SIZE) { unmap_file(&file); print("ERROR : %s not found\n", path); return 0; }
+
+	const uint* header = (const uint*)file.data; // format, sample rate, size
+	if (!header[1]) { unmap_file(&file); print("ERROR : %s has no sample rate\n", path); return 0; }
+
+	SoundAsset sound = {};
+	sound.format      = header[0];
+	sound.sample_rate = header[1];
+	sound.size        = (uint)glm::min((uint64)header[2], file.size - AUDIO_HEADER_SIZE); // the file can be shorter than it says
+	sound.data        = file.data + AUDIO_HEADER_SIZE;
+	sound.num_frames  = is_adpcm(sound.format) ? adpcm_num_frames(sound.data, sound.size, pcm_channels(sound.format)) : sound.size / pcm_frame_size(sound.format);
+	sound.streamed    = streamed;
+	sound.file        = file;
+
+	sounds[num_sounds] = sound;
+	return num_sounds++;
+}
+
+Audio AudioSystem::load(const char* path)
+{
+	Audio sound = map_sound(path, false);
+	if (!sound) return 0;
+
+	AudioCommand command = {};
+	command.type  = AUDIO_CMD_LOAD;
+	command.sound = sound;
+	while (!commands.push(command)) os_sleep(1); // can't be dropped, plays of it might be right behind
+
+	return sound;
+}
+
+Audio AudioSystem::open_stream(const char* path) { return map_sound(path, true); }
+
+void AudioSystem::post(const AudioCommand& command)
+{
+	if (!running) return;
+	if (!commands.push(command)) net_increment(&dropped_commands);
+}
+
+uint AudioSystem::play(Audio sound, float gain, byte priority, byte flags, float pitch, byte bus)
+{
+	if (!sound || sound >= num_sounds) return 0;
+
+	uint play_id = (uint)net_increment(&next_play_id);
+	if (!play_id) play_id = (uint)net_increment(&next_play_id); // 0 is nothing
+
+	AudioCommand command = {};
+	command.type     = AUDIO_CMD_PLAY;
+	command.sound    = sound;
+	command.play_id  = play_id;
+	command.priority = priority;
+	command.flags    = flags;
+	command.bus      = bus;
+	command.gain     = gain;
+	command.pitch    = pitch;
+	command.position = vec3(0);
+	post(command);
+
+	return command.play_id;
+}
+
+uint AudioSystem::play_at(Audio sound, vec3 position, float gain, byte priority, byte flags, float pitch, byte bus)
+{
+	if (!sound || sound >= num_sounds) return 0;
+
+	uint play_id = (uint)net_increment(&next_play_id);
+	if (!play_id) play_id = (uint)net_increment(&next_play_id);
+
+	AudioCommand command = {};
+	command.type     = AUDIO_CMD_PLAY;
+	command.sound    = sound;
+	command.play_id  = play_id;
+	command.priority = priority;
+	command.flags    = flags | AUDIO_POSITIONAL;
+	command.bus      = bus;
+	command.gain     = gain;
+	command.pitch    = pitch;
+	command.position = position;
+	post(command);
+
+	return command.play_id;
+}
+
+void AudioSystem::stop_sound(uint play_id)
+{
+	AudioCommand command = {};
+	command.type    = AUDIO_CMD_STOP;
+	command.play_id = play_id;
+	if (play_id) post(command);
+}
+
+void AudioSystem::set_gain(uint play_id, float gain)
+{
+	AudioCommand command = {};
+	command.type    = AUDIO_CMD_GAIN;
+	command.play_id = play_id;
+	command.gain    = gain;
+	if (play_id) post(command);
+}
+
+void AudioSystem::set_position(uint play_id, vec3 position)
+{
+	AudioCommand command = {};
+	command.type     = AUDIO_CMD_POSITION;
+	command.play_id  = play_id;
+	command.position = position;
+	if (play_id) post(command);
+}
+
+void AudioSystem::set_listener(const Camera& camera)
+{
+	AudioCommand command = {};
+	command.type     = AUDIO_CMD_LISTENER;
+	command.position = camera.position;
+	command.front    = camera.front;
+	command.up       = camera.up;
+	post(command);
+}
+
+void AudioSystem::set_bus(uint bus, float gain, float lowpass, float reverb_send)
+{
+	AudioCommand command = {};
+	command.type    = AUDIO_CMD_BUS;
+	command.bus     = bus;
+	command.gain    = gain;
+	command.lowpass = lowpass;
+	command.send    = reverb_send;
+	post(command);
+}
+
+// ---------------------- test --------------------- //
+
+// writes a .audio file of 16 bit samples, as they are or as ADPCM
+void write_audio_file(const char* path, uint channels, uint sample_rate, const int16* samples, uint num_frames, bool compressed = false)
+{
+	uint header[3] = { channels == 2 ? (uint)AL_FORMAT_STEREO16 : (uint)AL_FORMAT_MONO16, sample_rate, num_frames * channels * (uint)sizeof(int16) };
+	const void* data = samples;
+
+	byte* encoded = NULL;
+	if (compressed)
+	{
+		encoded = Alloc(byte, adpcm_encoded_size(num_frames, channels));
+		header[0] = channels == 2 ? AUDIO_FORMAT_ADPCM_STEREO : AUDIO_FORMAT_ADPCM_MONO;
+		header[2] = adpcm_encode(samples, num_frames, channels, encoded);
+		data = encoded;
+	}
+
+	FILE* file = fopen(path, "wb");
+	if (file)
+	{
+		fwrite(header, sizeof(uint), 3, file);
+		fwrite(data, 1, header[2], file);
+		fclose(file);
+	}
+	free(encoded);
+}
+
+// a 16 bit .audio file into an ADPCM one, false if it isn't one of those
+bool compress_audio_file(const char* path, const char* compressed_path)
+{
+	MappedFile file = map_file(path);
+	const uint* header = (const uint*)file.data;
+
+	bool wide = file.size >= AUDIO_HEADER_SIZE && (header[0] == AL_FORMAT_MONO16 || header[0] == AL_FORMAT_STEREO16);
+	if (wide)
+	{
+		uint channels = pcm_channels(header[0]);
+		uint size = (uint)glm::min((uint64)header[2], file.size - AUDIO_HEADER_SIZE);
+		write_audio_file(compressed_path, channels, header[1], (const int16*)(file.data + AUDIO_HEADER_SIZE), size / (channels * 2), true);
+	}
+	else print("ERROR : %s isn't a 16 bit .audio file\n", path);
+
+	unmap_file(&file);
+	return wide;
+}
+
+// a streamed track looping under 300 one-shots a second for 2 seconds, more than there are voices for
+void audio_test(uint mode = AUDIO_OPENAL, const char* blip_path = "audio_test_blip.audio", const char* music_path = "audio_test_music.audio")
+{
+	const uint rate = 44100;
+
+	uint blip_frames = rate / 5; // 200 ms
+	int16* blip = Alloc(int16, blip_frames);
+	for (uint i = 0; i < blip_frames; i++) blip[i] = (int16)(sinf(TWOPI * 880 * i / rate) * 8000 * (1 - i / (float)blip_frames));
+	write_audio_file(blip_path, 1, rate, blip, blip_frames);
+	free(blip);
+
+	uint music_frames = rate * 3; // short enough to loop during the test
+	int16* music = Alloc(int16, music_frames * 2);
+	for (uint i = 0; i < music_frames; i++) music[i * 2] = music[i * 2 + 1] = (int16)(sinf(TWOPI * 220 * i / rate) * 4000);
+	write_audio_file(music_path, 2, rate, music, music_frames);
+	free(music);
+
+	AudioSystem* audio = Alloc(AudioSystem, 1);
+	if (!audio->init(mode)) { out("audio : no sound card, nothing to test"); free(audio); return; }
+
+	Audio sfx   = audio->load(blip_path);
+	Audio theme = audio->open_stream(music_path);
+	audio->play(theme, .25f, AUDIO_PRIORITY_MUSIC, AUDIO_LOOP);
+
+	Timer timer = {};
+	timer.init();
+	timer.start();
+
+	uint requested = 0;
+	for (uint tick = 0; tick < 200; tick++) // 10 ms apart
+	{
+		for (uint i = 0; i < 3; i++, requested++)
+		{
+			byte priority = i == 0 ? AUDIO_PRIORITY_HIGH : (i == 1 ? AUDIO_PRIORITY_NORMAL : AUDIO_PRIORITY_LOW);
+			audio->play_at(sfx, vec3(randfns(), 0, randfns()) * 10.f, .2f, priority, 0, .5f + randfn());
+		}
+		os_sleep(10);
+	}
+	int64 microseconds = timer.microseconds_elapsed();
+
+	os_sleep(50); // let the audio thread catch up on the last commands
+	bool music_playing = audio->stats.streaming == 1;
+
+	out("audio : " << requested << " one-shots in " << microseconds / 1000 << " ms | played " << audio->stats.played - 1
+		<< ", stolen " << audio->stats.stolen << ", dropped " << audio->stats.dropped + audio->dropped_commands
+		<< " | music " << (music_playing ? "still playing" : "STOPPED") << ", stream underruns " << audio->stats.underruns);
+
+	if (mode != AUDIO_OPENAL)
+	{
+		uint64 blocks = audio->stats.blocks;
+		out("mixer : " << blocks << " blocks, " << (uint64)(microseconds / 1000000.0 * AUDIO_OUTPUT_RATE / MIXER_BLOCK) << " in real time | "
+			<< audio->stats.mix_us / (float)glm::max(blocks, (uint64)1) << " us per block, peak " << audio->stats.peak);
+	}
+
+	audio->shutdown();
+	free(audio);
+
+	remove(blip_path);
+	remove(music_path);
+}
+
+// a bank of two second sounds written as 16 bit PCM, then as ADPCM : how long loading them takes,
+// how much of them the audio thread keeps, & then all of them playing at once
+void audio_bank_test(uint mode = AUDIO_NULL, uint num_sounds = 64, const char* directory = ".")
+{
+	const uint rate = 44100, num_frames = rate * 2;
+	int16* samples = Alloc(int16, num_frames);
+	int16* decoded = Alloc(int16, num_frames);
+	byte*  encoded = Alloc(byte, adpcm_encoded_size(num_frames, 1));
+	char path[MAX_PATH_LENGTH];
+
+	double signal = 0, noise = 0;
+	for (uint s = 0; s < num_sounds; s++)
+	{
+		float pitch = 110.f * (1 + s % 12);
+		for (uint i = 0; i < num_frames; i++)
+		{
+			float t = i / (float)rate;
+			samples[i] = (int16)((sinf(TWOPI * pitch * t) * 6000 + sinf(TWOPI * pitch * 2.01f * t) * 3000 + randfns() * 300) * expf(-t));
+		}
+
+		for (uint compressed = 0; compressed < 2; compressed++)
+		{
+			snprintf(path, sizeof(path), "%s/bank_test_%u_%u.audio", directory, compressed, s);
+			write_audio_file(path, 1, rate, samples, num_frames, compressed);
+		}
+
+		// how close the codec gets
+		AdpcmDecoder decoder = {};
+		adpcm_decode(encoded, adpcm_encode(samples, num_frames, 1, encoded), 1, &decoder, decoded, num_frames);
+		for (uint i = 0; i < num_frames; i++) { signal += (double)samples[i] * samples[i]; noise += (double)(samples[i] - decoded[i]) * (samples[i] - decoded[i]); }
+	}
+	out("adpcm : " << 10 * log10(signal / glm::max(noise, 1.0)) << " dB signal to noise");
+
+	for (uint compressed = 0; compressed < 2; compressed++)
+	{
+		AudioSystem* audio = Alloc(AudioSystem, 1);
+		if (!audio->init(mode)) { out("audio : no sound card, nothing to test"); free(audio); break; }
+
+		Timer timer = {};
+		timer.init();
+		timer.start();
+
+		uint loaded = 0;
+		uint64 file_bytes = 0;
+		Audio* bank = Alloc(Audio, num_sounds);
+		for (uint s = 0; s < num_sounds; s++)
+		{
+			snprintf(path, sizeof(path), "%s/bank_test_%u_%u.audio", directory, compressed, s);
+			bank[s] = audio->load(path);
+			if (bank[s]) { loaded++; file_bytes += audio->sounds[bank[s]].size; }
+		}
+		int64 load_us = timer.microseconds_elapsed(); // what the game thread waits for
+
+		while (audio->stats.loaded < loaded) os_sleep(1);
+		int64 ready_us = timer.microseconds_elapsed(); // & what the audio thread does with them
+
+		uint64 blocks = audio->stats.blocks, mix_us = audio->stats.mix_us, decode_us = audio->stats.decode_us;
+		for (uint s = 0; s < num_sounds; s++) audio->play(bank[s], 1.f / num_sounds);
+		os_sleep(500);
+		blocks = glm::max(audio->stats.blocks - blocks, (uint64)1);
+
+		out((compressed ? "adpcm : " : "pcm16 : ") << loaded << " sounds, " << file_bytes / 1024 << " KB | load " << load_us / 1000.f
+			<< " ms, ready " << ready_us / 1000.f << " ms | resident " << audio->stats.resident / 1024 << " KB");
+		if (mode != AUDIO_OPENAL)
+			out("        " << audio->stats.playing << " playing | " << (audio->stats.decode_us - decode_us) / (float)blocks << " us decoding & "
+				<< (audio->stats.mix_us - mix_us) / (float)blocks << " us mixing per block, underruns " << audio->stats.underruns);
+
+		audio->shutdown();
+		free(audio);
+		free(bank);
+	}
+
+	for (uint s = 0; s < num_sounds; s++) for (uint compressed = 0; compressed < 2; compressed++)
+	{
+		snprintf(path, sizeof(path), "%s/bank_test_%u_%u.audio", directory, compressed, s);
+		remove(path);
+	}
+	free(samples);
+	free(decoded);
+	free(encoded);
+}
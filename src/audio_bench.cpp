@@ -0,0 +1,19 @@
+#define HEADLESS // the mixer needs no device
+#include "mixer.h"
+
+// audio_bench.exe [-voices 256] [-blocks 4000]
+int main(int argc, char** argv)
+{
+	console = Alloc(GameConsole, 1);
+
+	uint num_voices = MIXER_MAX_VOICES, num_blocks = 4000;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if      (!strcmp(argv[i], "-voices")) num_voices = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-blocks")) num_blocks = atoi(argv[i + 1]);
+		else print("unknown option %s\n", argv[i]);
+	}
+
+	mixer_benchmark(num_voices, num_blocks);
+	return 0;
+}
@@ -0,0 +1,141 @@
+#include "mixer.h"
+
+/* Codec : IMA ADPCM, 4 bits a sample, decoded a piece at a time
+
+	- blocks of ADPCM_BLOCK_FRAMES frames, every one the same size. a block starts with its frame count
+	  (only the last one is short), then where the decoder was for each channel, so decoding can start
+	  at any block without the ones before it. the samples follow, a channel after the other, low nibble first
+	- the decoder remembers where it stopped : reading on from there never redoes any of the block
+	- 16 bit in & out, about a quarter of the size of 16 bit PCM
+*/
+
+#define ADPCM_BLOCK_FRAMES   1024
+#define ADPCM_BLOCK_HEADER   4 // uint16 frames, uint16 nothing
+#define ADPCM_CHANNEL_HEADER 4 // int16 predictor, byte step index, byte nothing
+
+// .audio formats next to AL_FORMAT_*, nothing in AL uses these
+#define AUDIO_FORMAT_ADPCM_MONO   0xADC1
+#define AUDIO_FORMAT_ADPCM_STEREO 0xADC2
+
+const int adpcm_steps[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+const int adpcm_index_steps[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+struct AdpcmDecoder
+{
+	uint64 frame; // the next one out, {} = the start
+	int predictor[2], index[2];
+};
+
+bool is_adpcm(uint format) { return format == AUDIO_FORMAT_ADPCM_MONO || format == AUDIO_FORMAT_ADPCM_STEREO; }
+uint adpcm_block_size(uint channels) { return ADPCM_BLOCK_HEADER + channels * (ADPCM_CHANNEL_HEADER + ADPCM_BLOCK_FRAMES / 2); }
+uint adpcm_encoded_size(uint num_frames, uint channels) { return (num_frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES * adpcm_block_size(channels); }
+
+// the only short block is the last one
+uint adpcm_num_frames(const byte* data, uint size, uint channels)
+{
+	uint block_size = adpcm_block_size(channels);
+	uint num_blocks = size / block_size;
+	if (!num_blocks) return 0;
+
+	uint16 last = *(const uint16*)(data + (num_blocks - 1) * block_size);
+	return (num_blocks - 1) * ADPCM_BLOCK_FRAMES + glm::min((uint)last, (uint)ADPCM_BLOCK_FRAMES);
+}
+
+// one nibble back into a sample, moves the predictor & the step along
+inline int adpcm_step(int nibble, int* predictor, int* index)
+{
+	int diff = (adpcm_steps[*index] * ((nibble & 7) * 2 + 1)) >> 3; // no branches, the nibbles are noise to a predictor
+
+	*predictor = glm::clamp(*predictor + (nibble & 8 ? -diff : diff), -32768, 32767);
+	*index     = glm::clamp(*index + adpcm_index_steps[nibble & 7], 0, 88);
+	return *predictor;
+}
+
+// count frames from where the decoder is into interleaved 16 bit, fewer at the end of the data
+uint adpcm_decode(const byte* data, uint size, uint channels, AdpcmDecoder* decoder, int16* output, uint count)
+{
+	uint block_size = adpcm_block_size(channels);
+	uint done = 0;
+
+	while (done < count)
+	{
+		uint block = (uint)(decoder->frame / ADPCM_BLOCK_FRAMES);
+		uint first = (uint)(decoder->frame % ADPCM_BLOCK_FRAMES);
+		if ((uint64)(block + 1) * block_size > size) break;
+
+		const byte* header = data + (uint64)block * block_size;
+		uint frames = glm::min((uint)*(const uint16*)header, (uint)ADPCM_BLOCK_FRAMES);
+		if (first >= frames) break; // past the end of the last block
+
+		if (!first) for (uint c = 0; c < channels; c++)
+		{
+			const byte* channel = header + ADPCM_BLOCK_HEADER + c * ADPCM_CHANNEL_HEADER;
+			decoder->predictor[c] = *(const int16*)channel;
+			decoder->index[c]     = glm::min((int)channel[2], 88);
+		}
+
+		uint n = glm::min(frames - first, count - done);
+		for (uint c = 0; c < channels; c++)
+		{
+			const byte* nibbles = header + ADPCM_BLOCK_HEADER + channels * ADPCM_CHANNEL_HEADER + c * (ADPCM_BLOCK_FRAMES / 2);
+			int predictor = decoder->predictor[c], index = decoder->index[c];
+			int16* out = output + done * channels + c;
+
+			for (uint i = first; i < first + n; i++, out += channels)
+				*out = (int16)adpcm_step((nibbles[i >> 1] >> ((i & 1) * 4)) & 15, &predictor, &index);
+
+			decoder->predictor[c] = predictor;
+			decoder->index[c]     = index;
+		}
+
+		decoder->frame += n;
+		done += n;
+	}
+
+	return done;
+}
+
+// interleaved 16 bit into blocks, output needs adpcm_encoded_size() bytes. returns how many it wrote
+uint adpcm_encode(const int16* samples, uint num_frames, uint channels, byte* output)
+{
+	uint block_size = adpcm_block_size(channels);
+	uint num_blocks = (num_frames + ADPCM_BLOCK_FRAMES - 1) / ADPCM_BLOCK_FRAMES;
+	int index[2] = {}; // carried across blocks, the step size stays where the sound is
+
+	memset(output, 0, num_blocks * block_size);
+	for (uint b = 0; b < num_blocks; b++)
+	{
+		byte* header = output + b * block_size;
+		uint first  = b * ADPCM_BLOCK_FRAMES;
+		uint frames = glm::min(num_frames - first, (uint)ADPCM_BLOCK_FRAMES);
+		*(uint16*)header = (uint16)frames;
+
+		for (uint c = 0; c < channels; c++)
+		{
+			byte* channel = header + ADPCM_BLOCK_HEADER + c * ADPCM_CHANNEL_HEADER;
+			byte* nibbles = header + ADPCM_BLOCK_HEADER + channels * ADPCM_CHANNEL_HEADER + c * (ADPCM_BLOCK_FRAMES / 2);
+
+			int predictor = samples[first * channels + c]; // starts right on the first sample
+			*(int16*)channel = (int16)predictor;
+			channel[2] = (byte)index[c];
+
+			for (uint i = 0; i < frames; i++)
+			{
+				int diff = samples[(first + i) * channels + c] - predictor;
+				int nibble = diff < 0 ? 8 : 0;
+				nibble |= glm::min(abs(diff) * 4 / adpcm_steps[index[c]], 7); // the closest (n * 2 + 1) / 8 of a step
+
+				adpcm_step(nibble, &predictor, &index[c]); // stays in step with what the decoder will see
+				nibbles[i >> 1] |= nibble << ((i & 1) * 4);
+			}
+		}
+	}
+
+	return num_blocks * block_size;
+}
@@ -1,7 +1,110 @@
-#include "loader.h"
+#include "materials.h"
 
 /* GeometryRenderer : drawing geometry to the G-Buffer */
 
+enum INSTANCE_FORMAT {
+	INSTANCE_MAT4 = 0, // full model matrix        | 64 bytes per instance
+	INSTANCE_COMPACT   // position, rotation, scale | 24 bytes per instance
+};
+
+// position + uniform scale + quaternion. no shearing or non-uniform scale,
+// but that also means normals only need rotating in the vertex shader
+struct CompactInstance
+{
+	vec3  position;
+	float scale;
+	int16 rotation[4]; // unit quaternion (x, y, z, w) as snorm16
+};
+
+// normalizes & quantizes 2 quaternions per iteration with SSE2
+void pack_instances(uint count, const vec3* positions, const quat* rotations, const float* scales, CompactInstance* output)
+{
+	const __m128 snorm_max = _mm_set1_ps(32767.f);
+
+	const auto normalize = [](__m128 q) {
+		__m128 sq  = _mm_mul_ps(q, q);
+		__m128 sum = _mm_add_ps(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2))); // every lane = dot(q, q)
+		return _mm_div_ps(q, _mm_sqrt_ps(sum));
+	};
+
+	for (uint i = 0; i < count; i += 2)
+	{
+		uint next = (i + 1 < count) ? i + 1 : i; // odd count : pack the last one twice
+
+		__m128 a = normalize(_mm_loadu_ps(&rotations[i   ].x));
+		__m128 b = normalize(_mm_loadu_ps(&rotations[next].x));
+
+		__m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(_mm_mul_ps(a, snorm_max)),
+		                                 _mm_cvtps_epi32(_mm_mul_ps(b, snorm_max)));
+
+		output[i].position = positions[i];
+		output[i].scale    = scales[i];
+		_mm_storel_epi64((__m128i*)output[i].rotation, packed);
+
+		output[next].position = positions[next];
+		output[next].scale    = scales[next];
+		_mm_storel_epi64((__m128i*)output[next].rotation, _mm_unpackhi_epi64(packed, packed));
+	}
+}
+
+// same thing from model matrices; assumes they only hold translation, rotation & uniform scale
+void pack_instances(uint count, const mat4* models, CompactInstance* output)
+{
+	const uint BATCH = 256;
+	vec3  positions[BATCH];
+	quat  rotations[BATCH];
+	float scales[BATCH];
+
+	for (uint begin = 0; begin < count; begin += BATCH)
+	{
+		uint n = glm::min(count - begin, BATCH);
+		for (uint i = 0; i < n; i++)
+		{
+			const mat4& m = models[begin + i];
+			positions[i] = vec3(m[3]);
+			scales[i]    = glm::length(vec3(m[0]));
+			rotations[i] = scales[i] > 0 ? glm::quat_cast(mat3(m) / scales[i]) : quat(1, 0, 0, 0); // scaled to nothing, any rotation will do
+		}
+
+		pack_instances(n, positions, rotations, scales, output + begin);
+	}
+}
+
+// for instances that come one at a time & go to scattered slots : collects them, then packs a whole batch at once
+struct InstancePacker
+{
+	static const uint BATCH = 256;
+
+	CompactInstance* output;
+	uint  count;
+	uint  slots[BATCH];
+	vec3  positions[BATCH];
+	quat  rotations[BATCH];
+	float scales[BATCH];
+
+	void add(uint slot, vec3 position, quat rotation, float scale)
+	{
+		slots    [count] = slot;
+		positions[count] = position;
+		rotations[count] = rotation;
+		scales   [count] = scale;
+		if (++count == BATCH) flush();
+	}
+	void add(uint slot, const mat4& model) // translation, rotation & uniform scale only
+	{
+		float scale = glm::length(vec3(model[0]));
+		add(slot, vec3(model[3]), scale > 0 ? glm::quat_cast(mat3(model) / scale) : quat(1, 0, 0, 0), scale);
+	}
+	void flush() // WARNING : call once everything was added!
+	{
+		CompactInstance packed[BATCH];
+		pack_instances(count, positions, rotations, scales, packed);
+		for (uint i = 0; i < count; i++) output[slots[i]] = packed[i];
+		count = 0;
+	}
+};
+
 // instance data might not be in the same order as geometry data.
 // the number of instances of each mesh might vary every frame.
 // Therefore :
@@ -28,28 +131,40 @@ struct DrawBuffer
 	GLuint geom_buffer; // handle to vertex buffer
 	GLuint indx_buffer; // handle to index 
 	GLuint inst_buffer; // handle to instance buffer
+	GLuint matl_buffer; // handle to per-instance material index buffer
+	GLuint cmds_buffer; // handle to indirect draw command buffer
 
 	// runtime buffer info
 	uint max_buffer_size;
+	uint instance_format, instance_stride; // IN BYTES : sizeof(mat4) or sizeof(CompactInstance)
 
 	uint num_meshes;
 	uint total_instances; // total number of instances currently stored
 
+	uint* no_materials; // all 0, as long as the biggest batch that came without materials
+	uint  num_no_materials;
+
 	uint geom_size;
 	uint indx_size;
 	uint inst_size;
 
 	uint geom_offset, indx_offset;
 
-	void init(GLuint vao, uint buffer_size = KiloByte(256)) {
+	void init(GLuint vao, uint buffer_size = KiloByte(256), uint format = INSTANCE_MAT4) {
 
 		// this size is for : vertex buffer, index buffer, instance-data buffer
 		max_buffer_size = buffer_size;
 
+		instance_format = format;
+		instance_stride = (format == INSTANCE_COMPACT) ? sizeof(CompactInstance) : sizeof(mat4);
+		uint max_instances = max_buffer_size / instance_stride;
+
 		// generate gpu buffers : mesh vertices, mesh indices, & instance data
 		glGenBuffers(1, &geom_buffer);
 		glGenBuffers(1, &indx_buffer);
 		glGenBuffers(1, &inst_buffer);
+		glGenBuffers(1, &matl_buffer);
+		glGenBuffers(1, &cmds_buffer);
 
 		// IMPORTANT : bind the vao *before* binding anything else!
 		glBindVertexArray(vao);
@@ -82,13 +197,36 @@ struct DrawBuffer
 
 		// define per-mesh instance-data layout
 		uint num_vertex_attribs = 3;
-		for (uint i = num_vertex_attribs; i < 4 + num_vertex_attribs; i++)
+		if (instance_format == INSTANCE_COMPACT)
+		{
+			// vec4 position & scale, then the quaternion as 4 normalized shorts
+			glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, instance_stride, (void*)0);
+			glVertexAttribPointer(4, 4, GL_SHORT, GL_TRUE , instance_stride, (void*)(sizeof(vec4)));
+			for (uint i = 3; i < 5; i++)
+			{
+				glEnableVertexAttribArray(i);
+				glVertexAttribDivisor(i, 1);
+			}
+		}
+		else for (uint i = num_vertex_attribs; i < 4 + num_vertex_attribs; i++)
 		{
 			glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(sizeof(vec4) * (i - num_vertex_attribs)));
 			glEnableVertexAttribArray(i);
 			glVertexAttribDivisor(i, 1);
 		}
 
+		// gpu buffer for per-instance material indices : one uint per instance, same order as the instance data
+		glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+		glBufferData(GL_ARRAY_BUFFER, max_instances * sizeof(uint), NULL, GL_DYNAMIC_DRAW);
+
+		glVertexAttribIPointer(7, 1, GL_UNSIGNED_INT, sizeof(uint), (void*)0);
+		glEnableVertexAttribArray(7);
+		glVertexAttribDivisor(7, 1);
+
+		// gpu buffer for indirect draw commands : one per mesh
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, MAX_MESHES * 5 * sizeof(uint), NULL, GL_DYNAMIC_DRAW);
+
 		// gpu index buffer : ordered uints that reference vertices for building meshes
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, max_buffer_size, NULL, GL_STATIC_DRAW);
@@ -158,29 +296,100 @@ struct DrawBuffer
 	}
 
 	// This function appends per-mesh instance data to the appropriate gpu buffers
-	void add_instances(uint mesh_id, uint num_instances, mat4* instance_data)
+	// materials : one MaterialTable index per instance, NULL = all use material 0
+	// matrices can go into either format; compact buffers pack them on the way in
+	void add_instances(uint mesh_id, uint num_instances, mat4* instance_data, uint* materials = NULL)
 	{
-		glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+		if (instance_format == INSTANCE_MAT4)
+		{
+			add_instance_data(mesh_id, num_instances, instance_data, materials);
+			return;
+		}
 
-		uint instance_data_size = num_instances   * sizeof(mat4); // UNIT : BYTES
-		uint instance_offset    = total_instances * sizeof(mat4); // UNIT : BYTES
+		CompactInstance* packed = Alloc(CompactInstance, num_instances);
+		pack_instances(num_instances, instance_data, packed);
+		add_instance_data(mesh_id, num_instances, packed, materials);
+		free(packed);
+	}
+	void add_instances(uint mesh_id, uint num_instances, CompactInstance* instance_data, uint* materials = NULL)
+	{
+		if (instance_format != INSTANCE_COMPACT) { out("ERROR : DrawBuffer was not created with INSTANCE_COMPACT!"); stop; return; }
+
+		add_instance_data(mesh_id, num_instances, instance_data, materials);
+	}
+
+	// instance_data must already be in this buffer's instance format
+	void add_instance_data(uint mesh_id, uint num_instances, void* instance_data, uint* materials)
+	{
+		uint instance_data_size = num_instances   * instance_stride; // UNIT : BYTES
+		uint instance_offset    = total_instances * instance_stride; // UNIT : BYTES
 
+		if (instance_offset + instance_data_size > max_buffer_size) {
+			out("Instance VBO size exceeded! - " << instance_offset + instance_data_size);
+			stop; return;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
 		glBufferSubData(GL_ARRAY_BUFFER, instance_offset, instance_data_size, instance_data);
 
+		if (!materials && num_instances > num_no_materials)
+		{
+			free(no_materials);
+			no_materials     = Alloc(uint, num_instances);
+			num_no_materials = num_instances;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, total_instances * sizeof(uint), num_instances * sizeof(uint), materials ? materials : no_materials);
+
+		assign_instances(mesh_id, num_instances);
+	}
+
+	// reserves the next num_instances slots for mesh_id without uploading anything,
+	// returns the first slot (IN INSTANCES). fill them in with map_instances()
+	uint assign_instances(uint mesh_id, uint num_instances)
+	{
+		if ((total_instances + num_instances) * instance_stride > max_buffer_size) {
+			out("Instance VBO size exceeded! - " << (total_instances + num_instances) * instance_stride);
+			stop; return 0;
+		}
+
 		// update corresponding mesh info
 		for (uint i = 0; i < MAX_MESHES; i++)
 		{
 			if (mesh_info[i].mesh_id == mesh_id)
 			{
+				uint base_instance = total_instances;
 				mesh_info[i].num_instances = num_instances;
-				mesh_info[i].base_instance = total_instances; // UNIT : INSTANCES
+				mesh_info[i].base_instance = base_instance; // UNIT : INSTANCES
 				total_instances += num_instances;
-				return;
+				return base_instance;
 			}
 		}
 
 		out("ERROR : Instances do not match a stored mesh!");
-		stop;
+		stop; return 0;
+	}
+
+	// maps a range of instance slots for writing directly, instead of copying through add_instances()
+	// returns the instance data (in this buffer's instance format) & the matching material indices
+	// WARNING : call unmap_instances() before drawing!
+	void* map_instances(uint first_instance, uint num_instances, uint** materials)
+	{
+		const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT;
+
+		glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+		*materials = (uint*)glMapBufferRange(GL_ARRAY_BUFFER, first_instance * sizeof(uint), num_instances * sizeof(uint), access);
+
+		glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+		return glMapBufferRange(GL_ARRAY_BUFFER, first_instance * instance_stride, num_instances * instance_stride, access);
+	}
+	void unmap_instances()
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, matl_buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
 	}
 };
 
@@ -198,6 +407,16 @@ struct DrawList
 		uint base_instance; // IN INSTANCES
 	} mesh_params[MAX_MESHES];
 
+	// the same params in the layout glMultiDrawElementsIndirect wants
+	struct {
+		uint num_indices;
+		uint num_instances;
+		uint first_index;   // IN INDICES
+		uint base_vertex;   // IN VERTS
+		uint base_instance; // IN INSTANCES
+	} commands[MAX_MESHES];
+	uint num_commands;
+
 	void update(DrawBuffer* db)
 	{
 		*this = {}; // zero memory
@@ -215,13 +434,26 @@ struct DrawList
 			mesh_params[i].base_vertex   = db->mesh_info[i].base_vertex;
 			mesh_params[i].num_instances = db->mesh_info[i].num_instances;
 			mesh_params[i].base_instance = db->mesh_info[i].base_instance;
+
+			if (mesh_params[i].num_instances == 0)
+				continue;
+
+			uint n = num_commands++;
+			commands[n].num_indices   = mesh_params[i].num_indices;
+			commands[n].num_instances = mesh_params[i].num_instances;
+			commands[n].first_index   = mesh_params[i].index_offset / sizeof(uint);
+			commands[n].base_vertex   = mesh_params[i].base_vertex;
+			commands[n].base_instance = mesh_params[i].base_instance;
 		}
+
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, db->cmds_buffer);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, num_commands * sizeof(commands[0]), commands);
 	}
 };
 
 struct GeometryRenderer {
 	// geometry pass params
-	uint VAO, texture;
+	uint VAO, texture; // texture is a texture_id from the streamer
 	ShaderProgram shader; // geometry shader
 	Camera camera; // 3d camera
 
@@ -230,37 +462,41 @@ struct GeometryRenderer {
 	DrawBuffer drawbuffer;
 	DrawList   drawlist;
 
-	void init();
+	// streaming textures & materials
+	TextureStreamer textures;
+	MaterialTable   materials;
+
+	void init(uint instance_format = INSTANCE_MAT4);
 	void add_mesh(const char* filepath);
 	void draw(GameWindow* window); // geometry pass!
 };
 
-void GeometryRenderer::init()
+void GeometryRenderer::init(uint instance_format)
 {
-	shader.create("assets/shaders/geom.vert", "assets/shaders/geom.frag");
-
-	glGenVertexArrays(1, &VAO);
-	drawbuffer.init(VAO);
+	materials.init();
 
-	// Load texture
-	glActiveTexture(GL_TEXTURE0);
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	// Texture wrapping/filtering options (on currently bound texture object)
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// load & generate texture
-	int width, height, num_channels;
-	unsigned char* data = stbi_load("assets/textures/default.jpg", &width, &height, &num_channels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	} else out("Failed to load texture");
+	char defines[64] = {};
+	if (materials.bindless) strcat(defines, "#define BINDLESS\n");
+	if (instance_format == INSTANCE_COMPACT) strcat(defines, "#define COMPACT_INSTANCES\n");
+	shader.create("assets/shaders/geom.vert", "assets/shaders/geom.frag", defines);
 
-	stbi_image_free(data);
+	glGenVertexArrays(1, &VAO);
+	drawbuffer.init(VAO, KiloByte(256), instance_format);
+
+	// textures stream in on the background queue; the first time this runs the
+	// jpg gets transcoded to default.tex, after that the .tex is read directly
+	textures.init();
+	texture = textures.load("assets/textures/default.jpg", TEX_BC1);
+
+	// material 0 : what every instance without a material index gets
+	Material gold = {};
+	gold.albedo    = vec3(1.000, 0.766, 0.336);
+	gold.metallic  = 1;
+	gold.roughness = .5;
+	gold.ao        = 1;
+	gold.uv_scale  = 4;
+	gold.albedo_texture = texture;
+	materials.add(gold);
 
 	console->add_entry((char*)"Init GeometryRenderer", SUCCESS, RNDR);
 }
@@ -299,29 +535,17 @@ void GeometryRenderer::draw(GameWindow* window)
 	glBindVertexArray(VAO);
 	shader.bind();
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	textures.update(); // upload finished mips, request new ones
+	materials.update(&textures); // touches material textures, refreshes stale handles or layers
+	materials.bind();
 
 	uint pv = glGetUniformLocation(shader.id, "proj_view");
 	glUniformMatrix4fv(pv, 1, GL_FALSE, (float*)&proj_view);
 
 	//out("drawing total meshes : " << gpu_buffer.draw_list.total_meshes);
 
-	drawlist.update(&drawbuffer);
-
-	// draw each instanced mesh
-	for (uint i = 0; i < MAX_MESHES; i++)
-	{
-		if (drawlist.meshlist[i] == 0)
-			continue;
+	drawlist.update(&drawbuffer); // also uploads the indirect draw commands
 
-		uint num_indices     = drawlist.mesh_params[i].num_indices;
-		uint index_offset    = drawlist.mesh_params[i].index_offset;
-		uint vertex_offset   = drawlist.mesh_params[i].base_vertex;
-		uint num_instances   = drawlist.mesh_params[i].num_instances;
-		uint instance_offset = drawlist.mesh_params[i].base_instance;
-
-		glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT,
-			(void*)index_offset, num_instances, vertex_offset, instance_offset);
-	}
+	// every instanced mesh, every material : one draw call
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, drawlist.num_commands, 0);
 }
\ No newline at end of file
@@ -0,0 +1,555 @@
+#ifdef HEADLESS
+#include "logger.h" // the dedicated server simulates without anything that draws
+#else
+#include "scene.h"
+#endif
+
+/* Entities : archetype based entity-component system
+*
+* - an archetype is a set of components; every entity with exactly that set lives in its chunks
+* - chunks are fixed size blocks holding one array per component (SoA), each starting on a cache line,
+*   so iterating a component is a linear scan with no pointer chasing
+* - only the last chunk of an archetype is ever partially full; removing swaps the last entity into the hole
+* - systems declare what they read & write, and run_systems() runs non-conflicting systems
+*   at the same time, spread over the work queue one chunk at a time
+* - entities are referred to by handle (index + 1, 0 = no entity)
+*/
+
+#define CACHE_LINE 64
+
+const uint MAX_COMPONENTS = 64; // one bit each in a ComponentMask
+const uint MAX_ARCHETYPES = 256;
+const uint MAX_SYSTEMS    = 64;
+const uint ECS_CHUNK_SIZE = KiloByte(16);
+
+typedef uint64 ComponentMask;
+#define COMPONENT(id) ((ComponentMask)1 << (id))
+
+// built in components
+struct EntityTransform { // not the Transform in mathematics.h : uniform scale only, 32 bytes
+	vec3  position;
+	float scale;
+	quat  rotation;
+};
+struct Velocity {
+	vec3 linear;
+	vec3 angular; // axis * radians per second
+};
+struct MeshRef {
+	uint mesh_id;
+	uint material; // MaterialTable index
+};
+
+enum BUILTIN_COMPONENTS {
+	COMPONENT_TRANSFORM = 0,
+	COMPONENT_VELOCITY,
+	COMPONENT_MESH_REF,
+
+	NUM_BUILTIN_COMPONENTS
+};
+
+struct Chunk
+{
+	byte* data; // entity handles first, then one array per component
+	uint  count;
+};
+
+struct Archetype
+{
+	ComponentMask mask;
+	uint capacity; // entities per chunk
+	uint offsets[MAX_COMPONENTS]; // IN BYTES : where each component's array starts in a chunk
+
+	Chunk* chunks;
+	uint num_chunks, max_chunks; // chunks past num_chunks are empty but still allocated
+};
+
+// returns the array of component_id in this chunk
+template <typename T> T* components(Archetype* archetype, Chunk* chunk, uint component_id)
+{
+	return (T*)(chunk->data + archetype->offsets[component_id]);
+}
+
+// called once per matching chunk, possibly from any worker thread
+typedef void system_function(void* data, Archetype* archetype, Chunk* chunk);
+
+struct System
+{
+	const char* name;
+	ComponentMask reads, writes; // a system runs on every archetype that has all of these
+	system_function* function;
+	void* data;
+};
+
+struct World
+{
+	uint component_sizes[MAX_COMPONENTS];
+	uint num_components;
+
+	Archetype archetypes[MAX_ARCHETYPES];
+	uint num_archetypes;
+
+	struct {
+		uint archetype, chunk, row;
+	} *records; // per entity
+	uint* free_entities; // recycled handles
+	uint max_entities, num_entities, num_free;
+
+	System systems[MAX_SYSTEMS];
+	uint num_systems;
+
+	struct Job {
+		System* system;
+		Archetype* archetype;
+		Chunk* chunk;
+	} *jobs; // the chunks a phase of systems is working on
+	uint max_jobs;
+
+	void init(uint max_entities);
+	uint register_component(uint size); // returns component id
+	void add_system(const char* name, ComponentMask reads, ComponentMask writes, system_function* function, void* data);
+
+	uint create_entity(ComponentMask mask);
+	void destroy_entity(uint entity);
+	void set_components(uint entity, ComponentMask mask); // adds / removes components, moves the entity to another archetype
+	void* get(uint entity, uint component_id); // NULL if the entity doesn't have it
+	ComponentMask mask_of(uint entity);
+
+	void run_systems(); // runs every system over every matching chunk
+
+	uint find_archetype(ComponentMask mask); // creates it if needed
+	void add_row(uint entity, uint archetype);
+	void remove_row(uint entity);
+};
+
+void World::init(uint max)
+{
+	*this = {};
+	max_entities  = max;
+	records       = (decltype(records))calloc(max_entities, sizeof(*records));
+	free_entities = Alloc(uint, max_entities);
+
+	register_component(sizeof(EntityTransform));
+	register_component(sizeof(Velocity));
+	register_component(sizeof(MeshRef));
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init World | Max Entities : [%d]", max_entities);
+	console->add_entry(msg, SUCCESS, PHYS);
+}
+uint World::register_component(uint size)
+{
+	if (num_components == MAX_COMPONENTS) { out("ERROR : max components exceeded!"); stop; return 0; }
+
+	component_sizes[num_components] = size;
+	return num_components++;
+}
+void World::add_system(const char* name, ComponentMask reads, ComponentMask writes, system_function* function, void* data)
+{
+	if (num_systems == MAX_SYSTEMS) { out("ERROR : max systems exceeded!"); stop; return; }
+
+	systems[num_systems++] = { name, reads, writes, function, data };
+}
+
+uint World::find_archetype(ComponentMask mask)
+{
+	for (uint i = 0; i < num_archetypes; i++) if (archetypes[i].mask == mask) return i;
+
+	if (num_archetypes == MAX_ARCHETYPES) { out("ERROR : max archetypes exceeded!"); stop; return 0; }
+
+	Archetype* archetype = &archetypes[num_archetypes];
+	*archetype = {};
+	archetype->mask = mask;
+
+	// how many entities fit if every array gets padded out to a cache line
+	uint row_size = sizeof(uint), num_arrays = 1;
+	for (uint c = 0; c < num_components; c++)
+	{
+		if (!(mask & COMPONENT(c))) continue;
+		row_size += component_sizes[c];
+		num_arrays++;
+	}
+	archetype->capacity = (ECS_CHUNK_SIZE - num_arrays * CACHE_LINE) / row_size;
+
+	uint offset = 0;
+	offset += archetype->capacity * sizeof(uint); // entity handles
+	for (uint c = 0; c < num_components; c++)
+	{
+		if (!(mask & COMPONENT(c))) continue;
+		offset = (offset + CACHE_LINE - 1) & ~(CACHE_LINE - 1);
+		archetype->offsets[c] = offset;
+		offset += archetype->capacity * component_sizes[c];
+	}
+
+	return num_archetypes++;
+}
+
+// puts an entity at the end of an archetype, with zeroed components
+void World::add_row(uint entity, uint archetype_index)
+{
+	Archetype* archetype = &archetypes[archetype_index];
+
+	if (!archetype->num_chunks || archetype->chunks[archetype->num_chunks - 1].count == archetype->capacity)
+	{
+		if (archetype->num_chunks == archetype->max_chunks)
+		{
+			uint max_chunks = archetype->max_chunks ? archetype->max_chunks * 2 : 16;
+			archetype->chunks = (Chunk*)realloc(archetype->chunks, max_chunks * sizeof(Chunk));
+			memset(archetype->chunks + archetype->max_chunks, 0, (max_chunks - archetype->max_chunks) * sizeof(Chunk));
+			archetype->max_chunks = max_chunks;
+		}
+
+		Chunk* chunk = &archetype->chunks[archetype->num_chunks++];
+		if (!chunk->data) chunk->data = (byte*)_aligned_malloc(ECS_CHUNK_SIZE, CACHE_LINE);
+		chunk->count = 0;
+	}
+
+	uint chunk_index = archetype->num_chunks - 1;
+	Chunk* chunk = &archetype->chunks[chunk_index];
+	uint row = chunk->count++;
+
+	((uint*)chunk->data)[row] = entity;
+	for (uint c = 0; c < num_components; c++)
+	{
+		if (!(archetype->mask & COMPONENT(c))) continue;
+		memset(chunk->data + archetype->offsets[c] + row * component_sizes[c], 0, component_sizes[c]);
+	}
+
+	records[entity - 1] = { archetype_index, chunk_index, row };
+}
+
+// fills the entity's row with the last entity in its archetype
+void World::remove_row(uint entity)
+{
+	auto record = records[entity - 1];
+	Archetype* archetype = &archetypes[record.archetype];
+	Chunk* chunk = &archetype->chunks[record.chunk];
+	Chunk* last  = &archetype->chunks[archetype->num_chunks - 1];
+	uint last_row = last->count - 1;
+
+	if (chunk != last || record.row != last_row)
+	{
+		uint moved = ((uint*)last->data)[last_row];
+		((uint*)chunk->data)[record.row] = moved;
+
+		for (uint c = 0; c < num_components; c++)
+		{
+			if (!(archetype->mask & COMPONENT(c))) continue;
+			uint size = component_sizes[c];
+			memcpy(chunk->data + archetype->offsets[c] + record.row * size, last->data + archetype->offsets[c] + last_row * size, size);
+		}
+
+		records[moved - 1] = record;
+	}
+
+	if (--last->count == 0) archetype->num_chunks--; // keep the memory around for the next add_row()
+}
+
+uint World::create_entity(ComponentMask mask)
+{
+	uint entity;
+	if (num_free) entity = free_entities[--num_free];
+	else if (num_entities < max_entities) entity = ++num_entities;
+	else { out("ERROR : max entities exceeded!"); stop; return 0; }
+
+	add_row(entity, find_archetype(mask));
+	return entity;
+}
+void World::destroy_entity(uint entity)
+{
+	remove_row(entity);
+	free_entities[num_free++] = entity;
+}
+void World::set_components(uint entity, ComponentMask mask)
+{
+	auto old_record = records[entity - 1];
+	Archetype* old_archetype = &archetypes[old_record.archetype];
+	if (old_archetype->mask == mask) return;
+
+	uint new_index = find_archetype(mask);
+	add_row(entity, new_index);
+
+	// copy over whatever the two archetypes have in common
+	auto new_record = records[entity - 1];
+	Archetype* new_archetype = &archetypes[new_index];
+	Chunk* src = &old_archetype->chunks[old_record.chunk];
+	Chunk* dst = &new_archetype->chunks[new_record.chunk];
+
+	ComponentMask shared = old_archetype->mask & mask;
+	for (uint c = 0; c < num_components; c++)
+	{
+		if (!(shared & COMPONENT(c))) continue;
+		uint size = component_sizes[c];
+		memcpy(dst->data + new_archetype->offsets[c] + new_record.row * size, src->data + old_archetype->offsets[c] + old_record.row * size, size);
+	}
+
+	records[entity - 1] = old_record;
+	remove_row(entity);
+	records[entity - 1] = new_record;
+}
+void* World::get(uint entity, uint component_id)
+{
+	auto record = records[entity - 1];
+	Archetype* archetype = &archetypes[record.archetype];
+	if (!(archetype->mask & COMPONENT(component_id))) return NULL;
+
+	return archetype->chunks[record.chunk].data + archetype->offsets[component_id] + record.row * component_sizes[component_id];
+}
+ComponentMask World::mask_of(uint entity)
+{
+	return archetypes[records[entity - 1].archetype].mask;
+}
+
+void World::run_systems()
+{
+	const auto run_jobs = [](void* data, uint begin, uint end) {
+		Job* jobs = (Job*)data;
+		for (uint i = begin; i < end; i++)
+			jobs[i].system->function(jobs[i].system->data, jobs[i].archetype, jobs[i].chunk);
+	};
+
+	uint first = 0;
+	while (first < num_systems)
+	{
+		// grow a phase until a system touches something an earlier one in the phase writes (or vice versa)
+		ComponentMask phase_reads = 0, phase_writes = 0;
+		uint last = first;
+		for (; last < num_systems; last++)
+		{
+			System* system = &systems[last];
+			if (system->writes & (phase_reads | phase_writes)) break;
+			if (system->reads  & phase_writes) break;
+
+			phase_reads  |= system->reads;
+			phase_writes |= system->writes;
+		}
+
+		// one job per (system, chunk)
+		uint num_jobs = 0;
+		for (uint s = first; s < last; s++)
+		{
+			ComponentMask required = systems[s].reads | systems[s].writes;
+
+			for (uint a = 0; a < num_archetypes; a++)
+			{
+				Archetype* archetype = &archetypes[a];
+				if ((archetype->mask & required) != required) continue;
+
+				if (num_jobs + archetype->num_chunks > max_jobs)
+				{
+					max_jobs = (num_jobs + archetype->num_chunks) * 2;
+					jobs = (Job*)realloc(jobs, max_jobs * sizeof(Job));
+				}
+
+				for (uint c = 0; c < archetype->num_chunks; c++) jobs[num_jobs++] = { &systems[s], archetype, &archetype->chunks[c] };
+			}
+		}
+
+		parallel_for(num_jobs, 4, run_jobs, jobs);
+		first = last;
+	}
+}
+
+// built in systems ------------------------------------------------------------------------
+
+// physics : moves every entity with a transform & velocity
+void integrate_velocities(void* data, Archetype* archetype, Chunk* chunk)
+{
+	float dt = *(float*)data;
+
+	EntityTransform* transforms = components<EntityTransform>(archetype, chunk, COMPONENT_TRANSFORM);
+	Velocity*  velocities = components<Velocity >(archetype, chunk, COMPONENT_VELOCITY);
+
+	for (uint i = 0; i < chunk->count; i++)
+	{
+		transforms[i].position += velocities[i].linear * dt;
+
+		vec3 w = velocities[i].angular;
+		if (w == vec3(0)) continue;
+		float angle = glm::length(w) * dt;
+		transforms[i].rotation = glm::normalize(glm::angleAxis(angle, w / glm::length(w)) * transforms[i].rotation);
+	}
+}
+
+#ifndef HEADLESS
+
+// render extraction : every entity with a transform & mesh ref becomes an instance, grouped by mesh.
+// not a regular system since batching needs the per-mesh totals before anything can be written
+void extract_instances(World* world, DrawBuffer* db)
+{
+	const ComponentMask required = COMPONENT(COMPONENT_TRANSFORM) | COMPONENT(COMPONENT_MESH_REF);
+
+	struct Extract {
+		Archetype* archetype;
+		Chunk* chunk;
+		uint counts[MAX_MESHES + 1]; // instances of each mesh in this chunk, then where they start
+	};
+
+	struct {
+		Extract* chunks;
+		void* instances;
+		uint* materials;
+		bool compact;
+	} params = {};
+
+	uint num_chunks = 0;
+	for (uint a = 0; a < world->num_archetypes; a++)
+		if ((world->archetypes[a].mask & required) == required) num_chunks += world->archetypes[a].num_chunks;
+
+	if (!num_chunks) return;
+
+	params.chunks = Alloc(Extract, num_chunks);
+
+	num_chunks = 0;
+	for (uint a = 0; a < world->num_archetypes; a++)
+	{
+		Archetype* archetype = &world->archetypes[a];
+		if ((archetype->mask & required) != required) continue;
+
+		for (uint c = 0; c < archetype->num_chunks; c++)
+		{
+			params.chunks[num_chunks].archetype = archetype;
+			params.chunks[num_chunks].chunk     = &archetype->chunks[c];
+			num_chunks++;
+		}
+	}
+
+	// pass 1 : count meshes per chunk
+	const auto count_meshes = [](void* data, uint begin, uint end) {
+		Extract* chunks = (Extract*)data;
+		for (uint i = begin; i < end; i++)
+		{
+			MeshRef* meshes = components<MeshRef>(chunks[i].archetype, chunks[i].chunk, COMPONENT_MESH_REF);
+			for (uint r = 0; r < chunks[i].chunk->count; r++)
+				if (meshes[r].mesh_id <= MAX_MESHES) chunks[i].counts[meshes[r].mesh_id]++; // anything past that has nowhere to go
+		}
+	};
+	parallel_for(num_chunks, 16, count_meshes, params.chunks);
+
+	// reserve one block per mesh, then turn every chunk's counts into where it writes in that block
+	uint first_instance = 0, num_instances = 0;
+	for (uint m = 1; m <= MAX_MESHES; m++)
+	{
+		uint total = 0;
+		for (uint i = 0; i < num_chunks; i++) total += params.chunks[i].counts[m];
+		if (!total) continue;
+
+		uint base = db->assign_instances(m, total);
+		if (!num_instances) first_instance = base;
+
+		uint offset = base - first_instance;
+		for (uint i = 0; i < num_chunks; i++)
+		{
+			uint n = params.chunks[i].counts[m];
+			params.chunks[i].counts[m] = offset;
+			offset += n;
+		}
+		num_instances += total;
+	}
+
+	if (num_instances)
+	{
+		params.instances = db->map_instances(first_instance, num_instances, &params.materials);
+		params.compact   = db->instance_format == INSTANCE_COMPACT;
+
+		// pass 2 : write instances straight into the mapped buffers
+		const auto write_instances = [](void* data, uint begin, uint end) {
+			auto* p = (decltype(params)*)data;
+
+			InstancePacker packer; // every mesh has its own block, so slots scatter
+			packer.output = (CompactInstance*)p->instances;
+			packer.count  = 0;
+
+			for (uint i = begin; i < end; i++)
+			{
+				Extract* e = &p->chunks[i];
+				EntityTransform* transforms = components<EntityTransform>(e->archetype, e->chunk, COMPONENT_TRANSFORM);
+				MeshRef*   meshes     = components<MeshRef  >(e->archetype, e->chunk, COMPONENT_MESH_REF);
+
+				for (uint r = 0; r < e->chunk->count; r++)
+				{
+					uint mesh = meshes[r].mesh_id;
+					if (!mesh || mesh > MAX_MESHES) continue;
+
+					uint n = e->counts[mesh]++;
+					p->materials[n] = meshes[r].material;
+
+					EntityTransform t = transforms[r];
+					if (p->compact) packer.add(n, t.position, t.rotation, t.scale);
+					else ((mat4*)p->instances)[n] = trs(t.position, t.rotation, vec3(t.scale));
+				}
+			}
+
+			if (p->compact) packer.flush();
+		};
+		parallel_for(num_chunks, 16, write_instances, &params);
+
+		db->unmap_instances();
+	}
+
+	free(params.chunks);
+}
+
+#endif
+
+// 1M entities, half of them moving
+void ecs_benchmark()
+{
+	const uint NUM_ENTITIES = 1000000;
+	const uint NUM_FRAMES   = 100;
+
+	World* world = Alloc(World, 1);
+	world->init(NUM_ENTITIES);
+
+	float dt = 1.f / 60;
+	world->add_system("integrate", COMPONENT(COMPONENT_VELOCITY), COMPONENT(COMPONENT_TRANSFORM), integrate_velocities, &dt);
+
+	ComponentMask still  = COMPONENT(COMPONENT_TRANSFORM) | COMPONENT(COMPONENT_MESH_REF);
+	ComponentMask moving = still | COMPONENT(COMPONENT_VELOCITY);
+
+	for (uint i = 0; i < NUM_ENTITIES; i++)
+	{
+		uint entity = world->create_entity((i & 1) ? moving : still);
+
+		EntityTransform* t = (EntityTransform*)world->get(entity, COMPONENT_TRANSFORM);
+		t->position = randf3ns() * 100.f;
+		t->rotation = quat(1, 0, 0, 0);
+		t->scale    = 1;
+
+		((MeshRef*)world->get(entity, COMPONENT_MESH_REF))->mesh_id = 1 + i % 3;
+
+		if (i & 1) ((Velocity*)world->get(entity, COMPONENT_VELOCITY))->linear = randf3ns();
+	}
+
+	Timer timer = {};
+	timer.init();
+
+	// a plain linear scan over every transform + mesh ref
+	timer.start();
+	vec3 sum = vec3(0);
+	uint visited = 0;
+	for (uint a = 0; a < world->num_archetypes; a++)
+	{
+		Archetype* archetype = &world->archetypes[a];
+		if ((archetype->mask & still) != still) continue;
+
+		for (uint c = 0; c < archetype->num_chunks; c++)
+		{
+			Chunk* chunk = &archetype->chunks[c];
+			EntityTransform* transforms = components<EntityTransform>(archetype, chunk, COMPONENT_TRANSFORM);
+			MeshRef*   meshes     = components<MeshRef  >(archetype, chunk, COMPONENT_MESH_REF);
+			for (uint i = 0; i < chunk->count; i++) { sum += transforms[i].position; visited += meshes[i].mesh_id != 0; }
+		}
+	}
+	out("scan " << visited << " entities : " << timer.microseconds_elapsed() << " us (" << sum.x << ")");
+
+	int64 total = 0;
+	for (uint frame = 0; frame < NUM_FRAMES; frame++)
+	{
+		timer.start();
+		world->run_systems();
+		total += timer.microseconds_elapsed();
+	}
+	out("average run_systems : " << total / NUM_FRAMES << " us");
+}
@@ -0,0 +1,804 @@
+#include "logger.h"
+
+/* Input : GLFW callbacks write timestamped events into a lock-free ring, everything else is derived from it
+*
+* - nothing polls keys. a key that goes down & back up between two frames still shows up as a press,
+*   & begin_frame() runs right after glfwPollEvents(), so what the frame reads is never a frame old
+* - the ring is a NetQueue (one producer, one consumer). the callbacks run inside glfwPollEvents();
+*   on windows an event is stamped with when its message was posted, not when GLFW got around to it
+* - every frame the ring is drained into the frame's event list. Keyboard & Mouse, the actions
+*   & the fixed step replay all come from that list, so they can't disagree
+* - a fixed step simulation walks the events with step(until) : each step sees the buttons as they were at
+*   its own time & the presses since the step before it, instead of whatever the whole frame added up to
+* - events are plain data, inject() feeds recorded ones back in exactly like the callbacks do
+* - an InputRecording keeps every frame's InputState, a replay turns each one back into the events that make it.
+*   Keyboard, Mouse & the actions get what they got while recording, frame for frame. when inside a frame things
+*   happened isn't kept : a replayed frame's events all carry the time it's replayed at, so step() hands them
+*   all to the first step that reaches it, not to the steps they fell in while recording
+*/
+
+#define INPUT_RING_SIZE 1024 // events between two frames, far more than anyone can type
+#define INPUT_MAX_ACTIONS 32
+
+struct Button
+{
+	char is_pressed;
+	char was_pressed; // last frame
+	u16  id;
+	char went_down, went_up; // at some point this frame, however briefly
+};
+
+struct Mouse
+{
+	double raw_x, raw_y;   // pixel coordinates
+	double norm_x, norm_y; // normalized screen coordinates
+	double dx, dy;  // pos change since last frame in pixels
+	double norm_dx, norm_dy;
+
+	Button right_button, left_button;
+};
+
+// for selecting game objecs
+vec3 get_mouse_world_dir(Mouse mouse, mat4 proj_view)
+{
+	proj_view = glm::inverse(proj_view); // what is an unproject matrix?
+
+	vec4 ray_near = vec4(mouse.norm_x, mouse.norm_y, -1, 1); // near plane is z = -1
+	vec4 ray_far  = vec4(mouse.norm_x, mouse.norm_y,  0, 1);
+
+	// these are actually using inverse(proj_view)
+	ray_near = proj_view * ray_near; ray_near /= ray_near.w;
+	ray_far  = proj_view * ray_far;  ray_far /= ray_far.w;
+
+	return glm::normalize(ray_far - ray_near);
+}
+
+#define NUM_KEYBOARD_BUTTONS 34 // update when adding keyboard buttons
+struct Keyboard
+{
+	union
+	{
+		Button buttons[NUM_KEYBOARD_BUTTONS];
+
+		struct
+		{
+			Button A, B, C, D, E, F, G, H;
+			Button I, J, K, L, M, N, O, P;
+			Button Q, R, S, T, U, V, W, X;
+			Button Y, Z;
+
+			Button ESC, SPACE;
+			Button SHIFT, CTRL;
+			Button UP, DOWN, LEFT, RIGHT;
+		};
+	};
+};
+
+void init_keyboard(Keyboard* keyboard)
+{
+	keyboard->A = { false, false, GLFW_KEY_A };
+	keyboard->B = { false, false, GLFW_KEY_B };
+	keyboard->C = { false, false, GLFW_KEY_C };
+	keyboard->D = { false, false, GLFW_KEY_D };
+	keyboard->E = { false, false, GLFW_KEY_E };
+	keyboard->F = { false, false, GLFW_KEY_F };
+	keyboard->G = { false, false, GLFW_KEY_G };
+	keyboard->H = { false, false, GLFW_KEY_H };
+	keyboard->I = { false, false, GLFW_KEY_I };
+	keyboard->J = { false, false, GLFW_KEY_J };
+	keyboard->K = { false, false, GLFW_KEY_K };
+	keyboard->L = { false, false, GLFW_KEY_L };
+	keyboard->M = { false, false, GLFW_KEY_M };
+	keyboard->N = { false, false, GLFW_KEY_N };
+	keyboard->O = { false, false, GLFW_KEY_O };
+	keyboard->P = { false, false, GLFW_KEY_P };
+	keyboard->Q = { false, false, GLFW_KEY_Q };
+	keyboard->R = { false, false, GLFW_KEY_R };
+	keyboard->S = { false, false, GLFW_KEY_S };
+	keyboard->T = { false, false, GLFW_KEY_T };
+	keyboard->U = { false, false, GLFW_KEY_U };
+	keyboard->V = { false, false, GLFW_KEY_V };
+	keyboard->W = { false, false, GLFW_KEY_W };
+	keyboard->X = { false, false, GLFW_KEY_X };
+	keyboard->Y = { false, false, GLFW_KEY_Y };
+	keyboard->Z = { false, false, GLFW_KEY_Z };
+
+	keyboard->ESC   = { false, false, GLFW_KEY_ESCAPE       };
+	keyboard->SPACE = { false, false, GLFW_KEY_SPACE        };
+	keyboard->SHIFT = { false, false, GLFW_KEY_LEFT_SHIFT   };
+	keyboard->CTRL  = { false, false, GLFW_KEY_LEFT_CONTROL };
+
+	keyboard->UP    = { false, false, GLFW_KEY_UP    };
+	keyboard->DOWN  = { false, false, GLFW_KEY_DOWN  };
+	keyboard->LEFT  = { false, false, GLFW_KEY_LEFT  };
+	keyboard->RIGHT = { false, false, GLFW_KEY_RIGHT };
+}
+
+// ---------------------- events ------------------- //
+
+// buttons are numbered like Keyboard::buttons, then the mouse
+#define MOUSE_LEFT_BUTTON  (NUM_KEYBOARD_BUTTONS + 0)
+#define MOUSE_RIGHT_BUTTON (NUM_KEYBOARD_BUTTONS + 1)
+#define NUM_INPUT_BUTTONS  (NUM_KEYBOARD_BUTTONS + 2)
+
+enum INPUT_EVENT {
+	INPUT_BUTTON = 0,
+	INPUT_CURSOR,
+	INPUT_SCROLL
+};
+
+struct InputEvent
+{
+	int64 time; // microseconds on the input clock
+	u8  type;
+	u8  down;   // INPUT_BUTTON : 1 = pressed, 0 = released
+	u16 button; // INPUT_BUTTON
+	float x, y; // INPUT_CURSOR : pixels, INPUT_SCROLL : offsets
+};
+
+// buttons as of some point in time, & what changed since the state before it
+struct InputState
+{
+	uint64 down;     // bit per button
+	uint64 pressed;  // went down since the last begin(), even if it's back up already
+	uint64 released;
+	vec2 cursor;     // pixels
+	vec2 cursor_delta, scroll;
+	bool has_cursor; // the first position isn't a move
+
+	void begin() { pressed = released = 0; cursor_delta = scroll = vec2(0); } // keeps what's held
+	void apply(const InputEvent& event);
+
+	bool is_down(uint button) const { return (down    >> button) & 1; }
+	bool went_down(uint button) const { return (pressed >> button) & 1; }
+};
+
+void InputState::apply(const InputEvent& event)
+{
+	switch (event.type)
+	{
+	case INPUT_BUTTON:
+	{
+		uint64 bit = (uint64)1 << event.button;
+		if (event.down) { pressed  |= bit & ~down; down |=  bit; }
+		else            { released |= bit &  down; down &= ~bit; }
+	} break;
+	case INPUT_CURSOR:
+		if (has_cursor) cursor_delta += vec2(event.x, event.y) - cursor;
+		cursor = vec2(event.x, event.y);
+		has_cursor = true;
+		break;
+	case INPUT_SCROLL:
+		scroll += vec2(event.x, event.y);
+		break;
+	}
+}
+
+// --------------------- actions ------------------- //
+
+// a named set of buttons, any of which does the job
+struct InputAction
+{
+	string32 name;
+	uint64 buttons;
+};
+
+// ---------------------- system ------------------- //
+
+struct InputSystem
+{
+	NetQueue<InputEvent> ring; // callbacks -> frame
+	Timer clock;
+	int64 last_event_time; // producer side, keeps events in order
+	int8 button_of_key[GLFW_KEY_LAST + 1]; // -1 = not a button anything reads
+
+	InputEvent* events; // this frame's, after the ones step() hasn't reached yet
+	uint num_events, max_events;
+	uint next_event; // first one step() hasn't applied
+	bool stepping;   // step() was called since the last frame
+
+	int64 frame_time; // when this frame's events were collected
+	InputState frame; // everything that arrived this frame
+	InputState stepped; // as far as step() has got
+
+	InputAction actions[INPUT_MAX_ACTIONS];
+	uint num_actions;
+
+	bool replaying; // the callbacks ignore live input
+
+	void init(GLFWwindow* window, const Keyboard* keys); // window = NULL for events from inject() only
+	void release();
+
+	int64 now() { return clock.microseconds_elapsed(); }
+	void push(InputEvent event); // from the callbacks
+	void inject(const InputEvent* recorded, uint count); // like they just happened, times & all
+
+	void begin_frame(); // right after glfwPollEvents()
+	void update(Keyboard* keys, Mouse* mouse, uint screen_x, uint screen_y); // the per frame button structs, from this frame
+	InputState step(int64 until); // everything before until that no step has seen yet
+
+	uint add_action(const char* name); // index
+	void bind(uint action, uint button);
+	uint find_action(const char* name); // index + 1, 0 = no such action
+
+	// on a step's state, or the frame's
+	bool held    (uint action, const InputState& state) const { return (state.down     & actions[action].buttons) != 0; }
+	bool pressed (uint action, const InputState& state) const { return (state.pressed  & actions[action].buttons) != 0; }
+	bool released(uint action, const InputState& state) const { return (state.released & actions[action].buttons) != 0; }
+	float axis(uint negative, uint positive, const InputState& state) const { return (float)held(positive, state) - (float)held(negative, state); }
+
+	bool held    (uint action) const { return held    (action, frame); }
+	bool pressed (uint action) const { return pressed (action, frame); }
+	bool released(uint action) const { return released(action, frame); }
+	float axis(uint negative, uint positive) const { return axis(negative, positive, frame); }
+};
+
+// when the message behind the event being handled was posted. callbacks only ever run inside glfwPollEvents()
+int64 input_event_time(InputSystem* input)
+{
+	int64 time = input->now();
+
+#ifdef _WIN32
+	int64 age = (int64)(DWORD)(GetTickCount() - (DWORD)GetMessageTime()) * 1000;
+	if (age < 1000000) time -= age;
+#endif
+
+	// it was posted after the last poll, & step() needs them in order
+	time = glm::max(time, glm::max(input->last_event_time, input->frame_time));
+	input->last_event_time = time;
+	return time;
+}
+
+void input_key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	InputSystem* input = (InputSystem*)glfwGetWindowUserPointer(window);
+	if (input->replaying || action == GLFW_REPEAT || key < 0 || key > GLFW_KEY_LAST || input->button_of_key[key] < 0) return;
+
+	input->push({ input_event_time(input), INPUT_BUTTON, action == GLFW_PRESS, (u16)input->button_of_key[key] });
+}
+void input_mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
+{
+	InputSystem* input = (InputSystem*)glfwGetWindowUserPointer(window);
+	if (input->replaying || (button != GLFW_MOUSE_BUTTON_LEFT && button != GLFW_MOUSE_BUTTON_RIGHT)) return;
+
+	input->push({ input_event_time(input), INPUT_BUTTON, action == GLFW_PRESS, (u16)(button == GLFW_MOUSE_BUTTON_LEFT ? MOUSE_LEFT_BUTTON : MOUSE_RIGHT_BUTTON) });
+}
+void input_cursor_callback(GLFWwindow* window, double x, double y)
+{
+	InputSystem* input = (InputSystem*)glfwGetWindowUserPointer(window);
+	if (!input->replaying) input->push({ input_event_time(input), INPUT_CURSOR, 0, 0, (float)x, (float)y });
+}
+void input_scroll_callback(GLFWwindow* window, double x, double y)
+{
+	InputSystem* input = (InputSystem*)glfwGetWindowUserPointer(window);
+	if (!input->replaying) input->push({ input_event_time(input), INPUT_SCROLL, 0, 0, (float)x, (float)y });
+}
+
+void InputSystem::init(GLFWwindow* window, const Keyboard* keys)
+{
+	*this = {};
+	clock.init();
+	clock.start();
+
+	ring.init(INPUT_RING_SIZE);
+	max_events = INPUT_RING_SIZE;
+	events = Alloc(InputEvent, max_events);
+
+	memset(button_of_key, -1, sizeof(button_of_key));
+	for (uint i = 0; i < NUM_KEYBOARD_BUTTONS; i++) button_of_key[keys->buttons[i].id] = i;
+
+	// before ImGui installs its own, it calls these after handling the event
+	if (window)
+	{
+		glfwSetWindowUserPointer(window, this);
+		glfwSetKeyCallback(window, input_key_callback);
+		glfwSetMouseButtonCallback(window, input_mouse_button_callback);
+		glfwSetCursorPosCallback(window, input_cursor_callback);
+		glfwSetScrollCallback(window, input_scroll_callback);
+	}
+}
+
+void InputSystem::release()
+{
+	ring.release();
+	free(events);
+	*this = {};
+}
+
+void InputSystem::push(InputEvent event)
+{
+	if (!ring.push(event)) console->add_entry((char*)"input ring is full, event dropped", WARNING, WNDW);
+}
+
+void InputSystem::inject(const InputEvent* recorded, uint count)
+{
+	for (uint i = 0; i < count; i++)
+	{
+		last_event_time = glm::max(last_event_time, recorded[i].time);
+		push(recorded[i]);
+	}
+}
+
+void InputSystem::begin_frame()
+{
+	frame_time = now();
+	frame.begin();
+
+	// nobody is stepping through them : keep the step state current & start over
+	if (!stepping) while (next_event < num_events) stepped.apply(events[next_event++]);
+	stepping = false;
+
+	// what the steps haven't got to yet moves to the front, this frame's events go after it
+	uint pending = num_events - next_event;
+	memmove(events, events + next_event, pending * sizeof(InputEvent));
+	num_events = pending;
+	next_event = 0;
+
+	InputEvent event;
+	while (ring.pop(&event))
+	{
+		if (num_events == max_events)
+		{
+			max_events *= 2;
+			events = (InputEvent*)realloc(events, max_events * sizeof(InputEvent));
+		}
+
+		events[num_events++] = event;
+		frame.apply(event);
+	}
+}
+
+void update_button(Button* button, const InputState& state, uint index)
+{
+	button->was_pressed = button->is_pressed;
+	button->is_pressed  = state.is_down(index);
+	button->went_down   = state.went_down(index);
+	button->went_up     = (state.released >> index) & 1;
+}
+
+void InputSystem::update(Keyboard* keys, Mouse* mouse, uint screen_x, uint screen_y)
+{
+	for (uint i = 0; i < NUM_KEYBOARD_BUTTONS; i++) update_button(&keys->buttons[i], frame, i);
+	update_button(&mouse->left_button , frame, MOUSE_LEFT_BUTTON);
+	update_button(&mouse->right_button, frame, MOUSE_RIGHT_BUTTON);
+
+	mouse->raw_x = frame.cursor.x;
+	mouse->raw_y = frame.cursor.y;
+
+	mouse->dx =  frame.cursor_delta.x; // what do these mean again?
+	mouse->dy = -frame.cursor_delta.y;
+
+	mouse->norm_dx = mouse->dx / screen_x;
+	mouse->norm_dy = mouse->dy / screen_y;
+
+	mouse->norm_x = ((uint)mouse->raw_x % screen_x) / (double)screen_x;
+	mouse->norm_y = ((uint)mouse->raw_y % screen_y) / (double)screen_y;
+
+	mouse->norm_y = 1 - mouse->norm_y;
+	mouse->norm_x = (mouse->norm_x * 2) - 1;
+	mouse->norm_y = (mouse->norm_y * 2) - 1;
+}
+
+InputState InputSystem::step(int64 until)
+{
+	stepping = true;
+	stepped.begin();
+	while (next_event < num_events && events[next_event].time < until) stepped.apply(events[next_event++]);
+	return stepped;
+}
+
+uint InputSystem::add_action(const char* name)
+{
+	if (num_actions == INPUT_MAX_ACTIONS) { out("ERROR : max input actions exceeded!"); stop; return 0; }
+
+	InputAction* action = &actions[num_actions];
+	*action = {};
+	snprintf(action->name, sizeof(string32), "%s", name);
+	return num_actions++;
+}
+
+void InputSystem::bind(uint action, uint button) { actions[action].buttons |= (uint64)1 << button; }
+
+uint InputSystem::find_action(const char* name)
+{
+	for (uint i = 0; i < num_actions; i++) if (!strcmp(actions[i].name, name)) return i + 1;
+	return 0;
+}
+
+// -------------------- recording ------------------ //
+
+/* every frame's InputState, only what changed :
+
+	header : 'INPR', version, frames, screen width & height
+	frame  : 0, varint n                   n quiet frames (nothing held changed, nothing moved)
+	      or flags (INPUT_REC_*), then
+	         varint down ^ last down
+	         varint pressed, varint released   only when they aren't just what down changing implies
+	         int16 dx, dy                      cursor move, in whole pixels
+	         float x, y                        or the new position, when a move isn't that
+	         float x, y                        scroll
+*/
+
+#define INPUT_RECORDING_MAGIC   0x52504E49 // "INPR"
+#define INPUT_RECORDING_VERSION 1
+
+enum INPUT_RECORDING_FLAGS {
+	INPUT_REC_DOWN   = 1,
+	INPUT_REC_EDGES  = 2,
+	INPUT_REC_MOVE   = 4,
+	INPUT_REC_CURSOR = 8,
+	INPUT_REC_SCROLL = 16
+};
+
+struct InputRecordingHeader
+{
+	uint magic, version;
+	uint num_frames;
+	uint screen_width, screen_height;
+};
+
+struct InputRecording
+{
+	byte* data;
+	uint size, capacity;
+	uint cursor; // read position
+	uint num_frames, quiet_frames; // quiet_frames : the run not written out yet (recording) or not played yet (replay)
+	InputState last; // the frame before
+	uint screen_width, screen_height;
+
+	void init(uint screen_width, uint screen_height); // to record into
+	bool load(const char* path); // to replay
+	void release();
+
+	void add_frame(const InputState& frame);
+	bool save(const char* path);
+
+	bool next_frame(InputState* frame); // false once it's all played
+
+	void put(const void* bytes, uint count);
+	void put_varint(uint64 value);
+	bool get(void* bytes, uint count);
+	uint64 get_varint();
+};
+
+void InputRecording::init(uint width, uint height)
+{
+	*this = {};
+	screen_width  = width;
+	screen_height = height;
+	capacity = KiloByte(64);
+	data = Alloc(byte, capacity);
+}
+
+void InputRecording::release()
+{
+	free(data);
+	*this = {};
+}
+
+void InputRecording::put(const void* bytes, uint count)
+{
+	if (size + count > capacity)
+	{
+		while (size + count > capacity) capacity *= 2;
+		data = (byte*)realloc(data, capacity);
+	}
+	memcpy(data + size, bytes, count);
+	size += count;
+}
+
+void InputRecording::put_varint(uint64 value)
+{
+	byte bytes[10];
+	uint count = 0;
+	do { bytes[count++] = (byte)(value & 127) | (value > 127 ? 128 : 0); value >>= 7; } while (value);
+	put(bytes, count);
+}
+
+bool InputRecording::get(void* bytes, uint count)
+{
+	if (cursor + count > size) { cursor = size; return false; }
+	memcpy(bytes, data + cursor, count);
+	cursor += count;
+	return true;
+}
+
+uint64 InputRecording::get_varint()
+{
+	uint64 value = 0;
+	for (uint shift = 0; cursor < size && shift < 64; shift += 7)
+	{
+		byte b = data[cursor++];
+		value |= (uint64)(b & 127) << shift;
+		if (!(b & 128)) break;
+	}
+	return value;
+}
+
+void InputRecording::add_frame(const InputState& frame)
+{
+	num_frames++;
+
+	uint64 changed          = frame.down ^ last.down;
+	uint64 implied_pressed  = frame.down & ~last.down;
+	uint64 implied_released = last.down & ~frame.down;
+
+	byte flags = 0;
+	if (changed) flags |= INPUT_REC_DOWN;
+	if (frame.pressed != implied_pressed || frame.released != implied_released) flags |= INPUT_REC_EDGES;
+	if (frame.scroll != vec2(0)) flags |= INPUT_REC_SCROLL;
+
+	int16 move[2] = {};
+	if (frame.cursor != last.cursor || frame.has_cursor != last.has_cursor)
+	{
+		vec2 delta = frame.cursor - last.cursor;
+		bool whole = last.has_cursor && delta == glm::floor(delta) && glm::abs(delta.x) < 32768 && glm::abs(delta.y) < 32768;
+		if (whole) { move[0] = (int16)delta.x; move[1] = (int16)delta.y; }
+		whole = whole && last.cursor + vec2(move[0], move[1]) == frame.cursor; // has to come back out exactly
+		flags |= whole ? INPUT_REC_MOVE : INPUT_REC_CURSOR;
+	}
+
+	last = frame;
+	if (!flags) { quiet_frames++; return; }
+
+	if (quiet_frames) { byte zero = 0; put(&zero, 1); put_varint(quiet_frames); quiet_frames = 0; }
+
+	put(&flags, 1);
+	if (flags & INPUT_REC_DOWN)   put_varint(changed);
+	if (flags & INPUT_REC_EDGES)  { put_varint(frame.pressed); put_varint(frame.released); }
+	if (flags & INPUT_REC_MOVE)   put(move, sizeof(move));
+	if (flags & INPUT_REC_CURSOR) put(&frame.cursor, sizeof(vec2));
+	if (flags & INPUT_REC_SCROLL) put(&frame.scroll, sizeof(vec2));
+}
+
+bool InputRecording::save(const char* path)
+{
+	if (quiet_frames) { byte zero = 0; put(&zero, 1); put_varint(quiet_frames); quiet_frames = 0; }
+
+	FILE* file = fopen(path, "wb");
+	if (!file) { print("could not write %s\n", path); return false; }
+
+	InputRecordingHeader header = { INPUT_RECORDING_MAGIC, INPUT_RECORDING_VERSION, num_frames, screen_width, screen_height };
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(data, 1, size, file);
+	fclose(file);
+	return true;
+}
+
+bool InputRecording::load(const char* path)
+{
+	*this = {};
+
+	FILE* file = fopen(path, "rb");
+	if (!file) { print("could not open %s\n", path); return false; }
+
+	InputRecordingHeader header = {};
+	fread(&header, sizeof(header), 1, file);
+	if (header.magic != INPUT_RECORDING_MAGIC || header.version != INPUT_RECORDING_VERSION) { print("%s is not an input recording\n", path); fclose(file); return false; }
+
+	fseek(file, 0, SEEK_END);
+	size = capacity = (uint)(ftell(file) - sizeof(header));
+	fseek(file, sizeof(header), SEEK_SET);
+
+	data = Alloc(byte, size + 1);
+	size = (uint)fread(data, 1, size, file);
+	fclose(file);
+
+	num_frames    = header.num_frames;
+	screen_width  = header.screen_width;
+	screen_height = header.screen_height;
+	return true;
+}
+
+bool InputRecording::next_frame(InputState* frame)
+{
+	InputState next = last;
+	next.begin();
+
+	if (!quiet_frames && cursor < size && data[cursor] == 0) { cursor++; quiet_frames = (uint)get_varint(); }
+	if (quiet_frames) { quiet_frames--; *frame = last = next; return true; }
+	if (cursor >= size) return false;
+
+	byte flags = data[cursor++];
+	if (flags & INPUT_REC_DOWN) next.down ^= get_varint();
+
+	next.pressed  = next.down & ~last.down;
+	next.released = last.down & ~next.down;
+	if (flags & INPUT_REC_EDGES) { next.pressed = get_varint(); next.released = get_varint(); }
+
+	if (flags & INPUT_REC_MOVE)   { int16 move[2] = {}; get(move, sizeof(move)); next.cursor += vec2(move[0], move[1]); }
+	if (flags & INPUT_REC_CURSOR) get(&next.cursor, sizeof(vec2));
+	if (flags & (INPUT_REC_MOVE | INPUT_REC_CURSOR))
+	{
+		next.cursor_delta = last.has_cursor ? next.cursor - last.cursor : vec2(0);
+		next.has_cursor = true;
+	}
+	if (flags & INPUT_REC_SCROLL) get(&next.scroll, sizeof(vec2));
+
+	*frame = last = next;
+	return true;
+}
+
+// the events that take an InputSystem from previous to frame, all stamped with one time (the recording has no others)
+uint input_events_between(const InputState& previous, const InputState& frame, int64 time, InputEvent* events)
+{
+	uint count = 0;
+
+	uint64 changed = (previous.down ^ frame.down) | frame.pressed | frame.released;
+	for (uint b = 0; b < NUM_INPUT_BUTTONS; b++)
+	{
+		if (!((changed >> b) & 1)) continue;
+
+		bool was  = (previous.down >> b) & 1, is = (frame.down >> b) & 1;
+		bool down = (frame.pressed >> b) & 1, up = (frame.released >> b) & 1;
+
+		// every press needs the button up first & every release needs it down, whichever state it starts in
+		bool state = was;
+		if (state  && up  ) { events[count++] = { time, INPUT_BUTTON, 0, (u16)b }; state = false; up   = false; }
+		if (!state && down) { events[count++] = { time, INPUT_BUTTON, 1, (u16)b }; state = true;  down = false; }
+		if (state  && up  ) { events[count++] = { time, INPUT_BUTTON, 0, (u16)b }; state = false; }
+		if (state != is) events[count++] = { time, INPUT_BUTTON, is, (u16)b };
+	}
+
+	if (frame.has_cursor && (frame.cursor != previous.cursor || !previous.has_cursor)) events[count++] = { time, INPUT_CURSOR, 0, 0, frame.cursor.x, frame.cursor.y };
+	if (frame.scroll != vec2(0)) events[count++] = { time, INPUT_SCROLL, 0, 0, frame.scroll.x, frame.scroll.y };
+
+	return count;
+}
+
+#define INPUT_MAX_REPLAY_EVENTS (NUM_INPUT_BUTTONS * 3 + 2)
+
+int compare_frame_times(const void* a, const void* b)
+{
+	int64 x = *(const int64*)a, y = *(const int64*)b;
+	return (x > y) - (x < y);
+}
+
+// what a replay run gets judged by : average, percentiles & the worst frame, in milliseconds
+uint frame_time_report(const int64* frame_times, uint count, char* text, uint size)
+{
+	if (!count) return snprintf(text, size, "replay : no frames\n");
+
+	int64* sorted = Alloc(int64, count);
+	memcpy(sorted, frame_times, count * sizeof(int64));
+	qsort(sorted, count, sizeof(int64), compare_frame_times);
+
+	int64 total = 0;
+	for (uint i = 0; i < count; i++) total += sorted[i];
+
+	const auto percentile = [&](float p) { return sorted[glm::min(count - 1, (uint)(p * count))] / 1000.f; };
+	uint length = snprintf(text, size,
+		"replay : %u frames in %.2f s, %.1f fps\n"
+		"frame ms : avg %.3f | p50 %.3f | p95 %.3f | p99 %.3f | max %.3f\n",
+		count, total / 1000000.0, count * 1000000.0 / glm::max(total, (int64)1),
+		total / 1000.0 / count, percentile(.5f), percentile(.95f), percentile(.99f), sorted[count - 1] / 1000.f);
+
+	free(sorted);
+	return length;
+}
+
+// ---------------------- test --------------------- //
+
+// a tap between two frames & a fixed step simulation 4 steps behind the frame, out of events only
+void input_test()
+{
+	Keyboard keys = {};
+	init_keyboard(&keys);
+
+	InputSystem* input = Alloc(InputSystem, 1);
+	input->init(NULL, &keys);
+
+	uint jump = input->add_action("jump");
+	input->bind(jump, 27); // SPACE
+	input->bind(jump, MOUSE_LEFT_BUTTON);
+
+	// frame 1 : space goes down & up 3 ms apart, both between polls
+	InputEvent tap[] = {
+		{ 1000, INPUT_BUTTON, 1, 27 },
+		{ 4000, INPUT_BUTTON, 0, 27 },
+		{ 9000, INPUT_BUTTON, 1, 22 }, // W, held
+	};
+	input->inject(tap, 3);
+	input->begin_frame();
+
+	Mouse mouse = {};
+	input->update(&keys, &mouse, 1920, 1080);
+	bool tap_seen = input->pressed(jump) && keys.SPACE.went_down && !keys.SPACE.is_pressed && keys.W.is_pressed;
+
+	// the same events, 4 steps of 2.5 ms : the tap only lands in the first two, W only in the last
+	bool steps_right = true;
+	uint64 held_w = 0, pressed_jump = 0;
+	for (uint s = 0; s < 4; s++)
+	{
+		InputState state = input->step((s + 1) * 2500);
+		held_w       |= (uint64)state.is_down(22) << s;
+		pressed_jump |= (uint64)input->pressed(jump, state) << s;
+	}
+	steps_right = held_w == 0b1000 && pressed_jump == 0b0001;
+
+	// events past the last step wait for the next frame's steps
+	InputEvent late = { 20000, INPUT_BUTTON, 0, 22 };
+	input->inject(&late, 1);
+	input->begin_frame();
+	bool late_waits = input->step(15000).is_down(22) && !input->step(25000).is_down(22);
+
+	out("input : tap between frames " << (tap_seen ? "seen" : "LOST")
+		<< ", per step replay " << (steps_right ? "right" : "WRONG")
+		<< ", late events " << (late_waits ? "wait for their step" : "WRONG"));
+
+	input->release();
+	free(input);
+}
+
+// a made up session (held keys, taps, mouse look, the odd scroll) recorded, saved, loaded & replayed into a fresh InputSystem
+void input_recording_test(uint num_frames = 20000, const char* path = "input_recording_test.input")
+{
+	Keyboard keys = {};
+	init_keyboard(&keys);
+
+	InputSystem* live = Alloc(InputSystem, 1);
+	live->init(NULL, &keys);
+
+	InputRecording* recording = Alloc(InputRecording, 1);
+	recording->init(1920, 1080);
+
+	Random rng = {};
+	rng.seed(0x5EED);
+
+	InputState* expected = Alloc(InputState, num_frames);
+	vec2 cursor = vec2(960, 540);
+	for (uint f = 0; f < num_frames; f++)
+	{
+		int64 time = f * 8333;
+		InputEvent events[8];
+		uint count = 0;
+
+		if (rng.next_float() < .05f) events[count++] = { time, INPUT_BUTTON, (u8)(rng.next_uint() & 1), (u16)(rng.next_uint() % NUM_INPUT_BUTTONS) };
+		if (rng.next_float() < .01f) { u16 b = rng.next_uint() % NUM_INPUT_BUTTONS; events[count++] = { time, INPUT_BUTTON, 1, b }; events[count++] = { time + 1000, INPUT_BUTTON, 0, b }; }
+		if (rng.next_float() < .30f) { cursor += vec2((int)(rng.next_uint() % 21) - 10, (int)(rng.next_uint() % 21) - 10); events[count++] = { time, INPUT_CURSOR, 0, 0, cursor.x, cursor.y }; }
+		if (rng.next_float() < .002f) events[count++] = { time, INPUT_CURSOR, 0, 0, cursor.x + .5f, cursor.y }; // not a whole pixel
+		if (rng.next_float() < .01f) events[count++] = { time, INPUT_SCROLL, 0, 0, 0, 1 };
+
+		live->inject(events, count);
+		live->begin_frame();
+		recording->add_frame(live->frame);
+		expected[f] = live->frame;
+	}
+	recording->save(path);
+	uint bytes = recording->size;
+
+	InputRecording* replay = Alloc(InputRecording, 1);
+	replay->load(path);
+
+	InputSystem* replayed = Alloc(InputSystem, 1);
+	replayed->init(NULL, &keys);
+
+	uint wrong = 0, frames = 0;
+	InputState next;
+	while (1)
+	{
+		InputState previous = replay->last;
+		if (!replay->next_frame(&next)) break;
+
+		InputEvent events[INPUT_MAX_REPLAY_EVENTS];
+		replayed->inject(events, input_events_between(previous, next, replayed->now(), events));
+		replayed->begin_frame();
+
+		const InputState& a = replayed->frame;
+		const InputState& b = expected[frames++];
+		wrong += a.down != b.down || a.pressed != b.pressed || a.released != b.released || a.cursor != b.cursor || a.cursor_delta != b.cursor_delta || a.scroll != b.scroll;
+	}
+	remove(path);
+
+	out("input recording : " << frames << " of " << num_frames << " frames in " << bytes << " bytes (" << bytes / (float)num_frames << " per frame), " << wrong << " replayed wrong");
+
+	live->release();
+	replayed->release();
+	recording->release();
+	replay->release();
+	free(live);
+	free(replayed);
+	free(recording);
+	free(replay);
+	free(expected);
+}
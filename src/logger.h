@@ -16,7 +16,8 @@ enum LOGSOURCE {
    WNDW = 0, // Window
    RNDR,     // Renderer
    PHYS,     // Physics
-   NETW      // Networking
+   NETW,     // Networking
+   AUDI      // Audio
 };
 
 const uint MAX_LOGQUEUE_ENTRIES = 64;
@@ -45,22 +46,29 @@ struct GameConsole {
       logs.entries[idx].severity = severity;
       memcpy(logs.entries[idx].text, text, 62);
 
+#ifdef HEADLESS
+      print("%.62s\n", text); // nobody draws the console on a server
+#endif
+
       // increment + wrap around if needed
       logs.write_idx = (logs.write_idx + 1) % MAX_LOGQUEUE_ENTRIES;
    }
 } *console;
 
+#ifndef HEADLESS
+
 // This draws an imgui window for the console
 void draw_console(GameConsole* console)
 {
    LogQueue logs = console->logs;
 
    // Source colors — modern, balanced, and consistent brightness
-   const ImVec4 source_colors[4] = {
+   const ImVec4 source_colors[5] = {
        ImVec4(0.45f, 0.65f, 1.00f, 1.0f), // WNDW : Azure Blue
        ImVec4(0.75f, 0.60f, 1.00f, 1.0f), // RNDR : Vivid Violet
        ImVec4(1.00f, 0.55f, 0.45f, 1.0f), // PHYS : Coral Rust
-       ImVec4(1.00f, 0.80f, 0.55f, 1.0f)  // NETW : Signal Amber
+       ImVec4(1.00f, 0.80f, 0.55f, 1.0f), // NETW : Signal Amber
+       ImVec4(0.50f, 0.90f, 0.80f, 1.0f)  // AUDI : Sea Green
    };
 
    // Severity levels — distinct, modern color language
@@ -89,11 +97,12 @@ void draw_console(GameConsole* console)
        "S"  // success
    };
 
-   const char* source_messages[4] = {
+   const char* source_messages[5] = {
        "WNDW", // Window
        "RNDR", // Renderer
        "PHYS", // Physics
-       "NETW"  // Networking
+       "NETW", // Networking
+       "AUDI"  // Audio
    };
 
    // imgui window settings
@@ -144,4 +153,6 @@ void draw_console(GameConsole* console)
 
    ImGui::End();
    ImGui::PopStyleColor();
-}
\ No newline at end of file
+}
+
+#endif
\ No newline at end of file
@@ -1,17 +1,88 @@
-#include "drawer.h"
+#include "rollback.h"
 
-int main()
+// game.exe [-record session.input] [-replay session.input [-uncapped]] [-audio openal|software|null]
+int main(int argc, char** argv)
 {
 	console = Alloc(GameConsole, 1);
 
+	// worker threads : one per core for parallel work, a couple more for file io
+	uint num_cores = get_num_cores();
+	work_queue = Alloc(WorkQueue, 1);
+	background_queue = Alloc(WorkQueue, 1);
+	init_work_queue(work_queue, num_cores > 1 ? num_cores - 1 : 1);
+	init_work_queue(background_queue, 2);
+
+	uint audio_mode = AUDIO_OPENAL;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (strcmp(argv[i], "-audio")) continue;
+		if (!strcmp(argv[i + 1], "software")) audio_mode = AUDIO_SOFTWARE;
+		if (!strcmp(argv[i + 1], "null"    )) audio_mode = AUDIO_NULL;
+	}
+
 	GameWindow* window = Alloc(GameWindow, 1);
-	window->init(1920, 1080);
+	window->init(1920, 1080, audio_mode);
+
+	bool uncapped = false;
+	for (int i = 1; i < argc; i++) uncapped |= !strcmp(argv[i], "-uncapped");
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		if (!strcmp(argv[i], "-record")) window->record(argv[i + 1]);
+		if (!strcmp(argv[i], "-replay")) window->play(argv[i + 1], uncapped);
+	}
 
 	GeometryRenderer* geometry_renderer = Alloc(GeometryRenderer, 1);
-	geometry_renderer->init();
+	geometry_renderer->init(INSTANCE_COMPACT); // 24 byte instances, the models below are rigid
 	geometry_renderer->add_mesh("assets/meshes/SM/UV/sphere.mesh_uv");
 	geometry_renderer->add_mesh("assets/meshes/SM/UV/cube.mesh_uv");
 	geometry_renderer->add_mesh("assets/meshes/SM/UV/ammo.mesh_uv");
+	geometry_renderer->add_mesh("assets/meshes/SM/UV/palm_tree.mesh_uv"); // only ever drawn through the ecs below
+
+	// material 0 is gold, these get picked per instance
+	uint plastic = geometry_renderer->materials.add({ vec3(0.900, 0.100, 0.100), 0, .5, 1, 1, 0 });
+	uint iron    = geometry_renderer->materials.add({ vec3(0.560, 0.570, 0.580), 1, .5, 1, 1, 0 });
+
+	uint grass = geometry_renderer->materials.add({ vec3(0.300, 0.450, 0.150), 0, .9, 1, 1, 0 });
+
+	Terrain* terrain = Alloc(Terrain, 1);
+	terrain->init(0x5EED, grass, INSTANCE_COMPACT);
+
+	uint water = geometry_renderer->materials.add({ vec3(0.020, 0.120, 0.200), 0, .1, 1, 1, 0 });
+
+	Ocean* ocean = Alloc(Ocean, 1);
+	ocean->init(water, -4, vec2(12, 5), 2, .8f, INSTANCE_COMPACT);
+
+	// a row of swaying tubes until there are real skinned assets
+	Animator* animator = Alloc(Animator, 1);
+	animator->init(INSTANCE_COMPACT);
+	SkinnedMesh tube = {};
+	generate_skinned_tube(&tube, 16, 4, 12);
+	uint tube_mesh = animator->add_mesh(tube);
+	for (int i = 0; i < 8; i++)
+	{
+		uint c = animator->add_character(tube_mesh, transform(vec3(i * 2 - 7, 0, -6), quat(1, 0, 0, 0), vec3(.25f)), iron);
+		if (c) animator->play(c, 1 + (i & 1), 0);
+	}
+
+	SceneGraph* scene = Alloc(SceneGraph, 1);
+	scene->init(1024);
+	uint sphere = scene->create_node(0, vec3( 0, 0, 0), quat(1, 0, 0, 0), vec3(1), 1);
+	uint cube   = scene->create_node(0, vec3( 2, 0, 0), quat(1, 0, 0, 0), vec3(1), 2, plastic);
+	uint ammo   = scene->create_node(0, vec3(-1, 0, 0), quat(1, 0, 0, 0), vec3(1), 3, iron);
+
+	// a ring of slowly turning palm trees, drawn through extract_instances() instead of the scene graph
+	World* world = Alloc(World, 1);
+	world->init(1024);
+	float world_dt = 1.f / 120;
+	world->add_system("integrate", COMPONENT(COMPONENT_VELOCITY), COMPONENT(COMPONENT_TRANSFORM), integrate_velocities, &world_dt);
+	for (int i = 0; i < 16; i++)
+	{
+		float a = i * (2 * 3.14159265f / 16);
+		uint palm = world->create_entity(COMPONENT(COMPONENT_TRANSFORM) | COMPONENT(COMPONENT_VELOCITY) | COMPONENT(COMPONENT_MESH_REF));
+		*(EntityTransform*)world->get(palm, COMPONENT_TRANSFORM) = { vec3(cosf(a) * 12, 0, sinf(a) * 12), 1, quat(1, 0, 0, 0) };
+		*(Velocity*)world->get(palm, COMPONENT_VELOCITY) = { vec3(0), vec3(0, .2f, 0) };
+		*(MeshRef*)world->get(palm, COMPONENT_MESH_REF) = { 4, grass };
+	}
 
 	window->timer.start();
 	while (window->instance)
@@ -27,21 +98,33 @@ int main()
 
 		static float runningTime = 0;
 		runningTime += 1.f / 60000;
-		mat4 model[3] = { mat4(1), mat4(1) };
-		model[0] = glm::rotate(mat4(1), 360.f * runningTime, vec3(0, 1, 0));
+		float angle = 360.f * runningTime;
+		scene->set_local(sphere, vec3( 0, 0, 0), glm::angleAxis(angle, vec3(0, 1, 0)), vec3(1));
+		scene->set_local(cube  , vec3( 2, 0, 0), glm::angleAxis(angle, glm::normalize(vec3(1, 1, 0))), vec3(1));
+		scene->set_local(ammo  , vec3(-1, 0, 0), glm::angleAxis(angle, glm::normalize(vec3(0, 1, 1))), vec3(1));
+
+		scene->update();
+		scene->extract(&geometry_renderer->drawbuffer);
 
-		model[1] = glm::translate(mat4(1), vec3(2, 0, 0));
-		model[1] = glm::rotate(model[1], 360.f * runningTime, vec3(1, 1, 0));
+		world->run_systems();
+		extract_instances(world, &geometry_renderer->drawbuffer); // meshes the scene doesn't use, so the blocks don't overlap
 
-		model[2] = glm::translate(mat4(1), vec3(-1, 0, 0));
-		model[2] = glm::rotate(model[2], 360.f * runningTime, vec3(0, 1, 1));
+		// streams chunks in & out around the camera, never waits on the workers
+		terrain->update(geometry_renderer->camera.position);
 
-		geometry_renderer->drawbuffer.add_instances(1, 1, &model[0]);
-		geometry_renderer->drawbuffer.add_instances(2, 1, &model[1]);
-		geometry_renderer->drawbuffer.add_instances(3, 1, &model[2]);
+		static float ocean_time = 0;
+		ocean_time += 1.f / 120; // the frame rate target
+		ocean->update(ocean_time, geometry_renderer->camera.position);
+
+		animator->update(1.f / 120); // poses & skins every character on the workers
 
 		// geometry
 		geometry_renderer->draw(window);
+		terrain->draw(); // same pass, same shader
+		ocean->draw();
+		animator->draw();
+
+		window->audio.set_listener(geometry_renderer->camera); // draw() is what moves the camera
 
 		// gbuffer (direct lighting)
 		window->draw_gbuf(geometry_renderer->camera.position);
@@ -0,0 +1,214 @@
+#include "textures.h"
+
+/* MaterialTable : every material lives in one shader storage buffer
+*
+* - instances pick a material with a per-instance index (see DrawBuffer::add_instances)
+* - so every mesh & material can go out in the same multi-draw with no state changes
+* - with GL_ARB_bindless_texture, each material carries its own texture handle
+* - without it, every texture a material uses gets copied into a layer of one RGBA8 texture array
+*   (MATERIAL_LAYER_SIZE square, on unit 0) & the material carries the layer instead. the copy is
+*   redone whenever the streamer swaps the texture's storage, so streamed mips still show up
+*
+* material 0 is the default material (gold), so instances without an index still draw
+*/
+
+const uint MAX_MATERIALS = 1024;
+const uint MAX_MATERIAL_LAYERS = 64;  // different textures without bindless
+const uint MATERIAL_LAYER_SIZE = 256; // texels per side of every layer
+const uint MATERIAL_LAYER_MIPS = 9;   // 256 down to 1
+
+struct Material
+{
+	vec3  albedo; // base color
+	float metallic, roughness, ao;
+	float uv_scale;
+	uint  albedo_texture; // texture_id from the TextureStreamer, 0 = untextured
+};
+
+// matches the std430 layout in geom.frag
+struct GPU_Material
+{
+	vec4   albedo; // rgb = base color
+	vec4   params; // metallic, roughness, ao, uv scale
+	uint64 albedo_handle; // bindless handle, or layer + 1 without bindless. 0 = untextured
+	uint64 padding;
+};
+
+struct MaterialTable
+{
+	Material     materials[MAX_MATERIALS];
+	GPU_Material gpu_materials[MAX_MATERIALS];
+	uint texture_generations[MAX_MATERIALS]; // to notice when the streamer swaps a texture
+	uint num_materials;
+
+	GLuint ssbo;
+	bool bindless;
+	bool dirty; // re-upload on the next update()
+
+	// without bindless
+	GLuint layers; // GL_TEXTURE_2D_ARRAY
+	uint layer_textures[MAX_MATERIAL_LAYERS];    // texture_id in each layer
+	uint layer_generations[MAX_MATERIAL_LAYERS]; // of the texture when it was copied, + 1 so 0 always means stale
+	uint num_layers;
+	GLuint copy_fbo, copy_vao;
+	ShaderProgram copy_shader;
+
+	void init();
+	uint add(Material material); // returns material index
+	void set(uint index, Material material);
+	void update(TextureStreamer* textures); // once per frame, before drawing
+	void bind(); // binds the table to ssbo binding point 0, & the layers to texture unit 0
+
+	// internal
+	uint layer_of(uint texture_id); // + 1, 0 = out of layers
+	void copy_layers(TextureStreamer* textures);
+};
+
+void MaterialTable::init()
+{
+	bindless = GLEW_ARB_bindless_texture;
+
+	glGenBuffers(1, &ssbo);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(gpu_materials), NULL, GL_DYNAMIC_DRAW);
+
+	if (!bindless)
+	{
+		glGenTextures(1, &layers);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, MATERIAL_LAYER_MIPS, GL_RGBA8, MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE, MAX_MATERIAL_LAYERS);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		glGenFramebuffers(1, &copy_fbo);
+		glGenVertexArrays(1, &copy_vao); // the copy draws without vertex buffers, core still wants one bound
+		copy_shader.create("assets/shaders/layer.vert", "assets/shaders/layer.frag");
+	}
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init MaterialTable | Bindless : [%s]", bindless ? "yes" : "no, texture array");
+	console->add_entry(msg, bindless ? SUCCESS : WARNING, RNDR);
+}
+uint MaterialTable::add(Material material)
+{
+	if (num_materials == MAX_MATERIALS) { out("ERROR : max materials exceeded!"); stop; return 0; }
+
+	uint index = num_materials++;
+	set(index, material);
+	return index;
+}
+void MaterialTable::set(uint index, Material material)
+{
+	materials[index] = material;
+	texture_generations[index] = 0; // forces a handle refresh
+
+	gpu_materials[index].albedo = vec4(material.albedo, 1);
+	gpu_materials[index].params = vec4(material.metallic, material.roughness, material.ao, material.uv_scale);
+	gpu_materials[index].albedo_handle = 0;
+
+	// the layer never changes, only what's in it
+	if (!bindless && material.albedo_texture)
+	{
+		uint layer = layer_of(material.albedo_texture);
+		if (!layer) { out("ERROR : max material texture layers exceeded!"); stop; materials[index].albedo_texture = 0; }
+		gpu_materials[index].albedo_handle = layer;
+	}
+
+	dirty = true;
+}
+uint MaterialTable::layer_of(uint texture_id)
+{
+	for (uint i = 0; i < num_layers; i++) if (layer_textures[i] == texture_id) return i + 1;
+	if (num_layers == MAX_MATERIAL_LAYERS) return 0;
+
+	layer_textures[num_layers] = texture_id;
+	layer_generations[num_layers] = 0;
+	return ++num_layers;
+}
+void MaterialTable::update(TextureStreamer* textures)
+{
+	for (uint i = 0; i < num_materials; i++)
+	{
+		uint texture_id = materials[i].albedo_texture;
+		if (!texture_id) continue;
+
+		textures->touch(texture_id);
+		if (!bindless) continue; // the layers get refreshed below
+
+		// the streamer reallocates textures as mips come & go, so handles go stale
+		StreamedTexture* texture = &textures->textures[texture_id - 1];
+		if (texture_generations[i] == texture->generation + 1) continue;
+		texture_generations[i] = texture->generation + 1; // + 1 so 0 always means stale
+
+		uint64 handle = glGetTextureHandleARB(textures->gl_id(texture_id));
+		if (!glIsTextureHandleResidentARB(handle)) glMakeTextureHandleResidentARB(handle);
+
+		gpu_materials[i].albedo_handle = handle;
+		dirty = true;
+	}
+
+	if (!bindless) copy_layers(textures);
+	if (!dirty) return;
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, num_materials * sizeof(GPU_Material), gpu_materials);
+	dirty = false;
+}
+void MaterialTable::bind()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, ssbo);
+
+	if (bindless) return;
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+}
+
+// draws every texture that changed since its last copy into its layer, then redoes the array's mips.
+// only when the streamer moved something, so the state it touches is put back rather than assumed
+void MaterialTable::copy_layers(TextureStreamer* textures)
+{
+	uint stale = 0;
+	for (uint i = 0; i < num_layers; i++) stale += layer_generations[i] != textures->textures[layer_textures[i] - 1].generation + 1;
+	if (!stale) return;
+
+	GLint viewport[4], framebuffer, program, vao;
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vao);
+	GLboolean blend = glIsEnabled(GL_BLEND), depth_test = glIsEnabled(GL_DEPTH_TEST), cull = glIsEnabled(GL_CULL_FACE);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copy_fbo);
+	glViewport(0, 0, MATERIAL_LAYER_SIZE, MATERIAL_LAYER_SIZE);
+	glBindVertexArray(copy_vao);
+	copy_shader.bind();
+	glActiveTexture(GL_TEXTURE0);
+
+	for (uint i = 0; i < num_layers; i++)
+	{
+		uint generation = textures->textures[layer_textures[i] - 1].generation + 1;
+		if (layer_generations[i] == generation) continue;
+		layer_generations[i] = generation;
+
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, layers, 0, i);
+		glBindTexture(GL_TEXTURE_2D, textures->gl_id(layer_textures[i]));
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, layers);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glBindVertexArray(vao);
+	glUseProgram(program);
+	if (blend) glEnable(GL_BLEND);
+	if (depth_test) glEnable(GL_DEPTH_TEST);
+	if (cull) glEnable(GL_CULL_FACE);
+}
@@ -0,0 +1,590 @@
+#ifdef HEADLESS
+#include "logger.h" // the benchmark mixes without a window or a sound card
+#else
+#include "input.h"
+#endif
+
+/* Mixer : voices mixed on the cpu into float buffers, then through a graph of buses
+
+	- MIXER_BLOCK frames at a time. every voice is resampled (linear, or a straight copy when the rates match),
+	  given a gain per ear & added into its bus. the ears' gains come from the distance to the listener
+	  (inverse, clamped like AL_INVERSE_DISTANCE_CLAMPED) & an equal power pan along the listener's right
+	- gains ramp across the block towards where they should be, so moving sounds don't click
+	- the inner loop is written once against the lanes interface & picked at runtime (SSE2, AVX2, AVX-512),
+	  resampling positions become gathers
+	- buses : every bus has a one pole low-pass, an optional reverb & a gain, then gets added into its parent
+	  & optionally sent into a second bus (the reverb). a bus can only feed buses made before it,
+	  so walking them from the last one down to the master (bus 0) always has every input done first
+	- sounds are planar float. every channel is followed by MIXER_PAD frames : silence, or the start again
+	  for a loop, so interpolating past the last frame never needs a branch
+	- a voice can be limited to the frames that are there so far : a stream refills a looping ring
+	  ahead of the voice, & the voice stops at the limit (an underrun) until there's more
+*/
+
+#define MIXER_BLOCK      256 // frames per mix
+#define MIXER_MAX_VOICES 256
+#define MIXER_MAX_BUSES  16
+#define MIXER_PAD        2   // frames after every channel of a sound
+
+#define MIXER_REFERENCE_DISTANCE 1.f   // full volume inside this
+#define MIXER_MAX_DISTANCE       100.f // no quieter past this
+#define MIXER_ROLLOFF            1.f
+#define MIXER_MIN_PITCH          .0625f
+#define MIXER_MAX_PITCH          4.f // past 2 a stream's ring only stays 4 blocks ahead
+
+#define MIXER_LOOP       1
+#define MIXER_POSITIONAL 2
+#define MIXER_LIMITED    4 // stops at limit, an underrun while the stream is still going
+#define MIXER_LAST       8 // the stream is done, limit is the end of it
+
+struct MixerSound
+{
+	float* samples; // planar, each channel is num_frames + MIXER_PAD
+	uint num_frames, channels, sample_rate;
+
+	const float* channel(uint c) const { return samples + c * (num_frames + MIXER_PAD); }
+};
+
+struct MixerVoice
+{
+	const MixerSound* sound; // NULL = free
+	uint  flags, bus;
+	uint  frame; // into the sound
+	float frac, step; // where between frames, how far a frame of output moves
+	float gain;
+	vec3  position;
+	float left_gain, right_gain; // where the last ramp ended
+	bool  started;
+	uint64 consumed, limit; // frames of the sound read so far, & how far they can go with MIXER_LIMITED
+};
+
+struct MixerReverb
+{
+	float* lines; // every delay line back to back
+	uint   offset[2][6], length[2][6], position[2][6]; // per channel : 4 combs, then 2 allpasses
+	float  damped[2][4];
+	float  feedback, damping;
+};
+
+struct MixerBus
+{
+	float* left;
+	float* right;
+	uint  parent; // bus 0 has none
+	float gain;
+	float lowpass; // one pole coefficient, 1 = off
+	float lowpass_left, lowpass_right;
+	int   send; // -1 = none
+	float send_gain;
+	MixerReverb* reverb;
+};
+
+struct Mixer
+{
+	uint sample_rate;
+	uint simd; // SIMD_LEVEL
+
+	MixerVoice voices[MIXER_MAX_VOICES];
+	MixerBus buses[MIXER_MAX_BUSES];
+	uint num_buses;
+
+	vec3 listener_position, listener_right;
+
+	uint64 blocks, underruns;
+	uint active; // voices that made it into the last block
+
+	void init(uint sample_rate); // makes the master bus
+	void release();
+
+	uint add_bus(uint parent, float gain = 1);
+	uint add_reverb(uint parent, float room_size = .84f, float damping = .2f); // a bus that only puts out its reverb
+	void set_lowpass(uint bus, float cutoff); // hz, 0 = off
+	void set_send(uint bus, int target, float gain);
+	void set_listener(vec3 position, vec3 front, vec3 up);
+
+	MixerVoice* start(uint voice, const MixerSound* sound, uint bus, float gain, float pitch, uint flags, vec3 position = vec3(0));
+	void mix(); // one block, the result is in buses[0]
+
+	void mix_voice(MixerVoice* voice);
+	void process_bus(uint bus);
+};
+
+// ------------------------ lanes ------------------ //
+
+// out += interpolated input * ramped gain, for both ears. in_left == in_right for a mono sound
+template <typename L> void mix_voice_lanes(const float* in_left, const float* in_right, uint count, float frac, float step,
+	float left_gain, float left_ramp, float right_gain, float right_ramp, float* left, float* right)
+{
+	typedef typename L::F F;
+	typedef typename L::I I;
+
+	alignas(64) static const float lane_index[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	const F lanes = L::load(lane_index);
+	const bool mono  = in_left == in_right;
+	const bool exact = step == 1.f && frac == 0.f; // same rate & no pitch, nothing to interpolate
+
+	uint i = 0;
+	for (; i + L::N <= count; i += L::N)
+	{
+		F sample_left, sample_right;
+		if (exact)
+		{
+			sample_left  = L::load(in_left + i);
+			sample_right = mono ? sample_left : L::load(in_right + i);
+		}
+		else
+		{
+			F p = L::add(L::set(frac + i * step), L::mul(lanes, L::set(step)));
+			I index = L::floor(p);
+			F t = L::sub(p, L::tofloat(index));
+
+			F a = L::gatherf(in_left, index), b = L::gatherf(in_left + 1, index);
+			sample_left = L::add(a, L::mul(L::sub(b, a), t));
+
+			if (mono) sample_right = sample_left;
+			else
+			{
+				a = L::gatherf(in_right, index), b = L::gatherf(in_right + 1, index);
+				sample_right = L::add(a, L::mul(L::sub(b, a), t));
+			}
+		}
+
+		F gl = L::add(L::set(left_gain  + i * left_ramp ), L::mul(lanes, L::set(left_ramp )));
+		F gr = L::add(L::set(right_gain + i * right_ramp), L::mul(lanes, L::set(right_ramp)));
+		L::store(left  + i, L::add(L::load(left  + i), L::mul(sample_left , gl)));
+		L::store(right + i, L::add(L::load(right + i), L::mul(sample_right, gr)));
+	}
+
+	// the last few, same math
+	for (; i < count; i++)
+	{
+		float p = frac + i * step;
+		uint index = (uint)p;
+		float t = p - index;
+
+		float sample_left  = in_left [index] + (in_left [index + 1] - in_left [index]) * t;
+		float sample_right = in_right[index] + (in_right[index + 1] - in_right[index]) * t;
+		left [i] += sample_left  * (left_gain  + i * left_ramp );
+		right[i] += sample_right * (right_gain + i * right_ramp);
+	}
+}
+
+template <typename L> void add_scaled_lanes(const float* in, float gain, float* out, uint count)
+{
+	typename L::F g = L::set(gain);
+
+	uint i = 0;
+	for (; i + L::N <= count; i += L::N) L::store(out + i, L::add(L::load(out + i), L::mul(L::load(in + i), g)));
+	for (; i < count; i++) out[i] += in[i] * gain;
+}
+
+void mix_voice_simd(uint simd, const float* in_left, const float* in_right, uint count, float frac, float step,
+	float left_gain, float left_ramp, float right_gain, float right_ramp, float* left, float* right)
+{
+	switch (simd)
+	{
+	case SIMD_AVX512: mix_voice_lanes<Lanes_AVX512>(in_left, in_right, count, frac, step, left_gain, left_ramp, right_gain, right_ramp, left, right); break;
+	case SIMD_AVX2  : mix_voice_lanes<Lanes_AVX2  >(in_left, in_right, count, frac, step, left_gain, left_ramp, right_gain, right_ramp, left, right); break;
+	default         : mix_voice_lanes<Lanes_SSE2  >(in_left, in_right, count, frac, step, left_gain, left_ramp, right_gain, right_ramp, left, right); break;
+	}
+}
+
+void add_scaled_simd(uint simd, const float* in, float gain, float* out, uint count)
+{
+	switch (simd)
+	{
+	case SIMD_AVX512: add_scaled_lanes<Lanes_AVX512>(in, gain, out, count); break;
+	case SIMD_AVX2  : add_scaled_lanes<Lanes_AVX2  >(in, gain, out, count); break;
+	default         : add_scaled_lanes<Lanes_SSE2  >(in, gain, out, count); break;
+	}
+}
+
+// ------------------------ reverb ----------------- //
+
+// the combs, allpasses & low-passes all decay towards 0 through denormals, which x86 does ~100x slower.
+// MXCSR is per thread : whatever thread mixes calls this first
+void mixer_flush_denormals()
+{
+	_MM_SET_FLUSH_ZERO_MODE(_MM_FLUSH_ZERO_ON);
+	_MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+}
+
+// freeverb's tunings, at 44.1 kHz
+static const uint reverb_lengths[6] = { 1116, 1188, 1277, 1356, 556, 441 };
+#define REVERB_SPREAD 23 // the right ear's lines are this much longer
+
+MixerReverb* create_reverb(uint sample_rate, float room_size, float damping)
+{
+	MixerReverb* reverb = Alloc(MixerReverb, 1);
+	reverb->feedback = room_size;
+	reverb->damping  = damping;
+
+	uint total = 0;
+	for (uint c = 0; c < 2; c++) for (uint l = 0; l < 6; l++)
+	{
+		reverb->length[c][l] = (reverb_lengths[l] + c * REVERB_SPREAD) * sample_rate / 44100;
+		reverb->offset[c][l] = total;
+		total += reverb->length[c][l];
+	}
+
+	reverb->lines = Alloc(float, total);
+	return reverb;
+}
+
+void process_reverb(MixerReverb* reverb, float* samples, uint channel, uint count)
+{
+	float* lines    = reverb->lines;
+	uint*  offset   = reverb->offset  [channel];
+	uint*  length   = reverb->length  [channel];
+	uint*  position = reverb->position[channel];
+	float* damped   = reverb->damped  [channel];
+
+	for (uint i = 0; i < count; i++)
+	{
+		float input = samples[i] * .015f; // freeverb's fixed input gain
+		float output = 0;
+
+		// 4 damped combs in parallel
+		for (uint l = 0; l < 4; l++)
+		{
+			float* line = lines + offset[l];
+			float delayed = line[position[l]];
+			damped[l] = delayed * (1 - reverb->damping) + damped[l] * reverb->damping;
+			line[position[l]] = input + damped[l] * reverb->feedback;
+			if (++position[l] == length[l]) position[l] = 0;
+			output += delayed;
+		}
+
+		// then 2 allpasses in series
+		for (uint l = 4; l < 6; l++)
+		{
+			float* line = lines + offset[l];
+			float delayed = line[position[l]];
+			line[position[l]] = output + delayed * .5f;
+			if (++position[l] == length[l]) position[l] = 0;
+			output = delayed - output;
+		}
+
+		samples[i] = output;
+	}
+}
+
+// ------------------------ mixer ------------------ //
+
+void Mixer::init(uint sample_rate)
+{
+	*this = {};
+	this->sample_rate = sample_rate;
+	simd = simd_level();
+
+	add_bus(0); // the master
+}
+
+void Mixer::release()
+{
+	for (uint b = 0; b < num_buses; b++)
+	{
+		free(buses[b].left);
+		if (buses[b].reverb) { free(buses[b].reverb->lines); free(buses[b].reverb); }
+	}
+	*this = {};
+}
+
+uint Mixer::add_bus(uint parent, float gain)
+{
+	if (num_buses == MIXER_MAX_BUSES) return 0;
+
+	MixerBus* bus = &buses[num_buses];
+	*bus = {};
+	bus->left    = Alloc(float, MIXER_BLOCK * 2);
+	bus->right   = bus->left + MIXER_BLOCK;
+	bus->parent  = parent;
+	bus->gain    = gain;
+	bus->lowpass = 1;
+	bus->send    = -1;
+
+	return num_buses++;
+}
+
+uint Mixer::add_reverb(uint parent, float room_size, float damping)
+{
+	uint bus = add_bus(parent);
+	if (bus) buses[bus].reverb = create_reverb(sample_rate, room_size, damping);
+	return bus;
+}
+
+void Mixer::set_lowpass(uint bus, float cutoff)
+{
+	buses[bus].lowpass = cutoff > 0 ? 1 - expf(-TWOPI * cutoff / sample_rate) : 1;
+}
+
+void Mixer::set_send(uint bus, int target, float gain)
+{
+	if (target >= (int)bus) return; // it would get mixed after this bus is done
+	buses[bus].send      = target;
+	buses[bus].send_gain = gain;
+}
+
+void Mixer::set_listener(vec3 position, vec3 front, vec3 up)
+{
+	listener_position = position;
+	listener_right    = glm::normalize(glm::cross(front, up));
+}
+
+MixerVoice* Mixer::start(uint index, const MixerSound* sound, uint bus, float gain, float pitch, uint flags, vec3 position)
+{
+	MixerVoice* voice = &voices[index];
+	*voice = {};
+	if (!sound->num_frames) return voice; // nothing to play, it stays free
+
+	voice->sound    = sound;
+	voice->bus      = bus < num_buses ? bus : 0;
+	pitch = pitch > MIXER_MIN_PITCH ? glm::min(pitch, MIXER_MAX_PITCH) : MIXER_MIN_PITCH; // <= 0 or NaN would never move
+	voice->step     = pitch * sound->sample_rate / sample_rate;
+	voice->gain     = gain;
+	voice->flags    = flags;
+	voice->position = position;
+	return voice;
+}
+
+void Mixer::mix_voice(MixerVoice* voice)
+{
+	const MixerSound* sound = voice->sound;
+
+	// where the ears should be by the end of this block
+	float gain = voice->gain, pan = 0;
+	if ((voice->flags & MIXER_POSITIONAL) && sound->channels == 1)
+	{
+		vec3 to = voice->position - listener_position;
+		float distance = glm::length(to);
+		float clamped  = glm::clamp(distance, MIXER_REFERENCE_DISTANCE, MIXER_MAX_DISTANCE);
+
+		gain *= MIXER_REFERENCE_DISTANCE / (MIXER_REFERENCE_DISTANCE + MIXER_ROLLOFF * (clamped - MIXER_REFERENCE_DISTANCE));
+		if (distance > 1e-4f) pan = glm::dot(to / distance, listener_right);
+	}
+
+	float left_target = gain, right_target = gain;
+	if (sound->channels == 1)
+	{
+		float angle = (pan + 1) * PI / 4; // equal power, the middle is -3 dB in each ear
+		left_target  = gain * cosf(angle);
+		right_target = gain * sinf(angle);
+	}
+
+	if (!voice->started) { voice->left_gain = left_target; voice->right_gain = right_target; voice->started = true; }
+
+	float left_ramp  = (left_target  - voice->left_gain ) / MIXER_BLOCK;
+	float right_ramp = (right_target - voice->right_gain) / MIXER_BLOCK;
+
+	const float* in_left  = sound->channel(0);
+	const float* in_right = sound->channel(sound->channels > 1 ? 1 : 0);
+	MixerBus* bus = &buses[voice->bus];
+
+	uint done = 0;
+	while (done < MIXER_BLOCK)
+	{
+		// how much output there is before the end of the sound, or the limit
+		float available = (float)(sound->num_frames - voice->frame);
+		if (voice->flags & MIXER_LIMITED) available = glm::min(available, (float)(int64)(voice->limit - voice->consumed));
+
+		uint count = available > voice->frac ? (uint)ceilf((available - voice->frac) / voice->step) : 0;
+		count = glm::min(count, MIXER_BLOCK - done);
+
+		if (count)
+		{
+			mix_voice_simd(simd, in_left + voice->frame, in_right + voice->frame, count, voice->frac, voice->step,
+				voice->left_gain + done * left_ramp, left_ramp, voice->right_gain + done * right_ramp, right_ramp,
+				bus->left + done, bus->right + done);
+
+			float moved = voice->frac + count * voice->step;
+			uint whole = (uint)moved;
+			voice->frac      = moved - whole;
+			voice->frame    += whole;
+			voice->consumed += whole;
+			done += count;
+		}
+
+		if ((voice->flags & MIXER_LIMITED) && voice->consumed >= voice->limit)
+		{
+			if (voice->flags & MIXER_LAST) voice->sound = NULL;
+			else underruns++; // the rest of the block is silent, the stream will catch up
+			break;
+		}
+
+		if (voice->frame >= sound->num_frames)
+		{
+			if (!(voice->flags & MIXER_LOOP)) { voice->sound = NULL; break; }
+			voice->frame -= sound->num_frames;
+		}
+	}
+
+	voice->left_gain  = left_target;
+	voice->right_gain = right_target;
+}
+
+// low-pass, reverb & gain, then into the parent & the send
+void Mixer::process_bus(uint b)
+{
+	MixerBus* bus = &buses[b];
+
+	if (bus->lowpass < 1)
+	{
+		float a = bus->lowpass;
+		for (uint i = 0; i < MIXER_BLOCK; i++) bus->left [i] = bus->lowpass_left  += a * (bus->left [i] - bus->lowpass_left );
+		for (uint i = 0; i < MIXER_BLOCK; i++) bus->right[i] = bus->lowpass_right += a * (bus->right[i] - bus->lowpass_right);
+	}
+
+	if (bus->reverb)
+	{
+		process_reverb(bus->reverb, bus->left , 0, MIXER_BLOCK);
+		process_reverb(bus->reverb, bus->right, 1, MIXER_BLOCK);
+	}
+
+	if (!b) // the master
+	{
+		if (bus->gain != 1) for (uint i = 0; i < MIXER_BLOCK * 2; i++) bus->left[i] *= bus->gain;
+		return;
+	}
+
+	MixerBus* parent = &buses[bus->parent];
+	add_scaled_simd(simd, bus->left , bus->gain, parent->left , MIXER_BLOCK);
+	add_scaled_simd(simd, bus->right, bus->gain, parent->right, MIXER_BLOCK);
+
+	if (bus->send >= 0)
+	{
+		MixerBus* send = &buses[bus->send];
+		add_scaled_simd(simd, bus->left , bus->gain * bus->send_gain, send->left , MIXER_BLOCK);
+		add_scaled_simd(simd, bus->right, bus->gain * bus->send_gain, send->right, MIXER_BLOCK);
+	}
+}
+
+void Mixer::mix()
+{
+	for (uint b = 0; b < num_buses; b++) memset(buses[b].left, 0, MIXER_BLOCK * 2 * sizeof(float));
+
+	active = 0;
+	for (uint v = 0; v < MIXER_MAX_VOICES; v++)
+	{
+		if (!voices[v].sound) continue;
+		mix_voice(&voices[v]);
+		active++;
+	}
+
+	for (uint b = num_buses; b-- > 0;) process_bus(b);
+	blocks++;
+}
+
+// planar float to interleaved 16 bit, clipped
+void mixer_to_pcm16(const float* left, const float* right, int16* output, uint count)
+{
+	const __m128 scale = _mm_set1_ps(32767.f);
+
+	uint i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 l = _mm_mul_ps(_mm_loadu_ps(left  + i), scale);
+		__m128 r = _mm_mul_ps(_mm_loadu_ps(right + i), scale);
+		__m128i low  = _mm_cvtps_epi32(_mm_unpacklo_ps(l, r));
+		__m128i high = _mm_cvtps_epi32(_mm_unpackhi_ps(l, r));
+		_mm_storeu_si128((__m128i*)(output + i * 2), _mm_packs_epi32(low, high)); // saturates
+	}
+	for (; i < count; i++)
+	{
+		output[i * 2 + 0] = (int16)glm::clamp(left [i] * 32767.f, -32768.f, 32767.f);
+		output[i * 2 + 1] = (int16)glm::clamp(right[i] * 32767.f, -32768.f, 32767.f);
+	}
+}
+
+// makes a sound out of interleaved 16 bit samples, or an empty one for samples = NULL
+MixerSound make_mixer_sound(const int16* samples, uint num_frames, uint channels, uint sample_rate)
+{
+	MixerSound sound = { Alloc(float, (num_frames + MIXER_PAD) * channels), num_frames, channels, sample_rate };
+
+	if (samples) for (uint c = 0; c < channels; c++)
+	{
+		float* plane = sound.samples + c * (num_frames + MIXER_PAD);
+		for (uint i = 0; i < num_frames; i++) plane[i] = samples[i * channels + c] * (1.f / 32768);
+	}
+
+	return sound;
+}
+
+// a loop interpolates from its last frame into its first
+void pad_for_loop(MixerSound* sound)
+{
+	for (uint c = 0; c < sound->channels; c++)
+	{
+		float* plane = sound->samples + c * (sound->num_frames + MIXER_PAD);
+		for (uint i = 0; i < MIXER_PAD; i++) plane[sound->num_frames + i] = plane[i % sound->num_frames];
+	}
+}
+
+// ---------------------- benchmark ---------------- //
+
+/* how many voices one core keeps up with in real time, per SIMD level the cpu has :
+   half of them resample (a 44.1 kHz sound at a random pitch), the rest are straight copies,
+   every one positional & moving, through music / sfx / reverb buses */
+void mixer_benchmark(uint num_voices = MIXER_MAX_VOICES, uint num_blocks = 4000, uint sample_rate = 48000)
+{
+	num_voices = glm::min(num_voices, (uint)MIXER_MAX_VOICES);
+
+	uint csr = _mm_getcsr(); // like the audio thread, & back how it was for the caller
+	mixer_flush_denormals();
+
+	const uint sound_frames = 48000;
+	int16* noise = Alloc(int16, sound_frames);
+	for (uint i = 0; i < sound_frames; i++) noise[i] = (int16)(randfns() * 16000);
+
+	MixerSound native    = make_mixer_sound(noise, sound_frames, 1, sample_rate);
+	MixerSound resampled = make_mixer_sound(noise, sound_frames, 1, 44100);
+	pad_for_loop(&native);
+	pad_for_loop(&resampled);
+	free(noise);
+
+	const char* level_names[3] = { "SSE2", "AVX2", "AVX-512" };
+	double audio_ms = num_blocks * MIXER_BLOCK * 1000.0 / sample_rate;
+
+	for (uint level = SIMD_SSE2; level <= simd_level(); level++)
+	{
+		Mixer* mixer = Alloc(Mixer, 1);
+		mixer->init(sample_rate);
+		mixer->simd = level;
+
+		uint music  = mixer->add_bus(0, .8f);
+		uint sfx    = mixer->add_bus(0);
+		uint reverb = mixer->add_reverb(0);
+		mixer->set_lowpass(music, 8000);
+		mixer->set_send(sfx, reverb, .3f);
+		mixer->set_send(music, reverb, .1f);
+
+		for (uint v = 0; v < num_voices; v++)
+		{
+			bool resample = v & 1;
+			mixer->start(v, resample ? &resampled : &native, v % 3 ? sfx : music, .05f, resample ? .75f + randfn() * .5f : 1,
+				MIXER_LOOP | MIXER_POSITIONAL, vec3(randfns(), 0, randfns()) * 20.f);
+		}
+
+		Timer timer = {};
+		timer.init();
+		timer.start();
+
+		for (uint b = 0; b < num_blocks; b++)
+		{
+			float angle = b * .01f;
+			mixer->set_listener(vec3(0), vec3(cosf(angle), 0, sinf(angle)), vec3(0, 1, 0)); // turning on the spot
+			mixer->mix();
+		}
+
+		double cpu_ms = timer.microseconds_elapsed() / 1000.0;
+		print("mixer %-7s : %u voices, %.0f ms of audio in %.1f ms | %.2f us per block | %.0f voice blocks mixed per ms | %.0f voices in real time\n",
+			level_names[level], num_voices, audio_ms, cpu_ms, cpu_ms * 1000 / num_blocks,
+			num_voices * num_blocks / cpu_ms, num_voices * audio_ms / cpu_ms);
+
+		mixer->release();
+		free(mixer);
+	}
+
+	free(native.samples);
+	free(resampled.samples);
+	_mm_setcsr(csr);
+}
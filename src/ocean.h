@@ -0,0 +1,335 @@
+#include "terrain.h"
+
+/* Ocean : Tessendorf FFT waves
+*
+* - a Phillips spectrum is generated once in init(), then normalized to the requested wave height
+* - every frame the spectrum is advanced in time & turned into heights + choppy horizontal displacement
+*   with 2 inverse FFTs. heights & x displacement share one of them, since both come out real
+* - spectrum evolution, the FFT rows & building the vertices are all spread across the work queue
+* - the result tiles seamlessly, so a single patch is drawn as a grid of instances around the camera,
+*   with the geometry shader & a single material (like Terrain)
+*/
+
+const uint  OCEAN_N           = 256;    // FFT size, also quads per side of the patch
+const float OCEAN_PATCH_SIZE  = 256.f;  // world units per side
+const int   OCEAN_TILE_RADIUS = 2;      // in patches around the camera
+const float OCEAN_GRAVITY     = 9.81f;
+
+const uint OCEAN_VERTS     = OCEAN_N + 1; // per side, the last row & column close the tile
+const uint OCEAN_MAX_TILES = (2 * OCEAN_TILE_RADIUS + 1) * (2 * OCEAN_TILE_RADIUS + 1);
+
+struct OceanVertex {
+	vec3 position, normal;
+	vec2 uv;
+};
+
+struct Ocean
+{
+	FFT fft;
+
+	// spectrum, split complex, in FFT order (index k is frequency k for k < N / 2, k - N after)
+	float *h0_re, *h0_im;   // h0(k)
+	float *h0c_re, *h0c_im; // conj(h0(-k))
+	float *omega;           // dispersion : sqrt(g * |k|)
+	float *dir_x, *dir_z;   // k / |k|
+
+	// per frame, transformed in place
+	float *a_re, *a_im; // height + i * x displacement
+	float *b_re, *b_im; // z displacement
+
+	vec2  wind;        // m/s
+	float wave_height; // significant wave height, m
+	float choppiness;  // 0 = plain heightfield
+	float sea_level;
+
+	GLuint VAO;
+	GLuint vert_buffer, indx_buffer, inst_buffer;
+	uint instance_format;
+	uint material;
+	uint num_indices;
+	uint num_tiles;
+
+	void init(uint material, float sea_level = 0, vec2 wind = vec2(12, 5), float wave_height = 2, float choppiness = .8f, uint instance_format = INSTANCE_MAT4);
+	void simulate(float time, OceanVertex* vertices); // everything but the upload, OCEAN_VERTS^2 vertices
+	void update(float time, vec3 camera_position);    // once per frame
+	void draw(); // during the geometry pass, with the geometry shader bound
+
+	void init_simulation(); // no gl, so it also works headless
+};
+
+// Phillips spectrum, with the tiny waves a fraction of the largest one suppressed
+float phillips(vec2 k, vec2 wind)
+{
+	float k2 = glm::dot(k, k);
+	if (k2 < 1e-12f) return 0;
+
+	float speed = glm::length(wind);
+	float L = speed * speed / OCEAN_GRAVITY; // largest wave from a continuous wind
+	float l = L / 1000;
+
+	float k_dot_w = glm::dot(k / sqrtf(k2), wind / speed);
+
+	return expf(-1 / (k2 * L * L)) / (k2 * k2) * k_dot_w * k_dot_w * expf(-k2 * l * l);
+}
+
+void Ocean::init_simulation()
+{
+	const uint N = OCEAN_N;
+	fft.init(N);
+
+	h0_re  = Alloc(float, N * N); h0_im  = Alloc(float, N * N);
+	h0c_re = Alloc(float, N * N); h0c_im = Alloc(float, N * N);
+	omega  = Alloc(float, N * N);
+	dir_x  = Alloc(float, N * N); dir_z  = Alloc(float, N * N);
+	a_re   = Alloc(float, N * N); a_im   = Alloc(float, N * N);
+	b_re   = Alloc(float, N * N); b_im   = Alloc(float, N * N);
+
+	const float dk = TWOPI / OCEAN_PATCH_SIZE;
+
+	for (uint z = 0; z < N; z++)
+	for (uint x = 0; x < N; x++)
+	{
+		uint i = z * N + x;
+		vec2 k = vec2((x < N / 2) ? (int)x : (int)x - (int)N, (z < N / 2) ? (int)z : (int)z - (int)N) * dk;
+
+		// the nyquist row & column have no matching -k, they'd make the displacement complex
+		float amplitude = (x == N / 2 || z == N / 2) ? 0 : sqrtf(phillips(k, wind) * .5f);
+
+		Complex xi = gaussian_random_complex();
+		h0_re[i] = (float)xi.real() * amplitude;
+		h0_im[i] = (float)xi.imag() * amplitude;
+
+		float length = glm::length(k);
+		omega[i] = sqrtf(OCEAN_GRAVITY * length);
+		dir_x[i] = length > 0 ? k.x / length : 0;
+		dir_z[i] = length > 0 ? k.y / length : 0;
+	}
+
+	// scale so 4 standard deviations of height = wave_height. with an unscaled inverse FFT, variance = sum |h(k)|^2
+	double variance = 0;
+	for (uint i = 0; i < N * N; i++) variance += 2.0 * (h0_re[i] * h0_re[i] + h0_im[i] * h0_im[i]);
+
+	float scale = variance > 0 ? wave_height / (4 * (float)sqrt(variance)) : 0;
+	for (uint i = 0; i < N * N; i++) { h0_re[i] *= scale; h0_im[i] *= scale; }
+
+	for (uint z = 0; z < N; z++)
+	for (uint x = 0; x < N; x++)
+	{
+		uint i = z * N + x, mirror = ((N - z) % N) * N + (N - x) % N;
+		h0c_re[i] =  h0_re[mirror];
+		h0c_im[i] = -h0_im[mirror];
+	}
+}
+
+void Ocean::init(uint ocean_material, float level, vec2 ocean_wind, float height, float chop, uint format)
+{
+	material        = ocean_material;
+	instance_format = format;
+	sea_level       = level;
+	wind            = ocean_wind;
+	wave_height     = height;
+	choppiness      = chop;
+
+	const uint N = OCEAN_N;
+	init_simulation();
+
+	// gpu buffers : one patch, rewritten every frame, drawn once per tile
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &vert_buffer);
+	glGenBuffers(1, &indx_buffer);
+	glGenBuffers(1, &inst_buffer);
+
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	glBufferData(GL_ARRAY_BUFFER, OCEAN_VERTS * OCEAN_VERTS * sizeof(OceanVertex), NULL, GL_STREAM_DRAW);
+
+	// same layout as DrawBuffer meshes : vec3 position, vec3 normal, vec2 uv
+	uint stride = sizeof(OceanVertex);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3) * 2));
+	glEnableVertexAttribArray(2);
+
+	// tiles : same instance layout as the DrawBuffer, the material is set to a constant in draw()
+	uint instance_stride = (instance_format == INSTANCE_COMPACT) ? sizeof(CompactInstance) : sizeof(mat4);
+
+	glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+	glBufferData(GL_ARRAY_BUFFER, OCEAN_MAX_TILES * instance_stride, NULL, GL_DYNAMIC_DRAW);
+
+	if (instance_format == INSTANCE_COMPACT)
+	{
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, instance_stride, (void*)0);
+		glVertexAttribPointer(4, 4, GL_SHORT, GL_TRUE , instance_stride, (void*)(sizeof(vec4)));
+		for (uint i = 3; i < 5; i++)
+		{
+			glEnableVertexAttribArray(i);
+			glVertexAttribDivisor(i, 1);
+		}
+	}
+	else for (uint i = 3; i < 7; i++)
+	{
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (void*)(sizeof(vec4) * (i - 3)));
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+
+	// indices never change
+	uint* indices = Alloc(uint, N * N * 6);
+	num_indices = 0;
+	for (uint j = 0; j < N; j++)
+	for (uint i = 0; i < N; i++)
+	{
+		uint a = j * OCEAN_VERTS + i, b = a + 1, c = a + OCEAN_VERTS, d = c + 1;
+		uint quad[6] = { a, c, b, b, c, d }; // counter clockwise seen from above
+		memcpy(indices + num_indices, quad, sizeof(quad));
+		num_indices += 6;
+	}
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, num_indices * sizeof(uint), indices, GL_STATIC_DRAW);
+	free(indices);
+
+	glBindVertexArray(0);
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init Ocean | FFT : [%d x %d], Patch : [%.0fm]", N, N, OCEAN_PATCH_SIZE);
+	console->add_entry(msg, SUCCESS, RNDR);
+}
+
+void Ocean::simulate(float time, OceanVertex* vertices)
+{
+	struct Params {
+		Ocean* ocean;
+		float time;
+		OceanVertex* vertices;
+	} params = { this, time, vertices };
+
+	// h(k, t) = h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+	// x displacement = i * k.x / |k| * h, so (h + i * dx) = h * (1 - k.x / |k|)
+	const auto evolve = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		Ocean* o = p->ocean;
+
+		for (uint i = begin * OCEAN_N; i < end * OCEAN_N; i++)
+		{
+			float c = cosf(o->omega[i] * p->time), s = sinf(o->omega[i] * p->time);
+
+			float hr = (o->h0_re[i] + o->h0c_re[i]) * c - (o->h0_im[i] - o->h0c_im[i]) * s;
+			float hi = (o->h0_im[i] + o->h0c_im[i]) * c + (o->h0_re[i] - o->h0c_re[i]) * s;
+
+			o->a_re[i] = hr * (1 - o->dir_x[i]);
+			o->a_im[i] = hi * (1 - o->dir_x[i]);
+			o->b_re[i] = -hi * o->dir_z[i];
+			o->b_im[i] =  hr * o->dir_z[i];
+		}
+	};
+
+	parallel_for(OCEAN_N, 16, evolve, &params);
+
+	// both fields are real, so the imaginary part of b comes back ~0
+	fft.transform2D(a_re, a_im, true);
+	fft.transform2D(b_re, b_im, true);
+
+	// vertices : displaced grid, normals from the displaced neighbours so sharp crests stay lit correctly
+	const auto build = [](void* data, uint begin, uint end) {
+		Params* p = (Params*)data;
+		Ocean* o = p->ocean;
+		const int N = OCEAN_N;
+		const float step = OCEAN_PATCH_SIZE / N;
+
+		const auto point = [&](int x, int z) {
+			int i = ((z + N) % N) * N + (x + N) % N; // wraps, the patch is periodic
+			return vec3(x * step + o->choppiness * o->a_im[i], o->a_re[i], z * step + o->choppiness * o->b_re[i]); // pulls points towards the crests
+		};
+
+		for (uint j = begin; j < end; j++)
+		for (uint i = 0; i < OCEAN_VERTS; i++)
+		{
+			vec3 position = point(i, j);
+			vec3 dx = point(i + 1, j) - point(i - 1, j);
+			vec3 dz = point(i, j + 1) - point(i, j - 1);
+
+			p->vertices[j * OCEAN_VERTS + i] = { position, glm::normalize(glm::cross(dz, dx)), vec2(i, j) * (1.f / N) };
+		}
+	};
+
+	parallel_for(OCEAN_VERTS, 16, build, &params);
+}
+
+void Ocean::update(float time, vec3 camera_position)
+{
+	// workers write straight into the mapped buffer
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	OceanVertex* vertices = (OceanVertex*)glMapBufferRange(GL_ARRAY_BUFFER, 0, OCEAN_VERTS * OCEAN_VERTS * sizeof(OceanVertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (!vertices) { out("ERROR : could not map the ocean vertex buffer!"); return; }
+
+	simulate(time, vertices);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	// tiles snap to whole patches so the waves don't slide along with the camera
+	ivec2 center = ivec2(glm::floor(vec2(camera_position.x, camera_position.z) / OCEAN_PATCH_SIZE));
+
+	mat4 models[OCEAN_MAX_TILES];
+	num_tiles = 0;
+	for (int dz = -OCEAN_TILE_RADIUS; dz <= OCEAN_TILE_RADIUS; dz++)
+	for (int dx = -OCEAN_TILE_RADIUS; dx <= OCEAN_TILE_RADIUS; dx++)
+	{
+		vec3 corner = vec3((center.x + dx) * OCEAN_PATCH_SIZE, sea_level, (center.y + dz) * OCEAN_PATCH_SIZE);
+		models[num_tiles++] = glm::translate(mat4(1), corner);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, inst_buffer);
+	if (instance_format == INSTANCE_COMPACT)
+	{
+		CompactInstance packed[OCEAN_MAX_TILES];
+		pack_instances(num_tiles, models, packed);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, num_tiles * sizeof(CompactInstance), packed);
+	}
+	else glBufferSubData(GL_ARRAY_BUFFER, 0, num_tiles * sizeof(mat4), models);
+}
+
+void Ocean::draw()
+{
+	if (!num_tiles) return;
+
+	glBindVertexArray(VAO);
+	glVertexAttribI4ui(7, material, 0, 0, 0);
+	glDrawElementsInstanced(GL_TRIANGLES, num_indices, GL_UNSIGNED_INT, (void*)0, num_tiles);
+}
+
+// cpu side of a frame : needs to stay well under 8.3 ms for 120 fps
+void ocean_benchmark()
+{
+	const uint NUM_FRAMES = 120;
+
+	Ocean* ocean = Alloc(Ocean, 1);
+	ocean->wind        = vec2(12, 5);
+	ocean->wave_height = 2;
+	ocean->choppiness  = .8f;
+	ocean->init_simulation();
+
+	OceanVertex* vertices = Alloc(OceanVertex, OCEAN_VERTS * OCEAN_VERTS);
+
+	Timer timer = {};
+	timer.init();
+	timer.start();
+	for (uint frame = 0; frame < NUM_FRAMES; frame++) ocean->simulate(frame / 120.f, vertices);
+	int64 total = timer.microseconds_elapsed();
+
+	float min_height = 1e9, max_height = -1e9;
+	for (uint i = 0; i < OCEAN_VERTS * OCEAN_VERTS; i++)
+	{
+		min_height = glm::min(min_height, vertices[i].position.y);
+		max_height = glm::max(max_height, vertices[i].position.y);
+	}
+
+	print(" ocean %u x %u : %.3f ms per frame | heights [%.2f, %.2f]\n", OCEAN_N, OCEAN_N, total / 1000.f / NUM_FRAMES, min_height, max_height);
+
+	free(vertices);
+}
@@ -0,0 +1,594 @@
+#include "animation.h"
+
+/* Rollback : deterministic netcode for a handful of players
+*
+* - only inputs go over the wire : every player's Keyboard & Mouse buttons for every frame, nothing else
+* - every peer simulates every frame as soon as it has its own input. inputs that haven't arrived yet are predicted
+*   (the player keeps doing whatever they did last), and when the real one turns out different
+*   the simulation restores the snapshot from that frame & runs it forward again, all inside one tick
+* - the whole simulation state lives in one StateArena, so a snapshot is a memcpy & so is a restore.
+*   keep indices or offsets in it, not pointers : the checksum covers every byte & every peer's arena is somewhere else
+*   a Bullet world can't be in there (its own allocations, caches & pointers), a rolled back game steps its own physics
+* - a peer never gets more than max_prediction frames ahead of what it knows, fewer if resimulating that many
+*   wouldn't fit in the frame budget. past that it waits, which also keeps peers in step with each other
+* - inputs go out over UDP (a NetLink), every packet carries all of them the other side hasn't acked yet,
+*   so a lost packet costs nothing & a late one never holds up the ones behind it
+* - once a frame's inputs are all known its snapshot gets a checksum, peers swap the newest one & compare :
+*   a mismatch means the simulations went different ways (a desync) & nothing will bring them back
+* - determinism is the game's job : same binary, no uninitialized bytes, no wall clock or unseeded randomness in step()
+*/
+
+#define ROLLBACK_MAX_PLAYERS 4
+#define ROLLBACK_FRAMES      16 // snapshots kept, the furthest back a rollback can go
+#define ROLLBACK_INPUTS      64 // inputs kept per player
+#define ROLLBACK_CHECKSUMS   64 // checksums of confirmed frames kept, for comparing with late ones
+#define ROLLBACK_MAX_SEND    32 // inputs per packet
+#define ROLLBACK_INPUT_BITS  (NUM_KEYBOARD_BUTTONS + 2) // the keyboard, then the mouse's left & right
+
+// ---------------------- inputs ------------------- //
+
+// one player's buttons for one frame
+struct RollbackInput
+{
+	uint64 buttons; // bit i = Keyboard::buttons[i], then the mouse
+};
+
+RollbackInput rollback_input(const Keyboard* keys, const Mouse* mouse)
+{
+	RollbackInput input = {};
+	for (uint i = 0; i < NUM_KEYBOARD_BUTTONS; i++) input.buttons |= (uint64)(keys->buttons[i].is_pressed != 0) << i;
+	input.buttons |= (uint64)(mouse->left_button.is_pressed  != 0) << (NUM_KEYBOARD_BUTTONS + 0);
+	input.buttons |= (uint64)(mouse->right_button.is_pressed != 0) << (NUM_KEYBOARD_BUTTONS + 1);
+	return input;
+}
+
+// one fixed step's worth of InputSystem::step(), same bit order. a tap inside the step counts as held for it
+RollbackInput rollback_input(const InputState& state)
+{
+	RollbackInput input = { (state.down | state.pressed) & (((uint64)1 << NUM_INPUT_BUTTONS) - 1) };
+	return input;
+}
+
+// button = index into Keyboard::buttons, MOUSE_LEFT_BUTTON / MOUSE_RIGHT_BUTTON for the mouse
+inline bool input_down(RollbackInput input, uint button) { return (input.buttons >> button) & 1; }
+inline bool same_input(RollbackInput a, RollbackInput b) { return a.buttons == b.buttons; }
+
+// ----------------------- state ------------------- //
+
+// everything the simulation owns. allocate it all before Rollback::start(), snapshots copy [0, used)
+struct StateArena
+{
+	byte* memory;
+	uint size, used;
+
+	void init(uint max_size) { memory = Alloc(byte, max_size); size = max_size; used = 0; }
+	void release() { free(memory); *this = {}; }
+
+	void* alloc(uint bytes)
+	{
+		uint start = (used + 15) & ~15u;
+		if (start + bytes > size) { out("StateArena is full!"); return NULL; }
+		used = start + bytes;
+		return memory + start; // zeroed, so padding is the same on every peer
+	}
+	template<typename T> T* alloc(uint count = 1) { return (T*)alloc(count * sizeof(T)); }
+};
+
+// 64 bits over the whole state, 4 lanes so it isn't one long dependency chain
+uint64 state_checksum(const byte* data, uint size)
+{
+	const uint64 PRIME = 0x9E3779B97F4A7C15ull;
+	uint64 lanes[4] = { PRIME, PRIME * 3, PRIME * 5, PRIME * 7 };
+
+	uint i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		for (uint l = 0; l < 4; l++)
+		{
+			uint64 word;
+			memcpy(&word, data + i + l * 8, 8);
+			lanes[l] = (lanes[l] ^ word) * PRIME;
+			lanes[l] ^= lanes[l] >> 29;
+		}
+	}
+
+	uint64 hash = size;
+	for (uint l = 0; l < 4; l++) hash = (hash ^ lanes[l]) * PRIME;
+	for (; i < size; i++) hash = (hash ^ data[i]) * PRIME;
+	return hash ^ (hash >> 32);
+}
+
+// ---------------------- rollback ----------------- //
+
+// advances state by one frame, inputs[player]. has to come out the same on every peer given the same inputs
+typedef void rollback_step(void* state, const RollbackInput* inputs, uint num_players);
+
+struct RollbackPeer
+{
+	sockaddr_storage address;
+	int address_size;
+
+	uint received; // their inputs are known for every frame < received
+	uint acked;    // they have ours for every frame < acked
+};
+
+struct RollbackStats
+{
+	uint64 frames, stalls;
+	uint64 rollbacks, frames_resimulated;
+	uint max_rollback_frames;
+	int64 max_rollback_microseconds;
+	uint64 checksums_compared;
+	uint64 packets_sent, packets_received, bytes_sent;
+};
+
+struct Rollback
+{
+	uint num_players, local_player;
+	uint input_delay;    // frames between sampling the local input & using it, hides that much latency for free
+	uint max_prediction; // frames past the last one every input is known for
+	uint frame_budget;   // microseconds a whole rollback may take
+
+	rollback_step* step;
+	StateArena state;
+	byte* snapshots; // ROLLBACK_FRAMES copies of the state, the one for frame f is at f % ROLLBACK_FRAMES
+	uint snapshot_size;
+
+	RollbackInput inputs[ROLLBACK_MAX_PLAYERS][ROLLBACK_INPUTS]; // by frame % ROLLBACK_INPUTS, predicted past received
+	RollbackPeer peers[ROLLBACK_MAX_PLAYERS]; // by player, the local one is us
+	NetLink link;
+
+	uint frame;       // the next one to simulate
+	uint rollback_to; // the oldest simulated frame a late input changed, frame = nothing to redo
+	float step_microseconds; // running average
+
+	struct {
+		uint frame;
+		uint64 checksum;
+	} checksums[ROLLBACK_CHECKSUMS];
+	uint checksummed; // every confirmed frame < checksummed has one
+
+	bool desynced;
+	uint desync_frame;
+
+	RollbackStats stats;
+	Timer timer;
+
+	// the game allocates its state from this->state between init & start
+	bool init(const char* ip, const char* port, uint num_players, uint local_player, rollback_step* step, uint max_state_size,
+		uint input_delay = 2, uint max_prediction = 8, uint frame_budget = 4000);
+	bool add_peer(uint player, const char* ip, const char* port);
+	void start();
+	void release();
+
+	bool advance(RollbackInput local, double now); // once per fixed step, false = waiting on the other peers
+	uint confirmed(); // every input is known for every frame < confirmed()
+
+	void simulate(uint f, bool save);
+	void receive(double now);
+	void send(double now);
+	void check(uint f, uint64 checksum);
+};
+
+bool Rollback::init(const char* ip, const char* port, uint players, uint local, rollback_step* step_function, uint max_state_size,
+	uint delay, uint prediction, uint budget)
+{
+	*this = {};
+	if (players > ROLLBACK_MAX_PLAYERS || local >= players || prediction >= ROLLBACK_FRAMES) return false;
+	if (!link.init(ip, port, 64)) return false;
+
+	num_players    = players;
+	local_player   = local;
+	input_delay    = delay;
+	max_prediction = prediction;
+	frame_budget   = budget;
+	step           = step_function;
+	state.init(max_state_size);
+	timer.init();
+
+	// nobody has input for the first input_delay frames, they're empty on every peer
+	for (uint p = 0; p < num_players; p++) peers[p].received = input_delay;
+	return true;
+}
+
+bool Rollback::add_peer(uint player, const char* ip, const char* port)
+{
+	if (player >= num_players || player == local_player) return false;
+	return net_resolve(ip, port, &peers[player].address, &peers[player].address_size);
+}
+
+void Rollback::start()
+{
+	snapshot_size = state.used;
+	snapshots = Alloc(byte, ROLLBACK_FRAMES * snapshot_size);
+}
+
+void Rollback::release()
+{
+	link.release();
+	state.release();
+	free(snapshots);
+	*this = {};
+}
+
+uint Rollback::confirmed()
+{
+	uint oldest = peers[local_player].received;
+	for (uint p = 0; p < num_players; p++) oldest = glm::min(oldest, peers[p].received);
+	return oldest;
+}
+
+// runs frame f from the state as it is, save = keep a snapshot of it first
+void Rollback::simulate(uint f, bool save)
+{
+	if (save) memcpy(snapshots + (f % ROLLBACK_FRAMES) * snapshot_size, state.memory, snapshot_size);
+
+	// whoever hasn't been heard from for this frame keeps doing what they did last
+	RollbackInput frame_inputs[ROLLBACK_MAX_PLAYERS];
+	for (uint p = 0; p < num_players; p++)
+	{
+		uint received = peers[p].received;
+		if (f >= received) inputs[p][f % ROLLBACK_INPUTS] = received ? inputs[p][(received - 1) % ROLLBACK_INPUTS] : RollbackInput{};
+		frame_inputs[p] = inputs[p][f % ROLLBACK_INPUTS];
+	}
+
+	timer.start();
+	step(state.memory, frame_inputs, num_players);
+	float microseconds = (float)timer.microseconds_elapsed();
+	step_microseconds = step_microseconds ? step_microseconds * .95f + microseconds * .05f : microseconds;
+}
+
+bool Rollback::advance(RollbackInput local, double now)
+{
+	receive(now);
+
+	// a late input changed a frame that already ran : back to it & run everything since again
+	if (rollback_to < frame)
+	{
+		Timer rollback_timer = {};
+		rollback_timer.init();
+		rollback_timer.start();
+
+		memcpy(state.memory, snapshots + (rollback_to % ROLLBACK_FRAMES) * snapshot_size, snapshot_size);
+		for (uint f = rollback_to; f < frame; f++) simulate(f, f != rollback_to);
+
+		uint count = frame - rollback_to;
+		stats.rollbacks++;
+		stats.frames_resimulated += count;
+		stats.max_rollback_frames = glm::max(stats.max_rollback_frames, count);
+		stats.max_rollback_microseconds = glm::max(stats.max_rollback_microseconds, rollback_timer.microseconds_elapsed());
+	}
+	rollback_to = frame;
+
+	// snapshots that can't change anymore get their checksum
+	uint final_frames = glm::min(confirmed(), frame);
+	for (; checksummed <= final_frames; checksummed++)
+	{
+		uint f = checksummed;
+		if (f + ROLLBACK_FRAMES <= frame) continue; // snapshot's long gone, can't happen within max_prediction
+
+		const byte* snapshot = (f == frame) ? state.memory : snapshots + (f % ROLLBACK_FRAMES) * snapshot_size;
+		uint64 checksum = state_checksum(snapshot, snapshot_size);
+
+		uint slot = f % ROLLBACK_CHECKSUMS;
+		bool compared = checksums[slot].frame == f + 1; // a peer's checksum got here first, see check()
+		uint64 theirs = checksums[slot].checksum;
+		checksums[slot] = { f + 1, checksum }; // frame + 1, so zeroed means empty
+		if (compared) check(f, theirs);
+	}
+
+	// too far ahead of what's known, or resimulating that far wouldn't fit in a frame
+	uint limit = max_prediction;
+	if (step_microseconds > 0) limit = glm::clamp((uint)(frame_budget / step_microseconds), 1u, max_prediction);
+	if (frame >= confirmed() + limit)
+	{
+		stats.stalls++;
+		send(now);
+		return false;
+	}
+
+	uint input_frame = frame + input_delay;
+	inputs[local_player][input_frame % ROLLBACK_INPUTS] = local;
+	peers[local_player].received = input_frame + 1;
+
+	simulate(frame, true);
+	frame++;
+	rollback_to = frame;
+	stats.frames++;
+
+	send(now);
+	return true;
+}
+
+// our checksum for frame f against one from a peer
+void Rollback::check(uint f, uint64 checksum)
+{
+	stats.checksums_compared++;
+	if (checksums[f % ROLLBACK_CHECKSUMS].checksum == checksum || desynced) return;
+
+	desynced = true;
+	desync_frame = f;
+	out("rollback desync at frame " << f);
+}
+
+/* packet : sender (2 bits), ack (32), first frame (32), input count - 1 (5), then the inputs,
+   each one a bit for "same as the one before" or the whole ROLLBACK_INPUT_BITS.
+   then 1 bit for a checksum & if it's set frame (32) & checksum (64) */
+
+void Rollback::send(double now)
+{
+	RollbackPeer* local = &peers[local_player];
+
+	// the newest confirmed frame with a checksum
+	uint checksum_frame = checksummed ? checksummed - 1 : 0;
+	bool has_checksum = checksummed && checksums[checksum_frame % ROLLBACK_CHECKSUMS].frame == checksum_frame + 1;
+
+	for (uint p = 0; p < num_players; p++)
+	{
+		if (p == local_player) continue;
+		RollbackPeer* peer = &peers[p];
+
+		uint first = glm::max(peer->acked, input_delay);
+		uint count = glm::min(local->received - first, (uint)ROLLBACK_MAX_SEND);
+		if (local->received <= first) count = 0;
+
+		uint32 buffer[MAX_PACKET_SIZE / 4];
+		BitWriter writer;
+		writer.init(buffer, sizeof(buffer));
+		writer.write(local_player, 2);
+		writer.write(peer->received, 32);
+		writer.write(first, 32);
+		writer.write(count ? count - 1 : 0, 5);
+		writer.write(count != 0, 1);
+
+		RollbackInput previous = {};
+		for (uint i = 0; i < count; i++)
+		{
+			RollbackInput input = inputs[local_player][(first + i) % ROLLBACK_INPUTS];
+			bool same = i && same_input(input, previous);
+			writer.write(same, 1);
+			if (!same)
+			{
+				writer.write((uint32)input.buttons, 32);
+				writer.write((uint32)(input.buttons >> 32), ROLLBACK_INPUT_BITS - 32);
+			}
+			previous = input;
+		}
+
+		writer.write(has_checksum, 1);
+		if (has_checksum)
+		{
+			uint64 checksum = checksums[checksum_frame % ROLLBACK_CHECKSUMS].checksum;
+			writer.write(checksum_frame, 32);
+			writer.write((uint32)checksum, 32);
+			writer.write((uint32)(checksum >> 32), 32);
+		}
+		writer.flush();
+
+		link.send(&peer->address, peer->address_size, (byte*)buffer, writer.bytes(), now);
+		stats.packets_sent++;
+		stats.bytes_sent += writer.bytes() + PACKET_HEADER_SIZE;
+	}
+
+	link.flush(now);
+}
+
+void Rollback::receive(double now)
+{
+	NetDatagram batch[NET_MAX_DATAGRAMS];
+	uint32 buffers[NET_MAX_DATAGRAMS][MAX_PACKET_SIZE / 4 + 1];
+
+	while (1)
+	{
+		for (uint i = 0; i < NET_MAX_DATAGRAMS; i++) { batch[i].data = (byte*)buffers[i]; batch[i].size = MAX_PACKET_SIZE; }
+
+		uint count = link.receive(batch, NET_MAX_DATAGRAMS);
+		for (uint i = 0; i < count; i++)
+		{
+			BitReader reader;
+			reader.init(batch[i].data, batch[i].size);
+
+			uint player = reader.read(2);
+			if (player >= num_players || player == local_player || !net_same_address(&batch[i].address, &peers[player].address)) continue;
+			RollbackPeer* peer = &peers[player];
+			stats.packets_received++;
+
+			uint ack   = reader.read(32);
+			uint first = reader.read(32);
+			uint num_inputs = reader.read(5) + 1;
+			if (!reader.read(1)) num_inputs = 0;
+			peer->acked = glm::max(peer->acked, ack);
+
+			RollbackInput input = {};
+			for (uint n = 0; n < num_inputs; n++)
+			{
+				if (!reader.read(1))
+				{
+					input.buttons  = reader.read(32);
+					input.buttons |= (uint64)reader.read(ROLLBACK_INPUT_BITS - 32) << 32;
+				}
+				if (reader.overflow) break;
+
+				// only the next one in order counts, anything before it is a duplicate
+				uint f = first + n;
+				if (f != peer->received) continue;
+				if (f >= frame + ROLLBACK_INPUTS - ROLLBACK_FRAMES) break; // can't be this far ahead of us
+
+				RollbackInput* slot = &inputs[player][f % ROLLBACK_INPUTS];
+				if (f < frame && !same_input(*slot, input)) rollback_to = glm::min(rollback_to, f); // predicted wrong
+				*slot = input;
+				peer->received = f + 1;
+			}
+
+			if (reader.read(1) && !reader.overflow)
+			{
+				uint f = reader.read(32);
+				uint64 checksum = reader.read(32);
+				checksum |= (uint64)reader.read(32) << 32;
+				if (reader.overflow) continue;
+
+				// ours might not be there yet, then it's kept in the slot for when it is
+				uint slot = f % ROLLBACK_CHECKSUMS;
+				if (f < checksummed && checksums[slot].frame == f + 1) check(f, checksum);
+				else if (f >= checksummed) checksums[slot] = { f + 1, checksum };
+			}
+		}
+
+		if (count < NET_MAX_DATAGRAMS) return;
+	}
+}
+
+// ----------------------- test -------------------- //
+
+// a tiny game : players push a field of particles around
+#define ROLLBACK_TEST_PARTICLES 4096
+
+const uint ROLLBACK_TEST_KEYS[4] = { 22, 0, 18, 3 }; // W A S D, in Keyboard::buttons order
+
+struct RollbackTestState
+{
+	uint frame;
+	vec2 position[ROLLBACK_MAX_PLAYERS], velocity[ROLLBACK_MAX_PLAYERS];
+	vec2 particles[ROLLBACK_TEST_PARTICLES];
+};
+
+void rollback_test_setup(StateArena* arena)
+{
+	RollbackTestState* s = arena->alloc<RollbackTestState>();
+	for (uint i = 0; i < ROLLBACK_TEST_PARTICLES; i++) s->particles[i] = vec2(i % 64, i / 64) * .25f - vec2(8);
+	for (uint p = 0; p < ROLLBACK_MAX_PLAYERS; p++) s->position[p] = vec2(p * 4.f - 6, 0);
+}
+
+void rollback_test_step(void* data, const RollbackInput* inputs, uint num_players)
+{
+	const float dt = 1 / 60.f;
+	const uint* keys = ROLLBACK_TEST_KEYS;
+
+	RollbackTestState* s = (RollbackTestState*)data;
+	for (uint p = 0; p < num_players; p++)
+	{
+		RollbackInput in = inputs[p];
+		vec2 push = vec2(input_down(in, keys[3]) - input_down(in, keys[1]), input_down(in, keys[0]) - input_down(in, keys[2]));
+		s->velocity[p] = s->velocity[p] * .9f + push * (60 * dt);
+		s->position[p] += s->velocity[p] * dt;
+	}
+
+	for (uint i = 0; i < ROLLBACK_TEST_PARTICLES; i++)
+	for (uint p = 0; p < num_players; p++)
+	{
+		vec2 away = s->particles[i] - s->position[p];
+		float d2 = glm::dot(away, away);
+		if (d2 < 1) s->particles[i] += away * ((1 - d2) * 4 * dt);
+	}
+
+	s->frame++;
+}
+
+// the same, except one frame comes out a little different : what a stray uninitialized variable would do
+uint rollback_test_bad_frame;
+void rollback_test_step_wrong(void* data, const RollbackInput* inputs, uint num_players)
+{
+	rollback_test_step(data, inputs, num_players);
+
+	RollbackTestState* s = (RollbackTestState*)data;
+	if (s->frame == rollback_test_bad_frame) s->particles[0].x += .001f;
+}
+
+// two peers over loopback with latency, jitter & loss both ways. time is simulated, so it runs as fast as it can.
+// both have to agree with a simulation that had every input from the start, then one gets corrupted & the other has to notice
+void rollback_test(NetConditions conditions = { .05f, .05f, .01f }, uint num_frames = 1200)
+{
+	const uint MAX_FRAMES = num_frames + ROLLBACK_CHECKSUMS;
+	rollback_test_bad_frame = num_frames / 2;
+
+	for (uint pass = 0; pass < 2; pass++)
+	{
+		bool corrupt = (pass == 1);
+
+		Rollback* peers = Alloc(Rollback, 2);
+		char ports[2][8] = {};
+		for (uint i = 0; i < 2; i++)
+		{
+			rollback_step* step = (corrupt && i == 1) ? rollback_test_step_wrong : rollback_test_step;
+			if (!peers[i].init("127.0.0.1", "0", 2, i, step, sizeof(RollbackTestState) + 64)) return;
+			peers[i].link.conditions = conditions;
+			rollback_test_setup(&peers[i].state);
+			peers[i].start();
+			snprintf(ports[i], 8, "%u", peers[i].link.port);
+		}
+		peers[0].add_peer(1, "127.0.0.1", ports[1]);
+		peers[1].add_peer(0, "127.0.0.1", ports[0]);
+
+		// what each player actually pressed, by the frame it's for
+		RollbackInput* truth = Alloc(RollbackInput, 2 * MAX_FRAMES);
+		RollbackInput held[2] = {};
+		Random rng = {};
+		rng.seed(0x5EED + pass);
+
+		uint tick = 0;
+		while (peers[0].checksummed <= num_frames || peers[1].checksummed <= num_frames)
+		{
+			double now = tick++ / 60.0;
+			for (uint i = 0; i < 2; i++)
+			{
+				// a new direction now & then, so predictions are wrong now & then
+				if (rng.range(10u) == 0)
+				{
+					held[i].buttons = 0;
+					for (uint k = 0; k < 4; k++) if (rng.range(3u) == 0) held[i].buttons |= (uint64)1 << ROLLBACK_TEST_KEYS[k];
+				}
+
+				uint input_frame = peers[i].frame + peers[i].input_delay;
+				if (peers[i].frame >= MAX_FRAMES - peers[i].input_delay - 1) continue;
+				if (peers[i].advance(held[i], now)) truth[i * MAX_FRAMES + input_frame] = held[i];
+			}
+
+			if (tick > MAX_FRAMES * 4) break; // stuck
+		}
+
+		// everything again, in one go, with every input known
+		StateArena reference = {};
+		reference.init(sizeof(RollbackTestState) + 64);
+		rollback_test_setup(&reference);
+		for (uint f = 0; f < num_frames; f++)
+		{
+			RollbackInput frame_inputs[2] = { truth[f], truth[MAX_FRAMES + f] };
+			rollback_test_step(reference.memory, frame_inputs, 2);
+		}
+		uint64 expected = state_checksum(reference.memory, reference.used);
+
+		uint matched = 0;
+		for (uint i = 0; i < 2; i++)
+		{
+			Rollback* r = &peers[i];
+			matched += r->checksums[num_frames % ROLLBACK_CHECKSUMS].frame == num_frames + 1 && r->checksums[num_frames % ROLLBACK_CHECKSUMS].checksum == expected;
+		}
+
+		float seconds = tick / 60.f;
+		if (!corrupt)
+		{
+			print(" %.0f%% loss, %.0f ms latency : %u frames in %u ticks, %llu + %llu stalls\n", conditions.loss * 100, conditions.latency * 1000,
+				num_frames, tick, peers[0].stats.stalls, peers[1].stats.stalls);
+			for (uint i = 0; i < 2; i++)
+			{
+				RollbackStats* st = &peers[i].stats;
+				print(" peer %u : %llu rollbacks, %.1f frames each (max %u, %lld us), %.1f us per step, %.0f B/s up\n", i, st->rollbacks,
+					st->frames_resimulated / (float)glm::max(st->rollbacks, 1ull), st->max_rollback_frames, st->max_rollback_microseconds,
+					peers[i].step_microseconds, st->bytes_sent / seconds);
+			}
+			print(" %u of 2 peers match the reference at frame %u, %llu checksums compared, desync : %s\n", matched, num_frames,
+				peers[0].stats.checksums_compared + peers[1].stats.checksums_compared, (peers[0].desynced || peers[1].desynced) ? "YES" : "no");
+		}
+		else
+		{
+			print(" corrupted peer 1 at frame %u : desync seen by peer 0 at frame %u, by peer 1 at frame %u\n", num_frames / 2,
+				peers[0].desynced ? peers[0].desync_frame : 0, peers[1].desynced ? peers[1].desync_frame : 0);
+		}
+
+		reference.release();
+		peers[0].release();
+		peers[1].release();
+		free(peers);
+		free(truth);
+	}
+}
@@ -0,0 +1,314 @@
+#include "drawer.h"
+
+/* SceneGraph : parent / child transforms
+*
+* - every array is indexed by slot, and slots are kept sorted by depth in the hierarchy,
+*   so by the time a node is updated its parent already has been
+* - that also means every depth level can be updated in parallel
+* - only dirty nodes (and everything below them) get their world matrix rebuilt
+* - nodes are referred to by handle (index + 1, 0 = no node), since slots move around when sorting
+* - extract() writes world matrices straight into the DrawBuffer, grouped by mesh id
+*/
+
+const uint MAX_SCENE_DEPTH = 64;
+
+struct SceneGraph
+{
+	uint max_nodes, num_nodes;
+
+	// per slot
+	uint* parent; // slot + 1, 0 = root
+	byte* depth;
+	byte* dirty;
+	vec3* local_position;
+	quat* local_rotation;
+	vec3* local_scale;
+	mat4* world;
+	uint* mesh_id;  // 0 = not drawn
+	uint* material; // MaterialTable index
+	uint* handle_of;
+	uint* draw_index; // where this node goes within its mesh's instances
+
+	// per handle
+	uint* slot_of;
+
+	uint level_start[MAX_SCENE_DEPTH + 1]; // slots [level_start[d], level_start[d + 1]) are at depth d
+	uint mesh_counts[MAX_MESHES + 1];
+
+	bool unsorted;   // nodes were added since the last sort
+	bool regrouped;  // meshes changed since draw_index was last built
+
+	void* scratch; // for sorting
+
+	void init(uint max_nodes);
+	uint create_node(uint parent_handle, vec3 position, quat rotation = quat(1, 0, 0, 0), vec3 scale = vec3(1), uint mesh_id = 0, uint material = 0);
+	void set_local(uint handle, vec3 position, quat rotation, vec3 scale);
+	void set_mesh(uint handle, uint mesh_id, uint material = 0);
+	mat4 world_matrix(uint handle);
+	void update(); // recomputes dirty world matrices
+	void extract(DrawBuffer* db); // once per frame, after update()
+
+	void sort();
+	void group();
+};
+
+void SceneGraph::init(uint max)
+{
+	*this = {};
+	max_nodes = max;
+
+	parent         = Alloc(uint, max_nodes);
+	depth          = Alloc(byte, max_nodes);
+	dirty          = Alloc(byte, max_nodes);
+	local_position = Alloc(vec3, max_nodes);
+	local_rotation = Alloc(quat, max_nodes);
+	local_scale    = Alloc(vec3, max_nodes);
+	world          = Alloc(mat4, max_nodes);
+	mesh_id        = Alloc(uint, max_nodes);
+	material       = Alloc(uint, max_nodes);
+	handle_of      = Alloc(uint, max_nodes);
+	draw_index     = Alloc(uint, max_nodes);
+	slot_of        = Alloc(uint, max_nodes);
+	scratch        = Alloc(mat4, max_nodes);
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init SceneGraph | Max Nodes : [%d]", max_nodes);
+	console->add_entry(msg, SUCCESS, RNDR);
+}
+uint SceneGraph::create_node(uint parent_handle, vec3 position, quat rotation, vec3 scale, uint mesh, uint mat)
+{
+	if (num_nodes == max_nodes) { out("ERROR : max scene nodes exceeded!"); stop; return 0; }
+
+	uint parent_slot = parent_handle ? slot_of[parent_handle - 1] : 0;
+	uint node_depth  = parent_handle ? depth[parent_slot] + 1 : 0;
+
+	if (node_depth >= MAX_SCENE_DEPTH) { out("ERROR : scene graph is too deep!"); stop; return 0; }
+	if (mesh > MAX_MESHES) { out("ERROR : scene node mesh id past MAX_MESHES!"); stop; return 0; }
+
+	// new nodes go at the end & get sorted into place on the next update
+	uint slot = num_nodes++;
+	parent[slot]         = parent_handle ? parent_slot + 1 : 0;
+	depth[slot]          = node_depth;
+	dirty[slot]          = 1;
+	local_position[slot] = position;
+	local_rotation[slot] = rotation;
+	local_scale[slot]    = scale;
+	mesh_id[slot]        = mesh;
+	material[slot]       = mat;
+	handle_of[slot]      = slot + 1;
+	slot_of[slot]        = slot; // handles are handed out in creation order
+
+	unsorted  = true;
+	regrouped = true;
+	return slot + 1;
+}
+void SceneGraph::set_local(uint handle, vec3 position, quat rotation, vec3 scale)
+{
+	uint slot = slot_of[handle - 1];
+	local_position[slot] = position;
+	local_rotation[slot] = rotation;
+	local_scale[slot]    = scale;
+	dirty[slot] = 1;
+}
+void SceneGraph::set_mesh(uint handle, uint mesh, uint mat)
+{
+	if (mesh > MAX_MESHES) { out("ERROR : scene node mesh id past MAX_MESHES!"); stop; return; }
+
+	uint slot = slot_of[handle - 1];
+	if (mesh_id[slot] != mesh) regrouped = true;
+	mesh_id[slot]  = mesh;
+	material[slot] = mat;
+}
+mat4 SceneGraph::world_matrix(uint handle)
+{
+	return world[slot_of[handle - 1]];
+}
+
+// moves array[i] to array[new_slot[i]]
+template <typename T> void scene_permute(T* array, uint* new_slot, void* scratch, uint count)
+{
+	T* sorted = (T*)scratch;
+	for (uint i = 0; i < count; i++) sorted[new_slot[i]] = array[i];
+	memcpy(array, sorted, count * sizeof(T));
+}
+
+// counting sort by depth. stable, so siblings stay in creation order
+void SceneGraph::sort()
+{
+	uint counts[MAX_SCENE_DEPTH] = {};
+	for (uint i = 0; i < num_nodes; i++) counts[depth[i]]++;
+
+	level_start[0] = 0;
+	for (uint d = 0; d < MAX_SCENE_DEPTH; d++) level_start[d + 1] = level_start[d] + counts[d];
+
+	uint cursor[MAX_SCENE_DEPTH];
+	memcpy(cursor, level_start, sizeof(cursor));
+
+	uint* new_slot = Alloc(uint, num_nodes);
+	for (uint i = 0; i < num_nodes; i++) new_slot[i] = cursor[depth[i]]++;
+
+	// parents point at slots, so they have to be remapped too
+	for (uint i = 0; i < num_nodes; i++) if (parent[i]) parent[i] = new_slot[parent[i] - 1] + 1;
+
+	scene_permute(parent        , new_slot, scratch, num_nodes);
+	scene_permute(depth         , new_slot, scratch, num_nodes);
+	scene_permute(dirty         , new_slot, scratch, num_nodes);
+	scene_permute(local_position, new_slot, scratch, num_nodes);
+	scene_permute(local_rotation, new_slot, scratch, num_nodes);
+	scene_permute(local_scale   , new_slot, scratch, num_nodes);
+	scene_permute(world         , new_slot, scratch, num_nodes);
+	scene_permute(mesh_id       , new_slot, scratch, num_nodes);
+	scene_permute(material      , new_slot, scratch, num_nodes);
+	scene_permute(handle_of     , new_slot, scratch, num_nodes);
+
+	for (uint i = 0; i < num_nodes; i++) slot_of[handle_of[i] - 1] = i;
+
+	free(new_slot);
+	unsorted = false;
+}
+
+// works out where each drawn node lands in the instance buffer, only when meshes change
+void SceneGraph::group()
+{
+	for (uint i = 0; i <= MAX_MESHES; i++) mesh_counts[i] = 0;
+
+	for (uint i = 0; i < num_nodes; i++)
+		if (mesh_id[i] && mesh_id[i] <= MAX_MESHES) draw_index[i] = mesh_counts[mesh_id[i]]++;
+
+	regrouped = false;
+}
+
+void SceneGraph::update()
+{
+	if (unsorted) sort();
+
+	// each level only reads the levels above it
+	for (uint d = 0; d < MAX_SCENE_DEPTH; d++)
+	{
+		uint begin = level_start[d], count = level_start[d + 1] - begin;
+		if (!count) break;
+
+		struct Level { SceneGraph* scene; uint begin; } params = { this, begin };
+		const auto update_level = [](void* data, uint a, uint b) {
+			Level* level = (Level*)data;
+			SceneGraph* scene = level->scene;
+
+			for (uint i = level->begin + a; i < level->begin + b; i++)
+			{
+				uint p = scene->parent[i];
+				if (p && scene->dirty[p - 1]) scene->dirty[i] = 1; // parents moved, so children moved
+				if (!scene->dirty[i]) continue;
+
+				mat4 local = trs(scene->local_position[i], scene->local_rotation[i], scene->local_scale[i]);
+
+				if (p) mul(scene->world[p - 1], local, &scene->world[i]);
+				else   scene->world[i] = local;
+			}
+		};
+
+		parallel_for(count, 4096, update_level, &params);
+	}
+
+	memset(dirty, 0, num_nodes);
+}
+
+void SceneGraph::extract(DrawBuffer* db)
+{
+	if (regrouped) group();
+
+	uint mesh_base[MAX_MESHES + 1] = {};
+	uint first_instance = 0, num_instances = 0;
+
+	for (uint m = 1; m <= MAX_MESHES; m++)
+	{
+		if (!mesh_counts[m]) continue;
+
+		mesh_base[m] = db->assign_instances(m, mesh_counts[m]);
+		if (!num_instances) first_instance = mesh_base[m];
+		mesh_base[m]  -= first_instance;
+		num_instances += mesh_counts[m];
+	}
+
+	if (!num_instances) return;
+
+	struct Extract {
+		SceneGraph* scene;
+		uint* mesh_base;
+		void* instances;
+		uint* materials;
+		bool compact;
+	} params = { this, mesh_base };
+
+	params.instances = db->map_instances(first_instance, num_instances, &params.materials);
+	params.compact   = db->instance_format == INSTANCE_COMPACT;
+
+	const auto extract_nodes = [](void* data, uint begin, uint end) {
+		Extract* e = (Extract*)data;
+		SceneGraph* scene = e->scene;
+
+		InstancePacker packer; // meshes are interleaved, so slots scatter
+		packer.output = (CompactInstance*)e->instances;
+		packer.count  = 0;
+
+		for (uint i = begin; i < end; i++)
+		{
+			uint mesh = scene->mesh_id[i];
+			if (!mesh || mesh > MAX_MESHES) continue; // group() didn't count it
+
+			uint n = e->mesh_base[mesh] + scene->draw_index[i];
+			e->materials[n] = scene->material[i];
+
+			if (e->compact) packer.add(n, scene->world[i]);
+			else ((mat4*)e->instances)[n] = scene->world[i];
+		}
+
+		if (e->compact) packer.flush();
+	};
+
+	parallel_for(num_nodes, 4096, extract_nodes, &params);
+
+	db->unmap_instances();
+}
+
+// 1M nodes in random trees, 1% of them moved every frame
+void scene_benchmark()
+{
+	const uint NUM_NODES  = 1000000;
+	const uint NUM_FRAMES = 100;
+
+	SceneGraph* scene = Alloc(SceneGraph, 1);
+	scene->init(NUM_NODES);
+
+	// a few thousand roots, everything else hangs off a random earlier node
+	for (uint i = 0; i < NUM_NODES; i++)
+	{
+		uint parent = (i < 4096) ? 0 : 1 + random_uint(i, 7) % i;
+		if (parent && scene->depth[scene->slot_of[parent - 1]] + 1 >= MAX_SCENE_DEPTH) parent = 0;
+
+		scene->create_node(parent, randf3ns() * 8.f, glm::angleAxis(randfn() * TWOPI, glm::normalize(randf3ns() + vec3(0, 0, .01))));
+	}
+
+	Timer timer = {};
+	timer.init();
+
+	timer.start();
+	scene->update(); // sorts & builds everything once
+	timer.print_microseconds("first update : ");
+
+	int64 total = 0;
+	for (uint frame = 0; frame < NUM_FRAMES; frame++)
+	{
+		for (uint i = 0; i < NUM_NODES / 100; i++)
+		{
+			uint handle = 1 + random_uint(frame * NUM_NODES + i, 3) % NUM_NODES;
+			scene->set_local(handle, randf3ns() * 8.f, quat(1, 0, 0, 0), vec3(1));
+		}
+
+		timer.start();
+		scene->update();
+		total += timer.microseconds_elapsed();
+	}
+
+	out("average update, 1% dirty : " << total / NUM_FRAMES << " us");
+}
@@ -0,0 +1,95 @@
+#define HEADLESS // no window, GL, audio or UI
+#include "server.h"
+
+volatile bool server_running = true;
+
+BOOL WINAPI on_console_close(DWORD signal)
+{
+	server_running = false; // finish the tick, then shut down properly
+	return TRUE;
+}
+
+int main(int argc, char** argv)
+{
+	Timer clock = {};
+	clock.init();
+	clock.start(); // everything from here on is measured from process start
+
+	ServerConfig config = parse_server_config(argc, argv);
+	console = Alloc(GameConsole, 1);
+
+	// pinned : game thread, stats I/O thread, then a worker on every core left. otherwise one worker per core but this one
+	uint num_cores   = get_num_cores();
+	uint reserved    = config.first_core >= 0 ? config.first_core + 2 : 1;
+	uint num_workers = num_cores > reserved ? num_cores - reserved : 1;
+	if (config.first_core >= 0) pin_thread(config.first_core);
+
+	work_queue = Alloc(WorkQueue, 1);
+	init_work_queue(work_queue, num_workers, config.first_core >= 0 ? config.first_core + 2 : -1);
+
+	ServerSimulation* sim = Alloc(ServerSimulation, 1);
+	if (!sim->init(config)) { print("could not open port %s\n", config.port); return 1; }
+
+	Server* endpoint = NULL;
+	byte answered[SERVER_STATS_CLIENTS] = {};
+	if (config.stats_port)
+	{
+		endpoint = Alloc(Server, 1);
+		if (server_init(endpoint, NULL, config.stats_port, SERVER_STATS_CLIENTS) != 0) { free(endpoint); endpoint = NULL; }
+		else if (config.first_core >= 0) server_pin_io_thread(endpoint, config.first_core + 1);
+	}
+
+	SetConsoleCtrlHandler(on_console_close, TRUE);
+
+	ServerStats stats = {};
+	stats.startup_us   = clock.microseconds_elapsed();
+	stats.window_start = stats.startup_us;
+	print("serving %u entities on port %s at %.0f ticks per second, stats on %s | started in %.2f ms\n",
+		config.num_entities, config.port, config.tick_rate, endpoint ? config.stats_port : "nothing", stats.startup_us / 1000.f);
+
+	const int64 tick_us = (int64)(1000000 / config.tick_rate);
+	const float ticks_per_send = config.tick_rate / config.send_rate;
+	float send_accumulator = 0;
+	int64 next_tick = stats.startup_us;
+
+	while (server_running)
+	{
+		int64 now = clock.microseconds_elapsed();
+		if (now < next_tick)
+		{
+			if (next_tick - now > 1500) os_sleep(1); // the scheduler is only good to about a millisecond, spin the rest
+			continue;
+		}
+
+		if (now - next_tick > tick_us) stats.late_ticks++;
+		if (now - next_tick > SERVER_MAX_CATCH_UP * tick_us) { next_tick = now; stats.schedule_resets++; }
+		next_tick += tick_us;
+
+		double seconds = now / 1000000.0;
+		sim->replication.receive(seconds);
+		sim->replication.drop_silent(seconds, config.peer_timeout);
+
+		sim->step();
+
+		send_accumulator += 1;
+		if (send_accumulator >= ticks_per_send)
+		{
+			send_accumulator -= ticks_per_send;
+			sim->replicate();
+			sim->replication.send(seconds);
+		}
+
+		int64 end = clock.microseconds_elapsed();
+		stats.end_tick(end, end - now, sim->replication.link.bytes_sent);
+
+		if (endpoint) serve_stats(endpoint, answered, config, stats, sim, end);
+	}
+
+	print("shutting down after %llu ticks\n", stats.ticks);
+	if (endpoint) { server_shutdown(endpoint); free(endpoint); }
+	sim->release();
+	free(sim);
+	net_cleanup();
+
+	return 0;
+}
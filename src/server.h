@@ -0,0 +1,252 @@
+#include "entities.h"
+
+#include <psapi.h> // GetProcessMemoryInfo
+#pragma comment(lib, "psapi")
+
+/* Dedicated server : the simulation & replication, with nothing that draws, plays sound or reads input
+
+	server.exe [-port 27015] [-stats 27016] [-tick 60] [-send 20] [-entities 4096] [-area 256]
+	           [-budget 4096] [-radius 0] [-pin -1] [-timeout 5]
+
+	- src/server.cpp defines HEADLESS, so boilerplate.h leaves out GLEW, GLFW, OpenAL & ImGui :
+	  memory & startup are whatever the world & the replication state need, nothing else
+	- fixed tick rate. the loop sleeps until the next tick is about a millisecond away & spins the rest.
+	  a late tick is caught up on right away, a few in a row at most, after that the schedule starts over from now
+	- -pin N : the game thread gets core N, the stats I/O thread N + 1 & the workers one core each after that
+	- the stats endpoint answers anything that connects & sends a request (curl, a browser, netcat)
+	  with one "name value" pair per line, then hangs up
+*/
+
+#define SERVER_MAX_CATCH_UP  4 // ticks run back to back before the schedule gets reset
+#define SERVER_STATS_CLIENTS 8
+
+struct ServerConfig
+{
+	const char* port;       // replication, UDP
+	const char* stats_port; // stats endpoint, TCP. NULL = none
+	float tick_rate;        // simulation steps per second
+	float send_rate;        // replication packets per second, at most tick_rate
+	uint  num_entities;
+	float area;             // entities live in [-area, area] on x & z
+	uint  bytes_per_second; // replication budget per client
+	float interest_radius;  // 0 = every client gets every entity
+	int   first_core;       // -1 = no pinning
+	float peer_timeout;     // seconds
+};
+
+ServerConfig parse_server_config(int argc, char** argv)
+{
+	ServerConfig config = { "27015", "27016", 60, 20, 4096, 256, 4096, 0, -1, 5 };
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		const char* name  = argv[i];
+		const char* value = argv[i + 1];
+
+		if      (!strcmp(name, "-port"    )) config.port             = value;
+		else if (!strcmp(name, "-stats"   )) config.stats_port       = strcmp(value, "0") ? value : NULL;
+		else if (!strcmp(name, "-tick"    )) config.tick_rate        = (float)atof(value);
+		else if (!strcmp(name, "-send"    )) config.send_rate        = (float)atof(value);
+		else if (!strcmp(name, "-entities")) config.num_entities     = atoi(value);
+		else if (!strcmp(name, "-area"    )) config.area             = (float)atof(value);
+		else if (!strcmp(name, "-budget"  )) config.bytes_per_second = atoi(value);
+		else if (!strcmp(name, "-radius"  )) config.interest_radius  = (float)atof(value);
+		else if (!strcmp(name, "-pin"     )) config.first_core       = atoi(value);
+		else if (!strcmp(name, "-timeout" )) config.peer_timeout     = (float)atof(value);
+		else print("unknown option %s\n", name);
+	}
+
+	if (config.tick_rate < 1) config.tick_rate = 1;
+	if (config.send_rate > config.tick_rate || config.send_rate <= 0) config.send_rate = config.tick_rate;
+	if (config.num_entities > REPLICATION_MAX_ENTITIES) config.num_entities = REPLICATION_MAX_ENTITIES;
+	if (config.area > POSITION_EXTENT) config.area = POSITION_EXTENT;
+
+	return config;
+}
+
+// ------------------- simulation ------------------ //
+
+struct ServerSimulation
+{
+	World world;
+	ReplicationServer replication;
+	float dt, area;
+
+	bool init(const ServerConfig& config);
+	void release();
+
+	void step();      // every system, once per tick
+	void replicate(); // copies every transform into the replication state
+};
+
+// keeps everything inside the area by bouncing it off the edges
+void bounce_off_edges(void* data, Archetype* archetype, Chunk* chunk)
+{
+	float area = *(float*)data;
+
+	EntityTransform* transforms = components<EntityTransform>(archetype, chunk, COMPONENT_TRANSFORM);
+	Velocity*  velocities = components<Velocity >(archetype, chunk, COMPONENT_VELOCITY);
+
+	for (uint i = 0; i < chunk->count; i++)
+	{
+		vec3& p = transforms[i].position;
+		vec3& v = velocities[i].linear;
+		if (p.x < -area || p.x > area) { v.x = -v.x; p.x = glm::clamp(p.x, -area, area); }
+		if (p.z < -area || p.z > area) { v.z = -v.z; p.z = glm::clamp(p.z, -area, area); }
+	}
+}
+
+bool ServerSimulation::init(const ServerConfig& config)
+{
+	dt   = 1.f / config.tick_rate;
+	area = config.area;
+
+	if (!replication.init(NULL, config.port, config.num_entities, config.send_rate, config.bytes_per_second)) return false;
+	if (config.interest_radius > 0) replication.use_interest(config.interest_radius);
+
+	world.init(config.num_entities);
+	world.add_system("integrate", COMPONENT(COMPONENT_VELOCITY), COMPONENT(COMPONENT_TRANSFORM), integrate_velocities, &dt);
+	world.add_system("bounds"   , 0, COMPONENT(COMPONENT_TRANSFORM) | COMPONENT(COMPONENT_VELOCITY), bounce_off_edges, &area);
+
+	// stand-ins until there's a real game : everything wanders around the area
+	ComponentMask moving = COMPONENT(COMPONENT_TRANSFORM) | COMPONENT(COMPONENT_VELOCITY);
+	for (uint i = 0; i < config.num_entities; i++)
+	{
+		uint entity = world.create_entity(moving);
+
+		EntityTransform* t = (EntityTransform*)world.get(entity, COMPONENT_TRANSFORM);
+		t->position = vec3(randfns() * area, 0, randfns() * area);
+		t->rotation = quat(1, 0, 0, 0);
+		t->scale    = 1;
+
+		Velocity* v = (Velocity*)world.get(entity, COMPONENT_VELOCITY);
+		v->linear  = vec3(randfns(), 0, randfns()) * 4.f;
+		v->angular = vec3(0, randfns(), 0);
+	}
+
+	replicate();
+	return true;
+}
+
+void ServerSimulation::release()
+{
+	replication.release();
+	// the world has no release(), the server only ever makes one
+}
+
+void ServerSimulation::step() { world.run_systems(); }
+
+void ServerSimulation::replicate()
+{
+	for (uint a = 0; a < world.num_archetypes; a++)
+	{
+		Archetype* archetype = &world.archetypes[a];
+		if (!(archetype->mask & COMPONENT(COMPONENT_TRANSFORM))) continue;
+
+		for (uint c = 0; c < archetype->num_chunks; c++)
+		{
+			Chunk* chunk = &archetype->chunks[c];
+			uint* handles = (uint*)chunk->data;
+			EntityTransform* transforms = components<EntityTransform>(archetype, chunk, COMPONENT_TRANSFORM);
+
+			for (uint i = 0; i < chunk->count; i++) replication.set_entity(handles[i] - 1, transforms[i].position, transforms[i].rotation);
+		}
+	}
+}
+
+// --------------------- stats --------------------- //
+
+struct ServerStats
+{
+	int64 startup_us; // process start to the first tick
+	uint64 ticks, late_ticks, schedule_resets;
+
+	// the current second, then the last whole one
+	int64 window_start, tick_us_total, tick_us_max;
+	uint window_ticks;
+	float last_tick_us_avg, last_tick_us_max;
+	float last_bytes_per_second;
+	uint64 window_bytes;
+
+	void end_tick(int64 now, int64 tick_us, uint64 bytes_sent);
+};
+
+void ServerStats::end_tick(int64 now, int64 tick_us, uint64 bytes_sent)
+{
+	ticks++;
+	window_ticks++;
+	tick_us_total += tick_us;
+	if (tick_us > tick_us_max) tick_us_max = tick_us;
+
+	if (now - window_start < 1000000) return;
+
+	float seconds = (now - window_start) / 1000000.f;
+	last_tick_us_avg      = tick_us_total / (float)window_ticks;
+	last_tick_us_max      = (float)tick_us_max;
+	last_bytes_per_second = (bytes_sent - window_bytes) / seconds;
+
+	window_start  = now;
+	window_bytes  = bytes_sent;
+	window_ticks  = 0;
+	tick_us_total = tick_us_max = 0;
+}
+
+uint64 get_process_memory()
+{
+	PROCESS_MEMORY_COUNTERS counters = {};
+	GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+	return counters.WorkingSetSize;
+}
+
+uint write_server_stats(char* text, uint size, const ServerConfig& config, const ServerStats& stats, ServerSimulation* sim, int64 now)
+{
+	return snprintf(text, size,
+		"uptime_s %.1f\n"
+		"startup_ms %.2f\n"
+		"memory_mb %.2f\n"
+		"tick_rate %.0f\n"
+		"ticks %llu\n"
+		"late_ticks %llu\n"
+		"schedule_resets %llu\n"
+		"tick_us_avg %.1f\n"
+		"tick_us_max %.0f\n"
+		"entities %u\n"
+		"clients %u\n"
+		"downstream_bytes_per_second %.0f\n",
+		now / 1000000.0, stats.startup_us / 1000.0, get_process_memory() / (1024.0 * 1024.0),
+		config.tick_rate, stats.ticks, stats.late_ticks, stats.schedule_resets,
+		stats.last_tick_us_avg, stats.last_tick_us_max,
+		sim->world.num_entities - sim->world.num_free, sim->replication.num_peers,
+		stats.last_bytes_per_second);
+}
+
+// answers every request with the stats, whatever the request was, then hangs up
+void serve_stats(Server* endpoint, byte* answered, const ServerConfig& config, const ServerStats& stats, ServerSimulation* sim, int64 now)
+{
+	char body[1024];
+	uint body_size = 0; // only written once somebody asks
+
+	NetEvent event;
+	while (server_poll(endpoint, &event))
+	{
+		uint id = event.connection;
+		if (event.type == NET_CONNECT) answered[id] = 0;
+		if (event.type != NET_DATA || answered[id]) continue;
+
+		byte request[256];
+		while (server_recieve(endpoint, request, sizeof(request), id) == sizeof(request)); // closing on unread bytes would reset the connection
+
+		if (!body_size) body_size = glm::min(write_server_stats(body, sizeof(body), config, stats, sim, now), (uint)sizeof(body) - 1);
+
+		char header[128];
+		uint header_size = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n", body_size);
+
+		NetMessage* message = server_message(endpoint, header_size + body_size);
+		memcpy(message->data, header, header_size);
+		memcpy(message->data + header_size, body, body_size);
+		server_send_message(endpoint, message, id);
+		server_disconnect(endpoint, id); // the close is queued behind the flush
+
+		answered[id] = 1;
+	}
+}
@@ -0,0 +1,460 @@
+#include "entities.h"
+
+/* Terrain : procedural heightfield chunks streamed in around the camera
+*
+* - heights come from SimplexNoise::fractal_grid on the background queue, never on the main thread
+* - each chunk gets a LOD by distance (33, 17 or 9 verts per side) plus skirts that hide the cracks between LODs
+* - finished chunks are uploaded into fixed size slots of one vertex & index buffer,
+*   then everything is drawn with one multi-draw using the geometry shader & a single material
+* - heightfields are cached on disk (keyed by seed & chunk coordinate) so revisiting an area only costs a file read.
+*   the cache is capped at MAX_CACHED_TERRAIN_CHUNKS files & evicts the least recently used
+*/
+
+const uint  TERRAIN_CHUNK_VERTS = 33;   // per side, at LOD 0
+const float TERRAIN_CHUNK_SIZE  = 32.f; // world units per side
+const uint  TERRAIN_NUM_LODS    = 3;    // each LOD halves the verts per side
+const int   TERRAIN_VIEW_RADIUS = 6;    // in chunks
+
+const uint MAX_TERRAIN_CHUNKS = 256; // resident at once, (2 * radius + 1)^2 plus room for the ones on their way out
+const uint MAX_TERRAIN_LOADS_IN_FLIGHT   = 8;
+const uint MAX_TERRAIN_UPLOADS_PER_FRAME = 4;
+const uint MAX_CACHED_TERRAIN_CHUNKS     = 4096; // on disk, ~5 KB each
+
+const uint TERRAIN_HEIGHTS       = TERRAIN_CHUNK_VERTS + 2; // per side, 1 sample border for normals
+const uint TERRAIN_MAX_VERTICES  = TERRAIN_CHUNK_VERTS * TERRAIN_CHUNK_VERTS + 4 * TERRAIN_CHUNK_VERTS;
+const uint TERRAIN_MAX_INDICES   = (TERRAIN_CHUNK_VERTS - 1) * (TERRAIN_CHUNK_VERTS - 1) * 6 + 4 * (TERRAIN_CHUNK_VERTS - 1) * 6;
+const uint TERRAIN_CACHE_MAGIC   = 0x504D4854; // "THMP"
+
+#define TERRAIN_CACHE_DIRECTORY "cache/terrain/"
+
+struct TerrainVertex {
+	vec3 position, normal;
+	vec2 uv;
+};
+
+struct Terrain_Cache_Header {
+	uint magic;
+	uint seed;
+	int  x, z;
+	uint num_heights; // per side
+};
+
+struct Terrain;
+
+struct TerrainChunk
+{
+	bool  in_use;
+	ivec2 coord;
+	uint  lod; // of what's in the slot right now
+	uint  num_indices;
+	bool  resident;
+	uint  last_wanted_frame;
+
+	// written by the worker, read by the main thread once state == LOAD_DONE
+	struct {
+		volatile uint state;
+		uint lod;
+		Terrain* terrain;
+		bool from_cache, wrote_cache;
+		TerrainVertex* vertices;
+		uint* indices;
+		uint num_vertices, num_indices;
+	} load;
+};
+
+struct Terrain
+{
+	TerrainChunk chunks[MAX_TERRAIN_CHUNKS]; // chunk i lives in slot i of the gpu buffers
+
+	// generation params, read by the workers
+	uint  seed;
+	uint  octaves;
+	float height_scale;
+	vec2  seed_offset;
+	SimplexNoise noise;
+
+	// on disk cache
+	struct {
+		uint seed;
+		int  x, z;
+		uint last_used;
+	} cached[MAX_CACHED_TERRAIN_CHUNKS];
+	uint num_cached;
+
+	GLuint VAO;
+	GLuint vert_buffer, indx_buffer, cmds_buffer;
+	uint instance_format;
+	uint material;
+
+	struct {
+		uint num_indices;
+		uint num_instances;
+		uint first_index;   // IN INDICES
+		uint base_vertex;   // IN VERTS
+		uint base_instance; // IN INSTANCES
+	} commands[MAX_TERRAIN_CHUNKS];
+	uint num_commands;
+
+	uint loads_in_flight;
+	uint frame;
+
+	void init(uint seed, uint material, uint instance_format = INSTANCE_MAT4);
+	void update(vec3 camera_position); // once per frame : uploads finished chunks, requests new ones
+	void draw(); // during the geometry pass, with the geometry shader bound
+	float height(float x, float z); // generates on the spot, for gameplay queries
+
+	void request(TerrainChunk* chunk, uint lod);
+	void touch_cache(uint seed, int x, int z, bool added);
+};
+
+uint terrain_lod(ivec2 offset) // chunks further away get fewer vertices
+{
+	int distance = glm::max(abs(offset.x), abs(offset.y));
+	if (distance <= 1) return 0;
+	if (distance <= 3) return 1;
+	return 2;
+}
+
+void terrain_cache_path(char* path, uint seed, int x, int z)
+{
+	snprintf(path, 64, TERRAIN_CACHE_DIRECTORY "%08x_%d_%d.hmap", seed, x, z);
+}
+
+// TERRAIN_HEIGHTS^2 heights starting one sample before the chunk's corner
+void generate_terrain_heights(Terrain* terrain, ivec2 coord, float* heights)
+{
+	float step = TERRAIN_CHUNK_SIZE / (TERRAIN_CHUNK_VERTS - 1);
+	float x0 = coord.x * TERRAIN_CHUNK_SIZE - step + terrain->seed_offset.x;
+	float z0 = coord.y * TERRAIN_CHUNK_SIZE - step + terrain->seed_offset.y;
+
+	terrain->noise.fractal_grid(terrain->octaves, x0, z0, step, TERRAIN_HEIGHTS, TERRAIN_HEIGHTS, heights);
+
+	for (uint i = 0; i < TERRAIN_HEIGHTS * TERRAIN_HEIGHTS; i++) heights[i] *= terrain->height_scale;
+}
+
+// runs on the background queue : reads or generates the heightfield, then builds the mesh
+void terrain_chunk_job(void* param)
+{
+	TerrainChunk* chunk = (TerrainChunk*)param;
+	Terrain* terrain = chunk->load.terrain;
+
+	float heights[TERRAIN_HEIGHTS * TERRAIN_HEIGHTS];
+
+	char path[64];
+	terrain_cache_path(path, terrain->seed, chunk->coord.x, chunk->coord.y);
+
+	chunk->load.from_cache  = false;
+	chunk->load.wrote_cache = false;
+
+	FILE* file = fopen(path, "rb");
+	if (file)
+	{
+		Terrain_Cache_Header header = {};
+		fread(&header, sizeof(header), 1, file);
+
+		chunk->load.from_cache = header.magic == TERRAIN_CACHE_MAGIC && header.seed == terrain->seed
+			&& header.x == chunk->coord.x && header.z == chunk->coord.y && header.num_heights == TERRAIN_HEIGHTS
+			&& fread(heights, sizeof(heights), 1, file) == 1;
+
+		fclose(file);
+	}
+
+	if (!chunk->load.from_cache)
+	{
+		generate_terrain_heights(terrain, chunk->coord, heights);
+
+		file = fopen(path, "wb");
+		if (file)
+		{
+			Terrain_Cache_Header header = { TERRAIN_CACHE_MAGIC, terrain->seed, chunk->coord.x, chunk->coord.y, TERRAIN_HEIGHTS };
+			chunk->load.wrote_cache = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(heights, sizeof(heights), 1, file) == 1;
+			fclose(file);
+		}
+	}
+
+	// mesh : n * n grid, then one row of skirt vertices under each edge
+	uint stride = 1 << chunk->load.lod;
+	uint n = (TERRAIN_CHUNK_VERTS - 1) / stride + 1;
+	float step = TERRAIN_CHUNK_SIZE / (TERRAIN_CHUNK_VERTS - 1);
+	float skirt_depth = 2 * stride * step;
+
+	TerrainVertex* vertices = Alloc(TerrainVertex, n * n + 4 * n);
+	uint* indices = Alloc(uint, (n - 1) * (n - 1) * 6 + 4 * (n - 1) * 6);
+
+	const auto h = [&](uint x, uint z) { return heights[z * TERRAIN_HEIGHTS + x]; };
+
+	for (uint j = 0; j < n; j++)
+	for (uint i = 0; i < n; i++)
+	{
+		uint x = 1 + i * stride, z = 1 + j * stride; // in the bordered heightfield
+		vec3 position = vec3(chunk->coord.x * TERRAIN_CHUNK_SIZE + i * stride * step, h(x, z), chunk->coord.y * TERRAIN_CHUNK_SIZE + j * stride * step);
+		vec3 normal = glm::normalize(vec3(h(x - 1, z) - h(x + 1, z), 2 * step, h(x, z - 1) - h(x, z + 1)));
+
+		vertices[j * n + i] = { position, normal, vec2(position.x, position.z) / TERRAIN_CHUNK_SIZE };
+	}
+
+	uint num_indices = 0;
+	for (uint j = 0; j < n - 1; j++)
+	for (uint i = 0; i < n - 1; i++)
+	{
+		uint a = j * n + i, b = a + 1, c = a + n, d = c + 1;
+		uint quad[6] = { a, c, b, b, c, d }; // counter clockwise seen from above
+		memcpy(indices + num_indices, quad, sizeof(quad));
+		num_indices += 6;
+	}
+
+	// skirts : edge 0 = -z, 1 = +z, 2 = -x, 3 = +x. flip keeps them facing outwards
+	for (uint edge = 0; edge < 4; edge++)
+	{
+		uint skirt = n * n + edge * n;
+		bool flip = (edge == 1 || edge == 2);
+
+		for (uint k = 0; k < n; k++)
+		{
+			uint top = (edge == 0) ? k : (edge == 1) ? (n - 1) * n + k : (edge == 2) ? k * n : k * n + n - 1;
+			vertices[skirt + k] = vertices[top];
+			vertices[skirt + k].position.y -= skirt_depth;
+
+			if (k == n - 1) continue;
+
+			uint next = (edge < 2) ? top + 1 : top + n;
+			uint quad[6] = { top, next, skirt + k, next, skirt + k + 1, skirt + k };
+			if (flip) { quad[1] = skirt + k; quad[2] = next; quad[4] = skirt + k; quad[5] = skirt + k + 1; }
+			memcpy(indices + num_indices, quad, sizeof(quad));
+			num_indices += 6;
+		}
+	}
+
+	chunk->load.vertices     = vertices;
+	chunk->load.indices      = indices;
+	chunk->load.num_vertices = n * n + 4 * n;
+	chunk->load.num_indices  = num_indices;
+
+	_WriteBarrier(); // everything above has to land before the main thread sees LOAD_DONE
+	chunk->load.state = LOAD_DONE;
+}
+
+void Terrain::init(uint terrain_seed, uint terrain_material, uint format)
+{
+	seed            = terrain_seed;
+	material        = terrain_material;
+	instance_format = format;
+	octaves         = 6;
+	height_scale    = 12;
+	noise           = SimplexNoise(1.f / 128);
+	seed_offset     = vec2(random_uint(1, seed) & 0xFFFF, random_uint(2, seed) & 0xFFFF) * .731f;
+
+	// gpu buffers : one fixed size slot per chunk
+	glGenVertexArrays(1, &VAO);
+	glGenBuffers(1, &vert_buffer);
+	glGenBuffers(1, &indx_buffer);
+	glGenBuffers(1, &cmds_buffer);
+
+	glBindVertexArray(VAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+	glBufferData(GL_ARRAY_BUFFER, MAX_TERRAIN_CHUNKS * TERRAIN_MAX_VERTICES * sizeof(TerrainVertex), NULL, GL_DYNAMIC_DRAW);
+
+	// same layout as DrawBuffer meshes : vec3 position, vec3 normal, vec2 uv
+	uint stride = sizeof(TerrainVertex);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3)));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(vec3) * 2));
+	glEnableVertexAttribArray(2);
+
+	// no instance attributes : draw() sets them to constants instead
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, MAX_TERRAIN_CHUNKS * TERRAIN_MAX_INDICES * sizeof(uint), NULL, GL_DYNAMIC_DRAW);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(commands), NULL, GL_DYNAMIC_DRAW);
+
+	glBindVertexArray(0);
+
+	// find what's already cached; timestamps start at 0 so old files go first
+	CreateDirectoryA("cache", NULL);
+	CreateDirectoryA(TERRAIN_CACHE_DIRECTORY, NULL);
+
+	WIN32_FIND_DATAA file = {};
+	HANDLE search = FindFirstFileA(TERRAIN_CACHE_DIRECTORY "*.hmap", &file);
+	if (search != INVALID_HANDLE_VALUE)
+	{
+		do {
+			uint file_seed; int x, z;
+			if (sscanf(file.cFileName, "%08x_%d_%d.hmap", &file_seed, &x, &z) == 3 && num_cached < MAX_CACHED_TERRAIN_CHUNKS)
+				cached[num_cached++] = { file_seed, x, z, 0 };
+		} while (FindNextFileA(search, &file));
+		FindClose(search);
+	}
+
+	// log
+	char msg[62] = {};
+	snprintf(msg, 62, "Init Terrain | Seed : [%08x], Cached : [%d]", seed, num_cached);
+	console->add_entry(msg, SUCCESS, RNDR);
+}
+
+float Terrain::height(float x, float z)
+{
+	return noise.fractal(octaves, x + seed_offset.x, z + seed_offset.y) * height_scale;
+}
+
+// keeps the on disk cache under MAX_CACHED_TERRAIN_CHUNKS files
+void Terrain::touch_cache(uint file_seed, int x, int z, bool added)
+{
+	for (uint i = 0; i < num_cached; i++)
+	{
+		if (cached[i].seed == file_seed && cached[i].x == x && cached[i].z == z) { cached[i].last_used = frame; return; }
+	}
+
+	if (!added) return; // read a file we didn't know about, it'll get picked up next time
+
+	if (num_cached == MAX_CACHED_TERRAIN_CHUNKS)
+	{
+		uint oldest = 0;
+		for (uint i = 1; i < num_cached; i++) if (cached[i].last_used < cached[oldest].last_used) oldest = i;
+
+		// fails if a worker has the file open, in which case it stays on disk until the next scan
+		char path[64];
+		terrain_cache_path(path, cached[oldest].seed, cached[oldest].x, cached[oldest].z);
+		DeleteFileA(path);
+
+		cached[oldest] = cached[--num_cached];
+	}
+
+	cached[num_cached++] = { file_seed, x, z, frame };
+}
+
+void Terrain::request(TerrainChunk* chunk, uint lod)
+{
+	chunk->load.state   = LOAD_QUEUED;
+	chunk->load.lod     = lod;
+	chunk->load.terrain = this;
+	loads_in_flight++;
+
+	add_job(background_queue, terrain_chunk_job, chunk);
+}
+
+void Terrain::update(vec3 camera_position)
+{
+	frame++;
+
+	// upload finished chunks, a few per frame so a fast camera can't cause a spike
+	uint uploads = 0;
+	for (uint i = 0; i < MAX_TERRAIN_CHUNKS && uploads < MAX_TERRAIN_UPLOADS_PER_FRAME; i++)
+	{
+		TerrainChunk* chunk = &chunks[i];
+		if (chunk->load.state != LOAD_DONE) continue;
+		_ReadBarrier();
+
+		glBindBuffer(GL_ARRAY_BUFFER, vert_buffer);
+		glBufferSubData(GL_ARRAY_BUFFER, i * TERRAIN_MAX_VERTICES * sizeof(TerrainVertex), chunk->load.num_vertices * sizeof(TerrainVertex), chunk->load.vertices);
+
+		// indices are relative to the slot, base_vertex takes care of the rest
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indx_buffer);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, i * TERRAIN_MAX_INDICES * sizeof(uint), chunk->load.num_indices * sizeof(uint), chunk->load.indices);
+
+		touch_cache(seed, chunk->coord.x, chunk->coord.y, chunk->load.wrote_cache);
+
+		free(chunk->load.vertices);
+		free(chunk->load.indices);
+		chunk->load.vertices = NULL;
+		chunk->load.indices  = NULL;
+
+		chunk->lod         = chunk->load.lod;
+		chunk->num_indices = chunk->load.num_indices;
+		chunk->resident    = true;
+		chunk->load.state = LOAD_IDLE;
+		loads_in_flight--;
+		uploads++;
+	}
+
+	ivec2 center = ivec2(glm::floor(vec2(camera_position.x, camera_position.z) / TERRAIN_CHUNK_SIZE));
+
+	// chunks near the camera, by offset from the center chunk (index + 1, 0 = none)
+	const int WINDOW = 2 * TERRAIN_VIEW_RADIUS + 1;
+	uint window[WINDOW * WINDOW] = {};
+
+	for (uint i = 0; i < MAX_TERRAIN_CHUNKS; i++)
+	{
+		TerrainChunk* chunk = &chunks[i];
+		if (!chunk->in_use) continue;
+
+		ivec2 offset = chunk->coord - center;
+		if (abs(offset.x) <= TERRAIN_VIEW_RADIUS && abs(offset.y) <= TERRAIN_VIEW_RADIUS)
+		{
+			window[(offset.y + TERRAIN_VIEW_RADIUS) * WINDOW + offset.x + TERRAIN_VIEW_RADIUS] = i + 1;
+			chunk->last_wanted_frame = frame;
+		}
+		else if (chunk->load.state == LOAD_IDLE && chunk->last_wanted_frame + 60 < frame) // a second of slack before unloading
+		{
+			*chunk = {};
+		}
+	}
+
+	// request missing chunks & LOD changes, nearest first
+	for (int ring = 0; ring <= TERRAIN_VIEW_RADIUS && loads_in_flight < MAX_TERRAIN_LOADS_IN_FLIGHT; ring++)
+	for (int dz = -ring; dz <= ring; dz++)
+	for (int dx = -ring; dx <= ring; dx++)
+	{
+		if (glm::max(abs(dx), abs(dz)) != ring) continue; // only the edge of this ring
+		if (loads_in_flight == MAX_TERRAIN_LOADS_IN_FLIGHT) break;
+
+		uint lod = terrain_lod(ivec2(dx, dz));
+		uint index = window[(dz + TERRAIN_VIEW_RADIUS) * WINDOW + dx + TERRAIN_VIEW_RADIUS];
+
+		if (index)
+		{
+			TerrainChunk* chunk = &chunks[index - 1];
+			if (chunk->load.state == LOAD_IDLE && chunk->resident && chunk->lod != lod) request(chunk, lod);
+			continue;
+		}
+
+		// find a free slot
+		TerrainChunk* chunk = NULL;
+		for (uint i = 0; i < MAX_TERRAIN_CHUNKS && !chunk; i++) if (!chunks[i].in_use) chunk = &chunks[i];
+		if (!chunk) break; // everything's in use, wait for chunks to fall out of range
+
+		chunk->in_use = true;
+		chunk->coord = center + ivec2(dx, dz);
+		chunk->last_wanted_frame = frame;
+		request(chunk, lod);
+	}
+
+	// one draw command per resident chunk
+	num_commands = 0;
+	for (uint i = 0; i < MAX_TERRAIN_CHUNKS; i++)
+	{
+		if (!chunks[i].in_use || !chunks[i].resident) continue;
+
+		uint n = num_commands++;
+		commands[n].num_indices   = chunks[i].num_indices;
+		commands[n].num_instances = 1;
+		commands[n].first_index   = i * TERRAIN_MAX_INDICES;
+		commands[n].base_vertex   = i * TERRAIN_MAX_VERTICES;
+		commands[n].base_instance = 0;
+	}
+}
+
+void Terrain::draw()
+{
+	if (!num_commands) return;
+
+	glBindVertexArray(VAO);
+
+	// constant instance attributes : identity transform, the terrain material
+	if (instance_format == INSTANCE_COMPACT)
+	{
+		glVertexAttrib4f(3, 0, 0, 0, 1); // position, scale
+		glVertexAttrib4f(4, 0, 0, 0, 1); // rotation
+	}
+	else for (uint i = 0; i < 4; i++) glVertexAttrib4f(3 + i, i == 0, i == 1, i == 2, i == 3);
+	glVertexAttribI4ui(7, material, 0, 0, 0);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmds_buffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, num_commands * sizeof(commands[0]), commands);
+
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)0, num_commands, 0);
+}
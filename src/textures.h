@@ -0,0 +1,730 @@
+#include "loader.h"
+
+/* Textures : block compressed mip chains streamed in under a memory budget
+*
+* OFFLINE : convert_texture
+* - loads any image stb_image can read, builds the full mip chain on the cpu
+* - block compresses every mip (BC1 = color, BC5 = normals, BC7 = color + alpha)
+* - writes a .tex file : header, mip table, then mip data *smallest mip first*
+*
+* RUNTIME : TextureStreamer
+* - load() only reserves a slot, all file io & transcoding happens on the background queue
+* - the small mips (the "tail") are read in one go and never evicted
+* - every frame, used textures are refined one mip at a time until they reach the wanted mip
+* - if a refinement would go over budget, least recently used textures lose their top mip first
+*/
+
+enum TEXTURE_FORMAT {
+	TEX_BC1 = 1, // rgb       | 8  bytes per 4x4 block
+	TEX_BC5,     // rg        | 16 bytes per 4x4 block
+	TEX_BC7      // rgba      | 16 bytes per 4x4 block
+};
+
+#define TEXTURE_MAGIC 0x30584554 // "TEX0"
+#define MAX_TEXTURE_MIPS 16
+
+struct Texture_Header
+{
+	uint magic;
+	uint format;
+	uint width, height;
+	uint num_mips;
+};
+
+struct Texture_Mip
+{
+	uint offset, size; // IN BYTES : from the start of the file
+	uint width, height;
+};
+
+uint texture_block_size(uint format) { return (format == TEX_BC1) ? 8 : 16; }
+uint texture_mip_size(uint format, uint width, uint height)
+{
+	return ((width + 3) / 4) * ((height + 3) / 4) * texture_block_size(format);
+}
+GLenum texture_gl_format(uint format)
+{
+	switch (format)
+	{
+	case TEX_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TEX_BC5: return GL_COMPRESSED_RG_RGTC2;
+	case TEX_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+
+	return 0;
+}
+
+// --- block compression --- //
+
+// every encoder takes 16 rgba pixels (4x4, row major) & writes one block
+namespace BlockCompression
+{
+	// best-fit line through the block colors : mean + principal axis
+	void fit_line(const byte* rgba, uint num_channels, vec4* mean, vec4* axis)
+	{
+		vec4 m = vec4(0);
+		for (uint i = 0; i < 16; i++)
+		for (uint c = 0; c < num_channels; c++) m[c] += rgba[i * 4 + c];
+		m /= 16.f;
+
+		mat4 covariance = mat4(0);
+		for (uint i = 0; i < 16; i++)
+		{
+			vec4 d = vec4(0);
+			for (uint c = 0; c < num_channels; c++) d[c] = rgba[i * 4 + c] - m[c];
+			covariance += glm::outerProduct(d, d);
+		}
+
+		// power iteration : start from the diagonal so flat blocks still get a sane axis
+		vec4 a = vec4(covariance[0][0], covariance[1][1], covariance[2][2], covariance[3][3]);
+		for (uint i = 0; i < 8; i++)
+		{
+			a = covariance * a;
+			float len = glm::length(a);
+			if (len < 1e-6f) break;
+			a /= len;
+		}
+
+		*mean = m;
+		*axis = a;
+	}
+
+	u16  pack_565(vec4 c)
+	{
+		uint r = glm::clamp((int)(c.r * (31.f / 255.f) + .5f), 0, 31);
+		uint g = glm::clamp((int)(c.g * (63.f / 255.f) + .5f), 0, 63);
+		uint b = glm::clamp((int)(c.b * (31.f / 255.f) + .5f), 0, 31);
+		return (r << 11) | (g << 5) | b;
+	}
+	vec4 unpack_565(u16 c)
+	{
+		uint r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+		return vec4((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2), 255);
+	}
+
+	float distance_squared(const byte* pixel, vec4 color, uint num_channels)
+	{
+		float d = 0;
+		for (uint c = 0; c < num_channels; c++) d += (pixel[c] - color[c]) * (pixel[c] - color[c]);
+		return d;
+	}
+
+	void encode_bc1(const byte* rgba, byte* block)
+	{
+		vec4 mean, axis;
+		fit_line(rgba, 3, &mean, &axis);
+
+		float lo = 0, hi = 0;
+		for (uint i = 0; i < 16; i++)
+		{
+			float t = glm::dot(vec3(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2]) - vec3(mean), vec3(axis));
+			lo = glm::min(lo, t);
+			hi = glm::max(hi, t);
+		}
+
+		u16 c0 = pack_565(mean + axis * hi);
+		u16 c1 = pack_565(mean + axis * lo);
+		if (c0 < c1) { u16 tmp = c0; c0 = c1; c1 = tmp; } // c0 > c1 means 4 color mode
+
+		uint indices = 0;
+		if (c0 != c1)
+		{
+			vec4 palette[4];
+			palette[0] = unpack_565(c0);
+			palette[1] = unpack_565(c1);
+			palette[2] = (palette[0] * 2.f + palette[1]) / 3.f;
+			palette[3] = (palette[0] + palette[1] * 2.f) / 3.f;
+
+			for (uint i = 0; i < 16; i++)
+			{
+				uint best = 0; float best_error = FLT_MAX;
+				for (uint p = 0; p < 4; p++)
+				{
+					float error = distance_squared(rgba + i * 4, palette[p], 3);
+					if (error < best_error) { best_error = error; best = p; }
+				}
+				indices |= best << (i * 2);
+			}
+		}
+
+		memcpy(block + 0, &c0, 2);
+		memcpy(block + 2, &c1, 2);
+		memcpy(block + 4, &indices, 4);
+	}
+
+	// single channel, read from rgba[channel] : 8 bytes
+	void encode_bc4(const byte* rgba, uint channel, byte* block)
+	{
+		byte lo = 255, hi = 0;
+		for (uint i = 0; i < 16; i++)
+		{
+			byte v = rgba[i * 4 + channel];
+			if (v < lo) lo = v;
+			if (v > hi) hi = v;
+		}
+
+		// hi > lo means 8 value mode
+		float palette[8] = { (float)hi, (float)lo };
+		for (uint p = 2; p < 8; p++) palette[p] = ((8 - p) * hi + (p - 1) * lo) / 7.f;
+
+		uint64 indices = 0;
+		if (hi != lo)
+		{
+			for (uint i = 0; i < 16; i++)
+			{
+				uint best = 0; float best_error = FLT_MAX;
+				for (uint p = 0; p < 8; p++)
+				{
+					float error = fabsf(rgba[i * 4 + channel] - palette[p]);
+					if (error < best_error) { best_error = error; best = p; }
+				}
+				indices |= (uint64)best << (i * 3);
+			}
+		}
+
+		block[0] = hi;
+		block[1] = lo;
+		memcpy(block + 2, &indices, 6); // 48 bits, little endian
+	}
+
+	void encode_bc5(const byte* rgba, byte* block)
+	{
+		encode_bc4(rgba, 0, block + 0);
+		encode_bc4(rgba, 1, block + 8);
+	}
+
+	// BC7 mode 6 only : one subset, 7.7.7.7 endpoints + p-bit, 4 bit indices.
+	// not the best quality BC7 can do, but it is simple & handles alpha
+	void encode_bc7(const byte* rgba, byte* block)
+	{
+		const uint weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		vec4 mean, axis;
+		fit_line(rgba, 4, &mean, &axis);
+
+		float lo = 0, hi = 0;
+		for (uint i = 0; i < 16; i++)
+		{
+			float t = glm::dot(vec4(rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2], rgba[i * 4 + 3]) - mean, axis);
+			lo = glm::min(lo, t);
+			hi = glm::max(hi, t);
+		}
+
+		vec4 ends[2] = { mean + axis * lo, mean + axis * hi };
+
+		// quantize endpoints to 7 bits + a shared lsb (the p-bit), keep whichever p-bit fits better
+		uint q[2][4], p[2];
+		vec4 e[2];
+		for (uint n = 0; n < 2; n++)
+		{
+			float best_error = FLT_MAX;
+			for (uint pbit = 0; pbit < 2; pbit++)
+			{
+				uint candidate[4]; float error = 0;
+				for (uint c = 0; c < 4; c++)
+				{
+					candidate[c] = glm::clamp((int)((ends[n][c] - pbit) / 2.f + .5f), 0, 127);
+					float d = (float)(candidate[c] * 2 + pbit) - ends[n][c];
+					error += d * d;
+				}
+
+				if (error < best_error)
+				{
+					best_error = error;
+					p[n] = pbit;
+					for (uint c = 0; c < 4; c++) q[n][c] = candidate[c];
+				}
+			}
+
+			for (uint c = 0; c < 4; c++) e[n][c] = (float)((q[n][c] << 1) | p[n]);
+		}
+
+		vec4 palette[16];
+		for (uint w = 0; w < 16; w++)
+		for (uint c = 0; c < 4; c++)
+			palette[w][c] = (float)((((64 - weights[w]) * (uint)e[0][c]) + (weights[w] * (uint)e[1][c]) + 32) >> 6);
+
+		uint indices[16];
+		for (uint i = 0; i < 16; i++)
+		{
+			uint best = 0; float best_error = FLT_MAX;
+			for (uint w = 0; w < 16; w++)
+			{
+				float error = distance_squared(rgba + i * 4, palette[w], 4);
+				if (error < best_error) { best_error = error; best = w; }
+			}
+			indices[i] = best;
+		}
+
+		// the first index has an implicit 0 msb : flip the endpoints if it would need a 1
+		if (indices[0] & 8)
+		{
+			for (uint c = 0; c < 4; c++) { uint tmp = q[0][c]; q[0][c] = q[1][c]; q[1][c] = tmp; }
+			uint tmp = p[0]; p[0] = p[1]; p[1] = tmp;
+			for (uint i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+		}
+
+		// pack 128 bits, lsb first
+		uint64 bits[2] = {};
+		uint position = 0;
+		const auto put = [&](uint64 value, uint num_bits) {
+			for (uint b = 0; b < num_bits; b++, position++)
+				bits[position / 64] |= ((value >> b) & 1) << (position % 64);
+		};
+
+		put(1 << 6, 7); // mode 6
+		for (uint c = 0; c < 4; c++) { put(q[0][c], 7); put(q[1][c], 7); }
+		put(p[0], 1);
+		put(p[1], 1);
+		put(indices[0], 3);
+		for (uint i = 1; i < 16; i++) put(indices[i], 4);
+
+		memcpy(block, bits, 16);
+	}
+}
+
+// compresses an rgba8 image into blocks, edge blocks repeat the last row/column
+void compress_image(const byte* rgba, uint width, uint height, uint format, byte* output)
+{
+	uint block_size = texture_block_size(format);
+
+	for (uint by = 0; by < height; by += 4) {
+	for (uint bx = 0; bx < width;  bx += 4)
+	{
+		byte pixels[16 * 4];
+		for (uint y = 0; y < 4; y++) {
+		for (uint x = 0; x < 4; x++)
+		{
+			uint sx = glm::min(bx + x, width  - 1);
+			uint sy = glm::min(by + y, height - 1);
+			memcpy(pixels + (y * 4 + x) * 4, rgba + (sy * width + sx) * 4, 4);
+		}}
+
+		switch (format)
+		{
+		case TEX_BC1: BlockCompression::encode_bc1(pixels, output); break;
+		case TEX_BC5: BlockCompression::encode_bc5(pixels, output); break;
+		case TEX_BC7: BlockCompression::encode_bc7(pixels, output); break;
+		}
+
+		output += block_size;
+	}}
+}
+
+// 2x2 box filter, odd sizes clamp to the last row/column
+void downsample_image(const byte* src, uint width, uint height, byte* dst)
+{
+	uint dst_width  = glm::max(width  / 2, 1u);
+	uint dst_height = glm::max(height / 2, 1u);
+
+	for (uint y = 0; y < dst_height; y++) {
+	for (uint x = 0; x < dst_width;  x++)
+	{
+		uint x0 = glm::min(x * 2, width  - 1), x1 = glm::min(x * 2 + 1, width  - 1);
+		uint y0 = glm::min(y * 2, height - 1), y1 = glm::min(y * 2 + 1, height - 1);
+
+		for (uint c = 0; c < 4; c++)
+		{
+			uint sum = src[(y0 * width + x0) * 4 + c] + src[(y0 * width + x1) * 4 + c]
+			         + src[(y1 * width + x0) * 4 + c] + src[(y1 * width + x1) * 4 + c];
+			dst[(y * dst_width + x) * 4 + c] = (sum + 2) / 4;
+		}
+	}}
+}
+
+// offline converter : any image -> .tex, returns false on failure
+bool convert_texture(const char* src_path, const char* dst_path, uint format = TEX_BC7)
+{
+	int width, height, num_channels;
+	byte* image = stbi_load(src_path, &width, &height, &num_channels, 4);
+	if (!image) { print("could not open image file: %s\n", src_path); return false; }
+
+	Texture_Header header = { TEXTURE_MAGIC, format, (uint)width, (uint)height, 1 };
+	for (uint size = glm::max(width, height); size > 1; size /= 2) header.num_mips++;
+	header.num_mips = glm::min(header.num_mips, (uint)MAX_TEXTURE_MIPS);
+
+	Texture_Mip mips[MAX_TEXTURE_MIPS] = {};
+	byte* compressed[MAX_TEXTURE_MIPS] = {};
+
+	byte* level = image;
+	uint w = width, h = height;
+	for (uint m = 0; m < header.num_mips; m++)
+	{
+		mips[m].width  = w;
+		mips[m].height = h;
+		mips[m].size   = texture_mip_size(format, w, h);
+
+		compressed[m] = Alloc(byte, mips[m].size);
+		compress_image(level, w, h, format, compressed[m]);
+
+		if (m + 1 < header.num_mips)
+		{
+			byte* next = Alloc(byte, glm::max(w / 2, 1u) * glm::max(h / 2, 1u) * 4);
+			downsample_image(level, w, h, next);
+			if (level != image) free(level);
+			level = next;
+
+			w = glm::max(w / 2, 1u);
+			h = glm::max(h / 2, 1u);
+		}
+	}
+	if (level != image) free(level);
+	stbi_image_free(image);
+
+	// smallest mip first, so streaming reads always move forward in the file
+	uint offset = sizeof(Texture_Header) + sizeof(Texture_Mip) * header.num_mips;
+	for (int m = header.num_mips - 1; m >= 0; m--)
+	{
+		mips[m].offset = offset;
+		offset += mips[m].size;
+	}
+
+	FILE* file = fopen(dst_path, "wb");
+	if (!file) { print("could not write texture file: %s\n", dst_path); return false; }
+
+	fwrite(&header, sizeof(Texture_Header), 1, file);
+	fwrite(mips, sizeof(Texture_Mip), header.num_mips, file);
+	for (int m = header.num_mips - 1; m >= 0; m--) fwrite(compressed[m], 1, mips[m].size, file);
+
+	fclose(file);
+
+	for (uint m = 0; m < header.num_mips; m++) free(compressed[m]);
+	return true;
+}
+
+// --- streaming --- //
+
+const uint MAX_TEXTURES = 256;
+const uint MAX_TEXTURE_FILEPATH_LENGTH = 64;
+const uint MAX_TEXTURE_LOADS_IN_FLIGHT = 8;
+const uint TEXTURE_TAIL_SIZE = 64; // mips this size & smaller are loaded first & never evicted
+
+enum TEXTURE_LOAD_STATE {
+	LOAD_IDLE = 0,
+	LOAD_WAITING, // load() wants the header, update() queues it once there's room
+	LOAD_QUEUED,
+	LOAD_DONE,
+	LOAD_FAILED
+};
+
+struct StreamedTexture
+{
+	char source[MAX_TEXTURE_FILEPATH_LENGTH];   // what the user asked for
+	char filepath[MAX_TEXTURE_FILEPATH_LENGTH]; // the .tex file we stream from
+
+	GLuint gl_id;
+	uint generation; // bumps every time gl_id changes
+
+	Texture_Header header;
+	Texture_Mip mips[MAX_TEXTURE_MIPS];
+
+	uint resident_mip; // finest mip on the gpu (header.num_mips = nothing resident)
+	uint tail_mip;     // first mip of the tail
+	uint wanted_mip;   // finest mip we are allowed to stream in
+	uint resident_bytes;
+	uint last_used_frame;
+
+	// written by the worker, read by the main thread once state == LOAD_DONE
+	struct {
+		volatile uint state;
+		uint first_mip, last_mip; // inclusive, first_mip is the finest
+		uint format;              // only used when transcoding
+		byte* data;
+		Texture_Header header;
+		Texture_Mip mips[MAX_TEXTURE_MIPS];
+	} load;
+};
+
+// runs on the background queue : reads a range of mips, transcodes first if needed
+void texture_load_job(void* param)
+{
+	StreamedTexture* texture = (StreamedTexture*)param;
+
+	FILE* file = fopen(texture->filepath, "rb");
+	if (!file)
+	{
+		if (!convert_texture(texture->source, texture->filepath, texture->load.format)) { texture->load.state = LOAD_FAILED; return; }
+		file = fopen(texture->filepath, "rb");
+		if (!file) { texture->load.state = LOAD_FAILED; return; }
+	}
+
+	// first load : read the header & figure out where the tail starts
+	if (texture->load.first_mip == MAX_TEXTURE_MIPS)
+	{
+		Texture_Header* header = &texture->load.header;
+		fread(header, sizeof(Texture_Header), 1, file);
+
+		if (header->magic != TEXTURE_MAGIC || header->num_mips == 0 || header->num_mips > MAX_TEXTURE_MIPS)
+		{
+			print("invalid texture file: %s\n", texture->filepath);
+			fclose(file); texture->load.state = LOAD_FAILED; return;
+		}
+
+		fread(texture->load.mips, sizeof(Texture_Mip), header->num_mips, file);
+
+		uint tail_mip = header->num_mips - 1;
+		while (tail_mip > 0 && texture->load.mips[tail_mip - 1].width  <= TEXTURE_TAIL_SIZE
+		                    && texture->load.mips[tail_mip - 1].height <= TEXTURE_TAIL_SIZE) tail_mip--;
+
+		texture->load.first_mip = tail_mip;
+		texture->load.last_mip  = header->num_mips - 1;
+	}
+
+	// mips are stored smallest first, so any range of mips is one contiguous read
+	Texture_Mip* mips = texture->load.mips;
+	uint begin = mips[texture->load.last_mip].offset;
+	uint end   = mips[texture->load.first_mip].offset + mips[texture->load.first_mip].size;
+
+	texture->load.data = Alloc(byte, end - begin);
+	fseek(file, begin, SEEK_SET);
+	uint bytes_read = fread(texture->load.data, 1, end - begin, file);
+	fclose(file);
+
+	if (bytes_read != end - begin) { free(texture->load.data); texture->load.data = NULL; texture->load.state = LOAD_FAILED; return; }
+
+	_WriteBarrier(); // everything above has to land before the main thread sees LOAD_DONE
+	texture->load.state = LOAD_DONE;
+}
+
+struct TextureStreamer
+{
+	StreamedTexture textures[MAX_TEXTURES];
+	uint num_textures;
+
+	GLuint placeholder; // 1x1 white, bound until the tail arrives
+
+	uint budget; // IN BYTES : gpu memory all textures are allowed to use
+	uint resident_bytes;
+	uint pending_bytes; // requested but not uploaded yet
+	uint loads_in_flight;
+	uint frame;
+
+	void init(uint budget_bytes = MegaByte(256));
+	uint load(const char* path, uint format = TEX_BC7); // returns texture_id
+	void touch(uint texture_id, uint wanted_mip = 0);   // call for every texture used this frame
+	GLuint gl_id(uint texture_id);
+	void update(); // once per frame, on the main thread
+
+	// internal
+	void reallocate(StreamedTexture* texture, uint new_resident_mip);
+	bool evict_one(uint protected_frame);
+};
+
+void TextureStreamer::init(uint budget_bytes)
+{
+	budget = budget_bytes;
+
+	byte white[4] = { 255, 255, 255, 255 };
+	glGenTextures(1, &placeholder);
+	glBindTexture(GL_TEXTURE_2D, placeholder);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	char msg[62] = {};
+	snprintf(msg, 62, "Init TextureStreamer | Budget : [%d] bytes", budget);
+	console->add_entry(msg, SUCCESS, RNDR);
+}
+uint TextureStreamer::load(const char* path, uint format)
+{
+	// check if previously loaded
+	for (uint i = 0; i < num_textures; i++)
+		if (strcmp(textures[i].source, path) == 0) return i + 1;
+
+	if (num_textures == MAX_TEXTURES) { out("ERROR : Cannot load texture : [" << path << "]!"); return 0; }
+
+	uint path_length = strlen(path);
+	if (path_length + 4 >= MAX_TEXTURE_FILEPATH_LENGTH) // + 4 for the .tex extension
+	{
+		out("ERROR : max filepath exceeded!\n FILENAME : " << path);
+		stop; return 0;
+	}
+
+	StreamedTexture* texture = &textures[num_textures++];
+	*texture = {};
+	strcpy(texture->source, path);
+
+	// anything that isn't a .tex gets transcoded once to a .tex next to it
+	strcpy(texture->filepath, path);
+	char* extension = strrchr(texture->filepath, '.');
+	if (extension) *extension = 0;
+	strcat(texture->filepath, ".tex");
+
+	texture->header.num_mips = MAX_TEXTURE_MIPS;
+	texture->resident_mip    = MAX_TEXTURE_MIPS; // nothing resident yet
+	texture->last_used_frame = frame;
+
+	texture->load.first_mip = MAX_TEXTURE_MIPS; // means "read the header"
+	texture->load.format    = format;
+	texture->load.state     = LOAD_WAITING; // the job ring is shared, a big scene can't all go in at once
+
+	return num_textures; // avoid NULL value
+}
+void TextureStreamer::touch(uint texture_id, uint wanted_mip)
+{
+	if (texture_id == 0 || texture_id > num_textures) return;
+
+	StreamedTexture* texture = &textures[texture_id - 1];
+	texture->last_used_frame = frame;
+	texture->wanted_mip = wanted_mip;
+}
+GLuint TextureStreamer::gl_id(uint texture_id)
+{
+	if (texture_id == 0 || texture_id > num_textures) return placeholder;
+
+	GLuint id = textures[texture_id - 1].gl_id;
+	return id ? id : placeholder;
+}
+
+// moves the texture into new storage that starts at new_resident_mip, copying whatever overlaps
+void TextureStreamer::reallocate(StreamedTexture* texture, uint new_resident_mip)
+{
+	uint num_mips = texture->header.num_mips;
+	GLenum format = texture_gl_format(texture->header.format);
+
+	GLuint new_id = 0;
+	glGenTextures(1, &new_id);
+	glBindTexture(GL_TEXTURE_2D, new_id);
+	glTexStorage2D(GL_TEXTURE_2D, num_mips - new_resident_mip, format,
+		texture->mips[new_resident_mip].width, texture->mips[new_resident_mip].height);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	if (texture->gl_id)
+	{
+		uint first_shared = glm::max(new_resident_mip, texture->resident_mip);
+		for (uint m = first_shared; m < num_mips; m++)
+		{
+			glCopyImageSubData(
+				texture->gl_id, GL_TEXTURE_2D, m - texture->resident_mip, 0, 0, 0,
+				new_id        , GL_TEXTURE_2D, m - new_resident_mip     , 0, 0, 0,
+				texture->mips[m].width, texture->mips[m].height, 1);
+		}
+
+		glDeleteTextures(1, &texture->gl_id);
+	}
+
+	uint new_bytes = 0;
+	for (uint m = new_resident_mip; m < num_mips; m++) new_bytes += texture->mips[m].size;
+
+	resident_bytes = resident_bytes - texture->resident_bytes + new_bytes;
+	texture->resident_bytes = new_bytes;
+
+	texture->resident_mip = new_resident_mip;
+	texture->gl_id = new_id;
+	texture->generation++;
+}
+
+// drops the top mip of the least recently used texture, returns false if nothing can go
+bool TextureStreamer::evict_one(uint protected_frame)
+{
+	StreamedTexture* victim = NULL;
+
+	for (uint i = 0; i < num_textures; i++)
+	{
+		StreamedTexture* texture = &textures[i];
+		if (texture->resident_mip >= texture->tail_mip) continue; // only the tail is left
+		if (texture->last_used_frame >= protected_frame) continue;
+		if (texture->load.state != LOAD_IDLE) continue;
+
+		if (!victim || texture->last_used_frame < victim->last_used_frame) victim = texture;
+	}
+
+	if (!victim) return false;
+
+	reallocate(victim, victim->resident_mip + 1);
+	return true;
+}
+
+void TextureStreamer::update()
+{
+	frame++;
+
+	// upload finished loads
+	for (uint i = 0; i < num_textures; i++)
+	{
+		StreamedTexture* texture = &textures[i];
+
+		if (texture->load.state == LOAD_FAILED)
+		{
+			char msg[62] = {};
+			snprintf(msg, 62, "Texture load failed : [%s]", texture->source);
+			console->add_entry(msg, FIXME, RNDR);
+
+			if (texture->gl_id) pending_bytes -= texture->mips[texture->load.first_mip].size;
+
+			texture->load.state = LOAD_IDLE;
+			texture->tail_mip = texture->resident_mip; // never try again
+			loads_in_flight--;
+			continue;
+		}
+
+		if (texture->load.state != LOAD_DONE) continue;
+		_ReadBarrier();
+
+		if (!texture->gl_id) // the tail : this is the first time we've seen the header
+		{
+			texture->header = texture->load.header;
+			memcpy(texture->mips, texture->load.mips, sizeof(texture->mips));
+			texture->tail_mip = texture->load.first_mip;
+		}
+		else pending_bytes -= texture->mips[texture->load.first_mip].size;
+
+		reallocate(texture, texture->load.first_mip);
+
+		byte* data = texture->load.data;
+		for (int m = texture->load.last_mip; m >= (int)texture->load.first_mip; m--)
+		{
+			Texture_Mip mip = texture->mips[m];
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, m - texture->resident_mip, 0, 0, mip.width, mip.height,
+				texture_gl_format(texture->header.format), mip.size, data);
+			data += mip.size;
+		}
+
+		free(texture->load.data);
+		texture->load.data  = NULL;
+		texture->load.state = LOAD_IDLE;
+		loads_in_flight--;
+	}
+
+	// headers & tails first, nothing else can be drawn before them
+	for (uint i = 0; i < num_textures && loads_in_flight < MAX_TEXTURE_LOADS_IN_FLIGHT; i++)
+	{
+		StreamedTexture* texture = &textures[i];
+		if (texture->load.state != LOAD_WAITING) continue;
+
+		texture->load.state = LOAD_QUEUED;
+		loads_in_flight++;
+
+		add_job(background_queue, texture_load_job, texture);
+	}
+
+	// refine textures that were used recently, one mip at a time
+	for (uint i = 0; i < num_textures && loads_in_flight < MAX_TEXTURE_LOADS_IN_FLIGHT; i++)
+	{
+		StreamedTexture* texture = &textures[i];
+		if (texture->load.state != LOAD_IDLE || !texture->gl_id) continue;
+		if (texture->last_used_frame + 1 < frame) continue;
+		if (texture->resident_mip <= texture->wanted_mip || texture->resident_mip > texture->tail_mip) continue;
+
+		uint next_mip = texture->resident_mip - 1;
+
+		// make room : anything not used this frame or last can lose its top mip
+		bool fits = true;
+		while (resident_bytes + pending_bytes + texture->mips[next_mip].size > budget)
+			if (!evict_one(frame - 1)) { fits = false; break; }
+
+		if (!fits) continue; // everything else is in use, maybe a smaller mip still fits
+
+		texture->load.first_mip = next_mip;
+		texture->load.last_mip  = next_mip;
+		texture->load.state     = LOAD_QUEUED;
+		pending_bytes += texture->mips[next_mip].size;
+		loads_in_flight++;
+
+		add_job(background_queue, texture_load_job, texture);
+	}
+}
@@ -1,22 +1,33 @@
-#include "logger.h"
+#include "audio.h"
 
 // needed for gbuffer setup
 struct ShaderProgram
 {
 	GLuint id;
 
-	void create(const char* vert_path, const char* frag_path)
+	// defines (ex. "#define BINDLESS\n") get pasted right after the #version line of both shaders
+	void create(const char* vert_path, const char* frag_path, const char* defines = "")
 	{
 		char* vert_source = (char*)read_text_file_into_memory(vert_path);
 		char* frag_source = (char*)read_text_file_into_memory(frag_path);
 
-		GLuint vert_shader = glCreateShader(GL_VERTEX_SHADER);
-		glShaderSource(vert_shader, 1, &vert_source, NULL);
-		glCompileShader(vert_shader);
+		// #version has to stay first, so split each source after that line
+		const auto compile = [defines](GLenum type, char* source) {
+			char* body = strchr(source, '\n');
+			body = body ? body + 1 : source + strlen(source);
 
-		GLuint frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
-		glShaderSource(frag_shader, 1, &frag_source, NULL);
-		glCompileShader(frag_shader);
+			char version[64] = {};
+			memcpy(version, source, glm::min((uint)(body - source), 63u));
+
+			const char* sources[3] = { version, defines, body };
+			GLuint shader = glCreateShader(type);
+			glShaderSource(shader, 3, sources, NULL);
+			glCompileShader(shader);
+			return shader;
+		};
+
+		GLuint vert_shader = compile(GL_VERTEX_SHADER, vert_source);
+		GLuint frag_shader = compile(GL_FRAGMENT_SHADER, frag_source);
 
 		free(vert_source);
 		free(frag_source);
@@ -66,166 +77,6 @@ struct ShaderProgram
 	void set_mat4(const char* name, mat4  value) { glUniformMatrix4fv(glGetUniformLocation(id, name), 1, GL_FALSE, (float*)&value); }
 };
 
-struct Button
-{
-	char is_pressed;
-	char was_pressed;
-	u16  id;
-};
-
-struct Mouse
-{
-	double raw_x, raw_y;   // pixel coordinates
-	double norm_x, norm_y; // normalized screen coordinates
-	double dx, dy;  // pos change since last frame in pixels
-	double norm_dx, norm_dy;
-
-	Button right_button, left_button;
-};
-
-void update_mouse(Mouse* mouse, GLFWwindow* instance, uint screen_x, uint screen_y)
-{
-	static Mouse prev_mouse = {};
-
-	glfwGetCursorPos(instance, &mouse->raw_x, &mouse->raw_y);
-
-	mouse->dx = mouse->raw_x - prev_mouse.raw_x; // what do these mean again?
-	mouse->dy = prev_mouse.raw_y - mouse->raw_y;
-
-	mouse->norm_dx = mouse->dx / screen_x;
-	mouse->norm_dy = mouse->dy / screen_y;
-
-	prev_mouse.raw_x = mouse->raw_x;
-	prev_mouse.raw_y = mouse->raw_y;
-
-	mouse->norm_x = ((uint)mouse->raw_x % screen_x) / (double)screen_x;
-	mouse->norm_y = ((uint)mouse->raw_y % screen_y) / (double)screen_y;
-
-	mouse->norm_y = 1 - mouse->norm_y;
-	mouse->norm_x = (mouse->norm_x * 2) - 1;
-	mouse->norm_y = (mouse->norm_y * 2) - 1;
-
-	bool key_down = (glfwGetMouseButton(instance, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS);
-
-	if (key_down)
-	{
-		mouse->right_button.was_pressed = (mouse->right_button.is_pressed == true);
-		mouse->right_button.is_pressed = true;
-	}
-	else
-	{
-		mouse->right_button.was_pressed = (mouse->right_button.is_pressed == true);
-		mouse->right_button.is_pressed = false;
-	}
-
-	key_down = (glfwGetMouseButton(instance, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS);
-
-	if (key_down)
-	{
-		mouse->left_button.was_pressed = (mouse->left_button.is_pressed == true);
-		mouse->left_button.is_pressed = true;
-	}
-	else
-	{
-		mouse->left_button.was_pressed = (mouse->left_button.is_pressed == true);
-		mouse->left_button.is_pressed = false;
-	}
-}
-
-// for selecting game objecs
-vec3 get_mouse_world_dir(Mouse mouse, mat4 proj_view)
-{
-	proj_view = glm::inverse(proj_view); // what is an unproject matrix?
-
-	vec4 ray_near = vec4(mouse.norm_x, mouse.norm_y, -1, 1); // near plane is z = -1
-	vec4 ray_far  = vec4(mouse.norm_x, mouse.norm_y,  0, 1);
-
-	// these are actually using inverse(proj_view)
-	ray_near = proj_view * ray_near; ray_near /= ray_near.w;
-	ray_far  = proj_view * ray_far;  ray_far /= ray_far.w;
-
-	return glm::normalize(ray_far - ray_near);
-}
-
-#define NUM_KEYBOARD_BUTTONS 34 // update when adding keyboard buttons
-struct Keyboard
-{
-	union
-	{
-		Button buttons[NUM_KEYBOARD_BUTTONS];
-
-		struct
-		{
-			Button A, B, C, D, E, F, G, H;
-			Button I, J, K, L, M, N, O, P;
-			Button Q, R, S, T, U, V, W, X;
-			Button Y, Z;
-			
-			Button ESC, SPACE;
-			Button SHIFT, CTRL;
-			Button UP, DOWN, LEFT, RIGHT;
-		};
-	};
-};
-
-void init_keyboard(Keyboard* keyboard)
-{
-	keyboard->A = { false, false, GLFW_KEY_A };
-	keyboard->B = { false, false, GLFW_KEY_B };
-	keyboard->C = { false, false, GLFW_KEY_C };
-	keyboard->D = { false, false, GLFW_KEY_D };
-	keyboard->E = { false, false, GLFW_KEY_E };
-	keyboard->F = { false, false, GLFW_KEY_F };
-	keyboard->G = { false, false, GLFW_KEY_G };
-	keyboard->H = { false, false, GLFW_KEY_H };
-	keyboard->I = { false, false, GLFW_KEY_I };
-	keyboard->J = { false, false, GLFW_KEY_J };
-	keyboard->K = { false, false, GLFW_KEY_K };
-	keyboard->L = { false, false, GLFW_KEY_L };
-	keyboard->M = { false, false, GLFW_KEY_M };
-	keyboard->N = { false, false, GLFW_KEY_N };
-	keyboard->O = { false, false, GLFW_KEY_O };
-	keyboard->P = { false, false, GLFW_KEY_P };
-	keyboard->Q = { false, false, GLFW_KEY_Q };
-	keyboard->R = { false, false, GLFW_KEY_R };
-	keyboard->S = { false, false, GLFW_KEY_S };
-	keyboard->T = { false, false, GLFW_KEY_T };
-	keyboard->U = { false, false, GLFW_KEY_U };
-	keyboard->V = { false, false, GLFW_KEY_V };
-	keyboard->W = { false, false, GLFW_KEY_W };
-	keyboard->X = { false, false, GLFW_KEY_X };
-	keyboard->Y = { false, false, GLFW_KEY_Y };
-	keyboard->Z = { false, false, GLFW_KEY_Z };
-
-	keyboard->ESC   = { false, false, GLFW_KEY_ESCAPE       };
-	keyboard->SPACE = { false, false, GLFW_KEY_SPACE        };
-	keyboard->SHIFT = { false, false, GLFW_KEY_LEFT_SHIFT   };
-	keyboard->CTRL  = { false, false, GLFW_KEY_LEFT_CONTROL };
-
-	keyboard->UP    = { false, false, GLFW_KEY_UP    };
-	keyboard->DOWN  = { false, false, GLFW_KEY_DOWN  };
-	keyboard->LEFT  = { false, false, GLFW_KEY_LEFT  };
-	keyboard->RIGHT = { false, false, GLFW_KEY_RIGHT };
-}
-void update_keyboard(Keyboard* keyboard, GLFWwindow* instance)
-{
-	for (uint i = 0; i < NUM_KEYBOARD_BUTTONS; ++i)
-	{
-		bool key_down = (glfwGetKey(instance, keyboard->buttons[i].id) == GLFW_PRESS);
-
-		if (key_down)
-		{
-			keyboard->buttons[i].was_pressed = (keyboard->buttons[i].is_pressed == true);
-			keyboard->buttons[i].is_pressed = true;
-		}
-		else
-		{
-			keyboard->buttons[i].was_pressed = (keyboard->buttons[i].is_pressed == true);
-			keyboard->buttons[i].is_pressed = false;
-		}
-	}
-}
-
 // new
 
 enum WindowFocus
@@ -240,6 +91,17 @@ struct GameWindow
 
 	Mouse mouse;
 	Keyboard keys;
+	InputSystem input; // what mouse & keys are made from
+
+	AudioSystem audio; // on its own thread
+
+	// input recording & replay
+	InputRecording* recording; // saved on shutdown
+	InputRecording* replay;    // played back instead of live input, the window closes when it's done
+	char recording_path[MAX_PATH_LENGTH], replay_path[MAX_PATH_LENGTH];
+	bool uncapped; // no frame cap or v-sync during a replay
+	int64* frame_times; // every replayed frame, in microseconds
+	uint num_frame_times, max_frame_times;
 
 	GLFWwindow* instance;
 	uint screen_width, screen_height;
@@ -257,16 +119,20 @@ struct GameWindow
 		ShaderProgram shader;
 	} gbuf; // G-Buffer
 
-	void init(uint, uint);
+	void init(uint, uint, uint audio_mode = AUDIO_OPENAL);
 	uint begin_frame();
 	void end_frame();
 
 	void draw_gbuf(vec3 view_position);
 
+	void record(const char* path);
+	bool play(const char* path, bool uncapped = false);
+	void finish_replay(); // prints & saves the frame time report
+
 	void shutdown();
 };
 
-void GameWindow::init(uint screen_width, uint screen_height)
+void GameWindow::init(uint screen_width, uint screen_height, uint audio_mode)
 {
 	timer.init();
 	init_keyboard(&keys);
@@ -311,17 +177,12 @@ void GameWindow::init(uint screen_width, uint screen_height)
 	// Capture cursor
 	glfwSetInputMode(this->instance, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	// Audio Code | Todo : This should be moved to it's own place
+	input.init(instance, &keys); // has to come before ImGui hooks the callbacks
 
-	ALCdevice* audio_device = alcOpenDevice(NULL);
-	if (audio_device == NULL)
-		console->add_entry((char*)"cannot open sound card", SEVERITY::FIXME);
-
-	ALCcontext* audio_context = alcCreateContext(audio_device, NULL);
-	if (audio_context == NULL) { out("cannot open context"); }
-	alcMakeContextCurrent(audio_context);
-
-	console->add_entry((char*)"Init OpenAL", SEVERITY::SUCCESS, LOGSOURCE::WNDW);
+	if (audio.init(audio_mode))
+		console->add_entry((char*)(audio_mode == AUDIO_OPENAL ? "Init OpenAL" : "Init audio mixer"), SEVERITY::SUCCESS, LOGSOURCE::AUDI);
+	else
+		console->add_entry((char*)"cannot open sound card", SEVERITY::FIXME, LOGSOURCE::AUDI);
 
 	console->add_entry((char*)"Init Window", SEVERITY::SUCCESS);
 
@@ -450,26 +311,38 @@ void GameWindow::init(uint screen_width, uint screen_height)
 // Updates ImGui stuff
 uint GameWindow::begin_frame()
 {
-	update_keyboard(&keys, instance);
-	update_mouse(&mouse, instance, screen_width, screen_height);
-	
 	//console->add_entry((char*)"Beginning new frame...");
 	//console->add_entry((char*)"Poll glfw events & swap buffers...");
 
-	glfwPollEvents();
+	glfwPollEvents(); // first, so this frame sees this frame's input
+
+	if (replay)
+	{
+		InputState previous = replay->last, next;
+		if (!replay->next_frame(&next)) { finish_replay(); return 1; }
+
+		// per frame state only, so the whole frame's events land at once & step() can't spread them out like it did live
+		InputEvent events[INPUT_MAX_REPLAY_EVENTS];
+		input.inject(events, input_events_between(previous, next, input.now(), events));
+	}
+
+	input.begin_frame();
+	if (recording) recording->add_frame(input.frame);
+	input.update(&keys, &mouse, screen_width, screen_height);
+
 	glfwSwapBuffers(instance);
 
 	//console->add_entry((char*)"Handle key input...");
 
-	if (keys.ESC.is_pressed)
+	if (keys.ESC.went_down)
 	{
 		this->shutdown();
 		return 1;
 	}
 
-	if (keys.T.is_pressed)
+	if (keys.T.went_down)
 		glfwSetInputMode(instance, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-	if (keys.Y.is_pressed)
+	if (keys.Y.went_down)
 		glfwSetInputMode(instance, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
 	//console->add_entry((char*)"Update ImGui");
@@ -495,8 +368,10 @@ void GameWindow::end_frame()
 	//out(msg);
 	//console->add_entry(msg);
 
+	if (replay && num_frame_times < max_frame_times) frame_times[num_frame_times++] = microseconds_elapsed;
+
 	// if frame finished early, wait
-	if (milliseconds_elapsed < frame_milliseconds_target)
+	if (milliseconds_elapsed < frame_milliseconds_target && !(replay && uncapped))
 	{
 		out("Frame done; spare ms: [" << frame_milliseconds_target - milliseconds_elapsed << ']');
 		os_sleep(frame_milliseconds_target - milliseconds_elapsed);
@@ -523,51 +398,71 @@ void GameWindow::draw_gbuf(vec3 view_position)
 	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0, 1);
 }
 
-// Terminates GLFW
-// Sets instance to NULL (important)
-void GameWindow::shutdown()
+void GameWindow::record(const char* path)
 {
-	glfwTerminate();
-	this->instance = NULL;
+	recording = Alloc(InputRecording, 1);
+	recording->init(screen_width, screen_height);
+	snprintf(recording_path, MAX_PATH_LENGTH, "%s", path);
 }
 
-// audio
-
-/* -- how 2 play a sound --
-
-	Audio sound = load_audio("sound.audio");
-	play_sudio(sound);
-*/
-
-Audio load_audio(const char* path)
+bool GameWindow::play(const char* path, bool uncapped_replay)
 {
-	uint format, size, sample_rate;
-	byte* audio_data = NULL;
+	replay = Alloc(InputRecording, 1);
+	if (!replay->load(path)) { free(replay); replay = NULL; return false; }
 
-	FILE* file = fopen(path, "rb"); // rb = read binary
-	if (file == NULL) { print("ERROR : %s not found\n"); stop;  return 0; }
+	if (replay->screen_width != screen_width || replay->screen_height != screen_height)
+		print("replaying a %ux%u recording at %ux%u, the mouse won't line up\n", replay->screen_width, replay->screen_height, screen_width, screen_height);
 
-	fread(&format     , sizeof(uint), 1, file);
-	fread(&sample_rate, sizeof(uint), 1, file);
-	fread(&size       , sizeof(uint), 1, file);
+	snprintf(replay_path, MAX_PATH_LENGTH, "%s", path);
+	uncapped = uncapped_replay;
+	if (uncapped) glfwSwapInterval(0);
 
-	audio_data = Alloc(byte, size);
-	fread(audio_data, sizeof(byte), size, file);
+	// from nothing held, like the recording
+	input.replaying = true;
+	input.begin_frame();
+	input.frame = input.stepped = {};
 
-	fclose(file);
+	max_frame_times = replay->num_frames;
+	frame_times = Alloc(int64, max_frame_times);
+	return true;
+}
 
-	ALuint buffer_id = NULL;
-	alGenBuffers(1, &buffer_id);
-	alBufferData(buffer_id, format, audio_data, size, sample_rate);
+void GameWindow::finish_replay()
+{
+	char report[256];
+	uint length = frame_time_report(frame_times, num_frame_times, report, sizeof(report));
+	print("%s", report);
+
+	// next to the recording, to compare builds against
+	char report_path[MAX_PATH_LENGTH + 16];
+	snprintf(report_path, sizeof(report_path), "%s.report.txt", replay_path);
+	FILE* file = fopen(report_path, "wb");
+	if (file) { fwrite(report, 1, glm::min(length, (uint)sizeof(report) - 1), file); fclose(file); }
+
+	replay->release();
+	free(replay);
+	free(frame_times);
+	replay = NULL;
+	frame_times = NULL;
+	input.replaying = false;
+
+	this->shutdown();
+}
 
-	ALuint source_id = NULL;
-	alGenSources(1, &source_id);
-	alSourcei(source_id, AL_BUFFER, buffer_id);
+// Terminates GLFW
+// Sets instance to NULL (important)
+void GameWindow::shutdown()
+{
+	if (recording)
+	{
+		if (recording->save(recording_path)) print("recorded %u frames of input to %s (%u bytes)\n", recording->num_frames, recording_path, recording->size);
+		recording->release();
+		free(recording);
+		recording = NULL;
+	}
+
+	audio.shutdown();
 
-	free(audio_data);
-	return source_id;
+	glfwTerminate();
+	this->instance = NULL;
 }
-void play_audio(Audio source_id)
-{
-	//alSourcePlay(source_id);
-}
\ No newline at end of file